@@ -0,0 +1,110 @@
+/*
+* Step counting and activity classification on raw FIFO blocks
+* steps are peaks of the acceleration magnitude above gravity, every window of samples is
+* classified still, walking, running or shaking from its rms and the spacing of its peaks,
+* windows add up to per-minute summaries; constant memory, one pass per sample
+*
+*/
+
+#ifndef imu_activity_h
+#define imu_activity_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "./imu_edison.h"
+
+// window [s] and windows per summary
+#define IMU_ACTIVITY_WINDOW 2.0
+#define IMU_ACTIVITY_MINUTE 30
+// a step rises above this [m/s^2] and falls back below zero
+#define IMU_ACTIVITY_STEP 1.5
+// peaks closer than this [s] are no steps (more than 4 steps/s), the window is shaking
+#define IMU_ACTIVITY_STEP_MIN 0.25
+// rms [m/s^2] of a window below which it is still, and without steps above which it is shaking
+#define IMU_ACTIVITY_STILL 0.5
+#define IMU_ACTIVITY_SHAKE 3.0
+// running: rms [m/s^2] or cadence [steps/s] above these
+#define IMU_ACTIVITY_RUN 6.0
+#define IMU_ACTIVITY_RUN_CADENCE 2.4
+// time constant of the gravity estimate [s]
+#define IMU_ACTIVITY_TAU 1.0
+
+
+enum class Activity {
+  STILL,
+  WALKING,
+  RUNNING,
+  SHAKING
+};
+#define IMU_ACTIVITY_CLASSES 4
+
+// one minute of activity, IMU_ACTIVITY_MINUTE windows
+struct imu_activity_summary {
+  uint32_t minute; // since the start or the last reset()
+  uint32_t steps;
+  uint16_t windows[IMU_ACTIVITY_CLASSES]; // per Activity
+  Activity activity; // the most windows
+};
+
+
+class imu_activity {
+ public:
+  // [rate] sample rate [Hz] of the FIFO data, e.g. imu_edison::getSampleRate()
+  imu_activity(float rate = 25.0, int afs_sel = AFS_SEL);
+
+  // feeds [n] samples of [raw] as delivered by imu_edison::readFIFO()
+  // (6 values per sample, ACCEL XYZ, GYRO XYZ), only the acceleration is used
+  // returns the number of windows completed
+  size_t update(const int16_t* raw, size_t n);
+
+  // the last complete minute if it was not taken yet, false otherwise
+  // only one minute is kept, call it after every update()
+  bool getSummary(imu_activity_summary &summary);
+
+  // steps of walking and running windows since the start or the last reset()
+  inline uint32_t getSteps() {return m_steps;}
+  // class of the last complete window
+  inline Activity getActivity() {return m_activity;}
+
+  // starts over, e.g. after a gap in the FIFO data
+  void reset();
+
+  static const char* name(Activity type);
+
+ private:
+  void closeWindow();
+
+  float m_accel_sq; // raw^2 to (m/s^2)^2
+  float m_k; // gravity low-pass weight per sample
+  float m_rate;
+
+  size_t m_window;
+  size_t m_step_min;
+  float m_step;
+  float m_still_sq, m_shake_sq, m_run_sq;
+
+  float m_gravity; // low-passed magnitude [m/s^2]
+  bool m_init;
+
+  // peak detection: above the step level, samples since the last peak
+  bool m_peak;
+  size_t m_since_peak;
+
+  // current window: samples, sum of squares, peaks and if two came too close
+  size_t m_n;
+  float m_sq;
+  uint32_t m_peaks;
+  bool m_fast;
+
+  Activity m_activity;
+  uint32_t m_steps;
+
+  // current and last complete minute
+  imu_activity_summary m_minute;
+  size_t m_minute_windows;
+  imu_activity_summary m_summary;
+  bool m_summary_new;
+};
+
+#endif // imu_activity_h
@@ -0,0 +1,78 @@
+/*
+* Sampling plan for the auxiliary I2C slaves of the MPU 9250
+* from the requested sample rate and compass / BME read rates: sample rate divider, compass mode,
+* the shared I2C_MST_DLY, which slaves are delayed, shadowing, read lengths and where the data
+* lands in EXT_SENS_DATA; reports the rates actually achieved, without I2C access
+*
+*/
+
+#ifndef imu_aux_h
+#define imu_aux_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// read a slave as fast as the sensor delivers new data, no faster
+#define IMU_AUX_ODR 1000.0
+// internal rate of the accel/gyro with the DLPF on [Hz], divided by 1 + SMPLRT_DIV
+#define IMU_AUX_INTERNAL_RATE 1000.0
+// max. I2C_MST_DLY, the delayed slaves are read every I2C_MST_DLY + 1 samples
+#define IMU_AUX_MAX_DLY 0x1F
+
+// AK8963 CNTL1, 16Bit continuous measurement mode 1 / 2
+#define IMU_AUX_MAG_8HZ   0x12
+#define IMU_AUX_MAG_100HZ 0x16
+
+// bytes read per sample: AK8963 HXL..HZH and ST2 (which releases the data), BME280 press..hum
+#define IMU_AUX_MAG_LEN 7
+#define IMU_AUX_ENV_LEN 8
+// I2C_MST_DELAY_CTRL bits
+#define IMU_AUX_ES_SHADOW 0x80
+#define IMU_AUX_SLV0_DLY  0x01
+#define IMU_AUX_SLV1_DLY  0x02
+
+
+struct imu_aux_plan {
+  // accel/gyro, SMPLRT_DIV and the resulting rate [Hz]
+  uint8_t smplrt_div;
+  float sample_rate;
+
+  // I2C_MST_DLY and I2C_MST_DELAY_CTRL
+  uint8_t mst_dly;
+  uint8_t delay_ctrl;
+
+  // compass on slave 1: CNTL1 mode, its output rate, samples between reads,
+  // achieved read rate [Hz], bytes per read and offset in EXT_SENS_DATA; len 0 if off
+  uint8_t mag_mode;
+  float mag_odr;
+  int mag_div;
+  float mag_rate;
+  uint8_t mag_len;
+  uint8_t mag_offset;
+
+  // BME on slave 0, same as above with the output rate of its profile
+  float env_odr;
+  int env_div;
+  float env_rate;
+  uint8_t env_len;
+  uint8_t env_offset;
+
+  // bytes per second on the auxiliary bus, incl. address and register bytes
+  float bus_load;
+};
+
+
+class imu_aux {
+ public:
+  // plans for [rate] [Hz] of the accel/gyro and the compass / BME read at [mag_rate] / [env_rate],
+  // at most at their output rates ([env_odr] of the BME profile, see bme_comp::getRate())
+  // a rate of 0 turns the slave off, IMU_AUX_ODR reads it as fast as it measures
+  // a slave is read at least at its rate if the sample rate allows, if both are delayed the faster one
+  // sets the delay
+  static imu_aux_plan plan(float rate, float mag_rate, float env_rate, float env_odr);
+
+  // one line report of [p]
+  static void print(const imu_aux_plan &p);
+};
+
+#endif // imu_aux_h
@@ -0,0 +1,68 @@
+/*
+* Online gyroscope bias estimation on raw FIFO blocks
+* the variance of accel and gyro over windows of samples tells if the device is at rest,
+* the mean gyro rate of every window at rest updates the bias
+*
+*/
+
+#ifndef imu_bias_h
+#define imu_bias_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "./imu_edison.h"
+
+// samples per window, 1s at the default 25Hz
+#define IMU_BIAS_WINDOW 25
+// a mean rate above this [deg/s] is a slow rotation, not bias (MPU9250 ZRO tolerance is +-5deg/s)
+#define IMU_BIAS_MAX 10.0
+
+
+class imu_bias {
+ public:
+  // at rest if the standard deviation over [window] samples is below [accel_std] [m/s^2]
+  // and [gyro_std] [deg/s], summed over the axes
+  // the bias follows the window mean with weight [alpha], the first window at rest sets it
+  imu_bias(size_t window = IMU_BIAS_WINDOW, float accel_std = 0.1, float gyro_std = 0.5,
+    float alpha = 0.1, int afs_sel = AFS_SEL, int gfs_sel = GFS_SEL);
+
+  // feeds [n] samples of [raw] as delivered by imu_edison::readFIFO()
+  // (6 values per sample, ACCEL XYZ, GYRO XYZ)
+  // returns true if a window completed at rest and the bias was updated
+  bool update(const int16_t* raw, size_t n);
+
+  // result of the last complete window
+  inline bool isStill() {return m_still;}
+  // true once a window at rest was seen
+  inline bool isValid() {return m_valid;}
+  // gyro bias XYZ in raw values, e.g. for imu_convert::setGyroBias()
+  inline const float* getBias() {return m_bias;}
+  // number of complete windows / windows at rest so far
+  inline size_t getWindowCount() {return m_window_cnt;}
+  inline size_t getStillCount() {return m_still_cnt;}
+
+  // drops the bias and the current window
+  void reset();
+
+ private:
+  size_t m_window;
+  // thresholds on the summed variances [raw^2]
+  double m_accel_var;
+  double m_gyro_var;
+  double m_max_bias;
+  float m_alpha;
+
+  // sums over the current window, ACCEL XYZ, GYRO XYZ
+  int64_t m_sum[6];
+  int64_t m_sq[6];
+  size_t m_n;
+
+  float m_bias[3];
+  bool m_still;
+  bool m_valid;
+  size_t m_window_cnt;
+  size_t m_still_cnt;
+};
+
+#endif // imu_bias_h
@@ -0,0 +1,128 @@
+/*
+* Pre-trigger "black box" for raw FIFO samples
+* keeps the last seconds of samples in a fixed ring in RAM; when a trigger fires (WoM interrupt,
+* acceleration threshold, gesture), the windows before and after it are handed out as an event
+* record, so impacts and falls are kept at full rate without logging everything at that rate
+* one thread pushes, one thread collects, any thread may trigger; no locks
+*
+*/
+
+#ifndef imu_blackbox_h
+#define imu_blackbox_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+#include "./imu_edison.h"
+#include "./imu_clock.h"
+
+// event record: imu_blackbox_header, then pre + post samples of IMU_BLACKBOX_VALUES int16_t
+// (ACCEL XYZ, GYRO XYZ as delivered by imu_edison::readFIFO()), host byte order
+#define IMU_BLACKBOX_MAGIC 0x58424250 // "PBBX"
+#define IMU_BLACKBOX_VERSION 1
+#define IMU_BLACKBOX_VALUES 6
+
+
+enum class Trigger : uint8_t {
+  NONE,
+  WOM,        // wake on motion interrupt
+  THRESHOLD,  // acceleration beyond setThreshold()
+  GESTURE,    // detail is the Gesture
+  MANUAL
+};
+
+struct imu_blackbox_header {
+  uint32_t magic;
+  uint16_t version;
+  uint8_t cause;    // Trigger
+  uint8_t detail;
+  float rate;       // sample rate [Hz]
+  uint32_t pre;     // samples before the trigger sample
+  uint32_t post;    // samples from the trigger sample on
+  uint32_t lost;    // samples overwritten before they were collected, missing at the start
+  int64_t time;     // trigger sample [ns CLOCK_MONOTONIC], 0 without block times
+  uint64_t index;   // trigger sample, counted from the first push()
+};
+
+
+class imu_blackbox {
+ public:
+  // keeps [pre] [s] before and [post] [s] from a trigger on at [rate] [Hz], e.g. imu_edison::getSampleRate()
+  // the ring holds both windows twice, so collect() has at least that long to copy an event out
+  imu_blackbox(float rate = 25.0, float pre = 4.0, float post = 2.0, int afs_sel = AFS_SEL);
+
+  // producer: appends [n] samples of [raw] as delivered by imu_edison::readFIFO(), [block] are
+  // their times from imu_clock::stamp()
+  // returns true once per event, when its post-trigger window is complete, see collect()
+  bool push(const int16_t* raw, size_t n, const imu_block_time* block = NULL);
+
+  // fires at the sample [back] samples before the last one pushed, e.g. n - 1 - sample of an
+  // imu_gesture_event of the last block; ignored while an event is pending (see getMerged())
+  // returns true if the trigger was taken
+  bool trigger(Trigger cause, uint8_t detail = 0, size_t back = 0);
+
+  // triggers by itself when the acceleration exceeds [g], again after it fell below; 0 is off
+  void setThreshold(float g);
+
+  // consumer: copies the completed event to [header] and [data] and frees the ring for the next one
+  // returns false if no event is complete
+  bool collect(imu_blackbox_header &header, std::vector<int16_t> &data);
+
+  // event record to / from [filename]
+  static bool save(const char* filename, const imu_blackbox_header &header, const std::vector<int16_t> &data);
+  static bool load(const char* filename, imu_blackbox_header &header, std::vector<int16_t> &data);
+
+  // ring size and window lengths [samples]
+  inline size_t getCapacity() {return m_capacity;}
+  inline size_t getPre() {return m_pre;}
+  inline size_t getPost() {return m_post;}
+  inline float getRate() {return m_rate;}
+  // completed events, triggers ignored while one was pending
+  inline unsigned long getEvents() {return m_events;}
+  inline unsigned long getMerged() {return m_merged;}
+
+  static const char* name(Trigger cause);
+
+ private:
+  // marks [index] as trigger sample if no event is pending
+  bool arm(Trigger cause, uint8_t detail, uint64_t index);
+  // copies samples [first, last) out of the ring
+  void copy(uint64_t first, uint64_t last, int16_t* out);
+
+  // state of the event, IDLE -> ARMING -> ARMED (trigger) -> COMPLETE (push) -> IDLE (collect)
+  enum {IDLE, ARMING, ARMED, COMPLETE};
+
+  float m_rate;
+  size_t m_pre;
+  size_t m_post;
+  size_t m_capacity;
+  uint64_t m_mask;
+  std::vector<int16_t> m_ring;
+
+  // samples claimed by the producer, stored before they are written
+  std::atomic<uint64_t> m_head;
+
+  // threshold on the squared acceleration [LSB^2], 0 off
+  int64_t m_threshold;
+  float m_accel_lsb;
+  bool m_above;
+
+  // times of the last block, producer only
+  bool m_timed;
+  imu_block_time m_block;
+  uint64_t m_block_index;
+
+  // the pending event, written before ARMED / COMPLETE are stored
+  std::atomic<int> m_state;
+  Trigger m_cause;
+  uint8_t m_detail;
+  uint64_t m_index;
+  int64_t m_time;
+
+  std::atomic<unsigned long> m_events;
+  std::atomic<unsigned long> m_merged;
+};
+
+#endif // imu_blackbox_h
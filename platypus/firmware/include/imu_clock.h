@@ -0,0 +1,79 @@
+/*
+* Sample timestamps for FIFO blocks
+* every drained block is stamped with CLOCK_MONOTONIC, the sample times follow from a linear
+* fit of sample index vs. drain time, so the MPU oscillator drift against the host clock is
+* estimated on the way
+*
+*/
+
+#ifndef imu_clock_h
+#define imu_clock_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+// the fit is not trusted beyond this deviation from the nominal rate (MPU 9250: +-1%)
+#define IMU_CLOCK_MAX_DRIFT 0.05
+
+
+// times of one FIFO block
+struct imu_block_time {
+  int64_t first;  // first sample [ns CLOCK_MONOTONIC]
+  int64_t drain;  // FIFO count read [ns CLOCK_MONOTONIC]
+  double period;  // sample period [ns]
+  size_t n;       // samples in the block
+};
+
+
+class imu_clock {
+ public:
+  // [rate] nominal sample rate [Hz], e.g. imu_edison::getSampleRate()
+  // [forget] weight of older blocks in the fit per block
+  imu_clock(float rate = 25.0, double forget = 0.98);
+
+  // CLOCK_MONOTONIC [ns]
+  static inline int64_t now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+  }
+
+  // stamps a drained block of [n] samples, [count] samples were in the FIFO at [t] [ns],
+  // e.g. imu_edison::getFIFOCount() and getFIFOTime() after readFIFO()
+  // blocks have to follow each other without a gap, see resync()
+  void stamp(size_t count, size_t n, int64_t t, imu_block_time &block);
+
+  // time of sample [i] of [block] [ns]
+  static inline int64_t sampleTime(const imu_block_time &block, size_t i) {
+    return block.first + (int64_t) (i * block.period + 0.5);
+  }
+
+  // samples were lost (FIFO reset or overflow), starts a new fit but keeps the period
+  // a [rate] > 0 changes the nominal rate and drops the period as well
+  void resync(float rate = 0.0);
+
+  // estimated sample period [ns] and its deviation from the nominal rate [ppm],
+  // positive if the MPU runs slow against the host clock
+  inline double getPeriod() {return m_period;}
+  inline double getDrift() {return (m_period / m_nominal - 1.0) * 1e6;}
+  // blocks in the current fit
+  inline unsigned long getBlocks() {return m_blocks;}
+
+ private:
+  double m_nominal;
+  double m_forget;
+  double m_period;
+
+  // samples drained since resync()
+  uint64_t m_k;
+  unsigned long m_blocks;
+
+  // weighted sums of index x and time y [ns], relative to the last observation (m_x0, m_t0)
+  // so they stay small over long runs
+  uint64_t m_x0;
+  int64_t m_t0;
+  double m_w, m_sx, m_sy, m_sxx, m_sxy;
+};
+
+#endif // imu_clock_h
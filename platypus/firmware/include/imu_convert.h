@@ -0,0 +1,52 @@
+/*
+* Batch conversion of raw FIFO blocks to physical units
+* deinterleaves ACCEL XYZ, GYRO XYZ samples into one float array per axis
+*
+*/
+
+#ifndef imu_convert_h
+#define imu_convert_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "./imu_edison.h"
+
+
+// structure of arrays, each pointer needs room for the number of converted samples
+struct imu_soa {
+  float* accel[3]; // [m/s^2]
+  float* gyro[3];  // [deg/s]
+};
+
+
+class imu_convert {
+ public:
+  // scale factors for the full-scale range selections, see AFS_SEL / GFS_SEL
+  imu_convert(int afs_sel = AFS_SEL, int gfs_sel = GFS_SEL);
+
+  // recompute the scale factors after the full-scale ranges changed
+  void setRange(int afs_sel, int gfs_sel);
+
+  // factor from raw value to m/s^2 and deg/s
+  inline float getAccelScale() {return m_accel_scale;}
+  inline float getGyroScale() {return m_gyro_scale;}
+
+  // gyro bias XYZ in raw values, subtracted before scaling, e.g. from imu_bias::getBias()
+  void setGyroBias(const float* bias);
+  inline const float* getGyroBias() {return m_gyro_bias;}
+
+  // converts [n] samples from [in] as delivered by imu_edison::readFIFO()
+  // (6 values per sample, ACCEL XYZ, GYRO XYZ) into [out]
+  // uses SSE2 where available, the result is identical to convertScalar()
+  void convert(const int16_t* in, size_t n, const imu_soa &out);
+  // same as above, plain C++
+  void convertScalar(const int16_t* in, size_t n, const imu_soa &out);
+
+ private:
+  float m_accel_scale;
+  float m_gyro_scale;
+  float m_gyro_bias[3];
+};
+
+#endif // imu_convert_h
@@ -0,0 +1,82 @@
+/*
+* Digital Motion Processor of the MPU 9250
+* memory bank access, the DMP memory locations and FIFO packet parsing for the
+* 6-axis low-power quaternion of the InvenSense MotionDriver 6.12 firmware
+* the firmware image itself is not part of the tree, see DMP_FIRMWARE
+*
+*/
+
+#ifndef imu_dmp_h
+#define imu_dmp_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#include "./quaternion.h"
+
+// registers not in the public register map, as used by the MotionDriver
+#define MPU_BANK_SEL           0x6D   // R/W
+#define MPU_MEM_START_ADDR     0x6E   // R/W
+#define MPU_MEM_R_W            0x6F   // R/W, does not auto-increment, the memory address does
+#define MPU_PRGM_START_H       0x70   // R/W
+#define MPU_PRGM_START_L       0x71   // R/W
+
+// MPU_USER_CTRL bits
+#define MPU_USER_DMP_EN        0x80
+#define MPU_USER_FIFO_EN       0x40
+#define MPU_USER_I2C_MST_EN    0x20
+#define MPU_USER_DMP_RST       0x08
+#define MPU_USER_FIFO_RST      0x04
+
+// DMP memory, written in chunks that do not cross a bank
+#define DMP_MEM_SIZE           4096
+#define DMP_BANK_SIZE          256
+#define DMP_CHUNK_SIZE         16
+#define DMP_CODE_SIZE          3062
+#define DMP_START_ADDR         0x0400
+
+// where the firmware image (dmp_memory[] of inv_mpu_dmp_motion_driver.c) is expected
+#define DMP_FIRMWARE           "/home/root/mpu_dmp.bin"
+
+// the DMP runs at 200Hz (SMPLRT_DIV 4) and divides this down for the FIFO
+#define DMP_SAMPLE_RATE        200
+#define DMP_SMPLRT_DIV         4
+
+// memory locations (keys) in the MotionDriver 6.12 image
+#define DMP_D_0_22             (22 + 512)  // FIFO rate divider
+#define DMP_CFG_6              2753        // FIFO rate end of the program
+#define DMP_CFG_LP_QUAT        2712        // 3-axis low-power quaternion
+#define DMP_CFG_8              2718        // 6-axis low-power quaternion
+
+// one FIFO packet: quaternion [w, x, y, z] as 32Bit big endian in Q30
+#define DMP_PACKET_SIZE        16
+// max. bytes of one I2C block read from the FIFO, multiple of DMP_PACKET_SIZE
+#define DMP_BURST_SIZE         496
+// a packet is dropped if |q|^2 is off by more than this, in Q28 (2^-4 relative)
+#define DMP_QUAT_ERROR         (1 << 24)
+
+
+class imu_dmp {
+ public:
+  // reads the firmware image from [filename] into [image]
+  // returns false if the file can not be read or does not fit into the DMP memory
+  static bool loadImage(const char* filename, std::vector<uint8_t> &image);
+
+  // FIFO rate divider for DMP_D_0_22 (2 bytes big endian), [rate] in Hz, 1 .. DMP_SAMPLE_RATE
+  static void rateDivider(uint16_t rate, uint8_t* div);
+  // program end for DMP_CFG_6 after a rate change
+  static const uint8_t s_rate_end[12];
+  // DMP_CFG_8 with the 6-axis quaternion on / off, DMP_CFG_LP_QUAT off
+  static const uint8_t s_quat6_on[4];
+  static const uint8_t s_quat6_off[4];
+  static const uint8_t s_quat3_off[4];
+
+  // parses one FIFO packet into [q] [w, x, y, z] in Q30
+  // returns false if the quaternion is not a unit one, i.e. the FIFO is out of sync
+  static bool parse(const uint8_t* packet, int32_t* q);
+  // Q30 [w, x, y, z] to a quaternion
+  static void toQuaternion(const int32_t* q, quaternion<float> &out);
+};
+
+#endif // imu_dmp_h
@@ -9,12 +9,17 @@
 #define imu_edison_h
 
 #include <vector>
+#include <chrono>
 #include <math.h>
 #include <assert.h>
 
 #include "mraa.hpp"
 
 #include "./quaternion.h"
+#include "./bme_comp.h"
+#include "./imu_clock.h"
+#include "./imu_dmp.h"
+#include "./imu_aux.h"
 
 
 // Register names according to the datasheet.
@@ -158,29 +163,6 @@
 #define BME_HUM_MSB     0xFD
 #define BME_HUM_LSB     0xFE
 
-struct BME_calibration {
-  uint16_t dig_T1;
-  int16_t  dig_T2;
-  int16_t  dig_T3;
-
-  uint16_t dig_P1;
-  int16_t  dig_P2;
-  int16_t  dig_P3;
-  int16_t  dig_P4;
-  int16_t  dig_P5;  
-  int16_t  dig_P6;  
-  int16_t  dig_P7; 
-  int16_t  dig_P8;
-  int16_t  dig_P9;
-
-  uint8_t  dig_H1;
-  int16_t  dig_H2;
-  uint8_t  dig_H3;
-  int16_t  dig_H4;
-  int16_t  dig_H5;
-  int8_t  dig_H6;
-};
-
 // Gyro Full-Scale range select
 // 0: +-250 deg/s
 // 1: +-500 deg/s
@@ -195,6 +177,38 @@ struct BME_calibration {
 // 3: +-16 g
 #define AFS_SEL 1
 
+// output registers ACCEL_XOUT_H .. GYRO_ZOUT_L, read as one block
+#define MPU_RAW_SIZE           14
+
+// one sample of the output registers in register order, taken at the same instant
+// raw 16Bit values, no conversion
+struct ImuSample {
+  int16_t accel[3];
+  int16_t temp;
+  int16_t gyro[3];
+};
+
+// interrupt sources in MPU_INT_ENABLE / MPU_INT_STATUS
+#define MPU_INT_WOM            0x40
+#define MPU_INT_FIFO_OFLOW     0x10
+#define MPU_INT_FSYNC          0x08
+#define MPU_INT_RAW_RDY        0x01
+
+// wake-up rates of the low-power accel mode in MPU_LP_ACCEL (Lposc_clksel)
+#define MPU_LP_ODR_0_98HZ      0x02
+#define MPU_LP_ODR_3_91HZ      0x04
+#define MPU_LP_ODR_15_63HZ     0x06
+#define MPU_LP_ODR_62_50HZ     0x08
+
+// FIFO size in bytes and size of one FIFO sample (ACCEL XYZ, GYRO XYZ as 16Bit big endian)
+#define MPU_FIFO_SIZE          512
+#define MPU_FIFO_SAMPLE_SIZE   12
+// max. number of bytes fetched by one I2C block read from the FIFO, multiple of MPU_FIFO_SAMPLE_SIZE
+#define MPU_FIFO_BURST_SIZE    504
+
+// number of external sensor data registers (EXT_SENS_DATA_00..23)
+#define MPU_ES_DATA_SIZE       24
+
 
 class imu_edison {
  public:
@@ -209,6 +223,14 @@ class imu_edison {
   // initializes the IMU
   void setupIMU();
 
+  // low-power mode (true): gyro off, accel only woken up at [lp_odr] (MPU_LP_ODR_*), no FIFO,
+  // only the wake-on-motion interrupt stays enabled; back to full rate FIFO capture (false)
+  void lowPower(bool low_power, uint8_t lp_odr = MPU_LP_ODR_3_91HZ);
+  inline bool isLowPower() {return m_low_power;}
+  // number of changes into / out of the low-power mode
+  inline unsigned long getLowPowerEntries() {return m_lp_entries;}
+  inline unsigned long getLowPowerExits() {return m_lp_exits;}
+
   // get the IDs of the attached devices
   inline int getID() {return m_ID;}
   inline int getMagID() {return m_ID_mag;}
@@ -218,6 +240,9 @@ class imu_edison {
   // returns a vector according to [ACCEL_X, ACCEL_Y, ACCEL_Z, GYRO_X, GYRO_Y, GYRO_Z, TEMP]
   // raw 16Bit values, no conversion
   std::vector<int16_t> readRawIMU();
+  // same as above, but into [sample] without allocation
+  // returns false on I2C error, [sample] is left untouched then
+  bool readRawIMU(ImuSample &sample);
   // reads and returns only the temperature
   int16_t readRawTemp();
 
@@ -231,18 +256,46 @@ class imu_edison {
   // !! only to be used in conjunction with return values from readRawIMU() !!
   std::vector<float> toReadable(std::vector<int8_t> in);
   std::vector<float> toReadable(std::vector<int16_t> in);
+  // same as above, writes 7 values in the same order to [out]
+  void toReadable(const ImuSample &in, float* out);
 
   // convert raw values to readable, according to data sheet
   float accelToReadable(int16_t a);
   float gyroToReadable(int16_t g);
   float tempToReadable(int16_t t);
 
+  // sample rate [Hz] of the accel/gyro and the FIFO, read rates of the compass and the BME,
+  // see imu_aux::plan(); the BME is read at most at the output rate of its profile
+  // applied at once if the IMU is set up, otherwise by setupIMU(), 25Hz by default
+  // returns the plan with the rates actually achieved
+  const imu_aux_plan& setSampleRates(float rate, float mag_rate = IMU_AUX_ODR, float env_rate = IMU_AUX_ODR);
+  inline const imu_aux_plan& getAuxPlan() {return m_aux;}
+
+  // returns the sample rate of the accel/gyro outputs and the FIFO in [Hz]
+  // the quaternion rate in DMP mode
+  inline float getSampleRate() {return m_dmp ? m_dmp_rate : 1000.0 / (1 + m_smplrt_div);}
+
+  // on-chip DLPF of the accel and the gyro: the widest setting up to [hz] [Hz], 5Hz at least,
+  // see s_dlpf_hz; filters in software (imu_filter) narrow it further per consumer
+  // applied at once if the IMU is set up, otherwise by setupIMU(); by default the gyro is at
+  // 5Hz and the accel at 218Hz, the DMP mode uses 41Hz regardless
+  // returns the bandwidth [Hz] set
+  float setBandwidth(float hz);
+  inline float getBandwidth() {return s_dlpf_hz[m_dlpf];}
+  // 3dB bandwidth [Hz] of the gyro per DLPF_CFG at 1kHz, the accel with the same A_DLPF_CFG is close
+  static const float s_dlpf_hz[7];
+
+  // selects the interrupts [mask] (MPU_INT_*) that drive the INT pin (active low)
+  // [latch] holds the pin until the status is read, otherwise it pulses for 50us
+  void setInterrupts(uint8_t mask, bool latch = true);
+
   // returns the Interrupt Status register as is
   uint8_t getIntStatus();
 
-  // returns true if a FIFO/WOM interrupt has been issued
+  // returns true if a FIFO/WOM/raw data ready interrupt has been issued
   bool hasFIFOInt(uint8_t intStatus);
   bool hasWOMInt(uint8_t intStatus);
+  bool hasRawRdyInt(uint8_t intStatus);
 
   // resets the FIFO module
   void FIFOrst();
@@ -253,17 +306,69 @@ class imu_edison {
   // will return multiples of six, in order ACCEL XYZ, GYRO XYZ
   // returns empty vector if less than six values in FIFO
   std::vector<int16_t> readFIFO();
+  // same as above, but drains the FIFO with I2C block reads of up to MPU_FIFO_BURST_SIZE bytes
+  // directly into [data], which has room for [len] values
+  // returns the number of values written (multiple of six)
+  size_t readFIFO(int16_t* data, size_t len);
+  // samples in the FIFO and CLOCK_MONOTONIC [ns] when the count was read by the last readFIFO(),
+  // to stamp the block via imu_clock
+  inline size_t getFIFOCount() {return m_fifo_count;}
+  inline int64_t getFIFOTime() {return m_fifo_time;}
+
+  // DMP mode, the orientation is computed on the MPU and the FIFO holds quaternions, see imu_dmp.h
+  // uploads the firmware [image] to the DMP memory, reads it back and sets the program start
+  // call after setupIMU(), the device reset clears the memory
+  // returns false if the image does not fit or the read back differs
+  bool loadDMP(const uint8_t* image, size_t size, uint16_t start = DMP_START_ADDR);
+  // same as above, with the image read from [filename]
+  bool loadDMP(const char* filename = DMP_FIRMWARE);
+  // quaternion output rate [Hz], DMP_SAMPLE_RATE divided by an integer, applied at once if loaded
+  // returns the rate that is set
+  float setDMPRate(uint16_t rate);
+  // FIFO filled by the DMP with quaternions (true) or with raw samples (false), resets the FIFO
+  // returns false if no firmware is loaded
+  bool enableDMP(bool enable);
+  inline bool isDMP() {return m_dmp;}
+  // drains the FIFO of DMP packets into [q], which has room for [len] values,
+  // 4 per packet [w, x, y, z] in Q30 as imu_fusion_q::getQ(), see imu_dmp::toQuaternion()
+  // a corrupt packet means the FIFO is out of sync, it is reset and the packets so far returned
+  // returns the number of values written (multiple of four), getFIFOCount() counts packets
+  size_t readDMP(int32_t* q, size_t len);
+  // number of FIFO resets due to corrupt packets
+  inline unsigned long getDMPErrors() {return m_dmp_errors;}
 
   // reads the external sensor data from the 24 data registers
   std::vector<uint8_t> readESData();
-
-  // compensate BME adc values and return integers
-  // via BME280 datasheet sec 4.2.3
+  // same as above, but a shared snapshot that is only read again once it is older than
+  // [max_age] sample periods; the slaves are read as in getAuxPlan(), the delayed ones every
+  // getESDelay() + 1 periods, shadowing keeps the block consistent in between
+  const uint8_t* getESData(int max_age = 1);
+  // drops the snapshot, e.g. after changing the slave setup
+  inline void invalidateESData() {m_es_valid = false;}
+  // sample periods between two reads of the delayed slaves (I2C_MST_DLY)
+  inline int getESDelay() {return m_aux.mst_dly;}
+  // counters: snapshot reads over I2C / accesses served from the snapshot
+  inline unsigned long getESReads() {return m_es_reads;}
+  inline unsigned long getESHits() {return m_es_hits;}
+
+  // compensate single BME adc values and return integers, each call evaluates t_fine again
+  // via BME280 datasheet sec 4.2.3, see bme_comp for the single pass
   int32_t tfine(int32_t adc_T);
   int32_t compT(int32_t adc_T);
   uint32_t compP(int32_t adc_P, int32_t adc_T);
   uint32_t compH(int32_t adc_H, int32_t adc_T);
-
+  // compensation with the calibration read from the BME, e.g. for logged raw readings
+  inline bme_comp& getEnvComp() {return m_env;}
+
+  // oversampling, IIR filter and standby of the BME, e.g. BME_PROFILE_BREATH
+  // applied at once via I2C slave 4 if the BME is running, otherwise by setupIMU()
+  // the slave 0 delay follows the BME output rate at the current sample rate
+  // returns false if a write to the BME was not acknowledged
+  bool setEnvProfile(const BME_profile &profile);
+  inline const BME_profile& getEnvProfile() {return m_env_profile;}
+
+  // reads the EnvSens data, and returns raw adc values
+  void getEnvData(BME_raw &raw);
   // reads the EnvSens data, and returns compensated values
   void getEnvData(int32_t &comp_T, uint32_t &comp_P, uint32_t &comp_H);
   void getEnvData(float &comp_T, float &comp_P, float &comp_H);
@@ -271,7 +376,14 @@ class imu_edison {
   // reads the Compass data, and returns raw values
   void getCompassData(int16_t &mag_X, int16_t &mag_Y, int16_t &mag_Z);
   // reads the Compass data, and returns compensated values in [mGs]
-  void getCompassData(float &mag_X, float &mag_Y, float &mag_Z);
+  // hard/soft-iron correction from setCompassCalib() is applied unless [calibrated] is false
+  void getCompassData(float &mag_X, float &mag_Y, float &mag_Z, bool calibrated = true);
+
+  // hard/soft-iron correction for getCompassData(): mag = matrix * (mag - offset)
+  // [offset] in [mGs], [matrix] row major 3x3, e.g. from mag_calib
+  void setCompassCalib(const float* offset, const float* matrix);
+  // back to the factory sensitivity adjustment only
+  void clearCompassCalib();
 
   // filter update step for the madgwick IMU filter
   // data <ax,ay,az,wx,wy,wz> [m/s^2,deg/s]
@@ -288,11 +400,30 @@ class imu_edison {
   // reads the calibration data for the BME device
   void getENVCalib();
 
+  // writes [data] to register [addr] of the slave at [i2c] through I2C slave 4 while the MPU is master
+  // returns false on a NACK or if the transfer does not complete
+  bool writeSlaveRegister(uint8_t i2c, uint8_t addr, uint8_t data);
+  // plans the slaves for the requested rates, the BME profile and the DMP input rate
+  void planAux();
+  // writes the sample rate divider and the slave setup of the plan
+  void writeAux();
+  // max. age of the EXT_SENS_DATA snapshot for a slave read every [div] sensor samples
+  int esAge(int div);
+
+  // write [len] bytes of [data] starting at DMP memory address [addr], within one bank
+  // returns false if the chunk crosses a bank or the memory
+  bool writeMemory(uint16_t addr, const uint8_t* data, size_t len);
+  bool readMemory(uint16_t addr, uint8_t* data, size_t len);
+  // FIFO rate divider and quaternion output to the DMP memory
+  void writeDMPConfig();
+
   // initialize internal compass
   void initCompass();
 
   // write one byte [data] to register [addr] at i2c address [i2c]
   void writeRegister(uint8_t addr, uint8_t data, uint8_t i2c);
+  // write [len] bytes of [data] starting at register [addr] at i2c address [i2c] in a single transfer
+  void writeRegisters(uint8_t addr, const uint8_t* data, int len, uint8_t i2c);
   // read from register [addr] at i2c address [i2c]
   uint8_t readRegister(uint8_t addr, uint8_t i2c);
 
@@ -300,17 +431,61 @@ class imu_edison {
   // returns the 16bit 2's complement integer value put together via [addrH addrL]
   int16_t readRegister(uint8_t addrH, uint8_t addrL, uint8_t i2c);
 
+  // read [len] bytes starting at register [addr] at i2c address [i2c] in a single transfer
+  // returns the number of bytes read, or -1 on error
+  int readRegisters(uint8_t addr, uint8_t* data, int len, uint8_t i2c);
+
+  // set the slave address of the I2C context, only if it changed
+  void selectDevice(uint8_t i2c);
+
   mraa::I2c* m_i2c;
+  uint8_t m_i2c_selected;
   int m_i2c_bus;
   uint8_t m_mpu_address;
   // BME calibration data, in the order of Table 16 in the BME280 datasheet
-  BME_calibration m_env_calib;
+  bme_comp m_env;
+  BME_profile m_env_profile;
   bool m_init_env;
+  bool m_env_running;
 
   float m_HCalib_X, m_HCalib_Y, m_HCalib_Z;
+  // hard/soft-iron correction, see setCompassCalib()
+  float m_mag_offset[3];
+  float m_mag_matrix[9];
+  bool m_mag_calib;
 
   int m_ID, m_ID_mag, m_ID_env;
 
+  uint8_t m_smplrt_div;
+  // DLPF_CFG and A_DLPF_CFG, see setBandwidth()
+  uint8_t m_dlpf, m_accel_dlpf;
+  // requested rates and the plan, see setSampleRates(); true once setupIMU() is done
+  float m_rate, m_mag_rate, m_env_rate;
+  imu_aux_plan m_aux;
+  bool m_setup;
+
+  // DMP mode, see enableDMP()
+  bool m_dmp_loaded;
+  bool m_dmp;
+  float m_dmp_rate;
+  unsigned long m_dmp_errors;
+
+  // FIFO fill level at the last readFIFO(), see getFIFOTime()
+  size_t m_fifo_count;
+  int64_t m_fifo_time;
+
+  // snapshot of the external sensor data, see getESData()
+  uint8_t m_es_data[MPU_ES_DATA_SIZE];
+  std::chrono::steady_clock::time_point m_es_time;
+  bool m_es_valid;
+  unsigned long m_es_reads, m_es_hits;
+
+  // interrupt setup to restore after the low-power mode, see setInterrupts()
+  uint8_t m_int_mask;
+  bool m_int_latch;
+  bool m_low_power;
+  unsigned long m_lp_entries, m_lp_exits;
+
 };
 
 #endif // imu_edison_h
@@ -0,0 +1,82 @@
+/*
+* Biquad filter bank for raw FIFO blocks
+* cascaded Butterworth low-pass, high-pass and band-pass sections on all six channels, one
+* instance per consumer, so the DLPF of the chip can stay wide (see imu_edison::setBandwidth())
+* and every consumer gets the band it needs; the state carries over from block to block
+*
+*/
+
+#ifndef imu_filter_h
+#define imu_filter_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// biquad sections of a cascade, an 8th order low-pass or a 4th order band-pass
+#define IMU_FILTER_SECTIONS 4
+// channels side by side: ACCEL XYZ and GYRO XYZ in two SSE registers with one idle lane each
+#define IMU_FILTER_LANES 8
+
+
+enum class Filter {
+  NONE, // passes the data through
+  LOWPASS,
+  HIGHPASS,
+  BANDPASS
+};
+
+
+class imu_filter {
+ public:
+  // passes the data through until design(), [rate] sample rate [Hz] of the FIFO data,
+  // e.g. imu_edison::getSampleRate()
+  imu_filter(float rate = 25.0);
+
+  // Butterworth response [type] of [order] (even) with the cutoff [f1] [Hz], a band-pass from
+  // [f1] to [f2] with [order] on either edge
+  // returns false and leaves the filter as it was if a frequency is not below the Nyquist
+  // frequency or the cascade needs more than IMU_FILTER_SECTIONS sections
+  bool design(Filter type, float f1, float f2 = 0.0, int order = 2);
+
+  // filters [n] samples of [raw] as delivered by imu_edison::readFIFO()
+  // (6 values per sample, ACCEL XYZ, GYRO XYZ) to [out] in the same format, rounded to LSB;
+  // [out] may be [raw], the first sample after reset() is taken as the steady state
+  // uses SSE2 where available, the result matches filterScalar() exactly
+  void filter(const int16_t* raw, size_t n, int16_t* out);
+  // same as above, plain C++
+  void filterScalar(const int16_t* raw, size_t n, int16_t* out);
+
+  // gain of the cascade at [hz] [Hz]
+  double response(float hz);
+
+  inline Filter getType() {return m_type;}
+  inline size_t getSections() {return m_sections;}
+  inline float getRate() {return m_rate;}
+
+  // starts over, e.g. after a gap in the FIFO data
+  void reset();
+
+  static const char* name(Filter type);
+
+ private:
+  // appends a low-pass or high-pass section at [hz] [Hz] with quality [q]
+  void section(Filter type, float hz, double q);
+  // state of every section at rest with the input [s]
+  void prime(const int16_t* s);
+
+  float m_rate;
+  Filter m_type;
+  size_t m_sections;
+
+  // coefficients per section, normalized to a0 = 1
+  float m_b0[IMU_FILTER_SECTIONS], m_b1[IMU_FILTER_SECTIONS], m_b2[IMU_FILTER_SECTIONS];
+  float m_a1[IMU_FILTER_SECTIONS], m_a2[IMU_FILTER_SECTIONS];
+
+  // state of the transposed direct form II per section and lane, the lanes as the SSE registers
+  // hold them: [ACCEL X, Y, Z, idle] [idle, GYRO X, Y, Z]
+  float m_s1[IMU_FILTER_SECTIONS][IMU_FILTER_LANES];
+  float m_s2[IMU_FILTER_SECTIONS][IMU_FILTER_LANES];
+  bool m_primed;
+};
+
+#endif // imu_filter_h
@@ -0,0 +1,452 @@
+/*
+* Orientation filters for blocks of IMU samples
+* imu_fusion runs a filter policy (Madgwick, Mahony or complementary) over converted
+* FIFO blocks (see imu_convert), the magnetometer is taken from the latest snapshot
+* instead of the bus
+*
+*/
+
+#ifndef imu_fusion_h
+#define imu_fusion_h
+
+#include <stddef.h>
+
+#include "./quaternion.h"
+#include "./imu_convert.h"
+
+
+// A filter policy provides
+//   typedef value_type
+//   void step(T &q0, T &q1, T &q2, T &q3, T ax, T ay, T az, T gx, T gy, T gz, const T* m, T dT)
+//     one update of the quaternion (q0 = w), accel in any unit, gyro in [rad/s],
+//     [m] normalized magnetometer or NULL, the quaternion is normalized on return
+//   void reset()
+//     clears internal state besides the quaternion
+
+
+// Madgwick's gradient descent IMU and AHRS algorithms, same math as imu_edison::Madgwick*FilterStep()
+// See: http://www.x-io.co.uk/open-source-imu-and-ahrs-algorithms/
+template <typename T>
+class madgwick_filter {
+ public:
+  typedef T value_type;
+
+  // [error] is the gyro measurement error [deg/s]
+  madgwick_filter(T error = 5.0) {setError(error);}
+
+  inline void setError(T error) {m_beta = sqrt(3.0/4.0) * (M_PI * (error / 180.0));}
+
+  inline void step(T &q0, T &q1, T &q2, T &q3, T ax, T ay, T az, T gx, T gy, T gz, const T* m, T dT);
+  inline void reset() {}
+
+ private:
+  T m_beta;
+};
+
+
+// Mahony's nonlinear complementary filter, proportional and integral feedback
+// See: http://www.x-io.co.uk/open-source-imu-and-ahrs-algorithms/
+template <typename T>
+class mahony_filter {
+ public:
+  typedef T value_type;
+
+  mahony_filter(T kp = 1.0, T ki = 0.0) : m_kp(kp), m_ki(ki) {reset();}
+
+  inline void setGains(T kp, T ki) {m_kp = kp; m_ki = ki;}
+
+  inline void step(T &q0, T &q1, T &q2, T &q3, T ax, T ay, T az, T gx, T gy, T gz, const T* m, T dT);
+  inline void reset() {m_ix = 0.0; m_iy = 0.0; m_iz = 0.0;}
+
+ private:
+  T m_kp, m_ki;
+  // integral of the error, i.e. the gyro bias estimate [rad/s]
+  T m_ix, m_iy, m_iz;
+};
+
+
+// plain complementary filter: integrates the gyro and turns the result towards gravity
+// (roll, pitch) and the magnetometer (yaw) by a small-angle correction on the quaternion
+template <typename T>
+class complementary_filter {
+ public:
+  typedef T value_type;
+
+  // [alpha] is the weight of the gyro path per step, 1 - alpha that of accel/magnetometer
+  complementary_filter(T alpha = 0.98) : m_alpha(alpha) {}
+
+  inline void setAlpha(T alpha) {m_alpha = alpha;}
+
+  inline void step(T &q0, T &q1, T &q2, T &q3, T ax, T ay, T az, T gx, T gy, T gz, const T* m, T dT);
+  inline void reset() {}
+
+ private:
+  T m_alpha;
+};
+
+
+template <typename Filter = madgwick_filter<float> >
+class imu_fusion {
+ public:
+  typedef typename Filter::value_type T;
+
+  imu_fusion(const Filter &filter = Filter()) : m_filter(filter), m_has_mag(false) {}
+
+  inline Filter& getFilter() {return m_filter;}
+
+  // set the magnetometer snapshot used for all following samples, any unit
+  // e.g. from imu_edison::getCompassData(), normalized once here
+  void setMag(T mx, T my, T mz);
+  // no magnetometer, the filters only correct roll and pitch
+  inline void clearMag() {m_has_mag = false;}
+  inline bool hasMag() {return m_has_mag;}
+
+  // runs the filter over [n] samples of [in] (accel [m/s^2], gyro [deg/s]), [dT] seconds apart
+  void update(const imu_soa &in, size_t n, T dT);
+  // single sample <ax,ay,az,wx,wy,wz> [m/s^2,deg/s]
+  void update(const float* data, T dT);
+
+  inline quaternion<T>& getQuaternion() {return m_q;}
+  inline void setQuaternion(const quaternion<T> &q) {m_q = q;}
+
+  // back to the identity orientation and the initial filter state
+  inline void reset() {m_q = quaternion<T>(); m_filter.reset();}
+
+ private:
+  quaternion<T> m_q;
+  Filter m_filter;
+
+  bool m_has_mag;
+  T m_mag[3];
+};
+
+
+
+// Madgwick step
+template <typename T>
+inline void madgwick_filter<T>::step(T &q0, T &q1, T &q2, T &q3, T ax, T ay, T az, T gx, T gy, T gz, const T* m, T dT)
+{
+  T norm;
+  T s0, s1, s2, s3;
+
+  // Rate of change of quaternion from gyroscope
+  T qDot1 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+  T qDot2 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+  T qDot3 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+  T qDot4 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+  // Compute feedback only if accelerometer measurement valid (avoids NaN in accelerometer normalisation)
+  if (!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f)) && !((gx == 0.0f) && (gy == 0.0f) && (gz == 0.0f))) {
+
+    // Normalise accelerometer measurement
+    norm = 1.0f / sqrt(ax * ax + ay * ay + az * az);
+    ax *= norm;
+    ay *= norm;
+    az *= norm;
+
+    if (m == NULL) {
+      T _2q0 = 2.0f * q0;
+      T _2q1 = 2.0f * q1;
+      T _2q2 = 2.0f * q2;
+      T _2q3 = 2.0f * q3;
+      T _4q0 = 4.0f * q0;
+      T _4q1 = 4.0f * q1;
+      T _4q2 = 4.0f * q2;
+      T _8q1 = 8.0f * q1;
+      T _8q2 = 8.0f * q2;
+      T q0q0 = q0 * q0;
+      T q1q1 = q1 * q1;
+      T q2q2 = q2 * q2;
+      T q3q3 = q3 * q3;
+
+      // Gradient decent algorithm corrective step
+      s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+      s1 = _4q1 * q3q3 - _2q3 * ax + 4.0f * q0q0 * q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+      s2 = 4.0f * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+      s3 = 4.0f * q1q1 * q3 - _2q1 * ax + 4.0f * q2q2 * q3 - _2q2 * ay;
+    } else {
+      T mx = m[0], my = m[1], mz = m[2];
+
+      // Auxiliary variables to avoid repeated arithmetic
+      T _2q0mx = 2.0f * q0 * mx;
+      T _2q0my = 2.0f * q0 * my;
+      T _2q0mz = 2.0f * q0 * mz;
+      T _2q1mx = 2.0f * q1 * mx;
+      T _2q0 = 2.0f * q0;
+      T _2q1 = 2.0f * q1;
+      T _2q2 = 2.0f * q2;
+      T _2q3 = 2.0f * q3;
+      T q0q0 = q0 * q0;
+      T q0q1 = q0 * q1;
+      T q0q2 = q0 * q2;
+      T q0q3 = q0 * q3;
+      T q1q1 = q1 * q1;
+      T q1q2 = q1 * q2;
+      T q1q3 = q1 * q3;
+      T q2q2 = q2 * q2;
+      T q2q3 = q2 * q3;
+      T q3q3 = q3 * q3;
+
+      // Reference direction of Earth's magnetic field
+      T hx = mx * q0q0 - _2q0my * q3 + _2q0mz * q2 + mx * q1q1 + _2q1 * my * q2 + _2q1 * mz * q3 - mx  * q2q2 - mx * q3q3;
+      T hy = _2q0mx * q3 + my * q0q0 - _2q0mz * q1 + _2q1mx * q2 - my * q1q1 + my * q2q2 + _2q2 * mz * q3 - my * q3q3;
+      T _2bx = sqrt(hx * hx + hy * hy);
+      T _2bz = -_2q0mx * q2 + _2q0my * q1 + mz * q0q0 + _2q1mx * q3 - mz * q1q1 + _2q2 * my * q3 - mz  * q2q2 + mz * q3q3;
+      T _4bx = 2.0f * _2bx;
+      T _4bz = 2.0f * _2bz;
+      T _8bx = 2.0f * _4bx;
+      T _8bz = 2.0f * _4bz;
+
+      // residuals of the gravity and field directions
+      T ex = 2.0f * (q1q3 - q0q2) - ax;
+      T ey = 2.0f * (q0q1 + q2q3) - ay;
+      T ez = 2.0f * (0.5f - q1q1 - q2q2) - az;
+      T fx = _4bx * (0.5f - q2q2 - q3q3) + _4bz * (q1q3 - q0q2) - mx;
+      T fy = _4bx * (q1q2 - q0q3) + _4bz * (q0q1 + q2q3) - my;
+      T fz = _4bx * (q0q2 + q1q3) + _4bz * (0.5f - q1q1 - q2q2) - mz;
+
+      // Gradient decent algorithm corrective step
+      s0 = -_2q2 * ex + _2q1 * ey - _4bz * q2 * fx + (-_4bx * q3 + _4bz * q1) * fy + _4bx * q2 * fz;
+      s1 = _2q3 * ex + _2q0 * ey - 4.0f * q1 * ez + _4bz * q3 * fx + (_4bx * q2 + _4bz * q0) * fy + (_4bx * q3 - _8bz * q1) * fz;
+      s2 = -_2q0 * ex + _2q3 * ey - 4.0f * q2 * ez + (-_8bx * q2 - _4bz * q0) * fx + (_4bx * q1 + _4bz * q3) * fy + (_4bx * q0 - _8bz * q2) * fz;
+      s3 = _2q1 * ex + _2q2 * ey + (-_8bx * q3 + _4bz * q1) * fx + (-_4bx * q0 + _4bz * q2) * fy + _4bx * q1 * fz;
+    }
+
+    // normalise step magnitude and apply feedback step, no step if already at the minimum
+    norm = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+    if (norm > 0.0f) {
+      norm = m_beta / sqrt(norm);
+      qDot1 -= norm * s0;
+      qDot2 -= norm * s1;
+      qDot3 -= norm * s2;
+      qDot4 -= norm * s3;
+    }
+  }
+
+  // Integrate rate of change of quaternion to yield quaternion
+  q0 += qDot1 * dT;
+  q1 += qDot2 * dT;
+  q2 += qDot3 * dT;
+  q3 += qDot4 * dT;
+
+  // Normalise quaternion
+  norm = 1.0f / sqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+  q0 *= norm;
+  q1 *= norm;
+  q2 *= norm;
+  q3 *= norm;
+}
+
+
+// Mahony step
+template <typename T>
+inline void mahony_filter<T>::step(T &q0, T &q1, T &q2, T &q3, T ax, T ay, T az, T gx, T gy, T gz, const T* m, T dT)
+{
+  T norm;
+
+  // Compute feedback only if accelerometer measurement valid (avoids NaN in accelerometer normalisation)
+  if (!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) {
+
+    // Normalise accelerometer measurement
+    norm = 1.0f / sqrt(ax * ax + ay * ay + az * az);
+    ax *= norm;
+    ay *= norm;
+    az *= norm;
+
+    T q0q0 = q0 * q0;
+    T q0q1 = q0 * q1;
+    T q0q2 = q0 * q2;
+    T q0q3 = q0 * q3;
+    T q1q1 = q1 * q1;
+    T q1q2 = q1 * q2;
+    T q1q3 = q1 * q3;
+    T q2q2 = q2 * q2;
+    T q2q3 = q2 * q3;
+    T q3q3 = q3 * q3;
+
+    // Estimated direction of gravity, error is the cross product with the measured one
+    T vx = q1q3 - q0q2;
+    T vy = q0q1 + q2q3;
+    T vz = q0q0 - 0.5f + q3q3;
+    T ex = ay * vz - az * vy;
+    T ey = az * vx - ax * vz;
+    T ez = ax * vy - ay * vx;
+
+    if (m != NULL) {
+      T mx = m[0], my = m[1], mz = m[2];
+
+      // Reference direction of Earth's magnetic field
+      T hx = 2.0f * (mx * (0.5f - q2q2 - q3q3) + my * (q1q2 - q0q3) + mz * (q1q3 + q0q2));
+      T hy = 2.0f * (mx * (q1q2 + q0q3) + my * (0.5f - q1q1 - q3q3) + mz * (q2q3 - q0q1));
+      T bx = sqrt(hx * hx + hy * hy);
+      T bz = 2.0f * (mx * (q1q3 - q0q2) + my * (q2q3 + q0q1) + mz * (0.5f - q1q1 - q2q2));
+
+      // Estimated direction of the field
+      T wx = bx * (0.5f - q2q2 - q3q3) + bz * (q1q3 - q0q2);
+      T wy = bx * (q1q2 - q0q3) + bz * (q0q1 + q2q3);
+      T wz = bx * (q0q2 + q1q3) + bz * (0.5f - q1q1 - q2q2);
+      ex += my * wz - mz * wy;
+      ey += mz * wx - mx * wz;
+      ez += mx * wy - my * wx;
+    }
+
+    // Integral feedback, a bias estimate
+    if (m_ki > 0.0f) {
+      m_ix += 2.0f * m_ki * ex * dT;
+      m_iy += 2.0f * m_ki * ey * dT;
+      m_iz += 2.0f * m_ki * ez * dT;
+      gx += m_ix;
+      gy += m_iy;
+      gz += m_iz;
+    }
+
+    // Proportional feedback
+    gx += 2.0f * m_kp * ex;
+    gy += 2.0f * m_kp * ey;
+    gz += 2.0f * m_kp * ez;
+  }
+
+  // Integrate rate of change of quaternion
+  gx *= 0.5f * dT;
+  gy *= 0.5f * dT;
+  gz *= 0.5f * dT;
+  T qa = q0, qb = q1, qc = q2;
+  q0 += (-qb * gx - qc * gy - q3 * gz);
+  q1 += (qa * gx + qc * gz - q3 * gy);
+  q2 += (qa * gy - qb * gz + q3 * gx);
+  q3 += (qa * gz + qb * gy - qc * gx);
+
+  // Normalise quaternion
+  norm = 1.0f / sqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+  q0 *= norm;
+  q1 *= norm;
+  q2 *= norm;
+  q3 *= norm;
+}
+
+
+// complementary step
+template <typename T>
+inline void complementary_filter<T>::step(T &q0, T &q1, T &q2, T &q3, T ax, T ay, T az, T gx, T gy, T gz, const T* m, T dT)
+{
+  // gyro path
+  T qa = q0, qb = q1, qc = q2;
+  gx *= 0.5f * dT;
+  gy *= 0.5f * dT;
+  gz *= 0.5f * dT;
+  q0 += (-qb * gx - qc * gy - q3 * gz);
+  q1 += (qa * gx + qc * gz - q3 * gy);
+  q2 += (qa * gy - qb * gz + q3 * gx);
+  q3 += (qa * gz + qb * gy - qc * gx);
+
+  if (!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) {
+    T norm = 1.0f / sqrt(ax * ax + ay * ay + az * az);
+    ax *= norm;
+    ay *= norm;
+    az *= norm;
+
+    // gravity as the gyro path sees it, the cross product with the measured one is the
+    // small-angle rotation that takes the estimate onto the accelerometer (roll, pitch)
+    T vx = 2.0f * (q1 * q3 - q0 * q2);
+    T vy = 2.0f * (q0 * q1 + q2 * q3);
+    T vz = q0 * q0 - q1 * q1 - q2 * q2 + q3 * q3;
+    T ex = ay * vz - az * vy;
+    T ey = az * vx - ax * vz;
+    T ez = ax * vy - ay * vx;
+
+    if (m != NULL) {
+      T mx = m[0], my = m[1], mz = m[2];
+
+      // field as the gyro path expects it, only its rotation about gravity is taken (yaw)
+      T hx = mx * (q0 * q0 + q1 * q1 - q2 * q2 - q3 * q3) + 2.0f * (my * (q1 * q2 - q0 * q3) + mz * (q1 * q3 + q0 * q2));
+      T hy = 2.0f * (mx * (q1 * q2 + q0 * q3) + mz * (q2 * q3 - q0 * q1)) + my * (q0 * q0 - q1 * q1 + q2 * q2 - q3 * q3);
+      T bx = sqrt(hx * hx + hy * hy);
+      T bz = 2.0f * (mx * (q1 * q3 - q0 * q2) + my * (q2 * q3 + q0 * q1)) + mz * vz;
+      T wx = bx * (q0 * q0 + q1 * q1 - q2 * q2 - q3 * q3) + bz * vx;
+      T wy = 2.0f * bx * (q1 * q2 - q0 * q3) + bz * vy;
+      T wz = 2.0f * bx * (q0 * q2 + q1 * q3) + bz * vz;
+      T e = (my * wz - mz * wy) * vx + (mz * wx - mx * wz) * vy + (mx * wy - my * wx) * vz;
+      ex += e * vx;
+      ey += e * vy;
+      ez += e * vz;
+    }
+
+    // 1 - alpha of the correction per step, applied to the quaternion in the body frame
+    T k = 0.5f * (1.0f - m_alpha);
+    ex *= k;
+    ey *= k;
+    ez *= k;
+    qa = q0;
+    qb = q1;
+    qc = q2;
+    q0 += (-qb * ex - qc * ey - q3 * ez);
+    q1 += (qa * ex + qc * ez - q3 * ey);
+    q2 += (qa * ey - qb * ez + q3 * ex);
+    q3 += (qa * ez + qb * ey - qc * ex);
+  }
+
+  // Normalise quaternion
+  T norm = 1.0f / sqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+  q0 *= norm;
+  q1 *= norm;
+  q2 *= norm;
+  q3 *= norm;
+}
+
+
+// set the magnetometer snapshot
+template <typename Filter>
+void imu_fusion<Filter>::setMag(T mx, T my, T mz)
+{
+  T norm = sqrt(mx * mx + my * my + mz * mz);
+  if (norm == 0.0f) {
+    clearMag();
+    return;
+  }
+
+  m_mag[0] = mx / norm;
+  m_mag[1] = my / norm;
+  m_mag[2] = mz / norm;
+  m_has_mag = true;
+}
+
+
+// run the filter over a block
+template <typename Filter>
+void imu_fusion<Filter>::update(const imu_soa &in, size_t n, T dT)
+{
+  const T d2r = M_PI / 180.0;
+
+  // keep the state in locals for the whole block
+  T q0 = m_q.m_w;
+  T q1 = m_q.m_x;
+  T q2 = m_q.m_y;
+  T q3 = m_q.m_z;
+  const T* mag = m_has_mag ? m_mag : NULL;
+
+  for (size_t i = 0; i < n; ++i) {
+    m_filter.step(q0, q1, q2, q3,
+      in.accel[0][i], in.accel[1][i], in.accel[2][i],
+      in.gyro[0][i] * d2r, in.gyro[1][i] * d2r, in.gyro[2][i] * d2r,
+      mag, dT);
+  }
+
+  // already normalized, no quaternion::set()
+  m_q.m_w = q0;
+  m_q.m_x = q1;
+  m_q.m_y = q2;
+  m_q.m_z = q3;
+}
+
+
+// run the filter on a single sample
+template <typename Filter>
+void imu_fusion<Filter>::update(const float* data, T dT)
+{
+  float ax = data[0], ay = data[1], az = data[2];
+  float gx = data[3], gy = data[4], gz = data[5];
+  imu_soa in = {{&ax, &ay, &az}, {&gx, &gy, &gz}};
+  update(in, 1, dT);
+}
+
+#endif // imu_fusion_h
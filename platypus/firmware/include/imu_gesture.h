@@ -0,0 +1,105 @@
+/*
+* Streaming gesture recognition on raw FIFO blocks
+* one pass per sample over the acceleration with the gravity removed (low-passed and turned
+* with the gyro rates), taps are short spikes
+* between quiet samples, shakes a lasting high energy, face down/up the low-passed gravity
+* held for a while; all with hysteresis, so every gesture is reported once
+*
+*/
+
+#ifndef imu_gesture_h
+#define imu_gesture_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#include "./imu_edison.h"
+
+// a tap rises above this and falls back below the quiet level [m/s^2] within IMU_GESTURE_TAP_LEN
+#define IMU_GESTURE_TAP 4.0
+#define IMU_GESTURE_QUIET 1.5
+#define IMU_GESTURE_TAP_LEN 0.08 // [s]
+// the board must not rotate faster than this during a tap [deg/s], as the WoM tap before
+#define IMU_GESTURE_TAP_GYRO 45.0
+// second tap of a double tap within [s]
+#define IMU_GESTURE_DOUBLE 0.6
+// rms [m/s^2] over about IMU_GESTURE_TAU to start a shake, it ends below half of it
+#define IMU_GESTURE_SHAKE 5.0
+// time constant of the gravity and energy estimates [s]
+#define IMU_GESTURE_TAU 0.5
+// face down/up if gravity along Z is beyond this fraction of g for IMU_GESTURE_FACE_HOLD [s]
+#define IMU_GESTURE_FACE 0.7
+#define IMU_GESTURE_FACE_HOLD 1.0
+
+
+enum class Gesture {
+  TAP,
+  DOUBLE_TAP,
+  SHAKE,
+  FACE_DOWN,
+  FACE_UP
+};
+
+struct imu_gesture_event {
+  Gesture type;
+  // sample in the block passed to update() that completed the gesture, e.g. for imu_clock::sampleTime()
+  size_t sample;
+};
+
+
+class imu_gesture {
+ public:
+  // [rate] sample rate [Hz] of the FIFO data, e.g. imu_edison::getSampleRate()
+  imu_gesture(float rate = 25.0, int afs_sel = AFS_SEL, int gfs_sel = GFS_SEL);
+
+  // feeds [n] samples of [raw] as delivered by imu_edison::readFIFO()
+  // (6 values per sample, ACCEL XYZ, GYRO XYZ), appends the recognized gestures to [events]
+  // a tap is reported as soon as the sample after it is quiet, the second tap of a double tap
+  // as TAP followed by DOUBLE_TAP
+  // returns the number of events appended
+  size_t update(const int16_t* raw, size_t n, std::vector<imu_gesture_event> &events);
+
+  // state after the last update()
+  inline bool isShaking() {return m_shaking;}
+  inline bool isFaceDown() {return m_face < 0;}
+  // low-passed acceleration XYZ [m/s^2], gravity while the board is not accelerated
+  inline const float* getGravity() {return m_gravity;}
+
+  // starts over, e.g. after a gap in the FIFO data
+  void reset();
+
+  static const char* name(Gesture type);
+
+ private:
+  float m_accel_scale;
+  float m_gyro_scale;
+
+  // thresholds in samples and squared magnitudes
+  size_t m_tap_len;
+  size_t m_double;
+  size_t m_face_hold;
+  float m_tap_sq, m_quiet_sq, m_gyro_sq;
+  float m_shake_on, m_shake_off;
+  float m_face_z;
+  float m_k; // low-pass weight per sample
+  float m_dt; // sample period, incl. deg to rad
+
+  float m_gravity[3];
+  bool m_init;
+
+  // tap: samples in the current spike, quiet samples before it, samples since the last tap
+  size_t m_spike;
+  size_t m_quiet;
+  size_t m_since_tap;
+  bool m_spike_ok;
+
+  float m_energy;
+  bool m_shaking;
+
+  // -1 face down, 1 face up, samples the other orientation has been held
+  int m_face;
+  size_t m_face_cnt;
+};
+
+#endif // imu_gesture_h
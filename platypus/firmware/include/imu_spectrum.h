@@ -0,0 +1,105 @@
+/*
+* Streaming vibration spectrum of the acceleration
+* overlapping Hann windows over raw FIFO blocks, the mean of each axis removed (gravity, slow
+* tilts); a radix-2 real FFT per axis gives the band energies and the peak frequency per window
+*
+*/
+
+#ifndef imu_spectrum_h
+#define imu_spectrum_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#include "./imu_edison.h"
+
+// window length and hop [samples], 2.56s every 1.28s at 25Hz
+#define IMU_SPECTRUM_SIZE 64
+#define IMU_SPECTRUM_HOP 32
+// octave bands below the Nyquist frequency by default, at most IMU_SPECTRUM_MAX_BANDS
+#define IMU_SPECTRUM_BANDS 4
+#define IMU_SPECTRUM_MAX_BANDS 8
+// channels transformed side by side: ACCEL XYZ and one idle lane, as wide as an SSE register
+#define IMU_SPECTRUM_LANES 4
+
+
+// features of one window, energies are mean squares [(m/s^2)^2] summed over the axes
+struct imu_spectrum_window {
+  uint32_t window;   // counted from reset()
+  float peak;        // frequency of the strongest bin [Hz], interpolated between bins, 0 without one
+  float peak_energy; // energy of that bin
+  float rms;         // of the acceleration without its mean [m/s^2]
+  uint8_t bands;
+  float energy[IMU_SPECTRUM_MAX_BANDS];
+};
+
+
+class imu_spectrum {
+ public:
+  // windows of [size] samples (a power of 2) every [hop] samples of FIFO data at [rate] [Hz],
+  // e.g. imu_edison::getSampleRate()
+  imu_spectrum(float rate = 25.0, size_t size = IMU_SPECTRUM_SIZE, size_t hop = IMU_SPECTRUM_HOP, int afs_sel = AFS_SEL);
+
+  // [n] bands between [edges] [Hz] (n + 1 of them, ascending), a bin counts for the band its
+  // center frequency falls in
+  void setBands(const float* edges, size_t n);
+
+  // feeds [n] samples of [raw] as delivered by imu_edison::readFIFO()
+  // (6 values per sample, ACCEL XYZ, GYRO XYZ), appends the features of completed windows to [windows]
+  // returns the number of windows appended
+  size_t update(const int16_t* raw, size_t n, std::vector<imu_spectrum_window> &windows);
+
+  // power spectrum of a window of IMU_SPECTRUM_LANES interleaved channels, getSize() samples in [in],
+  // getBins() bins per channel (interleaved the same way) to [out], unscaled |X[k]|^2
+  // uses SSE where available, the result matches powerScalar() up to rounding
+  void power(const float* in, float* out);
+  // same as above, plain C++
+  void powerScalar(const float* in, float* out);
+
+  inline size_t getSize() {return m_size;}
+  inline size_t getBins() {return m_size / 2 + 1;}
+  // frequency of bin [k] [Hz]
+  inline float getFrequency(size_t k) {return k * m_rate / m_size;}
+
+  // starts over, e.g. after a gap in the FIFO data
+  void reset();
+
+ private:
+  // windowed, mean free samples of the last m_size to m_in, features of m_out to [w]
+  void prepare();
+  void features(imu_spectrum_window &w);
+
+  float m_rate;
+  size_t m_size;
+  size_t m_hop;
+  float m_accel_scale;
+
+  // FFT of m_size / 2 complex points: bit reversal, twiddles, and those of the real split
+  std::vector<uint32_t> m_bitrev;
+  std::vector<float> m_tw_re, m_tw_im;
+  std::vector<float> m_split_re, m_split_im;
+  // scratch, split complex per lane
+  std::vector<float> m_re, m_im;
+
+  // Hann window and the scale from |X[k]|^2 to a mean square
+  std::vector<float> m_hann;
+  float m_norm;
+
+  // band of each bin, -1 outside the bands
+  std::vector<int> m_band;
+  size_t m_bands;
+
+  // last m_size samples per axis [m/s^2], ring position, samples since the last window
+  std::vector<float> m_hist[3];
+  size_t m_pos;
+  size_t m_count;
+  size_t m_since;
+  uint32_t m_windows;
+
+  // window, its power spectrum, the energy per bin summed over the axes
+  std::vector<float> m_in, m_out;
+  std::vector<float> m_bin;
+};
+
+#endif // imu_spectrum_h
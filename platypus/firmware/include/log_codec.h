@@ -0,0 +1,60 @@
+/*
+* Lossless codec for the pages of the sample log
+* per channel the difference to the previous sample, zig-zag folded, then bit-packed per frame of
+* LOG_CODEC_FRAME samples with the width the frame needs above its minimum (frame of reference);
+* every page of a log file names its codec, see log_format
+*
+*/
+
+#ifndef log_codec_h
+#define log_codec_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "./log_arena.h"
+
+// samples per frame, a width and a minimum per channel and frame
+#define LOG_CODEC_FRAME 32
+// channels side by side in one SSE register with two idle lanes
+#define LOG_CODEC_LANES 8
+// worst case bytes of log_codec::encode() for [n] samples: the first sample, 3 bytes per
+// channel and frame, 16 bits per value
+#define LOG_CODEC_BOUND(n) (LOG_SAMPLE_SIZE + ((n) + LOG_CODEC_FRAME - 1) / LOG_CODEC_FRAME * 18 + (n) * LOG_SAMPLE_SIZE)
+
+
+enum class Codec : uint8_t {
+  RAW = 0,  // the samples as in a log_page, 16Bit big endian
+  DELTA = 1 // delta, zig-zag, frame of reference
+};
+
+
+class log_codec {
+ public:
+  log_codec();
+
+  // encodes [n] samples of [raw] (6 values per sample, ACCEL XYZ, GYRO XYZ) to [out] of at least
+  // LOG_CODEC_BOUND(n) bytes, returns the bytes written
+  // uses SSE2 where available, the output matches encodeScalar() exactly
+  size_t encode(const int16_t* raw, size_t n, uint8_t* out);
+  // same as above, plain C++
+  size_t encodeScalar(const int16_t* raw, size_t n, uint8_t* out);
+
+  // decodes [n] samples from [in] of [size] bytes to [raw], returns the bytes read,
+  // 0 if [in] is shorter or broken
+  size_t decode(const uint8_t* in, size_t size, size_t n, int16_t* raw);
+  size_t decodeScalar(const uint8_t* in, size_t size, size_t n, int16_t* raw);
+
+  static const char* name(Codec codec);
+
+ private:
+  // bit-packs the values of [m] samples of [frame] in lane [c] with [width] bits to [out]
+  static uint8_t* packLane(const uint16_t* frame, size_t m, int c, int width, uint8_t* out);
+  // the reverse to [frame], NULL if [in] ends before [end]
+  static const uint8_t* unpackLane(const uint8_t* in, const uint8_t* end, size_t m, int c, int width, uint16_t* frame);
+
+  // zig-zag deltas, then their offsets to the minimum of a frame, per sample and lane
+  uint16_t m_frame[LOG_CODEC_FRAME * LOG_CODEC_LANES];
+};
+
+#endif // log_codec_h
@@ -0,0 +1,101 @@
+/*
+* Versioned file format of the sample log
+* a segment file starts with a file header that describes the device, the sensor configuration
+* and the channels; every page follows with its own header of sequence number, timestamp,
+* sample count, codec and a CRC32C over the page, so pages can be checked and found on their own
+*
+*/
+
+#ifndef log_format_h
+#define log_format_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#include "./log_arena.h"
+#include "./log_codec.h"
+
+#define LOG_FORMAT_VERSION 2
+
+// file header, little endian:
+//  0 "PPSLOG", version (2), header size (64), page info size (LOG_HEADER_SIZE),
+// 12 device ID (16, NUL padded), 28 AFS [g] (2), GFS [dps] (2), 32 sample rate [Hz] (float),
+// 36 bandwidth [Hz] (float), 40 channels (1), bytes per value (1), 42 schema (18, NUL padded),
+// 60 CRC32C of the bytes before
+#define LOG_FILE_MAGIC "PPSLOG"
+#define LOG_FILE_HEADER_SIZE 64
+// page header, little endian:
+//  0 "PG", codec (1), flags (1, 0), 4 sequence number (4), 8 first sample [ns CLOCK_MONOTONIC] (8),
+// 16 samples (2), page info size (2), 20 payload size (4), 24 CRC32C of the bytes before, the
+// page info and the payload; the page info (time, light, temperature, pressure, humidity) and
+// the payload in the codec follow
+#define LOG_PAGE_MAGIC "PG"
+#define LOG_PAGE_HEADER_SIZE 28
+// worst case bytes of log_format::pack()
+#define LOG_FORMAT_PAGE_BOUND (LOG_PAGE_HEADER_SIZE + LOG_HEADER_SIZE + LOG_CODEC_BOUND(LOG_PAGE_SAMPLES))
+// channels of a sample in order
+#define LOG_SCHEMA "ax ay az gx gy gz"
+
+
+struct log_file_header {
+  uint16_t version;
+  char device[16];  // e.g. the host name, NUL padded
+  uint16_t afs;     // accelerometer full scale [g]
+  uint16_t gfs;     // gyroscope full scale [dps]
+  float rate;       // sample rate of the log [Hz]
+  float bandwidth;  // low-pass of the logged samples [Hz], 0 if none
+  uint8_t channels;
+  uint8_t value_size;
+  char schema[18];  // channel names separated by blanks
+
+  // the current version with the ACCEL XYZ, GYRO XYZ schema, nothing known about the device
+  log_file_header();
+};
+
+struct log_page_info {
+  Codec codec;
+  uint32_t sequence;
+  int64_t stamp;    // first sample [ns CLOCK_MONOTONIC]
+  size_t samples;
+  size_t size;      // bytes of the page in the file
+};
+
+
+class log_format {
+ public:
+  log_format();
+
+  // [header] to [out] of LOG_FILE_HEADER_SIZE bytes
+  static void writeHeader(const log_file_header &header, uint8_t* out);
+  // [header] from [in] of [size] bytes, false if it is not a file of a known version or the CRC
+  // does not match (a file of the datalog layout before version 2 has no file header)
+  static bool readHeader(const uint8_t* in, size_t size, log_file_header &header);
+
+  // [page] with its sequence number [sequence] to [out] of at least LOG_FORMAT_PAGE_BOUND bytes,
+  // the samples with [codec] or raw if it does not save anything; returns the bytes written
+  size_t pack(log_page* page, Codec codec, uint32_t sequence, uint8_t* out);
+  // the page at [in] of [size] bytes back to [page] as the logger filled it, its header to [info]
+  // (may be NULL); returns the bytes read, 0 if there is no complete page with a matching CRC
+  size_t unpack(const uint8_t* in, size_t size, log_page* page, log_page_info* info = NULL);
+
+  // header of the page at [in] of [size] bytes to [info] if the page is complete and its CRC
+  // matches, without decoding it
+  static bool check(const uint8_t* in, size_t size, log_page_info &info);
+  // offset of the next complete page with a matching CRC in [in] of [size] bytes, [size] if
+  // there is none, e.g. to go on behind a broken page
+  static size_t seek(const uint8_t* in, size_t size);
+
+  // CRC32C (Castagnoli) of [n] bytes at [data], continued from [crc]
+  // uses the SSE4.2 crc32 instruction where available, the result matches crc32cScalar()
+  static uint32_t crc32c(const uint8_t* data, size_t n, uint32_t crc = 0);
+  // same as above, plain C++ with a table
+  static uint32_t crc32cScalar(const uint8_t* data, size_t n, uint32_t crc = 0);
+
+ private:
+  log_codec m_codec;
+  // samples of a page in host order
+  std::vector<int16_t> m_raw;
+};
+
+#endif // log_format_h
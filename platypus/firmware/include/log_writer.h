@@ -0,0 +1,154 @@
+/*
+* Writer thread of the sample log
+* drains the pages committed to a log_arena in batches, one writev() per batch, into segment
+* files [dir][prefix]XXXX.bin of a bounded number of pages; fdatasync() as the policy says,
+* the segment number is looked up once at start() and counted on from there; the files are
+* written in the format of log_format, the pages packed with the codec on this thread; with a
+* journal (see log_journal) every page is on the flash within a bounded window while the
+* segments are still written in batches and synced rarely
+*
+*/
+
+#ifndef log_writer_h
+#define log_writer_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <sys/uio.h>
+
+#include "./log_arena.h"
+#include "./log_format.h"
+#include "./log_journal.h"
+
+// pages per segment file, 14.8 MB or 13.7h at 25Hz
+#define LOG_SEGMENT_PAGES 2048
+// pages per writev(), 115 kB
+#define LOG_WRITER_BATCH 16
+// [s] at most between two writes while pages are committed
+#define LOG_WRITER_DELAY 120.0
+// [s] between two fdatasync(), 0 after every batch, negative only when a segment is closed
+#define LOG_WRITER_SYNC 600.0
+
+
+struct log_writer_stats {
+  unsigned long pages;
+  unsigned long bytes;     // written, the headers included
+  unsigned long raw_bytes; // of the pages in RAM
+  unsigned long batches;
+  unsigned long segments; // opened
+  unsigned long syncs;
+  unsigned long errors;   // failed opens and writes, the pages are lost
+  unsigned long exhausted; // the IMU thread found no free page, see log_arena::getExhausted()
+  size_t depth;            // pages committed and not written
+  size_t max_depth;
+  float write_ms;          // the last batch incl. its fdatasync()
+  float max_write_ms;
+  float mean_write_ms;
+  unsigned long journal_pages; // appended to the journal
+  unsigned long journal_syncs;
+  unsigned long recovered;     // pages moved from the journal into their segment at start()
+};
+
+
+class log_writer {
+ public:
+  // writes the pages committed to [arena] to [dir][prefix]XXXX.bin, [segment_pages] pages per file
+  log_writer(log_arena* arena, const std::string &dir, const std::string &prefix = "datalog",
+    size_t segment_pages = LOG_SEGMENT_PAGES);
+  // stops the thread, the pages committed so far are written
+  ~log_writer();
+
+  // writes once [batch] pages are committed or [delay] [s] passed since the last write,
+  // fdatasync() every [sync] [s] (see LOG_WRITER_SYNC); call before start()
+  void setPolicy(size_t batch, float delay, float sync);
+  // the samples of every page with [codec] (Codec::RAW by default); call before start()
+  void setCodec(Codec codec);
+  // the file header of every segment, see log_file_header; call before start()
+  void setHeader(const log_file_header &header);
+  // appends every page to [dir][prefix].journal as soon as it is committed and syncs the journal
+  // [window] [s] after the first page not synced yet (see LOG_JOURNAL_WINDOW), negative for
+  // none (default); start() recovers the journal left by a crash; call before start()
+  void setJournal(float window);
+
+  // recovers the journal if enabled, looks up the next segment number in the directory (created
+  // if missing) and starts the thread
+  // returns false if the directory is not accessible
+  bool start();
+  // writes the pages committed so far and stops the thread
+  void stop();
+  // writes the pages committed so far without waiting for the batch; a partial page ends a
+  // segment anyway, so a forced save commits the page being filled and calls this
+  void flush();
+
+  log_writer_stats getStats();
+  // number of the segment written to next
+  inline int getSegment() {return m_segment;}
+  // sequence number of the next page, counted from 0 at construction
+  inline uint32_t getSequence() {return m_sequence;}
+  inline bool isRunning() {return m_running;}
+
+ private:
+  void run();
+  // takes, packs and returns committed pages to the arena while there is room, to the journal
+  void stage();
+  // one batch of staged pages, returns false if none was committed
+  bool writeBatch();
+  bool openSegment();
+  void closeSegment();
+  bool sync();
+  // the journal starts over behind the segment on the flash with the pages still staged
+  void resetJournal();
+  void syncJournal();
+
+  log_arena* m_arena;
+  std::string m_dir, m_prefix;
+  size_t m_segment_pages;
+
+  size_t m_batch;
+  std::chrono::steady_clock::duration m_delay;
+  float m_sync;
+  Codec m_codec;
+  log_file_header m_header;
+  float m_journal_window;
+
+  std::thread m_thread;
+  std::atomic<bool> m_running;
+  std::atomic<bool> m_flush;
+
+  // open segment, its number, pages and bytes so far, -1 if none
+  int m_fd;
+  std::atomic<int> m_segment;
+  size_t m_segment_written, m_segment_bytes;
+  std::atomic<uint32_t> m_sequence;
+  std::chrono::steady_clock::time_point m_last_write, m_last_sync;
+
+  // a page packed and returned to the arena, not in the segment yet
+  struct staged_page {
+    size_t raw_size;
+    bool full;
+  };
+  // batch buffers, allocated with the policy
+  std::vector<staged_page> m_staged_pages;
+  std::vector<struct iovec> m_iov;
+  size_t m_staged;
+  // packed pages of a batch, LOG_FORMAT_PAGE_BOUND bytes each
+  std::vector<uint8_t> m_packed;
+  log_format m_log_format;
+
+  // pages appended and not synced, the time they have to be
+  log_journal m_journal;
+  size_t m_journal_unsynced;
+  std::chrono::steady_clock::time_point m_journal_due;
+
+  std::mutex m_mtx_stats;
+  log_writer_stats m_stats;
+  double m_write_ms_sum;
+};
+
+#endif // log_writer_h
@@ -0,0 +1,72 @@
+/*
+* Streaming hard/soft-iron calibration of the magnetometer
+* least squares ellipsoid fit over the normal equations, updated per sample in constant
+* memory (no point cloud), the fit is a 9x9 Cholesky solve plus a 3x3 eigen decomposition
+*
+*/
+
+#ifndef mag_calib_h
+#define mag_calib_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// number of ellipsoid parameters: x^2 y^2 z^2 2xy 2xz 2yz 2x 2y 2z
+#define MAG_CALIB_PARAMS 9
+// samples needed before fit() is tried
+#define MAG_CALIB_MIN_SAMPLES 64
+
+
+class mag_calib {
+ public:
+  // [min_dist] is the distance [mGs] a sample needs from the last accepted one,
+  // so resting in one orientation does not outweigh the others
+  // [forget] < 1.0 lets old samples fade out, 1.0 keeps all of them
+  mag_calib(float min_dist = 30.0, double forget = 1.0);
+
+  // adds one uncalibrated measurement [mGs], e.g. imu_edison::getCompassData(x, y, z, false)
+  // returns true if the sample was accepted
+  bool add(float x, float y, float z);
+
+  // fits the ellipsoid to the samples added so far
+  // returns false and keeps the previous result if the samples do not describe an ellipsoid
+  bool fit();
+
+  // correction of the last successful fit: m_cal = matrix * (m - offset)
+  // offset [mGs], matrix row major 3x3, keeps the field strength
+  inline const float* getOffset() {return m_offset;}
+  inline const float* getMatrix() {return m_matrix;}
+  // radius of the fitted sphere [mGs]
+  inline float getFieldStrength() {return m_field;}
+  // true after the first successful fit or load()
+  inline bool isValid() {return m_valid;}
+  // number of accepted samples
+  inline size_t getCount() {return m_count;}
+
+  // applies the correction to [x, y, z] in place
+  void apply(float &x, float &y, float &z);
+
+  // drops all samples, the result stays
+  void clear();
+
+  // writes / reads the result as text, returns false on error
+  bool save(const char* path);
+  bool load(const char* path);
+
+ private:
+  // sum(d d^T) (upper triangle only) and sum(d), d the parameter row of a sample
+  double m_ata[MAG_CALIB_PARAMS * MAG_CALIB_PARAMS];
+  double m_atb[MAG_CALIB_PARAMS];
+  size_t m_count;
+
+  float m_last[3];
+  float m_min_dist;
+  double m_forget;
+
+  float m_offset[3];
+  float m_matrix[9];
+  float m_field;
+  bool m_valid;
+};
+
+#endif // mag_calib_h
@@ -0,0 +1,109 @@
+/*
+* Bosch BME280 compensation and measurement profiles
+* integer formulas of the BME280 datasheet sec 4.2.3, t_fine is evaluated once per measurement
+*
+*/
+
+#include "./bme_comp.h"
+
+// oversampling setting to number of conversions
+static const int OSRS_COUNT[6] = {0, 1, 2, 4, 8, 16};
+// t_sb setting to standby [ms]
+static const float STANDBY_MS[8] = {0.5, 62.5, 125.0, 250.0, 500.0, 1000.0, 10.0, 20.0};
+
+
+//_______________________________________________________________________________________________________
+bme_comp::bme_comp() {
+  BME_calibration calib = {};
+  setCalibration(calib);
+}
+
+//_______________________________________________________________________________________________________
+bme_comp::bme_comp(const BME_calibration &calib) {
+  setCalibration(calib);
+}
+
+//_______________________________________________________________________________________________________
+void bme_comp::setCalibration(const BME_calibration &calib) {
+  m_calib = calib;
+}
+
+//_______________________________________________________________________________________________________
+void bme_comp::parse(const uint8_t* data, BME_raw &raw) {
+  raw.adc_P = ((uint32_t) data[0] << 12) | ((uint32_t) data[1] << 4) | ((uint32_t) data[2] >> 4);
+  raw.adc_T = ((uint32_t) data[3] << 12) | ((uint32_t) data[4] << 4) | ((uint32_t) data[5] >> 4);
+  raw.adc_H = ((uint32_t) data[6] << 8) | data[7];
+}
+
+//_______________________________________________________________________________________________________
+int32_t bme_comp::tfine(int32_t adc_T) {
+  int32_t var1, var2;
+  var1  = ((((adc_T >> 3) - ((int32_t)m_calib.dig_T1 << 1))) * ((int32_t)m_calib.dig_T2)) >> 11;
+  var2  = (((((adc_T >> 4) - ((int32_t)m_calib.dig_T1)) * ((adc_T >> 4) - ((int32_t)m_calib.dig_T1))) >> 12) * ((int32_t)m_calib.dig_T3)) >> 14;
+  return var1 + var2;
+}
+
+//_______________________________________________________________________________________________________
+int32_t bme_comp::compT(int32_t t_fine) {
+  return (t_fine * 5 + 128) >> 8;
+}
+
+//_______________________________________________________________________________________________________
+uint32_t bme_comp::compP(int32_t adc_P, int32_t t_fine) {
+  int64_t var1, var2, p;
+  var1 = ((int64_t)t_fine) - 128000;
+  var2 = var1 * var1 * (int64_t)m_calib.dig_P6;
+  var2 = var2 + ((var1*(int64_t)m_calib.dig_P5) << 17);
+  var2 = var2 + (((int64_t)m_calib.dig_P4) << 35);
+  var1 = ((var1 * var1 * (int64_t)m_calib.dig_P3) >> 8) + ((var1 * (int64_t)m_calib.dig_P2) << 12);
+  var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)m_calib.dig_P1) >> 33;
+  if (var1 == 0)
+    return 0; // avoid division by zero
+  p = 1048576 - adc_P;
+  p = (((p << 31) - var2) * 3125) / var1;
+  var1 = (((int64_t)m_calib.dig_P9) * (p >> 13) * (p >> 13)) >> 25;
+  var2 = (((int64_t)m_calib.dig_P8) * p) >> 19;
+  p = ((p + var1 + var2) >> 8) + (((int64_t)m_calib.dig_P7) << 4);
+  return (uint32_t)p;
+}
+
+//_______________________________________________________________________________________________________
+uint32_t bme_comp::compH(int32_t adc_H, int32_t t_fine) {
+  int32_t v_x1_u32r;
+  v_x1_u32r = (t_fine - ((int32_t)76800));
+  v_x1_u32r = (((((adc_H << 14) - (((int32_t)m_calib.dig_H4) << 20) - (((int32_t)m_calib.dig_H5) * v_x1_u32r)) +
+    ((int32_t)16384)) >> 15) * (((((((v_x1_u32r * ((int32_t)m_calib.dig_H6)) >> 10) * (((v_x1_u32r *
+    ((int32_t)m_calib.dig_H3)) >> 11) + ((int32_t)32768))) >> 10) + ((int32_t)2097152)) *
+    ((int32_t)m_calib.dig_H2) + 8192) >> 14));
+  v_x1_u32r = (v_x1_u32r - (((((v_x1_u32r >> 15) * (v_x1_u32r >> 15)) >> 7) * ((int32_t)m_calib.dig_H1)) >> 4));
+  v_x1_u32r = (v_x1_u32r < 0 ? 0 : v_x1_u32r);
+  v_x1_u32r = (v_x1_u32r > 419430400 ? 419430400 : v_x1_u32r);
+  return (uint32_t)(v_x1_u32r >> 12);
+}
+
+//_______________________________________________________________________________________________________
+void bme_comp::compensate(const BME_raw &raw, BME_data &data) {
+  int32_t t_fine = tfine(raw.adc_T);
+  data.T = compT(t_fine);
+  data.P = compP(raw.adc_P, t_fine);
+  data.H = compH(raw.adc_H, t_fine);
+}
+
+//_______________________________________________________________________________________________________
+void bme_comp::compensate(const BME_raw* raw, BME_data* data, size_t n) {
+  for (size_t i = 0; i < n; ++i)
+    compensate(raw[i], data[i]);
+}
+
+//_______________________________________________________________________________________________________
+float bme_comp::getRate(const BME_profile &profile) {
+  // max measurement time [ms], the pressure and humidity conversions add 0.575ms each when enabled
+  float t = 1.25;
+  if (profile.osrs_t)
+    t += 2.3 * OSRS_COUNT[profile.osrs_t > 5 ? 5 : profile.osrs_t];
+  if (profile.osrs_p)
+    t += 2.3 * OSRS_COUNT[profile.osrs_p > 5 ? 5 : profile.osrs_p] + 0.575;
+  if (profile.osrs_h)
+    t += 2.3 * OSRS_COUNT[profile.osrs_h > 5 ? 5 : profile.osrs_h] + 0.575;
+  return 1000.0 / (t + STANDBY_MS[profile.t_sb & 0x07]);
+}
@@ -0,0 +1,93 @@
+/*
+* Sampling plan for the auxiliary I2C slaves of the MPU 9250
+* the I2C master reads the enabled slaves once per sample, the delayed ones only every
+* I2C_MST_DLY + 1 samples; there is one delay for all of them
+*
+*/
+
+#include <stdio.h>
+#include <math.h>
+
+#include "./imu_aux.h"
+
+// bytes of a register read besides the data: address write, register, address read
+#define READ_OVERHEAD 3
+
+
+//_______________________________________________________________________________________________________
+static int divider(float sample_rate, float rate, float odr) {
+  // the largest divider that still reads at [rate], no faster than the sensor measures
+  float target = rate < odr ? rate : odr;
+  int div = (int) floor(sample_rate / target);
+  return div < 1 ? 1 : div;
+}
+
+//_______________________________________________________________________________________________________
+imu_aux_plan imu_aux::plan(float rate, float mag_rate, float env_rate, float env_odr) {
+  imu_aux_plan p = imu_aux_plan();
+
+  long div = lround(IMU_AUX_INTERNAL_RATE / rate) - 1;
+  p.smplrt_div = div < 0 ? 0 : (div > 0xFF ? 0xFF : div);
+  p.sample_rate = IMU_AUX_INTERNAL_RATE / (1 + p.smplrt_div);
+
+  // slave 0 is read first, its data comes first in EXT_SENS_DATA
+  if (env_rate > 0.0 && env_odr > 0.0) {
+    p.env_odr = env_odr;
+    p.env_div = divider(p.sample_rate, env_rate, env_odr);
+    p.env_len = IMU_AUX_ENV_LEN;
+  }
+  if (mag_rate > 0.0) {
+    p.mag_mode = mag_rate <= 8.0 ? IMU_AUX_MAG_8HZ : IMU_AUX_MAG_100HZ;
+    p.mag_odr = mag_rate <= 8.0 ? 8.0 : 100.0;
+    p.mag_div = divider(p.sample_rate, mag_rate, p.mag_odr);
+    p.mag_len = IMU_AUX_MAG_LEN;
+    p.mag_offset = p.env_len;
+  }
+
+  // one delay for all delayed slaves, set by the one that needs the most reads
+  int dly = 0;
+  if (p.env_div > 1)
+    dly = p.env_div;
+  if (p.mag_div > 1 && (dly == 0 || p.mag_div < dly))
+    dly = p.mag_div;
+  if (dly > IMU_AUX_MAX_DLY + 1)
+    dly = IMU_AUX_MAX_DLY + 1;
+
+  if (dly > 1) {
+    p.mst_dly = dly - 1;
+    // shadowing keeps EXT_SENS_DATA of a delayed slave consistent until all slaves are read
+    p.delay_ctrl = IMU_AUX_ES_SHADOW;
+    if (p.env_div > 1) {
+      p.env_div = dly;
+      p.delay_ctrl |= IMU_AUX_SLV0_DLY;
+    }
+    if (p.mag_div > 1) {
+      p.mag_div = dly;
+      p.delay_ctrl |= IMU_AUX_SLV1_DLY;
+    }
+  }
+
+  if (p.env_len > 0)
+    p.env_rate = p.sample_rate / p.env_div;
+  if (p.mag_len > 0)
+    p.mag_rate = p.sample_rate / p.mag_div;
+  p.bus_load = p.env_rate * (p.env_len + READ_OVERHEAD) + p.mag_rate * (p.mag_len + READ_OVERHEAD);
+
+  return p;
+}
+
+//_______________________________________________________________________________________________________
+void imu_aux::print(const imu_aux_plan &p) {
+  printf("[IMU] Aux plan: %.1fHz, compass ", p.sample_rate);
+  if (p.mag_len > 0)
+    printf("%.1fHz (%.0fHz mode)", p.mag_rate, p.mag_odr);
+  else
+    printf("off");
+  printf(", BME ");
+  if (p.env_len > 0)
+    printf("%.1fHz (measures at %.1fHz)", p.env_rate, p.env_odr);
+  else
+    printf("off");
+  printf(", %.0f B/s on the aux bus.\n", p.bus_load);
+  fflush(stdout);
+}
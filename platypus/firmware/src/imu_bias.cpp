@@ -0,0 +1,81 @@
+/*
+* Online gyroscope bias estimation on raw FIFO blocks
+* only sums per window, the variances are computed once a window is complete
+*
+*/
+
+#include "./imu_bias.h"
+
+
+
+//_______________________________________________________________________________________________________
+imu_bias::imu_bias(size_t window, float accel_std, float gyro_std, float alpha, int afs_sel, int gfs_sel)
+ : m_window(window > 1 ? window : 2), m_alpha(alpha)
+{
+  // thresholds in raw values, see imu_convert::setRange()
+  double as = (1 << afs_sel) * 9.807 / 16384.0;
+  double gs = (1 << gfs_sel) / 131.0;
+  m_accel_var = (accel_std / as) * (accel_std / as);
+  m_gyro_var = (gyro_std / gs) * (gyro_std / gs);
+  m_max_bias = IMU_BIAS_MAX / gs;
+
+  reset();
+}
+
+//_______________________________________________________________________________________________________
+void imu_bias::reset() {
+  for (int j = 0; j < 6; ++j) {
+    m_sum[j] = 0;
+    m_sq[j] = 0;
+  }
+  m_n = 0;
+
+  for (int j = 0; j < 3; ++j)
+    m_bias[j] = 0.0;
+  m_still = false;
+  m_valid = false;
+  m_window_cnt = 0;
+  m_still_cnt = 0;
+}
+
+//_______________________________________________________________________________________________________
+bool imu_bias::update(const int16_t* raw, size_t n) {
+  bool updated = false;
+
+  for (size_t i = 0; i < n; ++i, raw += 6) {
+    for (int j = 0; j < 6; ++j) {
+      m_sum[j] += raw[j];
+      m_sq[j] += (int32_t) raw[j] * raw[j];
+    }
+    if (++m_n < m_window)
+      continue;
+
+    // variance = (sum(x^2) - sum(x)^2 / n) / n, summed over the axes
+    double var[2] = {0.0, 0.0}, mean[3];
+    for (int j = 0; j < 6; ++j)
+      var[j / 3] += ((double) m_sq[j] - (double) m_sum[j] * m_sum[j] / m_n) / m_n;
+    double norm = 0.0;
+    for (int j = 0; j < 3; ++j) {
+      mean[j] = (double) m_sum[j + 3] / m_n;
+      norm += mean[j] * mean[j];
+    }
+
+    ++m_window_cnt;
+    m_still = var[0] <= m_accel_var && var[1] <= m_gyro_var && norm <= m_max_bias * m_max_bias;
+    if (m_still) {
+      for (int j = 0; j < 3; ++j)
+        m_bias[j] = m_valid ? m_bias[j] + m_alpha * (mean[j] - m_bias[j]) : mean[j];
+      m_valid = true;
+      ++m_still_cnt;
+      updated = true;
+    }
+
+    for (int j = 0; j < 6; ++j) {
+      m_sum[j] = 0;
+      m_sq[j] = 0;
+    }
+    m_n = 0;
+  }
+
+  return updated;
+}
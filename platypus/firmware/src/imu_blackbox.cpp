@@ -0,0 +1,201 @@
+/*
+* Pre-trigger "black box" for raw FIFO samples
+* the producer claims samples in m_head before writing them, so collect() can tell afterwards
+* which of the samples it copied may have been overwritten meanwhile (as a seqlock reader would)
+*
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "./imu_blackbox.h"
+
+// smallest ring [samples]
+#define MIN_CAPACITY 64
+
+// the record header is written as is
+static_assert(sizeof(imu_blackbox_header) == 40, "imu_blackbox_header is padded");
+
+
+//_______________________________________________________________________________________________________
+imu_blackbox::imu_blackbox(float rate, float pre, float post, int afs_sel)
+    : m_rate(rate), m_head(0), m_threshold(0), m_above(false), m_timed(false), m_block_index(0),
+      m_state(IDLE), m_cause(Trigger::NONE), m_detail(0), m_index(0), m_time(0), m_events(0), m_merged(0) {
+  m_pre = (size_t) lround(pre * rate);
+  m_post = (size_t) lround(post * rate);
+  m_post = m_post > 0 ? m_post : 1;
+
+  // a power of two, so the position in the ring is a mask of the sample index
+  m_capacity = MIN_CAPACITY;
+  while (m_capacity < 2 * (m_pre + m_post))
+    m_capacity *= 2;
+  m_mask = m_capacity - 1;
+  m_ring.assign(m_capacity * IMU_BLACKBOX_VALUES, 0);
+
+  // see imu_convert::setRange()
+  m_accel_lsb = 16384.0 / (1 << afs_sel);
+  m_block = imu_block_time();
+}
+
+//_______________________________________________________________________________________________________
+bool imu_blackbox::push(const int16_t* raw, size_t n, const imu_block_time* block) {
+  uint64_t head = m_head.load(std::memory_order_relaxed);
+
+  // claim the slots before overwriting them
+  m_head.store(head + n, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  // a block longer than the ring keeps its last samples only
+  size_t skip = n > m_capacity ? n - m_capacity : 0;
+  const int16_t* src = raw + skip * IMU_BLACKBOX_VALUES;
+  for (uint64_t k = head + skip; k < head + n; ) {
+    size_t pos = k & m_mask;
+    size_t len = head + n - k < m_capacity - pos ? head + n - k : m_capacity - pos;
+    memcpy(&m_ring[pos * IMU_BLACKBOX_VALUES], src, len * IMU_BLACKBOX_VALUES * sizeof(int16_t));
+    src += len * IMU_BLACKBOX_VALUES;
+    k += len;
+  }
+
+  if (m_threshold > 0) {
+    const int16_t* s = raw;
+    for (size_t i = 0; i < n; ++i, s += IMU_BLACKBOX_VALUES) {
+      int64_t sq = (int64_t) ((int32_t) s[0] * s[0]) + (int32_t) s[1] * s[1] + (int32_t) s[2] * s[2];
+      if (!m_above && sq > m_threshold) {
+        m_above = true;
+        arm(Trigger::THRESHOLD, 0, head + i);
+      } else if (m_above && sq <= m_threshold) {
+        m_above = false;
+      }
+    }
+  }
+
+  if (block != NULL) {
+    m_block = *block;
+    m_block_index = head;
+    m_timed = true;
+  }
+
+  if (m_state.load(std::memory_order_acquire) != ARMED || head + n < m_index + m_post)
+    return false;
+
+  // the trigger time from the last block, the period covers the way back
+  m_time = m_timed ? m_block.first + (int64_t) llround(((double) m_index - (double) m_block_index) * m_block.period) : 0;
+  m_state.store(COMPLETE, std::memory_order_release);
+  ++m_events;
+  return true;
+}
+
+//_______________________________________________________________________________________________________
+bool imu_blackbox::trigger(Trigger cause, uint8_t detail, size_t back) {
+  uint64_t head = m_head.load(std::memory_order_acquire);
+  if (head == 0)
+    return false;
+  return arm(cause, detail, back < head ? head - 1 - back : 0);
+}
+
+//_______________________________________________________________________________________________________
+bool imu_blackbox::arm(Trigger cause, uint8_t detail, uint64_t index) {
+  int idle = IDLE;
+  if (!m_state.compare_exchange_strong(idle, ARMING, std::memory_order_acquire)) {
+    ++m_merged;
+    return false;
+  }
+
+  m_cause = cause;
+  m_detail = detail;
+  m_index = index;
+  m_state.store(ARMED, std::memory_order_release);
+  return true;
+}
+
+//_______________________________________________________________________________________________________
+void imu_blackbox::setThreshold(float g) {
+  float lsb = g * m_accel_lsb;
+  m_threshold = g > 0.0 ? (int64_t) (lsb * lsb) : 0;
+  m_above = false;
+}
+
+//_______________________________________________________________________________________________________
+void imu_blackbox::copy(uint64_t first, uint64_t last, int16_t* out) {
+  while (first < last) {
+    size_t pos = first & m_mask;
+    size_t n = last - first < m_capacity - pos ? last - first : m_capacity - pos;
+    memcpy(out, &m_ring[pos * IMU_BLACKBOX_VALUES], n * IMU_BLACKBOX_VALUES * sizeof(int16_t));
+    out += n * IMU_BLACKBOX_VALUES;
+    first += n;
+  }
+}
+
+//_______________________________________________________________________________________________________
+bool imu_blackbox::collect(imu_blackbox_header &header, std::vector<int16_t> &data) {
+  if (m_state.load(std::memory_order_acquire) != COMPLETE)
+    return false;
+
+  uint64_t start = m_index > m_pre ? m_index - m_pre : 0;
+  uint64_t end = m_index + m_post;
+  data.resize((end - start) * IMU_BLACKBOX_VALUES);
+  copy(start, end, data.data());
+
+  // samples the producer claimed since then may be overwritten, they are dropped from the front
+  std::atomic_thread_fence(std::memory_order_acquire);
+  uint64_t head = m_head.load(std::memory_order_relaxed);
+  uint64_t valid = head > m_capacity ? head - m_capacity : 0;
+  uint64_t first = valid > start ? (valid < end ? valid : end) : start;
+  if (first > start)
+    data.erase(data.begin(), data.begin() + (first - start) * IMU_BLACKBOX_VALUES);
+
+  header = imu_blackbox_header();
+  header.magic = IMU_BLACKBOX_MAGIC;
+  header.version = IMU_BLACKBOX_VERSION;
+  header.cause = (uint8_t) m_cause;
+  header.detail = m_detail;
+  header.rate = m_rate;
+  header.pre = first < m_index ? m_index - first : 0;
+  header.post = end - (first > m_index ? first : m_index);
+  header.lost = first - start;
+  header.time = m_time;
+  header.index = m_index;
+
+  m_state.store(IDLE, std::memory_order_release);
+  return true;
+}
+
+//_______________________________________________________________________________________________________
+bool imu_blackbox::save(const char* filename, const imu_blackbox_header &header, const std::vector<int16_t> &data) {
+  FILE* file = fopen(filename, "wb");
+  if (file == NULL)
+    return false;
+
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  ok = ok && fwrite(data.data(), sizeof(int16_t), data.size(), file) == data.size();
+  return fclose(file) == 0 && ok;
+}
+
+//_______________________________________________________________________________________________________
+bool imu_blackbox::load(const char* filename, imu_blackbox_header &header, std::vector<int16_t> &data) {
+  FILE* file = fopen(filename, "rb");
+  if (file == NULL)
+    return false;
+
+  bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+    header.magic == IMU_BLACKBOX_MAGIC && header.version == IMU_BLACKBOX_VERSION;
+  if (ok) {
+    data.resize(((size_t) header.pre + header.post) * IMU_BLACKBOX_VALUES);
+    ok = fread(data.data(), sizeof(int16_t), data.size(), file) == data.size();
+  }
+  fclose(file);
+  return ok;
+}
+
+//_______________________________________________________________________________________________________
+const char* imu_blackbox::name(Trigger cause) {
+  switch (cause) {
+    case Trigger::NONE: return "none";
+    case Trigger::WOM: return "wom";
+    case Trigger::THRESHOLD: return "threshold";
+    case Trigger::GESTURE: return "gesture";
+    case Trigger::MANUAL: return "manual";
+  }
+  return "unknown";
+}
@@ -0,0 +1,94 @@
+/*
+* Batch conversion of raw FIFO blocks to physical units
+* deinterleaves ACCEL XYZ, GYRO XYZ samples into one float array per axis
+*
+*/
+
+#include "./imu_convert.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+
+//_______________________________________________________________________________________________________
+imu_convert::imu_convert(int afs_sel, int gfs_sel) {
+  setRange(afs_sel, gfs_sel);
+  for (int j = 0; j < 3; ++j)
+    m_gyro_bias[j] = 0.0;
+}
+
+//_______________________________________________________________________________________________________
+void imu_convert::setRange(int afs_sel, int gfs_sel) {
+  // according to MPU9250 data sheet, same as imu_edison::accelToReadable() / gyroToReadable()
+  m_accel_scale = (float) ((1 << afs_sel) * 9.807 / 16384.0);
+  m_gyro_scale = (float) ((1 << gfs_sel) / 131.0);
+}
+
+//_______________________________________________________________________________________________________
+void imu_convert::setGyroBias(const float* bias) {
+  for (int j = 0; j < 3; ++j)
+    m_gyro_bias[j] = bias[j];
+}
+
+//_______________________________________________________________________________________________________
+void imu_convert::convert(const int16_t* in, size_t n, const imu_soa &out) {
+  size_t i = 0;
+
+#ifdef __SSE2__
+  const __m128 as = _mm_set1_ps(m_accel_scale);
+  const __m128 gs = _mm_set1_ps(m_gyro_scale);
+  const __m128 gb0 = _mm_set1_ps(m_gyro_bias[0]);
+  const __m128 gb1 = _mm_set1_ps(m_gyro_bias[1]);
+  const __m128 gb2 = _mm_set1_ps(m_gyro_bias[2]);
+
+  // 4 samples per step: 24 values in 3 loads, 6 float vectors v0..v5 holding values 4k..4k+3
+  for (; i + 4 <= n; i += 4) {
+    const int16_t* p = in + 6 * i;
+    __m128i r0 = _mm_loadu_si128((const __m128i*) p);
+    __m128i r1 = _mm_loadu_si128((const __m128i*) (p + 8));
+    __m128i r2 = _mm_loadu_si128((const __m128i*) (p + 16));
+
+    // sign extend to 32Bit via unpack and arithmetic shift
+    __m128 v0 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(r0, r0), 16));
+    __m128 v1 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(r0, r0), 16));
+    __m128 v2 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(r1, r1), 16));
+    __m128 v3 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(r1, r1), 16));
+    __m128 v4 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(r2, r2), 16));
+    __m128 v5 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(r2, r2), 16));
+
+    // gather the pairs of channels of samples 0,1 (v0..v2) and 2,3 (v3..v5)
+    __m128 p01 = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 2, 1, 0)); // 0 1 6 7
+    __m128 q01 = _mm_shuffle_ps(v3, v4, _MM_SHUFFLE(3, 2, 1, 0));
+    __m128 p23 = _mm_shuffle_ps(v0, v2, _MM_SHUFFLE(1, 0, 3, 2)); // 2 3 8 9
+    __m128 q23 = _mm_shuffle_ps(v3, v5, _MM_SHUFFLE(1, 0, 3, 2));
+    __m128 p45 = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(3, 2, 1, 0)); // 4 5 10 11
+    __m128 q45 = _mm_shuffle_ps(v4, v5, _MM_SHUFFLE(3, 2, 1, 0));
+
+    _mm_storeu_ps(out.accel[0] + i, _mm_mul_ps(_mm_shuffle_ps(p01, q01, _MM_SHUFFLE(2, 0, 2, 0)), as));
+    _mm_storeu_ps(out.accel[1] + i, _mm_mul_ps(_mm_shuffle_ps(p01, q01, _MM_SHUFFLE(3, 1, 3, 1)), as));
+    _mm_storeu_ps(out.accel[2] + i, _mm_mul_ps(_mm_shuffle_ps(p23, q23, _MM_SHUFFLE(2, 0, 2, 0)), as));
+    _mm_storeu_ps(out.gyro[0] + i, _mm_mul_ps(_mm_sub_ps(_mm_shuffle_ps(p23, q23, _MM_SHUFFLE(3, 1, 3, 1)), gb0), gs));
+    _mm_storeu_ps(out.gyro[1] + i, _mm_mul_ps(_mm_sub_ps(_mm_shuffle_ps(p45, q45, _MM_SHUFFLE(2, 0, 2, 0)), gb1), gs));
+    _mm_storeu_ps(out.gyro[2] + i, _mm_mul_ps(_mm_sub_ps(_mm_shuffle_ps(p45, q45, _MM_SHUFFLE(3, 1, 3, 1)), gb2), gs));
+  }
+#endif
+
+  // remainder
+  if (i < n) {
+    imu_soa rest = {{out.accel[0] + i, out.accel[1] + i, out.accel[2] + i},
+                    {out.gyro[0] + i, out.gyro[1] + i, out.gyro[2] + i}};
+    convertScalar(in + 6 * i, n - i, rest);
+  }
+}
+
+//_______________________________________________________________________________________________________
+void imu_convert::convertScalar(const int16_t* in, size_t n, const imu_soa &out) {
+  for (size_t i = 0; i < n; ++i, in += 6) {
+    for (int j = 0; j < 3; ++j) {
+      out.accel[j][i] = (float) in[j] * m_accel_scale;
+      out.gyro[j][i] = ((float) in[j + 3] - m_gyro_bias[j]) * m_gyro_scale;
+    }
+  }
+}
@@ -0,0 +1,60 @@
+/*
+* Digital Motion Processor of the MPU 9250
+* configuration bytes as written by dmp_set_fifo_rate() and dmp_enable_6x_lp_quat()
+* of the InvenSense MotionDriver 6.12
+*
+*/
+
+#include <stdio.h>
+
+#include "./imu_dmp.h"
+
+const uint8_t imu_dmp::s_rate_end[12] = {0xFE, 0xF2, 0xAB, 0xC4, 0xAA, 0xF1, 0xDF, 0xDF, 0xBB, 0xAF, 0xDF, 0xDF};
+const uint8_t imu_dmp::s_quat6_on[4] = {0x20, 0x28, 0x30, 0x38};
+const uint8_t imu_dmp::s_quat6_off[4] = {0xA3, 0xA3, 0xA3, 0xA3};
+const uint8_t imu_dmp::s_quat3_off[4] = {0x8B, 0x8B, 0x8B, 0x8B};
+
+
+//_______________________________________________________________________________________________________
+bool imu_dmp::loadImage(const char* filename, std::vector<uint8_t> &image) {
+  FILE* file = fopen(filename, "rb");
+  if (file == NULL)
+    return false;
+
+  image.resize(DMP_MEM_SIZE + 1);
+  size_t len = fread(image.data(), 1, image.size(), file);
+  fclose(file);
+
+  image.resize(len);
+  return len > 0 && len <= DMP_MEM_SIZE;
+}
+
+//_______________________________________________________________________________________________________
+void imu_dmp::rateDivider(uint16_t rate, uint8_t* div) {
+  if (rate < 1)
+    rate = 1;
+  if (rate > DMP_SAMPLE_RATE)
+    rate = DMP_SAMPLE_RATE;
+
+  uint16_t d = DMP_SAMPLE_RATE / rate - 1;
+  div[0] = d >> 8;
+  div[1] = d & 0xFF;
+}
+
+//_______________________________________________________________________________________________________
+bool imu_dmp::parse(const uint8_t* packet, int32_t* q) {
+  for (int i = 0; i < 4; ++i, packet += 4)
+    q[i] = (int32_t) (((uint32_t) packet[0] << 24) | ((uint32_t) packet[1] << 16) | ((uint32_t) packet[2] << 8) | packet[3]);
+
+  // |q|^2 in Q28 from the upper 16 bits, as the MotionDriver checks it
+  int64_t sq = 0;
+  for (int i = 0; i < 4; ++i)
+    sq += (int64_t) (q[i] >> 16) * (q[i] >> 16);
+  return sq > (1 << 28) - DMP_QUAT_ERROR && sq < (1 << 28) + DMP_QUAT_ERROR;
+}
+
+//_______________________________________________________________________________________________________
+void imu_dmp::toQuaternion(const int32_t* q, quaternion<float> &out) {
+  const float scale = 1.0 / (1 << 30);
+  out.set(q[1] * scale, q[2] * scale, q[3] * scale, q[0] * scale);
+}
@@ -5,18 +5,34 @@
 *
 */
 
+#include <string.h>
+
 #include "./imu_edison.h"
 
+// raw value to m/s^2 and deg/s, according to MPU9250 data sheet
+static const float ACCEL_SCALE = (1 << AFS_SEL) * 9.807 / 16384.0;
+static const float GYRO_SCALE = (1 << GFS_SEL) / 131.0;
 
 
 //_______________________________________________________________________________________________________
 imu_edison::imu_edison(int i2c_bus, uint8_t i2c_addr, bool init_env, bool init_sens)
- : m_i2c_bus(i2c_bus), m_mpu_address(i2c_addr), m_init_env(init_env),
- m_ID(-1), m_ID_mag(-1), m_ID_env(-1)
+ : m_i2c_bus(i2c_bus), m_mpu_address(i2c_addr), m_env_profile(BME_PROFILE_WEATHER),
+ m_init_env(init_env), m_env_running(false),
+ m_HCalib_X(1.0), m_HCalib_Y(1.0), m_HCalib_Z(1.0), m_mag_calib(false),
+ m_ID(-1), m_ID_mag(-1), m_ID_env(-1), m_smplrt_div(0x27), m_dlpf(0x06), m_accel_dlpf(0x00),
+ m_rate(25.0), m_mag_rate(IMU_AUX_ODR), m_env_rate(IMU_AUX_ODR), m_setup(false),
+ m_dmp_loaded(false), m_dmp(false), m_dmp_rate(25.0), m_dmp_errors(0), m_fifo_count(0), m_fifo_time(0),
+ m_es_valid(false), m_es_reads(0), m_es_hits(0),
+ m_int_mask(0), m_int_latch(true), m_low_power(false), m_lp_entries(0), m_lp_exits(0)
 {
+  for (int i = 0; i < MPU_ES_DATA_SIZE; ++i)
+    m_es_data[i] = 0;
+  planAux();
+
   if (init_sens) {
     m_i2c = new mraa::I2c(m_i2c_bus);
     m_i2c->address(m_mpu_address);
+    m_i2c_selected = m_mpu_address;
   }
 }
 
@@ -33,8 +49,17 @@ imu_edison::~imu_edison() {
 
 
 //_______________________________________________________________________________________________________
-void imu_edison::writeRegister(uint8_t addr, uint8_t data, uint8_t i2c) {
+void imu_edison::selectDevice(uint8_t i2c) {
+  if (i2c == m_i2c_selected)
+    return;
+
   m_i2c->address(i2c);
+  m_i2c_selected = i2c;
+}
+
+//_______________________________________________________________________________________________________
+void imu_edison::writeRegister(uint8_t addr, uint8_t data, uint8_t i2c) {
+  selectDevice(i2c);
 
   uint8_t rx_tx_buf[2];
   rx_tx_buf[0] = addr;
@@ -42,9 +67,21 @@ void imu_edison::writeRegister(uint8_t addr, uint8_t data, uint8_t i2c) {
   m_i2c->write(rx_tx_buf, 2);
 }
 
+//_______________________________________________________________________________________________________
+void imu_edison::writeRegisters(uint8_t addr, const uint8_t* data, int len, uint8_t i2c) {
+  selectDevice(i2c);
+
+  uint8_t tx_buf[DMP_CHUNK_SIZE + 1];
+  assert(len <= DMP_CHUNK_SIZE);
+  tx_buf[0] = addr;
+  for (int i = 0; i < len; ++i)
+    tx_buf[i + 1] = data[i];
+  m_i2c->write(tx_buf, len + 1);
+}
+
 //_______________________________________________________________________________________________________
 uint8_t imu_edison::readRegister(uint8_t addr, uint8_t i2c) {
-  m_i2c->address(i2c);
+  selectDevice(i2c);
 
   uint8_t data = 0;
 
@@ -57,7 +94,7 @@ uint8_t imu_edison::readRegister(uint8_t addr, uint8_t i2c) {
 
 //_______________________________________________________________________________________________________
 int16_t imu_edison::readRegister(uint8_t addrH, uint8_t addrL, uint8_t i2c) {
-  m_i2c->address(i2c);
+  selectDevice(i2c);
 
   uint8_t H = 0, L = 0;
 
@@ -72,6 +109,19 @@ int16_t imu_edison::readRegister(uint8_t addrH, uint8_t addrL, uint8_t i2c) {
   return (int16_t)((H<<8)+L);
 }
 
+//_______________________________________________________________________________________________________
+int imu_edison::readRegisters(uint8_t addr, uint8_t* data, int len, uint8_t i2c) {
+  selectDevice(i2c);
+
+  int cnt = -1;
+
+  try {
+    cnt = m_i2c->readBytesReg(addr, data, len);
+  } catch (std::invalid_argument& e) {}
+
+  return cnt;
+}
+
 
 
 /*
@@ -96,6 +146,11 @@ void imu_edison::sleep(bool sleep) {
 
 //_______________________________________________________________________________________________________
 void imu_edison::setupIMU() {
+  m_es_valid = false;
+  m_env_running = false;
+  m_dmp_loaded = false; // the reset clears the DMP memory
+  m_dmp = false;
+  planAux();
   writeRegister(MPU_PWR_MGMT_1, 0x80, m_mpu_address); // reset device
   usleep(200000);
   sleep(false);
@@ -110,24 +165,56 @@ void imu_edison::setupIMU() {
   assert(AFS_SEL >= 0 && AFS_SEL <= 3);
 
   // MPU init
-  writeRegister(MPU_SMPLRT_DIV, 0x27, m_mpu_address); //set sample rate to 25Hz (rate=1kHz/(1+div))
-  writeRegister(MPU_CONFIG, 0x06, m_mpu_address); //set DLPF_CFG to lowest bandwith (5 Hz @ Fs=1kHz)
+  writeAux(); //sample rate (rate=1kHz/(1+div)) and slave reads as planned
+  writeRegister(MPU_CONFIG, m_dlpf, m_mpu_address); //DLPF_CFG, see setBandwidth(), 5 Hz @ Fs=1kHz by default
   writeRegister(MPU_GYRO_CONFIG, GFS_SEL << 3, m_mpu_address); //Gyro Config, fs_sel
   writeRegister(MPU_ACCEL_CONFIG, AFS_SEL << 3, m_mpu_address); //Accel Config, fs_sel
-  writeRegister(MPU_ACCEL_CONFIG_2, 0x00, m_mpu_address); //Accel Config 2, set A_DLPF_CFG to highest bandwith (460 Hz @ Fs=1kHz)
+  writeRegister(MPU_ACCEL_CONFIG_2, m_accel_dlpf, m_mpu_address); //Accel Config 2, A_DLPF_CFG, 218 Hz @ Fs=1kHz by default
   writeRegister(MPU_FIFO_EN, 0x78, m_mpu_address); //enable fifo buffer for accel XYZ, gyro XYZ
-  writeRegister(MPU_INT_PIN_CFG, 0xA0, m_mpu_address); //interrupt pin config
-  writeRegister(MPU_INT_ENABLE, 0x50, m_mpu_address); //enable interrupt for FIFO and WoM
+  setInterrupts(MPU_INT_FIFO_OFLOW | MPU_INT_WOM); //enable interrupt for FIFO and WoM, latched
   writeRegister(MPU_MOT_THR, 0x80, m_mpu_address); //WoM threshold
   writeRegister(MPU_MOT_DETECT_CTRL, 0xC0, m_mpu_address); //WoM enable
   writeRegister(MPU_USER_CTRL, 0x64, m_mpu_address); //enable master i2c mode, enable FIFO, reset FIFO
 
   m_ID = readRegister(MPU_WHO_AM_I, m_mpu_address);
+  m_setup = true;
+  imu_aux::print(m_aux);
 
   printf("[IMU] Setup done.\n");
   fflush(stdout);
 }
 
+//_______________________________________________________________________________________________________
+void imu_edison::lowPower(bool low_power, uint8_t lp_odr) {
+  if (low_power == m_low_power)
+    return;
+
+  if (low_power) {
+    // sequence from the MPU9250 data sheet, "Wake-on-Motion Interrupt"
+    writeRegister(MPU_FIFO_EN, 0x00, m_mpu_address); //stop filling the FIFO
+    if (m_dmp)
+      writeRegister(MPU_USER_CTRL, MPU_USER_I2C_MST_EN, m_mpu_address); //DMP off, it needs the gyro
+    writeRegister(MPU_PWR_MGMT_1, 0x00, m_mpu_address); //cycle, sleep, standby off
+    writeRegister(MPU_PWR_MGMT_2, 0x07, m_mpu_address); //accel on, gyro off
+    writeRegister(MPU_ACCEL_CONFIG_2, 0x01, m_mpu_address); //A_DLPF_CFG 184Hz
+    writeRegister(MPU_INT_ENABLE, MPU_INT_WOM, m_mpu_address); //only WoM
+    writeRegister(MPU_MOT_DETECT_CTRL, 0xC0, m_mpu_address); //WoM enable, compare to previous sample
+    writeRegister(MPU_LP_ACCEL, lp_odr & 0x0F, m_mpu_address); //wake-up rate
+    writeRegister(MPU_PWR_MGMT_1, 0x20, m_mpu_address); //cycle between sleep and accel samples
+    ++m_lp_entries;
+  } else {
+    writeRegister(MPU_PWR_MGMT_1, 0x00, m_mpu_address); //cycle off
+    writeRegister(MPU_PWR_MGMT_2, 0x00, m_mpu_address); //accel and gyro on
+    writeRegister(MPU_ACCEL_CONFIG_2, m_accel_dlpf, m_mpu_address); //as in setupIMU()
+    setInterrupts(m_int_mask, m_int_latch);
+    writeRegister(MPU_FIFO_EN, m_dmp ? 0x00 : 0x78, m_mpu_address); //accel XYZ, gyro XYZ unless the DMP fills it
+    FIFOrst(); //restarts the DMP too
+    m_es_valid = false; // slaves were not sampled in cycle mode
+    ++m_lp_exits;
+  }
+  m_low_power = low_power;
+}
+
 //_______________________________________________________________________________________________________
 void imu_edison::initCompass() {
   writeRegister(MPU_USER_CTRL, 0x07, m_mpu_address); // reset FIFO, i2c, Signal
@@ -142,7 +229,7 @@ void imu_edison::initCompass() {
   m_HCalib_Z = (float)(readRegister(COMPASS_ASAZ, COMPASS_I2C_ADDR) - 128)/256.0 + 1.0;
   writeRegister(COMPASS_CNTL, 0x00, COMPASS_I2C_ADDR); // Power down
   usleep(1000);
-  writeRegister(COMPASS_CNTL, 0x16, COMPASS_I2C_ADDR); // continuous 16bit measurement @ 100Hz
+  writeRegister(COMPASS_CNTL, m_aux.mag_mode, COMPASS_I2C_ADDR); // continuous 16bit measurement @ 8 or 100Hz, or power down
   usleep(1000);
 
   m_ID_mag = readRegister(COMPASS_WHO_AM_I, COMPASS_I2C_ADDR);
@@ -151,8 +238,8 @@ void imu_edison::initCompass() {
   writeRegister(MPU_USER_CTRL, 0x20, m_mpu_address); //enable master i2c mode
 
   writeRegister(MPU_I2C_SLV1_ADDR, (0x80) | COMPASS_I2C_ADDR, m_mpu_address); // i2c address of compass; read operation
-  writeRegister(MPU_I2C_SLV1_REG, 0x03, m_mpu_address); // register address of first data value
-  writeRegister(MPU_I2C_SLV1_CTRL, 0x87, m_mpu_address); // enable slave 1; read 7 bytes per transaction
+  writeRegister(MPU_I2C_SLV1_REG, COMPASS_XOUT_L, m_mpu_address); // register address of first data value
+  // enabled with the read length by writeAux()
 
   printf("[IMU] Compass init.\n");
 }
@@ -166,9 +253,11 @@ void imu_edison::initENV() {
   usleep(200000);
   getENVCalib();
 
-  writeRegister(BME_CTRL_HUM, 0x01, BME_I2C_ADDR); // enable humidity sampling x1
-  writeRegister(BME_CONFIG, 0xA0, BME_I2C_ADDR); // 1s standby; IIR off
-  writeRegister(BME_CTRL_MEAS, 0x27, BME_I2C_ADDR); // enable temperature and pressure sampling x1; enable normal mode
+  // CONFIG is written in sleep mode, CTRL_HUM takes effect with the CTRL_MEAS write
+  const BME_profile &p = m_env_profile;
+  writeRegister(BME_CTRL_HUM, p.osrs_h, BME_I2C_ADDR); // humidity oversampling
+  writeRegister(BME_CONFIG, (p.t_sb << 5) | (p.filter << 2), BME_I2C_ADDR); // standby; IIR filter
+  writeRegister(BME_CTRL_MEAS, (p.osrs_t << 5) | (p.osrs_p << 2) | 0x03, BME_I2C_ADDR); // temperature and pressure oversampling; enable normal mode
 
   m_ID_env = readRegister(BME_ID, BME_I2C_ADDR);
 
@@ -176,47 +265,162 @@ void imu_edison::initENV() {
   writeRegister(MPU_USER_CTRL, 0x20, m_mpu_address); //enable master i2c mode
 
   writeRegister(MPU_I2C_SLV0_ADDR, (0x80) | BME_I2C_ADDR, m_mpu_address); // i2c address of env sens; read operation
-  writeRegister(MPU_I2C_SLV0_REG, 0xF7, m_mpu_address); // register address of first data value
-  writeRegister(MPU_I2C_SLV4_CTRL, 0x18, m_mpu_address); // set ext sens delay to once every 25 samples (1/s @ 25Hz)
-  writeRegister(MPU_I2C_MST_DELAY_CTRL, 0x81, m_mpu_address); // enable ext sens data shadowing delay; enable ext sens sample delay
-  writeRegister(MPU_I2C_SLV0_CTRL, 0x88, m_mpu_address); // enable slave 0; read 8 bytes per transaction
+  writeRegister(MPU_I2C_SLV0_REG, BME_PRESS_MSB, m_mpu_address); // register address of first data value
+  // enabled with the read length and delay by writeAux()
+  m_env_running = true;
 
   printf("[IMU] ExtSens init.\n");
 }
 
+//_______________________________________________________________________________________________________
+bool imu_edison::setEnvProfile(const BME_profile &profile) {
+  m_env_profile = profile;
+  if (!m_env_running)
+    return true;
+
+  // the BME only takes CONFIG in sleep mode
+  const BME_profile &p = m_env_profile;
+  bool ok = writeSlaveRegister(BME_I2C_ADDR, BME_CTRL_MEAS, (p.osrs_t << 5) | (p.osrs_p << 2));
+  ok = ok && writeSlaveRegister(BME_I2C_ADDR, BME_CTRL_HUM, p.osrs_h);
+  ok = ok && writeSlaveRegister(BME_I2C_ADDR, BME_CONFIG, (p.t_sb << 5) | (p.filter << 2));
+  ok = ok && writeSlaveRegister(BME_I2C_ADDR, BME_CTRL_MEAS, (p.osrs_t << 5) | (p.osrs_p << 2) | 0x03);
+
+  // the BME read rate follows its output rate
+  planAux();
+  writeAux();
+
+  printf("[IMU] ExtSens profile: %.1fHz, read every %d samples%s.\n", bme_comp::getRate(p), m_aux.env_div, ok ? "" : ", write failed");
+  fflush(stdout);
+  return ok;
+}
+
+//_______________________________________________________________________________________________________
+bool imu_edison::writeSlaveRegister(uint8_t i2c, uint8_t addr, uint8_t data) {
+  writeRegister(MPU_I2C_SLV4_ADDR, i2c, m_mpu_address); // write operation
+  writeRegister(MPU_I2C_SLV4_REG, addr, m_mpu_address);
+  writeRegister(MPU_I2C_SLV4_DO, data, m_mpu_address);
+  writeRegister(MPU_I2C_SLV4_CTRL, 0x80 | m_aux.mst_dly, m_mpu_address); // enable slave 4, keeps the ext sens delay
+
+  // slave 4 runs once per sample period, give it two
+  for (int ms = 0; ms < 2 * (1 + m_smplrt_div); ++ms) {
+    uint8_t status = readRegister(MPU_I2C_MST_STATUS, m_mpu_address);
+    if (status & 0x10) // I2C_SLV4_NACK
+      return false;
+    if (status & 0x40) // I2C_SLV4_DONE
+      return true;
+    usleep(1000);
+  }
+  return false;
+}
+
+//_______________________________________________________________________________________________________
+const imu_aux_plan& imu_edison::setSampleRates(float rate, float mag_rate, float env_rate) {
+  m_rate = rate;
+  m_mag_rate = mag_rate;
+  m_env_rate = env_rate;
+
+  uint8_t mag_mode = m_aux.mag_mode;
+  planAux();
+  if (!m_setup)
+    return m_aux;
+
+  // the compass only changes its mode from power down
+  if (m_aux.mag_mode != mag_mode) {
+    writeSlaveRegister(COMPASS_I2C_ADDR, COMPASS_CNTL, 0x00);
+    if (m_aux.mag_mode != 0x00)
+      writeSlaveRegister(COMPASS_I2C_ADDR, COMPASS_CNTL, m_aux.mag_mode);
+  }
+  writeAux();
+  imu_aux::print(m_aux);
+  return m_aux;
+}
+
+//_______________________________________________________________________________________________________
+// DLPF_CFG 0 runs at 8kHz, which the slave plan does not cover
+const float imu_edison::s_dlpf_hz[7] = {250.0, 184.0, 92.0, 41.0, 20.0, 10.0, 5.0};
+
+//_______________________________________________________________________________________________________
+float imu_edison::setBandwidth(float hz) {
+  uint8_t cfg = 6;
+  while (cfg > 1 && s_dlpf_hz[cfg - 1] <= hz)
+    --cfg;
+  m_dlpf = cfg;
+  m_accel_dlpf = cfg;
+  if (m_setup) {
+    if (!m_dmp)
+      writeRegister(MPU_CONFIG, m_dlpf, m_mpu_address);
+    if (!m_low_power)
+      writeRegister(MPU_ACCEL_CONFIG_2, m_accel_dlpf, m_mpu_address);
+  }
+  printf("[IMU] DLPF %.0fHz\n", s_dlpf_hz[m_dlpf]);
+  fflush(stdout);
+  return s_dlpf_hz[m_dlpf];
+}
+
+//_______________________________________________________________________________________________________
+void imu_edison::planAux() {
+  // the slaves run at the sensor rate, 200Hz in DMP mode
+  float env_odr = m_init_env ? bme_comp::getRate(m_env_profile) : 0.0;
+  m_aux = imu_aux::plan(m_dmp ? DMP_SAMPLE_RATE : m_rate, m_mag_rate, m_env_rate, env_odr);
+  if (!m_dmp)
+    m_smplrt_div = m_aux.smplrt_div;
+}
+
+//_______________________________________________________________________________________________________
+void imu_edison::writeAux() {
+  if (!m_dmp)
+    writeRegister(MPU_SMPLRT_DIV, m_smplrt_div, m_mpu_address);
+  // enable slave 0 (BME) and 1 (compass) with their read lengths
+  writeRegister(MPU_I2C_SLV0_CTRL, m_env_running && m_aux.env_len ? 0x80 | m_aux.env_len : 0x00, m_mpu_address);
+  writeRegister(MPU_I2C_SLV1_CTRL, m_aux.mag_len ? 0x80 | m_aux.mag_len : 0x00, m_mpu_address);
+  writeRegister(MPU_I2C_SLV4_CTRL, m_aux.mst_dly, m_mpu_address); // delayed slaves read every mst_dly + 1 samples
+  writeRegister(MPU_I2C_MST_DELAY_CTRL, m_aux.delay_ctrl, m_mpu_address); // shadowing; delayed slaves
+  m_es_valid = false;
+}
+
+//_______________________________________________________________________________________________________
+int imu_edison::esAge(int div) {
+  // [div] is in sensor samples, the snapshot age in periods of getSampleRate()
+  int age = (int) lround(div * getSampleRate() / m_aux.sample_rate);
+  return age < 1 ? 1 : age;
+}
+
 //_______________________________________________________________________________________________________
 void imu_edison::getENVCalib() {
   uint8_t calib_1[26];
   uint8_t calib_2[16];
+  BME_calibration calib;
 
   try {
-    m_i2c->address(BME_I2C_ADDR);
+    selectDevice(BME_I2C_ADDR);
     m_i2c->writeByte(BME_CALIB00);
     m_i2c->read(calib_1, 26);
     m_i2c->writeByte(BME_CALIB26);
     m_i2c->read(calib_2, 16);
   } catch (std::invalid_argument& e) {}
 
-  m_env_calib.dig_T1 = (uint16_t) ((calib_1[1]<<8) | calib_1[0]);
-  m_env_calib.dig_T2 = (int16_t) ((calib_1[3]<<8) | calib_1[2]);
-  m_env_calib.dig_T3 = (int16_t) ((calib_1[5]<<8) | calib_1[4]);
-
-  m_env_calib.dig_P1 = (uint16_t) ((calib_1[7]<<8) | calib_1[6]);
-  m_env_calib.dig_P2 = (int16_t) ((calib_1[9]<<8) | calib_1[8]);
-  m_env_calib.dig_P3 = (int16_t) ((calib_1[11]<<8) | calib_1[10]);
-  m_env_calib.dig_P4 = (int16_t) ((calib_1[13]<<8) | calib_1[12]);
-  m_env_calib.dig_P5 = (int16_t) ((calib_1[15]<<8) | calib_1[14]);
-  m_env_calib.dig_P6 = (int16_t) ((calib_1[17]<<8) | calib_1[16]);
-  m_env_calib.dig_P7 = (int16_t) ((calib_1[19]<<8) | calib_1[18]);
-  m_env_calib.dig_P8 = (int16_t) ((calib_1[21]<<8) | calib_1[20]);
-  m_env_calib.dig_P9 = (int16_t) ((calib_1[23]<<8) | calib_1[22]);
-
-  m_env_calib.dig_H1 = (uint8_t) (calib_1[25]);
-  m_env_calib.dig_H2 = (int16_t) ((calib_2[1]<<8) | calib_2[0]);
-  m_env_calib.dig_H3 = (uint8_t) (calib_2[2]);
-  m_env_calib.dig_H4 = (int16_t) ((calib_2[3]<<4) | (calib_2[4] & 0x0F));
-  m_env_calib.dig_H5 = (int16_t) (((calib_2[4] & 0xF0)>>4) | (calib_2[5]<<4));
-  m_env_calib.dig_H6 = (int8_t) (calib_2[6]);
+  calib.dig_T1 = (uint16_t) ((calib_1[1]<<8) | calib_1[0]);
+  calib.dig_T2 = (int16_t) ((calib_1[3]<<8) | calib_1[2]);
+  calib.dig_T3 = (int16_t) ((calib_1[5]<<8) | calib_1[4]);
+
+  calib.dig_P1 = (uint16_t) ((calib_1[7]<<8) | calib_1[6]);
+  calib.dig_P2 = (int16_t) ((calib_1[9]<<8) | calib_1[8]);
+  calib.dig_P3 = (int16_t) ((calib_1[11]<<8) | calib_1[10]);
+  calib.dig_P4 = (int16_t) ((calib_1[13]<<8) | calib_1[12]);
+  calib.dig_P5 = (int16_t) ((calib_1[15]<<8) | calib_1[14]);
+  calib.dig_P6 = (int16_t) ((calib_1[17]<<8) | calib_1[16]);
+  calib.dig_P7 = (int16_t) ((calib_1[19]<<8) | calib_1[18]);
+  calib.dig_P8 = (int16_t) ((calib_1[21]<<8) | calib_1[20]);
+  calib.dig_P9 = (int16_t) ((calib_1[23]<<8) | calib_1[22]);
+
+  calib.dig_H1 = (uint8_t) (calib_1[25]);
+  calib.dig_H2 = (int16_t) ((calib_2[1]<<8) | calib_2[0]);
+  calib.dig_H3 = (uint8_t) (calib_2[2]);
+  calib.dig_H4 = (int16_t) ((calib_2[3]<<4) | (calib_2[4] & 0x0F));
+  calib.dig_H5 = (int16_t) (((calib_2[4] & 0xF0)>>4) | (calib_2[5]<<4));
+  calib.dig_H6 = (int8_t) (calib_2[6]);
+
+  m_env.setCalibration(calib);
 }
 
 
@@ -227,22 +431,39 @@ void imu_edison::getENVCalib() {
 
 //_______________________________________________________________________________________________________
 std::vector<int16_t> imu_edison::readRawIMU() {
-  std::vector<int16_t> data;
-
-  // read accelerometer data
-  data.push_back(readRegister(MPU_ACCEL_XOUT_H, MPU_ACCEL_XOUT_L, m_mpu_address));
-  data.push_back(readRegister(MPU_ACCEL_YOUT_H, MPU_ACCEL_YOUT_L, m_mpu_address));
-  data.push_back(readRegister(MPU_ACCEL_ZOUT_H, MPU_ACCEL_ZOUT_L, m_mpu_address));
-  // read gyroscope data
-  data.push_back(readRegister(MPU_GYRO_XOUT_H, MPU_GYRO_XOUT_L, m_mpu_address));
-  data.push_back(readRegister(MPU_GYRO_YOUT_H, MPU_GYRO_YOUT_L, m_mpu_address));
-  data.push_back(readRegister(MPU_GYRO_ZOUT_H, MPU_GYRO_ZOUT_L, m_mpu_address));
-  // read temperature sensor data
-  data.push_back(readRegister(MPU_TEMP_OUT_H, MPU_TEMP_OUT_L, m_mpu_address));
+  std::vector<int16_t> data(7, 0);
+
+  ImuSample s;
+  if (!readRawIMU(s))
+    return data;
+
+  // [ACCEL_X, ACCEL_Y, ACCEL_Z, GYRO_X, GYRO_Y, GYRO_Z, TEMP]
+  for (int i = 0; i < 3; ++i) {
+    data[i] = s.accel[i];
+    data[i + 3] = s.gyro[i];
+  }
+  data[6] = s.temp;
 
   return data;
 }
 
+//_______________________________________________________________________________________________________
+bool imu_edison::readRawIMU(ImuSample &sample) {
+  uint8_t buffer[MPU_RAW_SIZE];
+
+  // accel, temp and gyro registers are consecutive, one block read gives a coherent sample
+  if (readRegisters(MPU_ACCEL_XOUT_H, buffer, MPU_RAW_SIZE, m_mpu_address) != MPU_RAW_SIZE)
+    return false;
+
+  for (int i = 0; i < 3; ++i) {
+    sample.accel[i] = (int16_t) ((buffer[2*i] << 8) | buffer[2*i + 1]);
+    sample.gyro[i] = (int16_t) ((buffer[2*i + 8] << 8) | buffer[2*i + 9]);
+  }
+  sample.temp = (int16_t) ((buffer[6] << 8) | buffer[7]);
+
+  return true;
+}
+
 //_______________________________________________________________________________________________________
 int16_t imu_edison::readRawTemp() {
   return readRegister(MPU_TEMP_OUT_H, MPU_TEMP_OUT_L, m_mpu_address);
@@ -299,13 +520,22 @@ std::vector<float> imu_edison::toReadable(std::vector<int16_t> in) {
   return out;
 }
 
+//_______________________________________________________________________________________________________
+void imu_edison::toReadable(const ImuSample &in, float* out) {
+  for (int i = 0; i < 3; ++i) {
+    out[i] = accelToReadable(in.accel[i]);
+    out[i + 3] = gyroToReadable(in.gyro[i]);
+  }
+  out[6] = tempToReadable(in.temp);
+}
+
 //_______________________________________________________________________________________________________
 float imu_edison::accelToReadable(int16_t a) {
-  return (a / (16384.0 / pow(2, AFS_SEL)) * 9.807);
+  return a * ACCEL_SCALE;
 }
 //_______________________________________________________________________________________________________
 float imu_edison::gyroToReadable(int16_t g) {
-  return (g / (131.0 / pow(2, GFS_SEL)));
+  return g * GYRO_SCALE;
 }
 //_______________________________________________________________________________________________________
 float imu_edison::tempToReadable(int16_t t) {
@@ -317,6 +547,15 @@ float imu_edison::tempToReadable(int16_t t) {
  * Interrupt handling
  */
 
+//_______________________________________________________________________________________________________
+void imu_edison::setInterrupts(uint8_t mask, bool latch) {
+  // active low, push-pull; latched until INT_STATUS is read or 50us pulse
+  writeRegister(MPU_INT_PIN_CFG, latch ? 0xA0 : 0x80, m_mpu_address);
+  writeRegister(MPU_INT_ENABLE, mask, m_mpu_address);
+  m_int_mask = mask;
+  m_int_latch = latch;
+}
+
 //_______________________________________________________________________________________________________
 uint8_t imu_edison::getIntStatus() {
   return readRegister(MPU_INT_STATUS, m_mpu_address);
@@ -330,6 +569,10 @@ bool imu_edison::hasFIFOInt(uint8_t intStatus) {
 bool imu_edison::hasWOMInt(uint8_t intStatus) {
   return (intStatus & (1<<6));
 }
+//_______________________________________________________________________________________________________
+bool imu_edison::hasRawRdyInt(uint8_t intStatus) {
+  return (intStatus & (1<<0));
+}
 
 
 
@@ -339,7 +582,13 @@ bool imu_edison::hasWOMInt(uint8_t intStatus) {
 
 //_______________________________________________________________________________________________________
 void imu_edison::FIFOrst() {
-  writeRegister(MPU_USER_CTRL, 0x64, m_mpu_address); //enable master i2c mode, enable FIFO, reset FIFO
+  if (m_dmp) {
+    // the DMP has to start over with a packet boundary
+    writeRegister(MPU_USER_CTRL, MPU_USER_I2C_MST_EN | MPU_USER_FIFO_RST | MPU_USER_DMP_RST, m_mpu_address);
+    writeRegister(MPU_USER_CTRL, MPU_USER_DMP_EN | MPU_USER_FIFO_EN | MPU_USER_I2C_MST_EN, m_mpu_address);
+  } else {
+    writeRegister(MPU_USER_CTRL, 0x64, m_mpu_address); //enable master i2c mode, enable FIFO, reset FIFO
+  }
   printf("[IMU] FIFO was reset.\n");
   fflush(stdout);
 }
@@ -347,22 +596,206 @@ void imu_edison::FIFOrst() {
 
 //_______________________________________________________________________________________________________
 int imu_edison::FIFOcnt() {
-  return readRegister(MPU_FIFO_COUNTH, MPU_FIFO_COUNTL, m_mpu_address);
+  uint8_t cnt[2];
+
+  // read COUNTH and COUNTL in one go, so both bytes belong to the same count
+  if (readRegisters(MPU_FIFO_COUNTH, cnt, 2, m_mpu_address) != 2)
+    return 0;
+
+  return ((cnt[0] & 0x1F) << 8) | cnt[1];
 }
 
 //_______________________________________________________________________________________________________
 std::vector<int16_t> imu_edison::readFIFO() {
-  int cnt = FIFOcnt();
-  std::vector<int16_t> data;
+  std::vector<int16_t> data(MPU_FIFO_SIZE / 2);
+  data.resize(readFIFO(data.data(), data.size()));
+  return data;
+}
+
+//_______________________________________________________________________________________________________
+size_t imu_edison::readFIFO(int16_t* data, size_t len) {
+  uint8_t buffer[MPU_FIFO_BURST_SIZE];
+
+  // only complete samples that fit into the given buffer
+  size_t samples = FIFOcnt() / MPU_FIFO_SAMPLE_SIZE;
+  m_fifo_time = imu_clock::now();
+  m_fifo_count = samples;
+  if (samples > len / 6)
+    samples = len / 6;
+
+  size_t n = 0;
+  while (samples > 0) {
+    size_t burst = samples;
+    if (burst > MPU_FIFO_BURST_SIZE / MPU_FIFO_SAMPLE_SIZE)
+      burst = MPU_FIFO_BURST_SIZE / MPU_FIFO_SAMPLE_SIZE;
+
+    // FIFO_R_W does not auto-increment, so a block read returns consecutive FIFO bytes
+    int bytes = burst * MPU_FIFO_SAMPLE_SIZE;
+    if (readRegisters(MPU_FIFO_R_W, buffer, bytes, m_mpu_address) != bytes)
+      break;
+
+    // combine High and Low part to int16
+    for (int i = 0; i < bytes; i += 2)
+      data[n++] = (int16_t)((buffer[i] << 8) | buffer[i+1]);
+
+    samples -= burst;
+  }
+
+  return n;
+}
+
+
+/*
+ * DMP handling
+ */
+
+//_______________________________________________________________________________________________________
+bool imu_edison::writeMemory(uint16_t addr, const uint8_t* data, size_t len) {
+  if ((addr % DMP_BANK_SIZE) + len > DMP_BANK_SIZE || addr + len > DMP_MEM_SIZE)
+    return false;
+
+  writeRegister(MPU_BANK_SEL, addr >> 8, m_mpu_address);
+  writeRegister(MPU_MEM_START_ADDR, addr & 0xFF, m_mpu_address);
+  writeRegisters(MPU_MEM_R_W, data, len, m_mpu_address);
+  return true;
+}
+
+//_______________________________________________________________________________________________________
+bool imu_edison::readMemory(uint16_t addr, uint8_t* data, size_t len) {
+  if ((addr % DMP_BANK_SIZE) + len > DMP_BANK_SIZE || addr + len > DMP_MEM_SIZE)
+    return false;
 
-  for (int i = 0; i < cnt/12; ++i) {
-    for (int j = 0; j < 6; ++j) {
-      // read from FIFO two times, first High then Low part, and save combined int16
-      data.push_back(readRegister(MPU_FIFO_R_W, MPU_FIFO_R_W, m_mpu_address));
+  writeRegister(MPU_BANK_SEL, addr >> 8, m_mpu_address);
+  writeRegister(MPU_MEM_START_ADDR, addr & 0xFF, m_mpu_address);
+  return readRegisters(MPU_MEM_R_W, data, len, m_mpu_address) == (int) len;
+}
+
+//_______________________________________________________________________________________________________
+bool imu_edison::loadDMP(const uint8_t* image, size_t size, uint16_t start) {
+  m_dmp_loaded = false;
+  if (size == 0 || size > DMP_MEM_SIZE)
+    return false;
+
+  // chunks end at the bank boundaries, each one is read back
+  uint8_t check[DMP_CHUNK_SIZE];
+  for (size_t addr = 0; addr < size; ) {
+    size_t len = DMP_CHUNK_SIZE;
+    if (len > size - addr)
+      len = size - addr;
+    if (len > DMP_BANK_SIZE - addr % DMP_BANK_SIZE)
+      len = DMP_BANK_SIZE - addr % DMP_BANK_SIZE;
+
+    if (!writeMemory(addr, image + addr, len) || !readMemory(addr, check, len) ||
+        memcmp(check, image + addr, len) != 0) {
+      printf("[IMU] DMP firmware verify failed at 0x%04lX.\n", (unsigned long) addr);
+      fflush(stdout);
+      return false;
     }
+    addr += len;
   }
 
-  return data;
+  writeRegister(MPU_PRGM_START_H, start >> 8, m_mpu_address);
+  writeRegister(MPU_PRGM_START_L, start & 0xFF, m_mpu_address);
+  m_dmp_loaded = true;
+  writeDMPConfig();
+
+  printf("[IMU] DMP firmware loaded, %lu bytes.\n", (unsigned long) size);
+  fflush(stdout);
+  return true;
+}
+
+//_______________________________________________________________________________________________________
+bool imu_edison::loadDMP(const char* filename) {
+  std::vector<uint8_t> image;
+  if (!imu_dmp::loadImage(filename, image)) {
+    printf("[IMU] Could not read DMP firmware %s.\n", filename);
+    fflush(stdout);
+    return false;
+  }
+  return loadDMP(image.data(), image.size());
+}
+
+//_______________________________________________________________________________________________________
+float imu_edison::setDMPRate(uint16_t rate) {
+  uint8_t div[2];
+  imu_dmp::rateDivider(rate, div);
+  m_dmp_rate = DMP_SAMPLE_RATE / (float) (((div[0] << 8) | div[1]) + 1);
+
+  if (m_dmp_loaded)
+    writeDMPConfig();
+  return m_dmp_rate;
+}
+
+//_______________________________________________________________________________________________________
+void imu_edison::writeDMPConfig() {
+  uint8_t div[2];
+  imu_dmp::rateDivider((uint16_t) lround(m_dmp_rate), div);
+  writeMemory(DMP_D_0_22, div, 2);
+  writeMemory(DMP_CFG_6, imu_dmp::s_rate_end, sizeof(imu_dmp::s_rate_end));
+
+  // only the 6-axis quaternion goes into the FIFO
+  writeMemory(DMP_CFG_LP_QUAT, imu_dmp::s_quat3_off, sizeof(imu_dmp::s_quat3_off));
+  writeMemory(DMP_CFG_8, imu_dmp::s_quat6_on, sizeof(imu_dmp::s_quat6_on));
+}
+
+//_______________________________________________________________________________________________________
+bool imu_edison::enableDMP(bool enable) {
+  if (enable && !m_dmp_loaded)
+    return false;
+
+  if (enable) {
+    writeRegister(MPU_FIFO_EN, 0x00, m_mpu_address); //the DMP fills the FIFO itself
+    writeRegister(MPU_SMPLRT_DIV, DMP_SMPLRT_DIV, m_mpu_address); //DMP input at 200Hz
+    writeRegister(MPU_CONFIG, 0x03, m_mpu_address); //DLPF_CFG 41Hz, below half the DMP input rate
+  } else {
+    writeRegister(MPU_USER_CTRL, MPU_USER_I2C_MST_EN, m_mpu_address); //DMP off
+    writeRegister(MPU_SMPLRT_DIV, m_smplrt_div, m_mpu_address); //as in setupIMU()
+    writeRegister(MPU_CONFIG, m_dlpf, m_mpu_address);
+    writeRegister(MPU_FIFO_EN, 0x78, m_mpu_address);
+  }
+  m_dmp = enable;
+
+  // the slaves are sampled at the new sensor rate
+  planAux();
+  writeAux();
+
+  FIFOrst();
+  return true;
+}
+
+//_______________________________________________________________________________________________________
+size_t imu_edison::readDMP(int32_t* q, size_t len) {
+  uint8_t buffer[DMP_BURST_SIZE];
+
+  // only complete packets that fit into the given buffer
+  size_t packets = FIFOcnt() / DMP_PACKET_SIZE;
+  m_fifo_time = imu_clock::now();
+  m_fifo_count = packets;
+  if (packets > len / 4)
+    packets = len / 4;
+
+  size_t n = 0;
+  while (packets > 0) {
+    size_t burst = packets;
+    if (burst > DMP_BURST_SIZE / DMP_PACKET_SIZE)
+      burst = DMP_BURST_SIZE / DMP_PACKET_SIZE;
+
+    int bytes = burst * DMP_PACKET_SIZE;
+    if (readRegisters(MPU_FIFO_R_W, buffer, bytes, m_mpu_address) != bytes)
+      break;
+
+    for (int i = 0; i < bytes; i += DMP_PACKET_SIZE, n += 4) {
+      if (!imu_dmp::parse(buffer + i, q + n)) {
+        ++m_dmp_errors;
+        FIFOrst();
+        return n;
+      }
+    }
+
+    packets -= burst;
+  }
+
+  return n;
 }
 
 
@@ -373,89 +806,66 @@ std::vector<int16_t> imu_edison::readFIFO() {
 //_______________________________________________________________________________________________________
 std::vector<uint8_t> imu_edison::readESData() {
   std::vector<uint8_t> data;
-  uint8_t buffer[24];
+  uint8_t buffer[24] = {0};
 
-  try {
-    m_i2c->readBytesReg(MPU_EXT_SENS_DATA_00, buffer, 24);
-  } catch (std::invalid_argument& e) {}
+  readRegisters(MPU_EXT_SENS_DATA_00, buffer, 24, m_mpu_address);
 
   data.assign(buffer, buffer + 24);
   return data;
 }
 
+//_______________________________________________________________________________________________________
+const uint8_t* imu_edison::getESData(int max_age) {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  float age = std::chrono::duration<float>(now - m_es_time).count() * getSampleRate();
+
+  if (m_es_valid && age < max_age) {
+    ++m_es_hits;
+    return m_es_data;
+  }
+
+  // a failed read keeps the old snapshot, but tries again next time
+  m_es_valid = readRegisters(MPU_EXT_SENS_DATA_00, m_es_data, MPU_ES_DATA_SIZE, m_mpu_address) == MPU_ES_DATA_SIZE;
+  m_es_time = now;
+  ++m_es_reads;
+  return m_es_data;
+}
+
 //_______________________________________________________________________________________________________
 int32_t imu_edison::tfine(int32_t adc_T) {
-  int32_t var1, var2, t_fine;
-  var1  = ((((adc_T >> 3) - ((int32_t)m_env_calib.dig_T1 << 1))) * ((int32_t)m_env_calib.dig_T2)) >> 11;
-  var2  = (((((adc_T >> 4) - ((int32_t)m_env_calib.dig_T1)) * ((adc_T >> 4) - ((int32_t)m_env_calib.dig_T1))) >> 12) * ((int32_t)m_env_calib.dig_T3)) >> 14;
-  t_fine = var1 + var2;
-  return t_fine;
+  return m_env.tfine(adc_T);
 }
 
 //_______________________________________________________________________________________________________
 int32_t imu_edison::compT(int32_t adc_T) {
-  int32_t t_fine, T;
-  t_fine = tfine(adc_T);
-  T = (t_fine * 5 + 128) >> 8;
-  return T;
+  return m_env.compT(m_env.tfine(adc_T));
 }
 
 //_______________________________________________________________________________________________________
 uint32_t imu_edison::compP(int32_t adc_P, int32_t adc_T) {
-  int32_t t_fine = tfine(adc_T);
-  int64_t var1, var2, p;
-  var1 = ((int64_t)t_fine) - 128000;
-  var2 = var1 * var1 * (int64_t)m_env_calib.dig_P6;
-  var2 = var2 + ((var1*(int64_t)m_env_calib.dig_P5) << 17);
-  var2 = var2 + (((int64_t)m_env_calib.dig_P4) << 35);
-  var1 = ((var1 * var1 * (int64_t)m_env_calib.dig_P3) >> 8) + ((var1 * (int64_t)m_env_calib.dig_P2) << 12);
-  var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)m_env_calib.dig_P1) >> 33;
-  if (var1 == 0)
-    return 0;
-  p = 1048576 - adc_P;
-  p = (((p << 31) - var2) * 3125) / var1;
-  var1 = (((int64_t)m_env_calib.dig_P9) * (p >> 13) * (p >> 13)) >> 25;
-  var2 = (((int64_t)m_env_calib.dig_P8) * p) >> 19;
-  p = ((p + var1 + var2) >> 8) + (((int64_t)m_env_calib.dig_P7) << 4);
-  return (uint32_t)p;
+  return m_env.compP(adc_P, m_env.tfine(adc_T));
 }
 
 //_______________________________________________________________________________________________________
 uint32_t imu_edison::compH(int32_t adc_H, int32_t adc_T) {
-  int32_t t_fine = tfine(adc_T);
-  int32_t v_x1_u32r;
-  v_x1_u32r = (t_fine - ((int32_t)76800));
-  v_x1_u32r = (((((adc_H << 14) - (((int32_t)m_env_calib.dig_H4) << 20) - (((int32_t)m_env_calib.dig_H5) * v_x1_u32r)) +
-    ((int32_t)16384)) >> 15) * (((((((v_x1_u32r * ((int32_t)m_env_calib.dig_H6)) >> 10) * (((v_x1_u32r *
-    ((int32_t)m_env_calib.dig_H3)) >> 11) + ((int32_t)32768))) >> 10) + ((int32_t)2097152)) *
-    ((int32_t)m_env_calib.dig_H2) + 8192) >> 14));
-  v_x1_u32r = (v_x1_u32r - (((((v_x1_u32r >> 15) * (v_x1_u32r >> 15)) >> 7) * ((int32_t)m_env_calib.dig_H1)) >> 4));
-  v_x1_u32r = (v_x1_u32r < 0 ? 0 : v_x1_u32r);
-  v_x1_u32r = (v_x1_u32r > 419430400 ? 419430400 : v_x1_u32r);
-  return (uint32_t)(v_x1_u32r >> 12);
+  return m_env.compH(adc_H, m_env.tfine(adc_T));
 }
 
 //_______________________________________________________________________________________________________
-void imu_edison::getEnvData(int32_t &comp_T, uint32_t &comp_P, uint32_t &comp_H) {
-  std::vector<uint8_t> es_data_raw = readESData();
-  int32_t adc_T;
-  int32_t adc_P;
-  int32_t adc_H;
-
-  adc_T  = (uint32_t)es_data_raw[5] >> 4;
-  adc_T |= (uint32_t)es_data_raw[4] << 4;
-  adc_T |= (uint32_t)es_data_raw[3] << 12;
-
-  adc_P  = (uint32_t)es_data_raw[2] >> 4;
-  adc_P |= (uint32_t)es_data_raw[1] << 4;
-  adc_P |= (uint32_t)es_data_raw[0] << 12;
-
-  adc_H = es_data_raw[7];
-  adc_H |= (uint32_t)es_data_raw[6] << 8;
+void imu_edison::getEnvData(BME_raw &raw) {
+  // the BME is only sampled every getESDelay() + 1 periods
+  bme_comp::parse(getESData(esAge(m_aux.env_div)) + m_aux.env_offset, raw);
+}
 
-  comp_T = compT(adc_T);
-  comp_P = compP(adc_P, adc_T);
-  comp_H = compH(adc_H, adc_T);
+//_______________________________________________________________________________________________________
+void imu_edison::getEnvData(int32_t &comp_T, uint32_t &comp_P, uint32_t &comp_H) {
+  BME_raw raw;
+  BME_data data;
+  getEnvData(raw);
+  m_env.compensate(raw, data);
+  comp_T = data.T;
+  comp_P = data.P;
+  comp_H = data.H;
 }
 
 //_______________________________________________________________________________________________________
@@ -475,20 +885,47 @@ void imu_edison::getEnvData(float &comp_T, float &comp_P, float &comp_H) {
 
 //_______________________________________________________________________________________________________
 void imu_edison::getCompassData(int16_t &mag_X, int16_t &mag_Y, int16_t &mag_Z) {
-  std::vector<uint8_t> es_data_raw = readESData();
-  if (!(es_data_raw[14] & 0x08)) { // Check if magnetic sensor overflow set
-    mag_X = (int16_t)(((int16_t)es_data_raw[9] << 8) | es_data_raw[8]);
-    mag_Y = (int16_t)(((int16_t)es_data_raw[11] << 8) | es_data_raw[10]);
-    mag_Z = (int16_t)(((int16_t)es_data_raw[13] << 8) | es_data_raw[12]);
+  if (m_aux.mag_len == 0) {
+    mag_X = mag_Y = mag_Z = 0;
+    return;
+  }
+
+  // behind the BME data if slave 0 is on
+  const uint8_t* es_data_raw = getESData(esAge(m_aux.mag_div)) + m_aux.mag_offset;
+  if (!(es_data_raw[6] & 0x08)) { // Check if magnetic sensor overflow set
+    mag_X = (int16_t)(((int16_t)es_data_raw[1] << 8) | es_data_raw[0]);
+    mag_Y = (int16_t)(((int16_t)es_data_raw[3] << 8) | es_data_raw[2]);
+    mag_Z = (int16_t)(((int16_t)es_data_raw[5] << 8) | es_data_raw[4]);
   }
 }
 //_______________________________________________________________________________________________________
-void imu_edison::getCompassData(float &mag_X, float &mag_Y, float &mag_Z) {
+void imu_edison::getCompassData(float &mag_X, float &mag_Y, float &mag_Z, bool calibrated) {
   int16_t raw_x, raw_y, raw_z;
   getCompassData(raw_x, raw_y, raw_z);
   mag_X = (float) (raw_x * (10.0 * 4912.0 / 32760.0) * m_HCalib_X);
   mag_Y = (float) (raw_y * (10.0 * 4912.0 / 32760.0) * m_HCalib_Y);
   mag_Z = (float) (raw_z * (10.0 * 4912.0 / 32760.0) * m_HCalib_Z);
+
+  if (calibrated && m_mag_calib) {
+    float x = mag_X - m_mag_offset[0], y = mag_Y - m_mag_offset[1], z = mag_Z - m_mag_offset[2];
+    mag_X = m_mag_matrix[0] * x + m_mag_matrix[1] * y + m_mag_matrix[2] * z;
+    mag_Y = m_mag_matrix[3] * x + m_mag_matrix[4] * y + m_mag_matrix[5] * z;
+    mag_Z = m_mag_matrix[6] * x + m_mag_matrix[7] * y + m_mag_matrix[8] * z;
+  }
+}
+
+//_______________________________________________________________________________________________________
+void imu_edison::setCompassCalib(const float* offset, const float* matrix) {
+  for (int i = 0; i < 3; ++i)
+    m_mag_offset[i] = offset[i];
+  for (int i = 0; i < 9; ++i)
+    m_mag_matrix[i] = matrix[i];
+  m_mag_calib = true;
+}
+
+//_______________________________________________________________________________________________________
+void imu_edison::clearCompassCalib() {
+  m_mag_calib = false;
 }
 
 
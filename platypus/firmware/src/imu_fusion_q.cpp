@@ -0,0 +1,171 @@
+/*
+* Fixed-point orientation filter for raw FIFO blocks
+* Madgwick's IMU algorithm in integer arithmetic: quaternion in Q30, unit vectors
+* via a table seeded Newton inverse square root, no float math per sample
+*
+*/
+
+#include "./imu_fusion_q.h"
+
+#define Q_ONE (1 << IMU_Q_FRAC)
+
+// seeds of the inverse square root, 1/sqrt(r) in Q29 for r = (i + 0.5) / 128
+#define INVSQRT_TABLE_SIZE 128
+
+struct invsqrt_table {
+  invsqrt_table() {
+    for (int i = 0; i < INVSQRT_TABLE_SIZE; ++i)
+      v[i] = (int32_t) ((1 << 29) / sqrt((i + 0.5) / INVSQRT_TABLE_SIZE) + 0.5);
+  }
+  int32_t v[INVSQRT_TABLE_SIZE];
+};
+
+static const invsqrt_table s_invsqrt;
+
+
+//_______________________________________________________________________________________________________
+// inverse square root of [x] > 0: 1/sqrt(x) = y * 2^(e - 60) with y in Q29 within (1, 2]
+// x is shifted by an even count into [2^60, 2^62), i.e. r = x / 2^62 in [0.25, 1),
+// the table seed is within 0.8%, two Newton steps bring that to 2^-25
+static inline int32_t invSqrt(uint64_t x, int &e) {
+  int s = __builtin_clzll(x) - 3;
+  s += (s & 1);
+  e = s / 2;
+  x = (s >= 0) ? (x << s) : (x >> -s);
+
+  int64_t r = (int64_t) (x >> 32); // Q30
+  int64_t y = s_invsqrt.v[x >> 55];
+  for (int i = 0; i < 2; ++i) {
+    int64_t t = (r * y) >> 30;
+    t = (t * y) >> 29;
+    y = (y * ((3LL << 29) - t)) >> 30;
+  }
+  return (int32_t) y;
+}
+
+//_______________________________________________________________________________________________________
+// [c] / sqrt(x) in Q30, with y and e from invSqrt(x)
+static inline int32_t scale(int64_t c, int32_t y, int e) {
+  int sh = 30 - e;
+  if (sh <= 0)
+    return (int32_t) ((c * y) << -sh);
+  return (int32_t) ((c * y + (1LL << (sh - 1))) >> sh);
+}
+
+//_______________________________________________________________________________________________________
+static inline int64_t mul(int64_t a, int64_t b) {
+  return (a * b) >> IMU_Q_FRAC;
+}
+
+
+
+//_______________________________________________________________________________________________________
+imu_fusion_q::imu_fusion_q(float error, float dT, int gfs_sel) {
+  setup(error, dT, gfs_sel);
+  reset();
+}
+
+//_______________________________________________________________________________________________________
+void imu_fusion_q::setup(float error, float dT, int gfs_sel) {
+  // half rotation angle per raw value and step [rad], see imu_convert::setRange()
+  double k = 0.5 * dT * ((1 << gfs_sel) / 131.0) * (M_PI / 180.0);
+  m_k_shift = 0;
+  while (k * pow(2.0, IMU_Q_FRAC + m_k_shift) < (1 << 29))
+    ++m_k_shift;
+  m_k_gyro = (int32_t) (k * pow(2.0, IMU_Q_FRAC + m_k_shift) + 0.5);
+
+  // same beta as madgwick_filter
+  double beta = sqrt(3.0/4.0) * (M_PI * (error / 180.0));
+  m_beta_dt = (int32_t) (beta * dT * Q_ONE + 0.5);
+}
+
+//_______________________________________________________________________________________________________
+void imu_fusion_q::reset() {
+  m_q[0] = Q_ONE;
+  m_q[1] = 0;
+  m_q[2] = 0;
+  m_q[3] = 0;
+}
+
+//_______________________________________________________________________________________________________
+void imu_fusion_q::getQuaternion(quaternion<float> &q) {
+  q.m_w = (float) m_q[0] / Q_ONE;
+  q.m_x = (float) m_q[1] / Q_ONE;
+  q.m_y = (float) m_q[2] / Q_ONE;
+  q.m_z = (float) m_q[3] / Q_ONE;
+}
+
+//_______________________________________________________________________________________________________
+void imu_fusion_q::update(const int16_t* raw, size_t n) {
+  int64_t q0 = m_q[0], q1 = m_q[1], q2 = m_q[2], q3 = m_q[3];
+  int32_t y;
+  int e;
+
+  for (size_t i = 0; i < n; ++i, raw += 6) {
+    // half rotation angles of this step, Q30
+    int64_t hx = ((int64_t) raw[3] * m_k_gyro) >> m_k_shift;
+    int64_t hy = ((int64_t) raw[4] * m_k_gyro) >> m_k_shift;
+    int64_t hz = ((int64_t) raw[5] * m_k_gyro) >> m_k_shift;
+
+    // rotation from gyroscope
+    int64_t d0 = (-q1 * hx - q2 * hy - q3 * hz) >> IMU_Q_FRAC;
+    int64_t d1 = (q0 * hx + q2 * hz - q3 * hy) >> IMU_Q_FRAC;
+    int64_t d2 = (q0 * hy - q1 * hz + q3 * hx) >> IMU_Q_FRAC;
+    int64_t d3 = (q0 * hz + q1 * hy - q2 * hx) >> IMU_Q_FRAC;
+
+    // feedback only with valid accelerometer and gyroscope values, as madgwick_filter
+    int64_t a2 = (int64_t) raw[0] * raw[0] + (int64_t) raw[1] * raw[1] + (int64_t) raw[2] * raw[2];
+    if (a2 != 0 && (raw[3] | raw[4] | raw[5]) != 0) {
+      y = invSqrt(a2, e);
+      int64_t ax = scale(raw[0], y, e);
+      int64_t ay = scale(raw[1], y, e);
+      int64_t az = scale(raw[2], y, e);
+
+      int64_t q0q0 = mul(q0, q0);
+      int64_t q3q3 = mul(q3, q3);
+      int64_t n12 = mul(q1, q1) + mul(q2, q2);
+
+      // gradient of the gravity error, half of the float version
+      int64_t s[4];
+      s[0] = 2 * mul(q0, n12) + mul(q2, ax) - mul(q1, ay);
+      s[1] = 2 * mul(q1, q3q3) - mul(q3, ax) + 2 * mul(q0q0, q1) - mul(q0, ay) - 2 * q1 + 4 * mul(q1, n12) + 2 * mul(q1, az);
+      s[2] = 2 * mul(q0q0, q2) + mul(q0, ax) + 2 * mul(q2, q3q3) - mul(q3, ay) - 2 * q2 + 4 * mul(q2, n12) + 2 * mul(q2, az);
+      s[3] = 2 * mul(q3, n12) - mul(q1, ax) - mul(q2, ay);
+
+      // only the direction counts, bring the largest component into [2^29, 2^30) before squaring
+      int64_t m = 0;
+      for (int j = 0; j < 4; ++j)
+        m |= (s[j] < 0) ? -s[j] : s[j];
+      if (m != 0) {
+        int sh = 63 - __builtin_clzll(m) - (IMU_Q_FRAC - 1);
+        uint64_t s2 = 0;
+        for (int j = 0; j < 4; ++j) {
+          s[j] = (sh >= 0) ? (s[j] >> sh) : (s[j] << -sh);
+          s2 += s[j] * s[j];
+        }
+        y = invSqrt(s2, e);
+        d0 -= mul(m_beta_dt, scale(s[0], y, e));
+        d1 -= mul(m_beta_dt, scale(s[1], y, e));
+        d2 -= mul(m_beta_dt, scale(s[2], y, e));
+        d3 -= mul(m_beta_dt, scale(s[3], y, e));
+      }
+    }
+
+    q0 += d0;
+    q1 += d1;
+    q2 += d2;
+    q3 += d3;
+
+    // normalise quaternion
+    y = invSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3, e);
+    q0 = scale(q0, y, e);
+    q1 = scale(q1, y, e);
+    q2 = scale(q2, y, e);
+    q3 = scale(q3, y, e);
+  }
+
+  m_q[0] = (int32_t) q0;
+  m_q[1] = (int32_t) q1;
+  m_q[2] = (int32_t) q2;
+  m_q[3] = (int32_t) q3;
+}
@@ -0,0 +1,169 @@
+/*
+* Interrupt driven IMU acquisition
+* wakes a reader thread on edges of the MPU INT pin instead of sleeping for fixed intervals
+*
+*/
+
+#include <chrono>
+
+#include "./imu_irq.h"
+
+
+/*
+ * Interrupt sources
+ */
+
+//_______________________________________________________________________________________________________
+gpio_irq_source::gpio_irq_source(int pin, mraa::Edge edge)
+ : m_pin(pin), m_edge(edge), m_gpio(NULL)
+{
+}
+
+//_______________________________________________________________________________________________________
+gpio_irq_source::~gpio_irq_source() {
+  detach();
+}
+
+//_______________________________________________________________________________________________________
+bool gpio_irq_source::attach(void (*handler)(void*), void* arg) {
+  detach();
+
+  m_gpio = new mraa::Gpio(m_pin);
+  m_gpio->dir(mraa::DIR_IN);
+  if (m_gpio->isr(m_edge, handler, arg) != mraa::SUCCESS) {
+    printf("[IMU] Could not attach interrupt handler to GPIO %d.\n", m_pin);
+    fflush(stdout);
+    delete m_gpio;
+    m_gpio = NULL;
+    return false;
+  }
+  m_gpio->mode(mraa::MODE_HIZ);
+
+  return true;
+}
+
+//_______________________________________________________________________________________________________
+void gpio_irq_source::detach() {
+  if (m_gpio == NULL)
+    return;
+
+  m_gpio->isrExit();
+  delete m_gpio;
+  m_gpio = NULL;
+}
+
+//_______________________________________________________________________________________________________
+bool soft_irq_source::attach(void (*handler)(void*), void* arg) {
+  std::lock_guard<std::mutex> lock(m_mtx);
+  m_handler = handler;
+  m_arg = arg;
+  return true;
+}
+
+//_______________________________________________________________________________________________________
+void soft_irq_source::detach() {
+  std::lock_guard<std::mutex> lock(m_mtx);
+  m_handler = NULL;
+  m_arg = NULL;
+}
+
+//_______________________________________________________________________________________________________
+void soft_irq_source::trigger() {
+  std::lock_guard<std::mutex> lock(m_mtx);
+  if (m_handler != NULL)
+    m_handler(m_arg);
+}
+
+
+/*
+ * Waiting for interrupts
+ */
+
+//_______________________________________________________________________________________________________
+imu_irq::imu_irq(imu_edison* imu, irq_source* src, size_t watermark)
+ : m_imu(imu), m_src(src), m_pending(0), m_wake(false),
+   m_interrupts(0), m_int_wakeups(0), m_timeouts(0)
+{
+  setWatermark(watermark);
+  m_src->attach(&imu_irq::isr, this);
+}
+
+//_______________________________________________________________________________________________________
+imu_irq::~imu_irq() {
+  m_src->detach();
+  wakeup();
+}
+
+//_______________________________________________________________________________________________________
+void imu_irq::isr(void* arg) {
+  imu_irq* self = (imu_irq*) arg;
+  {
+    std::lock_guard<std::mutex> lock(self->m_mtx);
+    ++self->m_pending;
+    ++self->m_interrupts;
+  }
+  self->m_cv.notify_one();
+}
+
+//_______________________________________________________________________________________________________
+uint8_t imu_irq::wait() {
+  std::unique_lock<std::mutex> lock(m_mtx);
+
+  bool edge = m_cv.wait_for(lock, std::chrono::milliseconds(m_timeout_ms),
+    [this] {return m_pending > 0 || m_wake;});
+  bool irq = m_pending > 0;
+
+  m_pending = 0;
+  m_wake = false;
+  lock.unlock();
+
+  if (!edge) {
+    ++m_timeouts;
+    return 0;
+  }
+  if (!irq)
+    return 0;
+
+  ++m_int_wakeups;
+
+  // reading the status also releases the latched pin
+  return m_imu->getIntStatus();
+}
+
+//_______________________________________________________________________________________________________
+uint8_t imu_irq::waitInterrupt() {
+  std::unique_lock<std::mutex> lock(m_mtx);
+
+  m_cv.wait(lock, [this] {return m_pending > 0 || m_wake;});
+  bool irq = m_pending > 0;
+
+  m_pending = 0;
+  m_wake = false;
+  lock.unlock();
+
+  if (!irq)
+    return 0;
+
+  ++m_int_wakeups;
+  return m_imu->getIntStatus();
+}
+
+//_______________________________________________________________________________________________________
+void imu_irq::wakeup() {
+  {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_wake = true;
+  }
+  m_cv.notify_all();
+}
+
+//_______________________________________________________________________________________________________
+void imu_irq::setWatermark(size_t samples) {
+  if (samples < 1)
+    samples = 1;
+  if (samples > MPU_FIFO_SIZE / MPU_FIFO_SAMPLE_SIZE)
+    samples = MPU_FIFO_SIZE / MPU_FIFO_SAMPLE_SIZE;
+
+  m_watermark = samples;
+  m_timeout_ms = (int) (1000.0 * samples / m_imu->getSampleRate());
+}
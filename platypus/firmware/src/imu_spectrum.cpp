@@ -0,0 +1,289 @@
+/*
+* Streaming vibration spectrum of the acceleration
+* the N point real FFT of each axis is an N/2 point complex FFT of the even and odd samples
+* followed by a split into the N/2 + 1 bins; the axes run side by side in the lanes of one
+* register, so every butterfly is a handful of vector operations
+*
+*/
+
+#include <math.h>
+#include <algorithm>
+
+#include "./imu_spectrum.h"
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#define LANES IMU_SPECTRUM_LANES
+
+
+//_______________________________________________________________________________________________________
+imu_spectrum::imu_spectrum(float rate, size_t size, size_t hop, int afs_sel) : m_rate(rate) {
+  // a power of 2, at least 4 samples
+  m_size = 4;
+  while (m_size < size)
+    m_size *= 2;
+  m_hop = hop < 1 ? 1 : (hop > m_size ? m_size : hop);
+  // see imu_convert::setRange()
+  m_accel_scale = (float) ((1 << afs_sel) * 9.807 / 16384.0);
+
+  const size_t half = m_size / 2;
+  int bits = 0;
+  while ((1u << bits) < half)
+    ++bits;
+  m_bitrev.resize(half);
+  for (size_t m = 0; m < half; ++m) {
+    uint32_t r = 0;
+    for (int b = 0; b < bits; ++b)
+      r |= ((m >> b) & 1) << (bits - 1 - b);
+    m_bitrev[m] = r;
+  }
+
+  m_tw_re.resize(half / 2 + 1);
+  m_tw_im.resize(half / 2 + 1);
+  for (size_t j = 0; j < m_tw_re.size(); ++j) {
+    m_tw_re[j] = (float) cos(2.0 * M_PI * j / half);
+    m_tw_im[j] = (float) -sin(2.0 * M_PI * j / half);
+  }
+  m_split_re.resize(half + 1);
+  m_split_im.resize(half + 1);
+  for (size_t k = 0; k <= half; ++k) {
+    m_split_re[k] = (float) cos(2.0 * M_PI * k / m_size);
+    m_split_im[k] = (float) -sin(2.0 * M_PI * k / m_size);
+  }
+  m_re.resize(half * LANES);
+  m_im.resize(half * LANES);
+
+  // periodic Hann window, the mean squares of all bins add up to the one of the windowed signal
+  m_hann.resize(m_size);
+  double sq = 0.0;
+  for (size_t i = 0; i < m_size; ++i) {
+    m_hann[i] = (float) (0.5 - 0.5 * cos(2.0 * M_PI * i / m_size));
+    sq += (double) m_hann[i] * m_hann[i];
+  }
+  m_norm = (float) (1.0 / (m_size * sq));
+
+  for (int j = 0; j < 3; ++j)
+    m_hist[j].resize(m_size);
+  m_in.resize(m_size * LANES);
+  m_out.resize(getBins() * LANES);
+  m_bin.resize(getBins());
+
+  // octave bands up to the Nyquist frequency
+  float edges[IMU_SPECTRUM_BANDS + 1];
+  for (int b = 0; b <= IMU_SPECTRUM_BANDS; ++b)
+    edges[b] = (float) (m_rate / 2.0 / (1 << (IMU_SPECTRUM_BANDS - b)));
+  setBands(edges, IMU_SPECTRUM_BANDS);
+
+  reset();
+}
+
+//_______________________________________________________________________________________________________
+void imu_spectrum::setBands(const float* edges, size_t n) {
+  m_bands = n > IMU_SPECTRUM_MAX_BANDS ? IMU_SPECTRUM_MAX_BANDS : n;
+  m_band.assign(getBins(), -1);
+  for (size_t k = 0; k < getBins(); ++k) {
+    float f = getFrequency(k);
+    for (size_t b = 0; b < m_bands; ++b) {
+      // the last band includes its upper edge, e.g. the Nyquist frequency
+      if (f >= edges[b] && (f < edges[b + 1] || (b + 1 == m_bands && f <= edges[b + 1]))) {
+        m_band[k] = (int) b;
+        break;
+      }
+    }
+  }
+}
+
+//_______________________________________________________________________________________________________
+void imu_spectrum::reset() {
+  for (int j = 0; j < 3; ++j)
+    std::fill(m_hist[j].begin(), m_hist[j].end(), 0.0f);
+  m_pos = 0;
+  m_count = 0;
+  m_since = 0;
+  m_windows = 0;
+}
+
+//_______________________________________________________________________________________________________
+size_t imu_spectrum::update(const int16_t* raw, size_t n, std::vector<imu_spectrum_window> &windows) {
+  size_t found = 0;
+  for (size_t i = 0; i < n; ++i, raw += 6) {
+    for (int j = 0; j < 3; ++j)
+      m_hist[j][m_pos] = raw[j] * m_accel_scale;
+    m_pos = (m_pos + 1) & (m_size - 1);
+    m_count = m_count < m_size ? m_count + 1 : m_size;
+    ++m_since;
+
+    if (m_count < m_size || m_since < m_hop)
+      continue;
+    m_since = 0;
+
+    prepare();
+    power(m_in.data(), m_out.data());
+    imu_spectrum_window w;
+    features(w);
+    windows.push_back(w);
+    ++found;
+  }
+  return found;
+}
+
+//_______________________________________________________________________________________________________
+void imu_spectrum::prepare() {
+  // oldest sample first, it is the next one to be overwritten
+  for (int j = 0; j < 3; ++j) {
+    const float* h = m_hist[j].data();
+    float mean = 0.0;
+    for (size_t i = 0; i < m_size; ++i)
+      mean += h[i];
+    mean /= m_size;
+
+    for (size_t i = 0; i < m_size; ++i)
+      m_in[i * LANES + j] = (h[(m_pos + i) & (m_size - 1)] - mean) * m_hann[i];
+  }
+  for (size_t i = 0; i < m_size; ++i)
+    m_in[i * LANES + 3] = 0.0;
+}
+
+//_______________________________________________________________________________________________________
+void imu_spectrum::features(imu_spectrum_window &w) {
+  w = imu_spectrum_window();
+  w.window = m_windows++;
+  w.bands = (uint8_t) m_bands;
+
+  const size_t half = m_size / 2;
+  float total = 0.0, p_prev = 0.0, p_next = 0.0;
+  size_t peak = 0;
+  float* p = m_bin.data();
+  for (size_t k = 0; k <= half; ++k) {
+    // one-sided, the bins in between stand for two
+    const float* o = &m_out[k * LANES];
+    p[k] = (o[0] + o[1] + o[2]) * m_norm * (k == 0 || k == half ? 1.0f : 2.0f);
+    total += p[k];
+    if (m_band[k] >= 0)
+      w.energy[m_band[k]] += p[k];
+    if (k > 0 && p[k] > w.peak_energy) {
+      w.peak_energy = p[k];
+      peak = k;
+    }
+  }
+  w.rms = sqrt(total);
+  if (peak == 0)
+    return;
+
+  // parabola through the peak and its neighbors
+  float delta = 0.0;
+  if (peak < half) {
+    p_prev = p[peak - 1];
+    p_next = p[peak + 1];
+    float d = p_prev - 2.0f * p[peak] + p_next;
+    delta = d < 0.0f ? 0.5f * (p_prev - p_next) / d : 0.0f;
+  }
+  w.peak = (peak + delta) * m_rate / m_size;
+}
+
+//_______________________________________________________________________________________________________
+void imu_spectrum::power(const float* in, float* out) {
+#ifdef __SSE__
+  const size_t half = m_size / 2;
+  float* re = m_re.data();
+  float* im = m_im.data();
+
+  // z[m] = x[2m] + i x[2m + 1] in bit reversed order
+  for (size_t m = 0; m < half; ++m) {
+    size_t r = m_bitrev[m] * LANES;
+    _mm_storeu_ps(re + r, _mm_loadu_ps(in + 2 * m * LANES));
+    _mm_storeu_ps(im + r, _mm_loadu_ps(in + (2 * m + 1) * LANES));
+  }
+
+  for (size_t len = 2; len <= half; len *= 2) {
+    const size_t h = len / 2, step = half / len;
+    for (size_t j = 0; j < h; ++j) {
+      const __m128 wr = _mm_set1_ps(m_tw_re[j * step]);
+      const __m128 wi = _mm_set1_ps(m_tw_im[j * step]);
+      for (size_t s = j; s < half; s += len) {
+        float* ar = re + s * LANES;
+        float* ai = im + s * LANES;
+        float* br = re + (s + h) * LANES;
+        float* bi = im + (s + h) * LANES;
+        __m128 xr = _mm_loadu_ps(br), xi = _mm_loadu_ps(bi);
+        __m128 tr = _mm_sub_ps(_mm_mul_ps(wr, xr), _mm_mul_ps(wi, xi));
+        __m128 ti = _mm_add_ps(_mm_mul_ps(wr, xi), _mm_mul_ps(wi, xr));
+        __m128 yr = _mm_loadu_ps(ar), yi = _mm_loadu_ps(ai);
+        _mm_storeu_ps(br, _mm_sub_ps(yr, tr));
+        _mm_storeu_ps(bi, _mm_sub_ps(yi, ti));
+        _mm_storeu_ps(ar, _mm_add_ps(yr, tr));
+        _mm_storeu_ps(ai, _mm_add_ps(yi, ti));
+      }
+    }
+  }
+
+  // X[k] = (Z[k] + Z*[M - k]) / 2 - i W^k (Z[k] - Z*[M - k]) / 2
+  const __m128 c = _mm_set1_ps(0.5f);
+  for (size_t k = 0; k <= half; ++k) {
+    size_t a = (k == half ? 0 : k) * LANES;
+    size_t b = (k == 0 ? 0 : half - k) * LANES;
+    __m128 ar = _mm_loadu_ps(re + a), ai = _mm_loadu_ps(im + a);
+    __m128 br = _mm_loadu_ps(re + b), bi = _mm_loadu_ps(im + b);
+    __m128 er = _mm_mul_ps(c, _mm_add_ps(ar, br));
+    __m128 ei = _mm_mul_ps(c, _mm_sub_ps(ai, bi));
+    __m128 odr = _mm_mul_ps(c, _mm_add_ps(ai, bi));
+    __m128 odi = _mm_mul_ps(c, _mm_sub_ps(br, ar));
+    const __m128 wr = _mm_set1_ps(m_split_re[k]);
+    const __m128 wi = _mm_set1_ps(m_split_im[k]);
+    __m128 xr = _mm_add_ps(er, _mm_sub_ps(_mm_mul_ps(wr, odr), _mm_mul_ps(wi, odi)));
+    __m128 xi = _mm_add_ps(ei, _mm_add_ps(_mm_mul_ps(wr, odi), _mm_mul_ps(wi, odr)));
+    _mm_storeu_ps(out + k * LANES, _mm_add_ps(_mm_mul_ps(xr, xr), _mm_mul_ps(xi, xi)));
+  }
+#else
+  powerScalar(in, out);
+#endif
+}
+
+//_______________________________________________________________________________________________________
+void imu_spectrum::powerScalar(const float* in, float* out) {
+  const size_t half = m_size / 2;
+  float* re = m_re.data();
+  float* im = m_im.data();
+
+  for (size_t m = 0; m < half; ++m) {
+    size_t r = m_bitrev[m] * LANES;
+    for (int l = 0; l < LANES; ++l) {
+      re[r + l] = in[2 * m * LANES + l];
+      im[r + l] = in[(2 * m + 1) * LANES + l];
+    }
+  }
+
+  for (size_t len = 2; len <= half; len *= 2) {
+    const size_t h = len / 2, step = half / len;
+    for (size_t j = 0; j < h; ++j) {
+      const float wr = m_tw_re[j * step], wi = m_tw_im[j * step];
+      for (size_t s = j; s < half; s += len) {
+        for (int l = 0; l < LANES; ++l) {
+          size_t a = s * LANES + l, b = (s + h) * LANES + l;
+          float tr = wr * re[b] - wi * im[b];
+          float ti = wr * im[b] + wi * re[b];
+          re[b] = re[a] - tr;
+          im[b] = im[a] - ti;
+          re[a] += tr;
+          im[a] += ti;
+        }
+      }
+    }
+  }
+
+  for (size_t k = 0; k <= half; ++k) {
+    size_t a = (k == half ? 0 : k) * LANES;
+    size_t b = (k == 0 ? 0 : half - k) * LANES;
+    for (int l = 0; l < LANES; ++l) {
+      float er = 0.5f * (re[a + l] + re[b + l]);
+      float ei = 0.5f * (im[a + l] - im[b + l]);
+      float odr = 0.5f * (im[a + l] + im[b + l]);
+      float odi = 0.5f * (re[b + l] - re[a + l]);
+      float xr = er + (m_split_re[k] * odr - m_split_im[k] * odi);
+      float xi = ei + (m_split_re[k] * odi + m_split_im[k] * odr);
+      out[k * LANES + l] = xr * xr + xi * xi;
+    }
+  }
+}
@@ -0,0 +1,273 @@
+/*
+* Versioned file format of the sample log
+* all fields are written byte by byte in little endian, the sample payload keeps the big endian
+* of the page (raw) or is the output of log_codec
+*
+*/
+
+#include <string.h>
+
+#include "./log_format.h"
+
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
+
+// reflected Castagnoli polynomial
+#define CRC32C_POLY 0x82F63B78
+
+
+//_______________________________________________________________________________________________________
+static inline void put16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t) (v & 0xFF);
+  p[1] = (uint8_t) (v >> 8);
+}
+
+//_______________________________________________________________________________________________________
+static inline void put32(uint8_t* p, uint32_t v) {
+  put16(p, (uint16_t) (v & 0xFFFF));
+  put16(p + 2, (uint16_t) (v >> 16));
+}
+
+//_______________________________________________________________________________________________________
+static inline uint16_t get16(const uint8_t* p) {
+  return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+//_______________________________________________________________________________________________________
+static inline uint32_t get32(const uint8_t* p) {
+  return get16(p) | ((uint32_t) get16(p + 2) << 16);
+}
+
+//_______________________________________________________________________________________________________
+static inline void putFloat(uint8_t* p, float v) {
+  uint32_t u;
+  memcpy(&u, &v, sizeof(u));
+  put32(p, u);
+}
+
+//_______________________________________________________________________________________________________
+static inline float getFloat(const uint8_t* p) {
+  uint32_t u = get32(p);
+  float v;
+  memcpy(&v, &u, sizeof(v));
+  return v;
+}
+
+//_______________________________________________________________________________________________________
+// the CRC32C of every byte value, built on first use
+static const uint32_t* crcTable() {
+  struct table {
+    uint32_t crc[256];
+    table() {
+      for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k)
+          c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        crc[i] = c;
+      }
+    }
+  };
+  static const table s_table;
+  return s_table.crc;
+}
+
+
+//_______________________________________________________________________________________________________
+log_file_header::log_file_header()
+    : version(LOG_FORMAT_VERSION), afs(0), gfs(0), rate(0.0), bandwidth(0.0), channels(6),
+      value_size(sizeof(int16_t)) {
+  memset(device, 0, sizeof(device));
+  memset(schema, 0, sizeof(schema));
+  memcpy(schema, LOG_SCHEMA, sizeof(LOG_SCHEMA) - 1);
+}
+
+
+//_______________________________________________________________________________________________________
+log_format::log_format() : m_raw(6 * LOG_PAGE_SAMPLES) {
+}
+
+//_______________________________________________________________________________________________________
+void log_format::writeHeader(const log_file_header &header, uint8_t* out) {
+  memset(out, 0, LOG_FILE_HEADER_SIZE);
+  memcpy(out, LOG_FILE_MAGIC, 6);
+  put16(out + 6, header.version);
+  put16(out + 8, LOG_FILE_HEADER_SIZE);
+  put16(out + 10, LOG_HEADER_SIZE);
+  memcpy(out + 12, header.device, sizeof(header.device));
+  put16(out + 28, header.afs);
+  put16(out + 30, header.gfs);
+  putFloat(out + 32, header.rate);
+  putFloat(out + 36, header.bandwidth);
+  out[40] = header.channels;
+  out[41] = header.value_size;
+  memcpy(out + 42, header.schema, sizeof(header.schema));
+  put32(out + 60, crc32c(out, 60));
+}
+
+//_______________________________________________________________________________________________________
+bool log_format::readHeader(const uint8_t* in, size_t size, log_file_header &header) {
+  if (size < LOG_FILE_HEADER_SIZE || memcmp(in, LOG_FILE_MAGIC, 6) != 0)
+    return false;
+  if (get16(in + 6) != LOG_FORMAT_VERSION || get16(in + 8) != LOG_FILE_HEADER_SIZE ||
+      get16(in + 10) != LOG_HEADER_SIZE || get32(in + 60) != crc32c(in, 60))
+    return false;
+
+  header.version = get16(in + 6);
+  memcpy(header.device, in + 12, sizeof(header.device));
+  header.device[sizeof(header.device) - 1] = 0;
+  header.afs = get16(in + 28);
+  header.gfs = get16(in + 30);
+  header.rate = getFloat(in + 32);
+  header.bandwidth = getFloat(in + 36);
+  header.channels = in[40];
+  header.value_size = in[41];
+  memcpy(header.schema, in + 42, sizeof(header.schema));
+  header.schema[sizeof(header.schema) - 1] = 0;
+  return true;
+}
+
+//_______________________________________________________________________________________________________
+size_t log_format::pack(log_page* page, Codec codec, uint32_t sequence, uint8_t* out) {
+  const size_t n = page->getSamples();
+  const uint8_t* samples = page->data + LOG_HEADER_SIZE;
+  uint8_t* payload = out + LOG_PAGE_HEADER_SIZE + LOG_HEADER_SIZE;
+  size_t size = n * LOG_SAMPLE_SIZE;
+
+  if (codec != Codec::RAW && n > 0) {
+    for (size_t i = 0; i < 6 * n; ++i)
+      m_raw[i] = (int16_t) ((samples[2 * i] << 8) | samples[2 * i + 1]);
+    size_t packed = m_codec.encode(m_raw.data(), n, payload);
+    if (packed < size)
+      size = packed;
+    else
+      codec = Codec::RAW;
+  } else {
+    codec = Codec::RAW;
+  }
+  if (codec == Codec::RAW)
+    memcpy(payload, samples, size);
+
+  memcpy(out, LOG_PAGE_MAGIC, 2);
+  out[2] = (uint8_t) codec;
+  out[3] = 0;
+  put32(out + 4, sequence);
+  put32(out + 8, (uint32_t) ((uint64_t) page->stamp & 0xFFFFFFFF));
+  put32(out + 12, (uint32_t) ((uint64_t) page->stamp >> 32));
+  put16(out + 16, (uint16_t) n);
+  put16(out + 18, LOG_HEADER_SIZE);
+  put32(out + 20, (uint32_t) size);
+  memcpy(out + LOG_PAGE_HEADER_SIZE, page->header(), LOG_HEADER_SIZE);
+  uint32_t crc = crc32c(out, 24);
+  put32(out + 24, crc32c(out + LOG_PAGE_HEADER_SIZE, LOG_HEADER_SIZE + size, crc));
+  return LOG_PAGE_HEADER_SIZE + LOG_HEADER_SIZE + size;
+}
+
+//_______________________________________________________________________________________________________
+size_t log_format::unpack(const uint8_t* in, size_t size, log_page* page, log_page_info* info) {
+  log_page_info page_info;
+  if (!check(in, size, page_info))
+    return 0;
+
+  const size_t n = page_info.samples;
+  const size_t bytes = page_info.size - LOG_PAGE_HEADER_SIZE - LOG_HEADER_SIZE;
+  const uint8_t* payload = in + LOG_PAGE_HEADER_SIZE + LOG_HEADER_SIZE;
+  uint8_t* samples = page->data + LOG_HEADER_SIZE;
+  if (page_info.codec == Codec::DELTA) {
+    if (m_codec.decode(payload, bytes, n, m_raw.data()) != bytes)
+      return 0;
+    for (size_t i = 0; i < 6 * n; ++i) {
+      samples[2 * i] = (uint8_t) ((uint16_t) m_raw[i] >> 8);
+      samples[2 * i + 1] = (uint8_t) (m_raw[i] & 0xFF);
+    }
+  } else {
+    memcpy(samples, payload, bytes);
+  }
+  memcpy(page->header(), in + LOG_PAGE_HEADER_SIZE, LOG_HEADER_SIZE);
+  page->size = LOG_HEADER_SIZE + n * LOG_SAMPLE_SIZE;
+  page->stamp = page_info.stamp;
+  if (info != NULL)
+    *info = page_info;
+  return page_info.size;
+}
+
+//_______________________________________________________________________________________________________
+bool log_format::check(const uint8_t* in, size_t size, log_page_info &info) {
+  if (size < LOG_PAGE_HEADER_SIZE + LOG_HEADER_SIZE || memcmp(in, LOG_PAGE_MAGIC, 2) != 0 || in[3] != 0)
+    return false;
+  const size_t n = get16(in + 16), bytes = get32(in + 20);
+  if (n > LOG_PAGE_SAMPLES || get16(in + 18) != LOG_HEADER_SIZE ||
+      bytes > size - LOG_PAGE_HEADER_SIZE - LOG_HEADER_SIZE)
+    return false;
+  switch ((Codec) in[2]) {
+    case Codec::RAW:
+      if (bytes != n * LOG_SAMPLE_SIZE)
+        return false;
+      break;
+    case Codec::DELTA:
+      if (n == 0 || bytes > LOG_CODEC_BOUND(n))
+        return false;
+      break;
+    default:
+      return false;
+  }
+  uint32_t crc = crc32c(in, 24);
+  if (get32(in + 24) != crc32c(in + LOG_PAGE_HEADER_SIZE, LOG_HEADER_SIZE + bytes, crc))
+    return false;
+
+  info.codec = (Codec) in[2];
+  info.sequence = get32(in + 4);
+  info.stamp = (int64_t) (get32(in + 8) | ((uint64_t) get32(in + 12) << 32));
+  info.samples = n;
+  info.size = LOG_PAGE_HEADER_SIZE + LOG_HEADER_SIZE + bytes;
+  return true;
+}
+
+//_______________________________________________________________________________________________________
+size_t log_format::seek(const uint8_t* in, size_t size) {
+  log_page_info info;
+  for (size_t pos = 0; pos + LOG_PAGE_HEADER_SIZE + LOG_HEADER_SIZE <= size; ++pos) {
+    const uint8_t* p = (const uint8_t*) memchr(in + pos, LOG_PAGE_MAGIC[0], size - pos);
+    if (p == NULL)
+      break;
+    pos = p - in;
+    if (check(p, size - pos, info))
+      return pos;
+  }
+  return size;
+}
+
+//_______________________________________________________________________________________________________
+uint32_t log_format::crc32c(const uint8_t* data, size_t n, uint32_t crc) {
+#ifdef __SSE4_2__
+  uint32_t c = ~crc;
+#ifdef __x86_64__
+  uint64_t c64 = c;
+  for (; n >= 8; n -= 8, data += 8) {
+    uint64_t v;
+    memcpy(&v, data, sizeof(v));
+    c64 = _mm_crc32_u64(c64, v);
+  }
+  c = (uint32_t) c64;
+#endif
+  for (; n >= 4; n -= 4, data += 4) {
+    uint32_t v;
+    memcpy(&v, data, sizeof(v));
+    c = _mm_crc32_u32(c, v);
+  }
+  for (; n > 0; --n, ++data)
+    c = _mm_crc32_u8(c, *data);
+  return ~c;
+#else
+  return crc32cScalar(data, n, crc);
+#endif
+}
+
+//_______________________________________________________________________________________________________
+uint32_t log_format::crc32cScalar(const uint8_t* data, size_t n, uint32_t crc) {
+  const uint32_t* table = crcTable();
+  uint32_t c = ~crc;
+  for (; n > 0; --n, ++data)
+    c = table[(c ^ *data) & 0xFF] ^ (c >> 8);
+  return ~c;
+}
@@ -0,0 +1,375 @@
+/*
+* Writer thread of the sample log
+* the IMU thread only commits pages; this thread sleeps in log_arena::wait() until a batch is
+* due, packs the pages of a batch, returns them to the arena and writes them with one writev();
+* with the journal it wakes for every page, appends it to the journal and keeps it staged
+* until the batch is due
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "./log_writer.h"
+
+typedef std::chrono::steady_clock Clock;
+
+
+//_______________________________________________________________________________________________________
+log_writer::log_writer(log_arena* arena, const std::string &dir, const std::string &prefix, size_t segment_pages)
+    : m_arena(arena), m_dir(dir), m_prefix(prefix), m_segment_pages(segment_pages > 0 ? segment_pages : 1),
+      m_codec(Codec::RAW), m_journal_window(-1.0), m_running(false), m_flush(false), m_fd(-1), m_segment(0),
+      m_segment_written(0), m_segment_bytes(0), m_sequence(0), m_staged(0), m_journal_unsynced(0),
+      m_write_ms_sum(0.0) {
+  if (!m_dir.empty() && m_dir[m_dir.size() - 1] != '/')
+    m_dir += '/';
+  m_stats = log_writer_stats();
+  setPolicy(LOG_WRITER_BATCH, LOG_WRITER_DELAY, LOG_WRITER_SYNC);
+}
+
+//_______________________________________________________________________________________________________
+log_writer::~log_writer() {
+  stop();
+}
+
+//_______________________________________________________________________________________________________
+void log_writer::setPolicy(size_t batch, float delay, float sync) {
+  if (m_running)
+    return;
+  // at most IOV_MAX entries per writev()
+  m_batch = batch > 0 ? (batch < IOV_MAX ? batch : IOV_MAX) : 1;
+  m_delay = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(delay));
+  m_sync = sync;
+  m_staged_pages.resize(m_batch);
+  m_iov.resize(m_batch);
+  m_packed.resize(m_batch * LOG_FORMAT_PAGE_BOUND);
+}
+
+//_______________________________________________________________________________________________________
+void log_writer::setCodec(Codec codec) {
+  if (!m_running)
+    m_codec = codec;
+}
+
+//_______________________________________________________________________________________________________
+void log_writer::setHeader(const log_file_header &header) {
+  if (!m_running)
+    m_header = header;
+}
+
+//_______________________________________________________________________________________________________
+void log_writer::setJournal(float window) {
+  if (!m_running)
+    m_journal_window = window;
+}
+
+//_______________________________________________________________________________________________________
+bool log_writer::start() {
+  if (m_running)
+    return true;
+
+  DIR* dir = opendir(m_dir.c_str());
+  if (dir == NULL) {
+    mkdir(m_dir.c_str(), S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+    dir = opendir(m_dir.c_str());
+    if (dir == NULL) {
+      printf("[LOG] Cannot open %s: %s\n", m_dir.c_str(), strerror(errno));
+      fflush(stdout);
+      return false;
+    }
+    printf("[LOG] Created directory %s\n", m_dir.c_str());
+  }
+
+  // before the scan, the pages of a crash go to the segment they belong to
+  const std::string journal = m_dir + m_prefix + ".journal";
+  if (m_journal_window >= 0.0) {
+    size_t recovered = log_journal::recover(journal, m_dir, m_prefix);
+    std::lock_guard<std::mutex> lock(m_mtx_stats);
+    m_stats.recovered += recovered;
+  }
+
+  // the next number after the highest one found, the only directory scan
+  int next = 0;
+  struct dirent* ent;
+  while ((ent = readdir(dir)) != NULL) {
+    if (strncmp(ent->d_name, m_prefix.c_str(), m_prefix.size()) != 0)
+      continue;
+    const char* digits = ent->d_name + m_prefix.size();
+    char* end;
+    long num = strtol(digits, &end, 10);
+    if (end != digits && strcmp(end, ".bin") == 0 && num + 1 > next)
+      next = (int) num + 1;
+  }
+  closedir(dir);
+  m_segment = next;
+  if (m_journal_window >= 0.0 && !m_journal.open(journal, next, m_header)) {
+    printf("[LOG] Writing without a journal.\n");
+    fflush(stdout);
+  }
+
+  m_last_write = Clock::now();
+  m_last_sync = m_last_write;
+  m_running = true;
+  m_thread = std::thread(&log_writer::run, this);
+  pthread_setname_np(m_thread.native_handle(), "pps:log_writer");
+
+  printf("[LOG] Writer on %s%s%04d.bin, %zu pages per batch, %zu per segment, codec %s.\n",
+    m_dir.c_str(), m_prefix.c_str(), next, m_batch, m_segment_pages, log_codec::name(m_codec));
+  if (m_journal.isOpen())
+    printf("[LOG] Journal %s, synced within %.1f s.\n", journal.c_str(), m_journal_window);
+  fflush(stdout);
+  return true;
+}
+
+//_______________________________________________________________________________________________________
+void log_writer::stop() {
+  if (!m_running)
+    return;
+  m_running = false;
+  m_arena->wakeup();
+  m_thread.join();
+}
+
+//_______________________________________________________________________________________________________
+void log_writer::flush() {
+  m_flush = true;
+  m_arena->wakeup();
+}
+
+//_______________________________________________________________________________________________________
+void log_writer::run() {
+  // with the journal every page is taken right away, the batch waits in the staging buffers
+  const bool journal = m_journal.isOpen();
+  while (true) {
+    Clock::time_point now = Clock::now();
+    Clock::duration left = m_delay - (now - m_last_write);
+    if (m_journal_unsynced > 0 && m_journal_due - now < left)
+      left = m_journal_due - now;
+    if (m_running && !m_flush && left > Clock::duration::zero())
+      m_arena->wait(journal ? 1 : m_batch, left);
+
+    bool running = m_running;
+    bool flush = m_flush.exchange(false);
+    if (journal)
+      stage();
+    size_t depth = m_arena->getCommitted() + m_staged;
+    {
+      std::lock_guard<std::mutex> lock(m_mtx_stats);
+      m_stats.max_depth = depth > m_stats.max_depth ? depth : m_stats.max_depth;
+    }
+
+    // a full batch, the delay, a flush or the end: everything committed goes out
+    if (depth >= m_batch || Clock::now() - m_last_write >= m_delay || flush || !running) {
+      while (writeBatch()) {
+      }
+      m_last_write = Clock::now();
+    }
+    if (m_journal_unsynced > 0 && (Clock::now() >= m_journal_due || flush || !running))
+      syncJournal();
+
+    if (!running)
+      break;
+  }
+  closeSegment();
+
+  // everything is in the segments, nothing to recover
+  if (journal) {
+    m_journal.close();
+    unlink((m_dir + m_prefix + ".journal").c_str());
+  }
+}
+
+//_______________________________________________________________________________________________________
+void log_writer::stage() {
+  const size_t first = m_staged;
+  while (m_staged < m_batch) {
+    log_page* page = m_arena->take();
+    if (page == NULL)
+      break;
+    uint8_t* packed = &m_packed[m_staged * LOG_FORMAT_PAGE_BOUND];
+    m_staged_pages[m_staged].raw_size = page->size;
+    m_staged_pages[m_staged].full = page->isFull();
+    m_iov[m_staged].iov_base = packed;
+    m_iov[m_staged].iov_len = m_log_format.pack(page, m_codec, m_sequence++, packed);
+    m_arena->release(page);
+    ++m_staged;
+  }
+  if (m_staged == first || !m_journal.isOpen())
+    return;
+
+  // one sequential append, the sync follows within the window
+  if (m_journal_unsynced == 0)
+    m_journal_due = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(m_journal_window));
+  bool ok = m_journal.append(&m_iov[first], (int) (m_staged - first));
+  m_journal_unsynced += m_staged - first;
+  std::lock_guard<std::mutex> lock(m_mtx_stats);
+  if (ok)
+    m_stats.journal_pages += m_staged - first;
+  else
+    ++m_stats.errors;
+}
+
+//_______________________________________________________________________________________________________
+bool log_writer::writeBatch() {
+  Clock::time_point t0 = Clock::now();
+  stage();
+
+  // up to the end of the segment or a partial page, which ends it as well
+  size_t n = 0;
+  bool end = false;
+  size_t bytes = 0, raw_bytes = 0;
+  while (n < m_staged && !end) {
+    raw_bytes += m_staged_pages[n].raw_size;
+    bytes += m_iov[n].iov_len;
+    end = !m_staged_pages[n].full || m_segment_written + n + 1 >= m_segment_pages;
+    ++n;
+  }
+  if (n == 0)
+    return false;
+
+  bool ok = m_fd >= 0 || openSegment();
+  if (ok && !log_journal::writeAll(m_fd, m_iov.data(), (int) n)) {
+    printf("[LOG] Writing %s segment %d failed: %s\n", m_prefix.c_str(), (int) m_segment, strerror(errno));
+    fflush(stdout);
+    ok = false;
+  }
+  m_segment_written += n;
+  if (ok)
+    m_segment_bytes += bytes;
+
+  // the pages behind the batch move to the front
+  m_staged -= n;
+  for (size_t i = 0; i < m_staged; ++i) {
+    uint8_t* packed = &m_packed[i * LOG_FORMAT_PAGE_BOUND];
+    memmove(packed, m_iov[n + i].iov_base, m_iov[n + i].iov_len);
+    m_iov[i].iov_base = packed;
+    m_iov[i].iov_len = m_iov[n + i].iov_len;
+    m_staged_pages[i] = m_staged_pages[n + i];
+  }
+
+  if (end)
+    closeSegment();
+  else if (m_sync >= 0.0 && Clock::now() - m_last_sync >= std::chrono::duration<float>(m_sync) && sync())
+    resetJournal();
+
+  float ms = std::chrono::duration<float, std::milli>(Clock::now() - t0).count();
+  std::lock_guard<std::mutex> lock(m_mtx_stats);
+  if (ok) {
+    m_stats.pages += n;
+    m_stats.bytes += bytes;
+    m_stats.raw_bytes += raw_bytes;
+  } else {
+    ++m_stats.errors;
+  }
+  ++m_stats.batches;
+  m_stats.write_ms = ms;
+  m_stats.max_write_ms = ms > m_stats.max_write_ms ? ms : m_stats.max_write_ms;
+  m_write_ms_sum += ms;
+  return true;
+}
+
+//_______________________________________________________________________________________________________
+bool log_writer::openSegment() {
+  char name[16];
+  snprintf(name, sizeof(name), "%04d.bin", (int) m_segment);
+  std::string filename = m_dir + m_prefix + name;
+
+  m_fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (m_fd < 0) {
+    printf("[LOG] Cannot open %s: %s\n", filename.c_str(), strerror(errno));
+    fflush(stdout);
+    return false;
+  }
+
+  // a new file starts with the file header, an existing one (e.g. after a failed write) has it
+  struct stat st;
+  uint8_t header[LOG_FILE_HEADER_SIZE];
+  log_format::writeHeader(m_header, header);
+  m_segment_bytes = fstat(m_fd, &st) == 0 ? st.st_size : 0;
+  if (m_segment_bytes == 0 && write(m_fd, header, sizeof(header)) != (ssize_t) sizeof(header)) {
+    printf("[LOG] Writing the header of %s failed: %s\n", filename.c_str(), strerror(errno));
+    fflush(stdout);
+    close(m_fd);
+    m_fd = -1;
+    return false;
+  }
+  m_segment_written = 0;
+  m_segment_bytes = m_segment_bytes > 0 ? m_segment_bytes : sizeof(header);
+  std::lock_guard<std::mutex> lock(m_mtx_stats);
+  ++m_stats.segments;
+  m_stats.bytes += sizeof(header);
+  return true;
+}
+
+//_______________________________________________________________________________________________________
+void log_writer::closeSegment() {
+  // none open after a failed open, the next batch tries the same number again
+  if (m_fd < 0) {
+    m_segment_written = 0;
+    return;
+  }
+  sync();
+  close(m_fd);
+  m_fd = -1;
+  m_segment_written = 0;
+  m_segment_bytes = 0;
+  ++m_segment;
+  resetJournal();
+}
+
+//_______________________________________________________________________________________________________
+bool log_writer::sync() {
+  bool ok = m_fd >= 0 && fdatasync(m_fd) == 0;
+  if (ok) {
+    std::lock_guard<std::mutex> lock(m_mtx_stats);
+    ++m_stats.syncs;
+  }
+  m_last_sync = Clock::now();
+  return ok;
+}
+
+//_______________________________________________________________________________________________________
+void log_writer::resetJournal() {
+  if (!m_journal.isOpen())
+    return;
+  bool ok = m_journal.reset(m_segment, m_segment_bytes, m_iov.data(), (int) m_staged);
+  m_journal_unsynced = 0;
+  std::lock_guard<std::mutex> lock(m_mtx_stats);
+  if (ok)
+    ++m_stats.journal_syncs;
+  else
+    ++m_stats.errors;
+}
+
+//_______________________________________________________________________________________________________
+void log_writer::syncJournal() {
+  bool ok = m_journal.sync();
+  m_journal_unsynced = 0;
+  std::lock_guard<std::mutex> lock(m_mtx_stats);
+  if (ok)
+    ++m_stats.journal_syncs;
+  else
+    ++m_stats.errors;
+}
+
+//_______________________________________________________________________________________________________
+log_writer_stats log_writer::getStats() {
+  log_writer_stats stats;
+  {
+    std::lock_guard<std::mutex> lock(m_mtx_stats);
+    stats = m_stats;
+    stats.mean_write_ms = m_stats.batches > 0 ? (float) (m_write_ms_sum / m_stats.batches) : 0.0f;
+  }
+  stats.depth = m_arena->getCommitted();
+  stats.exhausted = m_arena->getExhausted();
+  return stats;
+}
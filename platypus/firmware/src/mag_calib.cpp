@@ -0,0 +1,248 @@
+/*
+* Streaming hard/soft-iron calibration of the magnetometer
+* fits x^T M x + 2 g^T x = 1 to the samples, the center is -M^-1 g, the soft-iron
+* matrix is sqrt(M) scaled to keep the volume of the ellipsoid
+*
+*/
+
+#include "./mag_calib.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+// samples are scaled by this before the fit [mGs], keeps the normal equations well conditioned
+#define MAG_CALIB_NORM 1000.0
+
+
+//_______________________________________________________________________________________________________
+// solves [a] x = [b] in place for symmetric positive definite [a] (upper triangle used)
+// returns false if [a] is not positive definite
+static bool cholesky(double* a, double* b, int n) {
+  // a = U^T U, U in the upper triangle
+  for (int i = 0; i < n; ++i) {
+    for (int j = i; j < n; ++j) {
+      double s = a[i*n + j];
+      for (int k = 0; k < i; ++k)
+        s -= a[k*n + i] * a[k*n + j];
+      if (i == j) {
+        if (s <= 1e-12 * fabs(a[i*n + i]) || s <= 0.0)
+          return false;
+        a[i*n + i] = sqrt(s);
+      } else {
+        a[i*n + j] = s / a[i*n + i];
+      }
+    }
+  }
+
+  // forward and back substitution
+  for (int i = 0; i < n; ++i) {
+    for (int k = 0; k < i; ++k)
+      b[i] -= a[k*n + i] * b[k];
+    b[i] /= a[i*n + i];
+  }
+  for (int i = n - 1; i >= 0; --i) {
+    for (int k = i + 1; k < n; ++k)
+      b[i] -= a[i*n + k] * b[k];
+    b[i] /= a[i*n + i];
+  }
+  return true;
+}
+
+//_______________________________________________________________________________________________________
+// eigen decomposition of the symmetric 3x3 matrix [a] by Jacobi rotations
+// [a] becomes diagonal (the eigenvalues), the columns of [v] are the eigenvectors
+static void jacobi3(double a[3][3], double v[3][3]) {
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 3; ++j)
+      v[i][j] = (i == j) ? 1.0 : 0.0;
+
+  for (int sweep = 0; sweep < 16; ++sweep) {
+    double off = fabs(a[0][1]) + fabs(a[0][2]) + fabs(a[1][2]);
+    if (off < 1e-15 * (fabs(a[0][0]) + fabs(a[1][1]) + fabs(a[2][2])))
+      break;
+
+    for (int p = 0; p < 2; ++p) {
+      for (int q = p + 1; q < 3; ++q) {
+        if (a[p][q] == 0.0)
+          continue;
+        double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+        double t = (theta >= 0.0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+        double c = 1.0 / sqrt(t * t + 1.0), s = t * c;
+
+        for (int k = 0; k < 3; ++k) {
+          double akp = a[k][p], akq = a[k][q];
+          a[k][p] = c * akp - s * akq;
+          a[k][q] = s * akp + c * akq;
+        }
+        for (int k = 0; k < 3; ++k) {
+          double apk = a[p][k], aqk = a[q][k];
+          a[p][k] = c * apk - s * aqk;
+          a[q][k] = s * apk + c * aqk;
+        }
+        for (int k = 0; k < 3; ++k) {
+          double vkp = v[k][p], vkq = v[k][q];
+          v[k][p] = c * vkp - s * vkq;
+          v[k][q] = s * vkp + c * vkq;
+        }
+      }
+    }
+  }
+}
+
+
+
+//_______________________________________________________________________________________________________
+mag_calib::mag_calib(float min_dist, double forget)
+ : m_min_dist(min_dist), m_forget(forget), m_field(0.0), m_valid(false)
+{
+  clear();
+  for (int i = 0; i < 3; ++i) {
+    m_offset[i] = 0.0;
+    for (int j = 0; j < 3; ++j)
+      m_matrix[3*i + j] = (i == j) ? 1.0 : 0.0;
+  }
+}
+
+//_______________________________________________________________________________________________________
+void mag_calib::clear() {
+  memset(m_ata, 0, sizeof(m_ata));
+  memset(m_atb, 0, sizeof(m_atb));
+  m_count = 0;
+}
+
+//_______________________________________________________________________________________________________
+bool mag_calib::add(float x, float y, float z) {
+  if (m_count > 0) {
+    float dx = x - m_last[0], dy = y - m_last[1], dz = z - m_last[2];
+    if (dx*dx + dy*dy + dz*dz < m_min_dist * m_min_dist)
+      return false;
+  }
+  m_last[0] = x;
+  m_last[1] = y;
+  m_last[2] = z;
+
+  double u = x / MAG_CALIB_NORM, v = y / MAG_CALIB_NORM, w = z / MAG_CALIB_NORM;
+  const int n = MAG_CALIB_PARAMS;
+  double d[n] = {u*u, v*v, w*w, 2.0*u*v, 2.0*u*w, 2.0*v*w, 2.0*u, 2.0*v, 2.0*w};
+
+  for (int i = 0; i < n; ++i) {
+    for (int j = i; j < n; ++j)
+      m_ata[i*n + j] = m_forget * m_ata[i*n + j] + d[i] * d[j];
+    m_atb[i] = m_forget * m_atb[i] + d[i];
+  }
+  ++m_count;
+  return true;
+}
+
+//_______________________________________________________________________________________________________
+bool mag_calib::fit() {
+  if (m_count < MAG_CALIB_MIN_SAMPLES)
+    return false;
+
+  double a[MAG_CALIB_PARAMS * MAG_CALIB_PARAMS], p[MAG_CALIB_PARAMS];
+  memcpy(a, m_ata, sizeof(a));
+  memcpy(p, m_atb, sizeof(p));
+  if (!cholesky(a, p, MAG_CALIB_PARAMS))
+    return false;
+
+  // x^T M x + 2 g^T x = 1
+  double M[3][3] = {{p[0], p[3], p[4]},
+                    {p[3], p[1], p[5]},
+                    {p[4], p[5], p[2]}};
+  double g[3] = {p[6], p[7], p[8]};
+
+  double lambda[3][3], V[3][3];
+  memcpy(lambda, M, sizeof(lambda));
+  jacobi3(lambda, V);
+  for (int i = 0; i < 3; ++i)
+    if (lambda[i][i] <= 0.0)
+      return false; // not an ellipsoid
+
+  // center c = -M^-1 g = -V diag(1/lambda) V^T g
+  double c[3] = {0.0, 0.0, 0.0};
+  for (int i = 0; i < 3; ++i) {
+    double t = 0.0;
+    for (int k = 0; k < 3; ++k)
+      t += V[k][i] * g[k];
+    t /= lambda[i][i];
+    for (int k = 0; k < 3; ++k)
+      c[k] -= V[k][i] * t;
+  }
+
+  // (x - c)^T M (x - c) = 1 + c^T M c = k
+  double k = 1.0;
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 3; ++j)
+      k += c[i] * M[i][j] * c[j];
+  if (k <= 0.0)
+    return false;
+
+  // semi-axes 1/sqrt(lambda/k), the sphere gets their geometric mean as radius
+  double det = lambda[0][0] * lambda[1][1] * lambda[2][2] / (k * k * k);
+  double field = pow(det, -1.0 / 6.0);
+
+  // matrix = field * V sqrt(diag(lambda/k)) V^T
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      double s = 0.0;
+      for (int n = 0; n < 3; ++n)
+        s += V[i][n] * sqrt(lambda[n][n] / k) * V[j][n];
+      m_matrix[3*i + j] = (float) (field * s);
+    }
+    m_offset[i] = (float) (c[i] * MAG_CALIB_NORM);
+  }
+  m_field = (float) (field * MAG_CALIB_NORM);
+  m_valid = true;
+  return true;
+}
+
+//_______________________________________________________________________________________________________
+void mag_calib::apply(float &x, float &y, float &z) {
+  float u = x - m_offset[0], v = y - m_offset[1], w = z - m_offset[2];
+  x = m_matrix[0] * u + m_matrix[1] * v + m_matrix[2] * w;
+  y = m_matrix[3] * u + m_matrix[4] * v + m_matrix[5] * w;
+  z = m_matrix[6] * u + m_matrix[7] * v + m_matrix[8] * w;
+}
+
+//_______________________________________________________________________________________________________
+bool mag_calib::save(const char* path) {
+  FILE* f = fopen(path, "w");
+  if (f == NULL)
+    return false;
+
+  fprintf(f, "magcalib 1\n");
+  fprintf(f, "offset %.9g %.9g %.9g\n", m_offset[0], m_offset[1], m_offset[2]);
+  fprintf(f, "matrix");
+  for (int i = 0; i < 9; ++i)
+    fprintf(f, " %.9g", m_matrix[i]);
+  fprintf(f, "\nfield %.9g\n", m_field);
+
+  bool ok = !ferror(f);
+  return (fclose(f) == 0) && ok;
+}
+
+//_______________________________________________________________________________________________________
+bool mag_calib::load(const char* path) {
+  FILE* f = fopen(path, "r");
+  if (f == NULL)
+    return false;
+
+  int version = 0;
+  float offset[3], matrix[9], field;
+  bool ok = fscanf(f, "magcalib %d", &version) == 1 && version == 1
+    && fscanf(f, " offset %f %f %f", &offset[0], &offset[1], &offset[2]) == 3
+    && fscanf(f, " matrix") == 0;
+  for (int i = 0; ok && i < 9; ++i)
+    ok = fscanf(f, "%f", &matrix[i]) == 1;
+  ok = ok && fscanf(f, " field %f", &field) == 1;
+  fclose(f);
+  if (!ok)
+    return false;
+
+  memcpy(m_offset, offset, sizeof(m_offset));
+  memcpy(m_matrix, matrix, sizeof(m_matrix));
+  m_field = field;
+  m_valid = true;
+  return true;
+}
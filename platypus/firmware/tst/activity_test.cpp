@@ -0,0 +1,106 @@
+/*
+* Host test: step counting and activity classification
+* a synthetic FIFO stream of a minute each still, walking, running and shaking, with the board
+* tilted, fed in blocks of one watermark; checks the per-minute summaries, the steps and the cost
+* build via build_sim.sh
+*
+*/
+
+#include <chrono>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+
+#include "imu_activity.h"
+#include "imu_convert.h"
+#include "check.h"
+
+#define RATE 25.0 // [Hz]
+#define BLOCK 25 // watermark
+#define RUNS 50
+
+// cadence [steps/s] and vertical amplitude [m/s^2] of each minute, shaking sideways
+#define WALK_CADENCE 1.8
+#define WALK_AMP 3.0
+#define RUN_CADENCE 2.8
+#define RUN_AMP 9.0
+#define SHAKE_FREQ 6.0
+#define SHAKE_AMP 12.0
+
+typedef std::chrono::steady_clock Clock;
+
+
+//_______________________________________________________________________________________________________
+float noise(float amp) {
+  return amp * (2.0 * rand() / (float) RAND_MAX - 1.0);
+}
+
+//_______________________________________________________________________________________________________
+void generate(std::vector<int16_t> &raw, imu_convert &conv) {
+  // gravity and the vertical motion along a tilted axis
+  const float up[3] = {0.0, 0.5, 0.866};
+  size_t n = (size_t) (4 * 60 * RATE);
+  for (size_t i = 0; i < n; ++i) {
+    double t = i / RATE;
+    int minute = (int) (t / 60.0);
+
+    float v = 9.807, side = 0.0;
+    if (minute == 1)
+      v += WALK_AMP * sin(2.0 * M_PI * WALK_CADENCE * t);
+    else if (minute == 2)
+      v += RUN_AMP * sin(2.0 * M_PI * RUN_CADENCE * t);
+    else if (minute == 3)
+      side = SHAKE_AMP * sin(2.0 * M_PI * SHAKE_FREQ * t);
+
+    float a[3] = {side + noise(0.1), v * up[1] + noise(0.1), v * up[2] + noise(0.1)};
+    for (int j = 0; j < 3; ++j)
+      raw.push_back((int16_t) lround(a[j] / conv.getAccelScale()));
+    for (int j = 0; j < 3; ++j)
+      raw.push_back((int16_t) lround(noise(1.0) / conv.getGyroScale()));
+  }
+}
+
+
+//_______________________________________________________________________________________________________
+int main(int argc, char** argv) {
+  imu_convert conv;
+  imu_activity act(RATE);
+  srand(1);
+
+  std::vector<int16_t> raw;
+  generate(raw, conv);
+  size_t n = raw.size() / 6;
+
+  std::vector<imu_activity_summary> minutes;
+  for (size_t i = 0; i < n; i += BLOCK) {
+    size_t len = (n - i < BLOCK) ? n - i : BLOCK;
+    act.update(&raw[6 * i], len);
+    imu_activity_summary s;
+    if (act.getSummary(s)) {
+      minutes.push_back(s);
+      printf("       minute %u: %-7s %3u steps, windows %u still, %u walking, %u running, %u shaking\n",
+        s.minute, imu_activity::name(s.activity), s.steps, s.windows[0], s.windows[1], s.windows[2], s.windows[3]);
+    }
+  }
+
+  check(minutes.size() == 4, "one summary per minute");
+  if (minutes.size() != 4)
+    return 1;
+  check(minutes[0].activity == Activity::STILL && minutes[0].steps == 0, "still");
+  check(minutes[1].activity == Activity::WALKING && fabs(minutes[1].steps - 60 * WALK_CADENCE) <= 4, "walking steps");
+  check(minutes[2].activity == Activity::RUNNING && fabs(minutes[2].steps - 60 * RUN_CADENCE) <= 4, "running steps");
+  check(minutes[3].activity == Activity::SHAKING && minutes[3].steps == 0, "shaking is no steps");
+  check(act.getSteps() == minutes[1].steps + minutes[2].steps, "total steps");
+
+  // cost of one pass, the state is a few scalars whatever the length
+  Clock::time_point t0 = Clock::now();
+  for (int r = 0; r < RUNS; ++r) {
+    act.reset();
+    act.update(&raw[0], n);
+  }
+  double ns = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / (RUNS * n);
+  printf("       %.1f ns/sample, %lu bytes of state\n", ns, sizeof(imu_activity));
+
+  return m_failed ? 1 : 0;
+}
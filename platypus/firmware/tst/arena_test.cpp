@@ -0,0 +1,179 @@
+/*
+* Host test: page arena of the sample log
+* pages as datalog.h reads them, the header reserved when a page is begun, a bounded number of
+* pages, the order of the pages through a writer thread, and the cost per sample against the
+* growing byte vector with a modulo test the logger used before
+* build via build_sim.sh
+*
+*/
+
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <string.h>
+#include <stdio.h>
+
+#include "log_arena.h"
+#include "datalog.h"
+#include "check.h"
+
+#define LOG_FILE "/tmp/arena_test.bin"
+#define SAMPLES 2000 // 3 full pages and a partial one
+#define THREADED 2000000 // samples through a writer thread
+#define BLOCK 25 // samples per FIFO block
+
+typedef std::chrono::steady_clock Clock;
+
+
+//_______________________________________________________________________________________________________
+// [n] samples from sample [k] on, every value tells its sample and channel
+void samples(uint64_t k, size_t n, int16_t* raw) {
+  for (size_t i = 0; i < n; ++i)
+    for (int c = 0; c < 6; ++c)
+      raw[6 * i + c] = (int16_t) (((k + i) * 6 + c) & 0xFFFF);
+}
+
+//_______________________________________________________________________________________________________
+// appends [n] samples to [page] of [arena], begins and commits pages as the logger does
+// returns the number of samples left over for lack of pages
+size_t log(log_arena &arena, log_page* &page, const int16_t* raw, size_t n) {
+  while (n > 0) {
+    if (page == NULL) {
+      page = arena.begin();
+      if (page == NULL)
+        return n;
+      memset(page->header(), 0xA5, LOG_HEADER_SIZE);
+    }
+    size_t k = page->append(raw, n);
+    raw += 6 * k;
+    n -= k;
+    if (page->isFull()) {
+      arena.commit(page);
+      page = NULL;
+    }
+  }
+  return 0;
+}
+
+
+//_______________________________________________________________________________________________________
+int main(int argc, char** argv) {
+  check(LOG_PAGE_SIZE == DATALOG_HEADER_SIZE + DATALOG_PAGE_SAMPLES * DATALOG_SAMPLE_SIZE, "page size as the readers expect");
+
+  // pages written to a file, read back as a datalog
+  {
+    log_arena arena(8);
+    log_page* page = NULL;
+    std::vector<int16_t> raw(6 * SAMPLES);
+    samples(0, SAMPLES, raw.data());
+    for (size_t i = 0; i < SAMPLES; i += BLOCK)
+      log(arena, page, &raw[6 * i], BLOCK);
+    check(arena.getCommitted() == 3 && page != NULL && page->getSamples() == SAMPLES - 3 * LOG_PAGE_SAMPLES,
+      "full pages committed, the last one open");
+    arena.commit(page);
+    check(arena.getBytes() == 3 * LOG_PAGE_SIZE + LOG_HEADER_SIZE + (SAMPLES - 3 * LOG_PAGE_SAMPLES) * LOG_SAMPLE_SIZE,
+      "bytes waiting for the writer");
+
+    FILE* file = fopen(LOG_FILE, "wb");
+    bool headers = true;
+    while ((page = arena.take()) != NULL) {
+      headers = headers && page->header()[0] == 0xA5 && page->header()[LOG_HEADER_SIZE - 1] == 0xA5;
+      fwrite(page->data, 1, page->size, file);
+      arena.release(page);
+    }
+    fclose(file);
+    std::vector<int16_t> back;
+    size_t n = readDatalog(LOG_FILE, back);
+    remove(LOG_FILE);
+    check(headers && n == SAMPLES && back == raw, "headers reserved, samples read back");
+  }
+
+  // bounded: without a free page the IMU thread gets none until the writer returns one
+  {
+    log_arena arena(4);
+    std::vector<log_page*> pages;
+    log_page* page;
+    while ((page = arena.begin()) != NULL)
+      pages.push_back(page);
+    check(pages.size() == 4 && arena.begin() == NULL, "no more pages than allocated");
+    arena.commit(pages[0]);
+    arena.release(arena.take());
+    check(arena.begin() == pages[0] && pages[0]->size == LOG_HEADER_SIZE, "written page back in use");
+  }
+
+  // IMU thread against a writer thread
+  {
+    log_arena arena(16);
+    std::atomic<bool> running(true);
+    size_t stalls = 0, written = 0;
+    bool ordered = true;
+    std::thread writer([&]() {
+      uint64_t k = 0;
+      while (true) {
+        bool more = running;
+        log_page* page = arena.take();
+        if (page == NULL) {
+          if (!more)
+            break;
+          std::this_thread::yield();
+          continue;
+        }
+        // the first value of every page continues the last one
+        int16_t first = (int16_t) ((page->data[LOG_HEADER_SIZE] << 8) | page->data[LOG_HEADER_SIZE + 1]);
+        ordered = ordered && first == (int16_t) ((k * 6) & 0xFFFF);
+        k += page->getSamples();
+        written += page->getSamples();
+        arena.release(page);
+      }
+    });
+    log_page* page = NULL;
+    std::vector<int16_t> raw(6 * BLOCK);
+    for (uint64_t k = 0; k < THREADED; k += BLOCK) {
+      samples(k, BLOCK, raw.data());
+      // the writer falls behind at times, the rest of the block waits for a page
+      size_t left = BLOCK;
+      while ((left = log(arena, page, &raw[6 * (BLOCK - left)], left)) > 0) {
+        ++stalls;
+        std::this_thread::yield();
+      }
+    }
+    if (page != NULL)
+      arena.commit(page);
+    running = false;
+    writer.join();
+    printf("       %d samples through %lu pages, the IMU thread found no page %lu times\n",
+      THREADED, arena.getPages(), stalls);
+    check(written == THREADED && ordered, "pages in order through the writer");
+  }
+
+  // cost per sample: arena page against the vector of the logger before
+  {
+    const int loops = 200;
+    std::vector<int16_t> raw(6 * LOG_PAGE_SAMPLES);
+    samples(0, LOG_PAGE_SAMPLES, raw.data());
+    log_arena arena(loops);
+    log_page* page = NULL;
+    Clock::time_point t0 = Clock::now();
+    for (int i = 0; i < loops; ++i)
+      log(arena, page, raw.data(), LOG_PAGE_SAMPLES);
+    double pages = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / (loops * LOG_PAGE_SAMPLES);
+
+    std::vector<uint8_t> memory;
+    t0 = Clock::now();
+    for (int i = 0; i < loops; ++i) {
+      for (size_t j = 0; j < raw.size(); ++j) {
+        if (memory.size() % LOG_PAGE_SIZE == 0)
+          memory.insert(memory.end(), LOG_HEADER_SIZE, 0xA5);
+        memory.push_back((raw[j] & 0xFF00) >> 8);
+        memory.push_back(raw[j] & 0xFF);
+      }
+    }
+    double vector = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / (loops * LOG_PAGE_SAMPLES);
+    printf("       %.1f ns/sample into pages, %.1f ns/sample into a growing vector (%.1f MB)\n",
+      pages, vector, memory.size() / 1e6);
+    check(arena.getBytes() == memory.size(), "same bytes either way");
+  }
+
+  return m_failed ? 1 : 0;
+}
@@ -0,0 +1,99 @@
+/*
+* Host test: sampling plan of the auxiliary I2C slaves
+* plans for sample rates from 25Hz to 1kHz against the fixed setup before (compass read every
+* sample in its 100Hz mode), the registers imu_edison writes at setup and when the rates change,
+* and the compass data found behind the BME data or at the start of EXT_SENS_DATA
+* build via build_sim.sh
+*
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "imu_aux.h"
+#include "imu_edison.h"
+#include "bme_comp.h"
+#include "sim/mpu_sim.h"
+#include "check.h"
+
+
+//_______________________________________________________________________________________________________
+bool near(float a, float b) {
+  return fabs(a - b) < 1e-3 * b;
+}
+
+
+//_______________________________________________________________________________________________________
+int main(int argc, char** argv) {
+  const float weather = bme_comp::getRate(BME_PROFILE_WEATHER);
+  const float breath = bme_comp::getRate(BME_PROFILE_BREATH);
+
+  // the default at 25Hz is the setup as it was: compass every sample, BME once a second
+  imu_aux_plan p = imu_aux::plan(25.0, IMU_AUX_ODR, IMU_AUX_ODR, weather);
+  check(p.smplrt_div == 0x27 && p.mag_mode == IMU_AUX_MAG_100HZ && p.mag_div == 1 && p.mst_dly == 0x18 &&
+    p.delay_ctrl == (IMU_AUX_ES_SHADOW | IMU_AUX_SLV0_DLY) && p.env_len == 8 && p.mag_len == 7 && p.mag_offset == 8,
+    "25Hz default as before");
+
+  // raising the sample rate keeps the slaves at their rates
+  printf("       rate    compass          BME              aux bus   fixed setup\n");
+  const float rates[4] = {25.0, 100.0, 200.0, 1000.0};
+  bool at_rate = true, less = true;
+  for (int i = 0; i < 4; ++i) {
+    p = imu_aux::plan(rates[i], 8.0, IMU_AUX_ODR, weather);
+    // compass every sample, BME as before limited by the 5 bit delay
+    float fixed = p.sample_rate * (7 + 3) + p.sample_rate / (p.sample_rate / weather > 32 ? 32 : floor(p.sample_rate / weather)) * (8 + 3);
+    printf("       %6.1f  %6.2fHz (%2d)   %6.2fHz (%2d)   %5.0f B/s %6.0f B/s\n",
+      p.sample_rate, p.mag_rate, p.mag_div, p.env_rate, p.env_div, p.bus_load, fixed);
+    at_rate = at_rate && near(p.sample_rate, rates[i]) && p.mag_rate >= 8.0 && p.env_rate >= weather;
+    if (rates[i] > 25.0)
+      less = less && p.bus_load < fixed / 2;
+  }
+  check(at_rate, "sample rates met, the slaves read at least at their rates");
+  check(less, "less than half the aux bus load of the fixed setup above 25Hz");
+
+  // one delay for both: the faster one sets it
+  p = imu_aux::plan(200.0, 8.0, IMU_AUX_ODR, breath);
+  check(p.mag_div == 15 && p.env_div == 15 && p.mst_dly == 14 &&
+    p.delay_ctrl == (IMU_AUX_ES_SHADOW | IMU_AUX_SLV0_DLY | IMU_AUX_SLV1_DLY), "shared delay from the faster slave");
+  // the 5 bit delay limits how far a slave is divided down
+  p = imu_aux::plan(1000.0, 0.0, IMU_AUX_ODR, weather);
+  check(p.mst_dly == IMU_AUX_MAX_DLY && near(p.env_rate, 1000.0 / 32) && p.mag_len == 0 && p.mag_mode == 0x00,
+    "delay limited to 32 samples, compass off");
+  // a slave faster than the sample rate is read every sample
+  p = imu_aux::plan(10.0, 100.0, 0.0, weather);
+  check(p.mag_div == 1 && near(p.mag_rate, 10.0) && p.env_len == 0 && p.mag_offset == 0 && p.delay_ctrl == 0,
+    "compass every sample, BME off, no delay");
+
+  // registers, compass only
+  mpu_sim mpu;
+  imu_edison imu;
+  imu.setSampleRates(100.0, 8.0);
+  imu.setupIMU();
+  check(mpu.m_reg[MPU_SMPLRT_DIV] == 9 && mpu.m_reg[MPU_I2C_SLV0_CTRL] == 0x00 && mpu.m_reg[MPU_I2C_SLV1_CTRL] == 0x87 &&
+    mpu.m_reg[MPU_I2C_SLV4_CTRL] == 11 && mpu.m_reg[MPU_I2C_MST_DELAY_CTRL] == (IMU_AUX_ES_SHADOW | IMU_AUX_SLV1_DLY) &&
+    imu.getSampleRate() == 100.0, "registers written by setupIMU()");
+
+  // without the BME the compass data starts at EXT_SENS_DATA_00
+  const uint8_t mag[7] = {0x34, 0x12, 0x78, 0x56, 0xBC, 0x9A, 0x00};
+  for (int i = 0; i < 7; ++i)
+    mpu.m_reg[MPU_EXT_SENS_DATA_00 + i] = mag[i];
+  int16_t x, y, z;
+  imu.getCompassData(x, y, z);
+  check(x == 0x1234 && y == 0x5678 && z == (int16_t) 0x9ABC, "compass data at its offset");
+
+  // at runtime, the compass mode is changed through slave 4 from power down
+  mpu.m_slave_writes.clear();
+  p = imu.setSampleRates(200.0, 100.0);
+  check(mpu.m_slave_writes.size() == 2 && mpu.m_slave_writes[0].addr == COMPASS_I2C_ADDR &&
+    mpu.m_slave_writes[0].reg == COMPASS_CNTL && mpu.m_slave_writes[0].data == 0x00 &&
+    mpu.m_slave_writes[1].data == IMU_AUX_MAG_100HZ, "compass mode changed through slave 4");
+  check(mpu.m_reg[MPU_SMPLRT_DIV] == 4 && mpu.m_reg[MPU_I2C_SLV4_CTRL] == 1 && p.mag_div == 2 && near(p.mag_rate, 100.0) &&
+    imu.getESDelay() == 1, "new rates applied");
+  mpu.m_slave_writes.clear();
+  imu.setSampleRates(50.0, 100.0);
+  check(mpu.m_slave_writes.empty() && mpu.m_reg[MPU_SMPLRT_DIV] == 19 && mpu.m_reg[MPU_I2C_MST_DELAY_CTRL] == 0x00,
+    "same compass mode, no delay at 50Hz");
+
+  return m_failed ? 1 : 0;
+}
@@ -0,0 +1,119 @@
+/*
+* Host test: online gyro bias estimation
+* a synthetic FIFO stream alternates between rest and motion with a constant gyro bias,
+* checks the stillness detection, the estimated bias and its removal in imu_convert
+* build via build_sim.sh
+*
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+
+#include "imu_bias.h"
+#include "imu_convert.h"
+#include "check.h"
+
+#define RATE 25.0 // [Hz]
+#define BLOCK 42 // full FIFO
+
+
+// true gyro bias [deg/s]
+static const float BIAS[3] = {0.8, -1.5, 0.35};
+
+//_______________________________________________________________________________________________________
+float noise(float amp) {
+  return amp * (2.0 * rand() / (float) RAND_MAX - 1.0);
+}
+
+//_______________________________________________________________________________________________________
+// [seconds] of raw samples, at rest or shaking
+void generate(std::vector<int16_t> &raw, float seconds, bool moving, imu_convert &conv) {
+  size_t n = (size_t) (seconds * RATE);
+  for (size_t i = 0; i < n; ++i) {
+    float t = i / RATE;
+    float a[3] = {noise(0.05), noise(0.05), 9.807f + noise(0.05)};
+    float w[3] = {BIAS[0] + noise(0.1), BIAS[1] + noise(0.1), BIAS[2] + noise(0.1)};
+    if (moving) {
+      a[0] += 3.0 * sin(7.0 * t);
+      w[1] += 40.0 * cos(3.0 * t);
+    }
+    for (int j = 0; j < 3; ++j)
+      raw.push_back((int16_t) lround(a[j] / conv.getAccelScale()));
+    for (int j = 0; j < 3; ++j)
+      raw.push_back((int16_t) lround(w[j] / conv.getGyroScale()));
+  }
+}
+
+
+//_______________________________________________________________________________________________________
+int main(int argc, char** argv) {
+  imu_convert conv;
+  imu_bias bias;
+  srand(1);
+
+  // moving from power on, then at rest, moving again, at rest
+  std::vector<int16_t> raw;
+  generate(raw, 10.0, true, conv);
+  size_t rest1 = raw.size() / 6;
+  generate(raw, 20.0, false, conv);
+  size_t move2 = raw.size() / 6;
+  generate(raw, 10.0, true, conv);
+  size_t rest2 = raw.size() / 6;
+  generate(raw, 20.0, false, conv);
+  size_t n = raw.size() / 6;
+
+  // feed FIFO blocks, the state is checked at the end of every block
+  int wrong = 0, blocks = 0;
+  bool early = false;
+  for (size_t i = 0; i < n; i += BLOCK) {
+    size_t len = (n - i < BLOCK) ? n - i : BLOCK;
+    bias.update(&raw[6 * i], len);
+
+    // the window needs to be completely inside a phase
+    size_t end = i + len;
+    bool at_rest = (end >= rest1 + BLOCK && end < move2) || end >= rest2 + BLOCK;
+    bool moving = end < rest1 || (end >= move2 + BLOCK && end < rest2);
+    if ((at_rest && !bias.isStill()) || (moving && bias.isStill()))
+      ++wrong;
+    ++blocks;
+    early = early || (end < rest1 && bias.isValid());
+  }
+  check(!early, "no bias estimated while moving");
+  printf("       %d of %d blocks with a wrong rest state, %zu windows at rest\n", wrong, blocks, bias.getStillCount());
+
+  float err = 0.0;
+  for (int j = 0; j < 3; ++j) {
+    float b = bias.getBias()[j] * conv.getGyroScale();
+    printf("       axis %d: %6.3f deg/s (true %6.3f)\n", j, b, BIAS[j]);
+    err = fabs(b - BIAS[j]) > err ? fabs(b - BIAS[j]) : err;
+  }
+  check(wrong == 0, "rest detected in every block");
+  check(bias.isValid() && err < 0.05, "bias estimated within 0.05 deg/s");
+
+  // bias removed in the conversion, SIMD and scalar agree
+  conv.setGyroBias(bias.getBias());
+  size_t len = n - rest2;
+  std::vector<float> buf(12 * len);
+  imu_soa out = {{&buf[0], &buf[len], &buf[2 * len]}, {&buf[3 * len], &buf[4 * len], &buf[5 * len]}};
+  imu_soa out_scalar = {{&buf[6 * len], &buf[7 * len], &buf[8 * len]}, {&buf[9 * len], &buf[10 * len], &buf[11 * len]}};
+  conv.convert(&raw[6 * rest2], len, out);
+  conv.convertScalar(&raw[6 * rest2], len, out_scalar);
+  bool same = true;
+  for (size_t i = 0; i < 6 * len; ++i)
+    same = same && buf[i] == buf[6 * len + i];
+  check(same, "SIMD and scalar conversion agree");
+  bool removed = true;
+  for (int j = 0; j < 3; ++j) {
+    double mean = 0.0;
+    for (size_t i = 0; i < len; ++i)
+      mean += out.gyro[j][i];
+    mean /= len;
+    printf("       axis %d at rest after correction: %6.3f deg/s\n", j, mean);
+    removed = removed && fabs(mean) < 0.05;
+  }
+  check(removed, "bias removed in the conversion");
+
+  return m_failed ? 1 : 0;
+}
@@ -0,0 +1,158 @@
+/*
+* Host test: biquad filter bank
+* the Butterworth cutoffs of low-pass, high-pass and band-pass cascades, sines through the filter
+* against the designed gain, SSE against scalar, FIFO blocks against one pass, the steady state
+* from the first sample, and the on-chip DLPF as imu_edison::setBandwidth() selects it
+* build via build_sim.sh
+*
+*/
+
+#include <chrono>
+#include <vector>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "mpu_sim.h"
+#include "imu_edison.h"
+#include "imu_filter.h"
+#include "check.h"
+
+#define RATE 100.0 // [Hz]
+#define BLOCK 37 // samples per FIFO block
+#define AMP 4000.0 // [LSB]
+
+typedef std::chrono::steady_clock Clock;
+
+
+//_______________________________________________________________________________________________________
+// [n] samples of a sine at [hz] on all six channels around [offset], the phase differs per channel
+std::vector<int16_t> sine(size_t n, double hz, double offset = 0.0) {
+  std::vector<int16_t> raw(6 * n);
+  for (size_t i = 0; i < n; ++i)
+    for (int c = 0; c < 6; ++c)
+      raw[6 * i + c] = (int16_t) lround(offset + AMP * sin(2.0 * M_PI * hz * i / RATE + c));
+  return raw;
+}
+
+//_______________________________________________________________________________________________________
+// largest deviation from [offset] of channel [c] from sample [from] on
+double amplitude(const std::vector<int16_t> &raw, int c, size_t from, double offset = 0.0) {
+  double a = 0.0;
+  for (size_t i = from; i < raw.size() / 6; ++i)
+    a = fabs(raw[6 * i + c] - offset) > a ? fabs(raw[6 * i + c] - offset) : a;
+  return a;
+}
+
+
+//_______________________________________________________________________________________________________
+int main(int argc, char** argv) {
+  // cutoffs at -3dB, the band-pass flat in between
+  {
+    imu_filter lp(RATE), hp(RATE), bp(RATE);
+    bool ok = lp.design(Filter::LOWPASS, 5.0, 0.0, 4) && hp.design(Filter::HIGHPASS, 0.5, 0.0, 2) &&
+      bp.design(Filter::BANDPASS, 0.5, 5.0, 2);
+    printf("       low-pass 5Hz 4th order: %.3f at 5Hz, %.4f at 20Hz; high-pass 0.5Hz: %.3f at 0.5Hz, %.4f at 0.05Hz\n",
+      lp.response(5.0), lp.response(20.0), hp.response(0.5), hp.response(0.05));
+    printf("       band-pass 0.5-5Hz: %.3f at 0.5Hz, %.3f at 1.6Hz, %.3f at 5Hz\n",
+      bp.response(0.5), bp.response(1.6), bp.response(5.0));
+    check(ok && lp.getSections() == 2 && hp.getSections() == 1 && bp.getSections() == 2, "cascades designed");
+    check(fabs(lp.response(5.0) - M_SQRT1_2) < 1e-3 && fabs(hp.response(0.5) - M_SQRT1_2) < 1e-3 &&
+      lp.response(20.0) < 0.01 && hp.response(0.05) < 0.02, "Butterworth cutoffs");
+    check(fabs(bp.response(1.6) - 1.0) < 0.05 && bp.response(0.1) < 0.05 && bp.response(20.0) < 0.1, "band-pass");
+    check(!lp.design(Filter::LOWPASS, 60.0) && !lp.design(Filter::LOWPASS, 5.0, 0.0, 3) &&
+      !lp.design(Filter::BANDPASS, 0.5, 5.0, 6) && lp.getSections() == 2, "invalid designs refused");
+  }
+
+  // sines through the filter, in FIFO blocks, SSE against scalar
+  {
+    const double freqs[4] = {1.0, 5.0, 10.0, 25.0};
+    bool gain = true, same = true, blocks = true;
+    for (int f = 0; f < 4; ++f) {
+      std::vector<int16_t> raw = sine(2000, freqs[f]);
+      imu_filter simd(RATE), scalar(RATE), whole(RATE);
+      simd.design(Filter::LOWPASS, 5.0, 0.0, 4);
+      scalar.design(Filter::LOWPASS, 5.0, 0.0, 4);
+      whole.design(Filter::LOWPASS, 5.0, 0.0, 4);
+
+      std::vector<int16_t> a(raw.size()), b(raw.size()), w(raw.size());
+      for (size_t i = 0; i < raw.size() / 6; i += BLOCK) {
+        size_t n = raw.size() / 6 - i < BLOCK ? raw.size() / 6 - i : BLOCK;
+        simd.filter(&raw[6 * i], n, &a[6 * i]);
+        scalar.filterScalar(&raw[6 * i], n, &b[6 * i]);
+      }
+      whole.filter(raw.data(), raw.size() / 6, w.data());
+      same = same && a == b;
+      blocks = blocks && a == w;
+
+      // settled after a second
+      for (int c = 0; c < 6; ++c) {
+        double expect = AMP * simd.response(freqs[f]);
+        gain = gain && fabs(amplitude(a, c, 100) - expect) < 0.01 * AMP;
+      }
+      printf("       %4.1fHz: amplitude %5.0f, designed %5.0f [LSB]\n",
+        freqs[f], amplitude(a, 0, 100), AMP * simd.response(freqs[f]));
+    }
+    check(gain, "amplitudes as designed");
+    check(same, "SSE as scalar");
+    check(blocks, "blocks as one pass");
+  }
+
+  // steady state from the first sample, no step from zero; in place
+  {
+    std::vector<int16_t> raw(6 * 200);
+    for (size_t i = 0; i < raw.size(); ++i)
+      raw[i] = (i % 6) == 2 ? 8192 : -120;
+    imu_filter lp(RATE), hp(RATE);
+    lp.design(Filter::LOWPASS, 2.0, 0.0, 8);
+    hp.design(Filter::HIGHPASS, 0.5);
+    std::vector<int16_t> low = raw, high(raw.size());
+    lp.filter(low.data(), low.size() / 6, low.data());
+    hp.filter(raw.data(), raw.size() / 6, high.data());
+    bool steady = true;
+    for (size_t i = 0; i < raw.size(); ++i)
+      steady = steady && abs(low[i] - raw[i]) <= 1 && abs(high[i]) <= 1;
+    check(steady, "at rest from the first sample, also in place");
+
+    imu_filter none(RATE);
+    std::vector<int16_t> copy(raw.size());
+    none.filter(raw.data(), raw.size() / 6, copy.data());
+    check(copy == raw && none.getType() == Filter::NONE, "no design passes through");
+  }
+
+  // cost per sample, 8th order on six channels
+  {
+    std::vector<int16_t> raw = sine(BLOCK, 3.0), out(raw.size());
+    imu_filter f(RATE);
+    f.design(Filter::BANDPASS, 0.5, 5.0, 4);
+    const int loops = 50000;
+    Clock::time_point t0 = Clock::now();
+    for (int i = 0; i < loops; ++i)
+      f.filter(raw.data(), BLOCK, out.data());
+    double simd = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / (loops * BLOCK);
+    t0 = Clock::now();
+    for (int i = 0; i < loops; ++i)
+      f.filterScalar(raw.data(), BLOCK, out.data());
+    double scalar = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / (loops * BLOCK);
+    printf("       %s, %lu sections, 6 channels: %.1f ns/sample SSE, %.1f ns/sample scalar\n",
+      imu_filter::name(f.getType()), f.getSections(), simd, scalar);
+  }
+
+  // on-chip DLPF
+  {
+    mpu_sim mpu;
+    imu_edison imu;
+    imu.setupIMU();
+    check(mpu.m_reg[MPU_CONFIG] == 0x06 && mpu.m_reg[MPU_ACCEL_CONFIG_2] == 0x00, "DLPF as before by default");
+    float hz = imu.setBandwidth(RATE / 2);
+    check(hz == 41.0 && mpu.m_reg[MPU_CONFIG] == 0x03 && mpu.m_reg[MPU_ACCEL_CONFIG_2] == 0x03,
+      "widest DLPF below the Nyquist frequency");
+    check(imu.setBandwidth(1000.0) == 184.0 && imu.setBandwidth(1.0) == 5.0 && imu.setBandwidth(12.5) == 10.0,
+      "DLPF limits");
+    imu.lowPower(true);
+    imu.lowPower(false);
+    check(mpu.m_reg[MPU_ACCEL_CONFIG_2] == 0x05, "accel DLPF back after the low-power mode");
+  }
+
+  return m_failed ? 1 : 0;
+}
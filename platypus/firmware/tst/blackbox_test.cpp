@@ -0,0 +1,200 @@
+/*
+* Host test: pre-trigger black box
+* an impact in a 200Hz stream fires the threshold, the event record holds the windows before and
+* after it with the trigger time from the block stamps; events collected late lose their oldest
+* samples, gesture triggers point back into the last block, records survive a save/load round
+* trip; a producer, a trigger and a collector thread run against each other without locks
+* build via build_sim.sh
+*
+*/
+
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "imu_blackbox.h"
+#include "imu_gesture.h"
+#include "check.h"
+
+#define RATE 200.0 // [Hz]
+#define PRE 1.0 // [s]
+#define POST 0.5 // [s]
+#define BLOCK 31 // samples per FIFO block at this rate
+#define ONE_G 8192 // [LSB] at AFS_SEL 1
+#define RECORD_FILE "/tmp/blackbox_test.bin"
+#define THREADED 300000 // samples pushed against the collector, a block every 20us
+
+typedef std::chrono::steady_clock Clock;
+
+
+//_______________________________________________________________________________________________________
+// at rest, with the sample index in the gyro values so records can be checked for gaps
+void sample(uint64_t k, int16_t* s, bool impact = false) {
+  s[0] = impact ? 3 * ONE_G : 0;
+  s[1] = 0;
+  s[2] = ONE_G;
+  s[3] = k & 0x7FFF;
+  s[4] = (k >> 15) & 0x7FFF;
+  s[5] = 0;
+}
+
+//_______________________________________________________________________________________________________
+uint64_t marker(const int16_t* s) {
+  return (uint64_t) s[3] | ((uint64_t) s[4] << 15);
+}
+
+//_______________________________________________________________________________________________________
+// record holds consecutive samples from [first] on, as many as the header says
+bool consecutive(const imu_blackbox_header &h, const std::vector<int16_t> &data, uint64_t first) {
+  if (data.size() != ((size_t) h.pre + h.post) * IMU_BLACKBOX_VALUES)
+    return false;
+  for (size_t i = 0; i < data.size() / IMU_BLACKBOX_VALUES; ++i)
+    if (marker(&data[i * IMU_BLACKBOX_VALUES]) != first + i)
+      return false;
+  return true;
+}
+
+//_______________________________________________________________________________________________________
+// pushes samples [k, k + n), impacts at [impact_a] and [impact_b], returns push()
+bool block(imu_blackbox &box, uint64_t k, size_t n, uint64_t impact_a = 0, uint64_t impact_b = 0) {
+  std::vector<int16_t> raw(n * IMU_BLACKBOX_VALUES);
+  for (size_t i = 0; i < n; ++i)
+    sample(k + i, &raw[i * IMU_BLACKBOX_VALUES], k + i == impact_a || k + i == impact_b);
+
+  imu_block_time t;
+  t.first = 1000000000LL + (int64_t) (k * 1e9 / RATE);
+  t.period = 1e9 / RATE;
+  t.drain = t.first + (int64_t) (n * t.period);
+  t.n = n;
+  return box.push(raw.data(), n, &t);
+}
+
+
+//_______________________________________________________________________________________________________
+int main(int argc, char** argv) {
+  imu_blackbox box(RATE, PRE, POST);
+  box.setThreshold(3.0);
+  imu_blackbox_header h;
+  std::vector<int16_t> data;
+  check(!box.trigger(Trigger::MANUAL), "no trigger before the first sample");
+
+  // impact, a second one within the post window is part of the same event
+  uint64_t k = 0;
+  int complete = 0;
+  while (k < 10 * RATE) {
+    if (block(box, k, BLOCK, 1000, 1040)) {
+      ++complete;
+      check(k + BLOCK >= 1000 + box.getPost() && k < 1000 + box.getPost(), "complete with the post window");
+      check(box.collect(h, data), "event collected");
+    }
+    k += BLOCK;
+  }
+  check(complete == 1 && box.getEvents() == 1 && box.getMerged() == 1, "one event, the second impact merged");
+  check(h.cause == (uint8_t) Trigger::THRESHOLD && h.index == 1000 && h.pre == PRE * RATE && h.post == POST * RATE &&
+    h.lost == 0, "windows before and after the impact");
+  check(consecutive(h, data, 1000 - h.pre) && data[h.pre * IMU_BLACKBOX_VALUES] == 3 * ONE_G, "record without gaps");
+  check(llabs(h.time - (1000000000LL + (int64_t) (1000 * 1e9 / RATE))) < 1000, "trigger time from the block stamps");
+  check(!box.collect(h, data), "nothing left to collect");
+
+  // collected late: the oldest samples are overwritten, the rest is kept
+  uint64_t impact = k + 400;
+  bool done = false;
+  while (!done)
+    done = block(box, k, BLOCK, impact), k += BLOCK;
+  uint64_t start = impact - box.getPre();
+  while (k < start + box.getCapacity() + 50)
+    block(box, k, BLOCK), k += BLOCK;
+  check(box.collect(h, data) && h.lost == k - box.getCapacity() - start && h.pre == box.getPre() - h.lost &&
+    consecutive(h, data, start + h.lost), "late collect drops the overwritten samples");
+
+  // a tap found by imu_gesture at sample 5 of the last block
+  uint64_t tap = k + 5;
+  block(box, k, BLOCK);
+  k += BLOCK;
+  check(box.trigger(Trigger::GESTURE, (uint8_t) Gesture::TAP, BLOCK - 1 - 5) && !box.trigger(Trigger::WOM),
+    "gesture trigger taken, a WoM right after it merged");
+  while (!block(box, k, BLOCK))
+    k += BLOCK;
+  k += BLOCK;
+  check(box.collect(h, data) && h.cause == (uint8_t) Trigger::GESTURE && h.detail == (uint8_t) Gesture::TAP &&
+    h.index == tap && consecutive(h, data, tap - h.pre), "gesture record around the tap");
+
+  // record file
+  bool saved = imu_blackbox::save(RECORD_FILE, h, data);
+  imu_blackbox_header h2;
+  std::vector<int16_t> data2;
+  bool loaded = imu_blackbox::load(RECORD_FILE, h2, data2);
+  FILE* file = fopen(RECORD_FILE, "rb");
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fclose(file);
+  remove(RECORD_FILE);
+  printf("       event record %ld B for %.1fs at %.0fHz, continuous logging at that rate %.0f B/min\n",
+    size, PRE + POST, RATE, RATE * 60 * IMU_BLACKBOX_VALUES * sizeof(int16_t));
+  check(saved && loaded && data2 == data && h2.index == h.index && h2.time == h.time && h2.cause == h.cause &&
+    size == (long) (sizeof(h) + data.size() * sizeof(int16_t)), "record saved and loaded");
+  check(!imu_blackbox::load("does/not/exist.bin", h2, data2), "missing record file");
+
+  // cost of a push at this rate
+  imu_blackbox bench(RATE, PRE, POST);
+  bench.setThreshold(3.0);
+  std::vector<int16_t> raw(BLOCK * IMU_BLACKBOX_VALUES);
+  for (size_t i = 0; i < BLOCK; ++i)
+    sample(i, &raw[i * IMU_BLACKBOX_VALUES]);
+  Clock::time_point t0 = Clock::now();
+  for (int i = 0; i < 100000; ++i)
+    bench.push(raw.data(), BLOCK);
+  double ns = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / (100000.0 * BLOCK);
+  printf("       push: %.1f ns/sample incl. the threshold, ring %lu samples, %lu B\n",
+    ns, bench.getCapacity(), bench.getCapacity() * IMU_BLACKBOX_VALUES * sizeof(int16_t));
+
+  // producer, trigger and collector threads
+  imu_blackbox shared(RATE, 0.2, 0.1);
+  std::atomic<bool> running(true);
+  unsigned long records = 0, broken = 0, lost = 0;
+  std::thread producer([&]() {
+    std::vector<int16_t> raw(BLOCK * IMU_BLACKBOX_VALUES);
+    for (uint64_t k = 0; k < THREADED; k += BLOCK) {
+      for (size_t i = 0; i < BLOCK; ++i)
+        sample(k + i, &raw[i * IMU_BLACKBOX_VALUES]);
+      shared.push(raw.data(), BLOCK);
+      std::this_thread::sleep_for(std::chrono::microseconds(20));
+    }
+    running = false;
+  });
+  std::thread triggers([&]() {
+    while (running) {
+      shared.trigger(Trigger::MANUAL);
+      std::this_thread::yield();
+    }
+  });
+  std::thread collector([&]() {
+    imu_blackbox_header h;
+    std::vector<int16_t> data;
+    while (true) {
+      bool more = running;
+      if (!shared.collect(h, data)) {
+        if (!more)
+          break;
+        continue;
+      }
+      ++records;
+      lost += h.lost;
+      // the first sample kept, also if the trigger sample itself was overwritten
+      if (!consecutive(h, data, h.index + shared.getPost() - h.post - h.pre))
+        ++broken;
+    }
+  });
+  producer.join();
+  triggers.join();
+  collector.join();
+  printf("       threads: %lu records, %lu samples lost to the producer, %lu triggers merged\n",
+    records, lost, shared.getMerged());
+  check(records > 100 && broken == 0, "records consistent while the producer keeps going");
+
+  return m_failed ? 1 : 0;
+}
@@ -0,0 +1,27 @@
+#!/bin/sh
+# host builds against the simulated I2C bus in sim/, no Edison or libmraa needed
+CXX=${CXX:-g++}
+CFLAGS="-O2 -Wall -std=c++0x -Isim -I../include"
+
+$CXX $CFLAGS -o fifo_bench fifo_bench.cpp sim/mpu_sim.cpp ../src/imu_edison.cpp ../src/bme_comp.cpp ../src/imu_dmp.cpp ../src/imu_aux.cpp
+$CXX $CFLAGS -o irq_test irq_test.cpp sim/mpu_sim.cpp ../src/imu_edison.cpp ../src/bme_comp.cpp ../src/imu_dmp.cpp ../src/imu_aux.cpp ../src/imu_irq.cpp -pthread
+$CXX $CFLAGS -o convert_bench convert_bench.cpp sim/mpu_sim.cpp ../src/imu_edison.cpp ../src/bme_comp.cpp ../src/imu_dmp.cpp ../src/imu_aux.cpp ../src/imu_convert.cpp
+$CXX $CFLAGS -o fusion_bench fusion_bench.cpp sim/mpu_sim.cpp ../src/imu_edison.cpp ../src/bme_comp.cpp ../src/imu_dmp.cpp ../src/imu_aux.cpp
+$CXX $CFLAGS -o filter_replay filter_replay.cpp ../src/imu_convert.cpp ../src/imu_fusion_q.cpp
+$CXX $CFLAGS -o mag_calib_test mag_calib_test.cpp sim/mpu_sim.cpp ../src/imu_edison.cpp ../src/bme_comp.cpp ../src/imu_dmp.cpp ../src/imu_aux.cpp ../src/mag_calib.cpp
+$CXX $CFLAGS -o bias_test bias_test.cpp ../src/imu_bias.cpp ../src/imu_convert.cpp
+$CXX $CFLAGS -o es_cache_test es_cache_test.cpp sim/mpu_sim.cpp ../src/imu_edison.cpp ../src/bme_comp.cpp ../src/imu_dmp.cpp ../src/imu_aux.cpp
+$CXX $CFLAGS -o env_test env_test.cpp sim/mpu_sim.cpp ../src/imu_edison.cpp ../src/bme_comp.cpp ../src/imu_dmp.cpp ../src/imu_aux.cpp
+$CXX $CFLAGS -o clock_test clock_test.cpp sim/mpu_sim.cpp ../src/imu_edison.cpp ../src/bme_comp.cpp ../src/imu_dmp.cpp ../src/imu_aux.cpp ../src/imu_clock.cpp
+$CXX $CFLAGS -o gesture_test gesture_test.cpp ../src/imu_gesture.cpp ../src/imu_convert.cpp
+$CXX $CFLAGS -o activity_test activity_test.cpp ../src/imu_activity.cpp ../src/imu_convert.cpp
+$CXX $CFLAGS -o dmp_test dmp_test.cpp sim/mpu_sim.cpp ../src/imu_edison.cpp ../src/bme_comp.cpp ../src/imu_dmp.cpp ../src/imu_aux.cpp
+$CXX $CFLAGS -o aux_test aux_test.cpp sim/mpu_sim.cpp ../src/imu_edison.cpp ../src/bme_comp.cpp ../src/imu_dmp.cpp ../src/imu_aux.cpp
+$CXX $CFLAGS -o blackbox_test blackbox_test.cpp ../src/imu_blackbox.cpp -pthread
+$CXX $CFLAGS -o spectrum_test spectrum_test.cpp ../src/imu_spectrum.cpp
+$CXX $CFLAGS -o biquad_test biquad_test.cpp sim/mpu_sim.cpp ../src/imu_edison.cpp ../src/bme_comp.cpp ../src/imu_dmp.cpp ../src/imu_aux.cpp ../src/imu_filter.cpp
+$CXX $CFLAGS -o arena_test arena_test.cpp ../src/log_arena.cpp -pthread
+$CXX $CFLAGS -o writer_test writer_test.cpp ../src/log_arena.cpp ../src/log_codec.cpp ../src/log_format.cpp ../src/log_journal.cpp ../src/log_writer.cpp -pthread
+$CXX $CFLAGS -o codec_test codec_test.cpp ../src/log_arena.cpp ../src/log_codec.cpp
+$CXX $CFLAGS -msse4.2 -o format_test format_test.cpp ../src/log_arena.cpp ../src/log_codec.cpp ../src/log_format.cpp
+$CXX $CFLAGS -msse4.2 -o journal_test journal_test.cpp ../src/log_arena.cpp ../src/log_codec.cpp ../src/log_format.cpp ../src/log_journal.cpp ../src/log_writer.cpp -pthread
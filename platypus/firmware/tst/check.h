@@ -0,0 +1,25 @@
+/*
+* Checks of the host tests
+* every check prints [ OK ] or [FAIL] with what it checked, informational lines are indented
+* to the same column; main() returns m_failed ? 1 : 0
+*
+*/
+
+#ifndef check_h
+#define check_h
+
+#include <stdio.h>
+
+// failed checks so far
+static int m_failed = 0;
+
+
+// prints [what] with the outcome [ok], counts the failures
+inline void check(bool ok, const char* what) {
+  printf("%s %s\n", ok ? "[ OK ]" : "[FAIL]", what);
+  fflush(stdout);
+  if (!ok)
+    ++m_failed;
+}
+
+#endif // check_h
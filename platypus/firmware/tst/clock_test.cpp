@@ -0,0 +1,100 @@
+/*
+* Host test: sample timestamps for FIFO blocks
+* an MPU with a drifting oscillator is drained at irregular intervals, the stamped sample times
+* are compared with the true ones and with a fixed 25Hz time base as pps_import.py assumes,
+* plus the FIFO count and time recorded by imu_edison::readFIFO()
+* build via build_sim.sh
+*
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "imu_clock.h"
+#include "imu_edison.h"
+#include "sim/mpu_sim.h"
+#include "check.h"
+
+#define RATE 25.0 // nominal [Hz]
+#define DRIFT 3000.0 // MPU slower than nominal [ppm]
+#define DURATION 600.0 // [s]
+#define WARMUP 60.0 // [s] before the errors are counted
+#define LOST 17 // samples lost in a FIFO reset
+
+
+//_______________________________________________________________________________________________________
+double uniform(double a, double b) {
+  return a + (b - a) * rand() / (double) RAND_MAX;
+}
+
+
+//_______________________________________________________________________________________________________
+int main(int argc, char** argv) {
+  srand(1);
+  imu_clock clock(RATE);
+
+  // true time of sample k [ns], the first one at a random phase
+  const double period = 1e9 / RATE * (1.0 + DRIFT * 1e-6);
+  const int64_t t0 = 5000000000LL + (int64_t) uniform(0.0, period);
+  uint64_t k = 0; // next sample to drain
+  bool lost = false;
+
+  // drained every 0.5 .. 1.5s as with the watermark and interrupts in between
+  double t = 0.0, err_max = 0.0, err_sq = 0.0, naive_max = 0.0;
+  int64_t naive_t0 = 0;
+  size_t cnt = 0;
+  while (t < DURATION) {
+    t += uniform(0.5, 1.5);
+    int64_t t_drain = t0 + (int64_t) (t * 1e9);
+
+    // a FIFO reset halfway drops some samples
+    if (!lost && t > DURATION / 2) {
+      k += LOST;
+      clock.resync();
+      lost = true;
+    }
+
+    // samples taken up to now, the drain takes the whole FIFO
+    uint64_t taken = (uint64_t) ((t_drain - t0) / period) + 1;
+    size_t n = taken - k;
+    imu_block_time block;
+    clock.stamp(n, n, t_drain, block);
+    if (naive_t0 == 0)
+      naive_t0 = block.first;
+
+    for (size_t i = 0; i < n; ++i, ++k) {
+      if (t < WARMUP)
+        continue;
+      double truth = t0 + k * period;
+      double e = fabs(imu_clock::sampleTime(block, i) - truth) / 1e6;
+      err_max = e > err_max ? e : err_max;
+      err_sq += e * e;
+      ++cnt;
+      double naive = fabs(naive_t0 + k * 1e9 / RATE - truth) / 1e6;
+      naive_max = naive > naive_max ? naive : naive_max;
+    }
+  }
+
+  printf("       drift %.0f ppm (true %.0f), %lu blocks in the fit\n", clock.getDrift(), DRIFT, clock.getBlocks());
+  printf("       sample time error: rms %.2f ms, max %.2f ms; fixed %.0fHz: max %.0f ms\n",
+    sqrt(err_sq / cnt), err_max, RATE, naive_max);
+  check(fabs(clock.getDrift() - DRIFT) < 200.0, "drift estimated");
+  check(sqrt(err_sq / cnt) < 4.0 && err_max < 10.0, "sample times within a quarter period");
+  check(naive_max > 100.0 * err_max, "better than a fixed rate");
+
+  // imu_edison records the fill level and the time of the count
+  mpu_sim mpu;
+  imu_edison imu;
+  int16_t sample[6] = {1, 2, 3, 4, 5, 6};
+  for (int i = 0; i < 10; ++i)
+    mpu.pushFIFO(sample);
+  int16_t data[30];
+  int64_t before = imu_clock::now();
+  size_t len = imu.readFIFO(data, 30);
+  int64_t after = imu_clock::now();
+  check(len == 30 && imu.getFIFOCount() == 10 && imu.getFIFOTime() >= before && imu.getFIFOTime() <= after,
+    "FIFO count and time recorded by readFIFO()");
+
+  return m_failed ? 1 : 0;
+}
@@ -0,0 +1,108 @@
+/*
+* Host test: lossless codec of the sample log pages
+* encode and decode back to the same samples for smooth, noisy, full scale and constant data and
+* partial frames, SSE against scalar byte for byte, the ratio on IMU-like data
+* build via build_sim.sh
+*
+*/
+
+#include <chrono>
+#include <vector>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "log_codec.h"
+#include "check.h"
+
+#define ROUNDS 2000 // pages for the timing
+
+typedef std::chrono::steady_clock Clock;
+
+
+//_______________________________________________________________________________________________________
+// [n] samples like a logged IMU in slow motion: gravity on Z, a slow swing, a few LSB noise
+std::vector<int16_t> smooth(size_t n) {
+  std::vector<int16_t> raw(6 * n);
+  for (size_t i = 0; i < n; ++i)
+    for (int c = 0; c < 6; ++c) {
+      double v = (c == 2 ? 16384.0 : 0.0) + 300.0 * sin(2.0 * M_PI * 0.2 * i / 25.0 + c) + (rand() % 9 - 4);
+      raw[6 * i + c] = (int16_t) lrint(v);
+    }
+  return raw;
+}
+
+//_______________________________________________________________________________________________________
+// [n] samples of uniform noise over the full range, deltas wrap around
+std::vector<int16_t> noise(size_t n) {
+  std::vector<int16_t> raw(6 * n);
+  for (size_t i = 0; i < raw.size(); ++i)
+    raw[i] = (int16_t) (rand() & 0xFFFF);
+  return raw;
+}
+
+//_______________________________________________________________________________________________________
+// encodes [raw] with SSE and scalar, decodes either way, returns the encoded size or 0 on a mismatch
+size_t roundTrip(log_codec &codec, const std::vector<int16_t> &raw) {
+  const size_t n = raw.size() / 6;
+  std::vector<uint8_t> a(LOG_CODEC_BOUND(n)), b(LOG_CODEC_BOUND(n));
+  size_t sa = codec.encode(raw.data(), n, a.data());
+  size_t sb = codec.encodeScalar(raw.data(), n, b.data());
+  if (sa != sb || memcmp(a.data(), b.data(), sa) != 0 || sa > LOG_CODEC_BOUND(n))
+    return 0;
+
+  std::vector<int16_t> back(6 * n), back_scalar(6 * n);
+  if (codec.decode(a.data(), sa, n, back.data()) != sa || codec.decodeScalar(a.data(), sa, n, back_scalar.data()) != sa)
+    return 0;
+  return back == raw && back_scalar == raw ? sa : 0;
+}
+
+
+//_______________________________________________________________________________________________________
+int main(int argc, char** argv) {
+  srand(23);
+  log_codec codec;
+
+  // round trips
+  size_t full = roundTrip(codec, smooth(LOG_PAGE_SAMPLES));
+  printf("       smooth page: %lu bytes of %d, ratio %.2f\n", full, LOG_PAGE_SAMPLES * LOG_SAMPLE_SIZE,
+    (double) full / (LOG_PAGE_SAMPLES * LOG_SAMPLE_SIZE));
+  check(full > 0, "smooth page decoded, SSE and scalar identical");
+  check(full > 0 && full * 2 < LOG_PAGE_SAMPLES * LOG_SAMPLE_SIZE, "smooth page below half its size");
+  check(roundTrip(codec, noise(LOG_PAGE_SAMPLES)) > 0, "full scale noise decoded");
+  check(roundTrip(codec, std::vector<int16_t>(6 * LOG_PAGE_SAMPLES, -1234)) ==
+    LOG_SAMPLE_SIZE + (LOG_PAGE_SAMPLES + LOG_CODEC_FRAME - 1) / LOG_CODEC_FRAME * 18, "constant data takes no bits");
+  bool partial = true;
+  const size_t counts[] = {1, 2, LOG_CODEC_FRAME - 1, LOG_CODEC_FRAME, LOG_CODEC_FRAME + 1, 37, 599};
+  for (size_t k = 0; k < sizeof(counts) / sizeof(counts[0]); ++k)
+    partial = partial && roundTrip(codec, smooth(counts[k])) > 0 && roundTrip(codec, noise(counts[k])) > 0;
+  check(partial, "partial frames decoded");
+
+  // extremes next to each other, the deltas overflow 16Bit
+  std::vector<int16_t> jumps(6 * 100);
+  for (size_t i = 0; i < jumps.size(); ++i)
+    jumps[i] = (i / 6) % 2 ? 32767 : -32768;
+  check(roundTrip(codec, jumps) > 0, "deltas wrapping around");
+
+  // timing
+  std::vector<int16_t> raw = smooth(LOG_PAGE_SAMPLES), back(raw.size());
+  std::vector<uint8_t> enc(LOG_CODEC_BOUND(LOG_PAGE_SAMPLES));
+  size_t size = 0;
+  double t[4];
+  for (int mode = 0; mode < 4; ++mode) {
+    Clock::time_point t0 = Clock::now();
+    for (int r = 0; r < ROUNDS; ++r) {
+      switch (mode) {
+        case 0: size = codec.encode(raw.data(), LOG_PAGE_SAMPLES, enc.data()); break;
+        case 1: size = codec.encodeScalar(raw.data(), LOG_PAGE_SAMPLES, enc.data()); break;
+        case 2: codec.decode(enc.data(), size, LOG_PAGE_SAMPLES, back.data()); break;
+        case 3: codec.decodeScalar(enc.data(), size, LOG_PAGE_SAMPLES, back.data()); break;
+      }
+    }
+    t[mode] = std::chrono::duration<double, std::micro>(Clock::now() - t0).count() / ROUNDS;
+  }
+  printf("       per page: encode %.1f us (scalar %.1f), decode %.1f us (scalar %.1f)\n", t[0], t[1], t[2], t[3]);
+
+  return m_failed ? 1 : 0;
+}
@@ -0,0 +1,97 @@
+/*
+* Host benchmark: converting raw FIFO blocks to physical units
+* compares toReadable() per sample with the scalar and SSE2 batch conversion of imu_convert
+* build via build_sim.sh
+*
+*/
+
+#include <chrono>
+#include <vector>
+
+#include "imu_edison.h"
+#include "imu_convert.h"
+#include "sim/mpu_sim.h"
+
+#define SAMPLES 4096
+#define RUNS 200
+
+typedef std::chrono::steady_clock Clock;
+
+
+//_______________________________________________________________________________________________________
+double usSince(Clock::time_point t0) {
+  return std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+}
+
+//_______________________________________________________________________________________________________
+void report(const char* name, double us) {
+  printf("%-8s %9.2f us per block  %7.2f ns per sample\n", name, us / RUNS, us * 1000.0 / RUNS / SAMPLES);
+}
+
+
+//_______________________________________________________________________________________________________
+int main(int argc, char** argv) {
+  mpu_sim mpu;
+  imu_edison imu;
+  imu_convert conv;
+
+  // odd count to exercise the scalar remainder of the SIMD path
+  const size_t n = SAMPLES - 3;
+  std::vector<int16_t> raw(6 * SAMPLES);
+  for (size_t i = 0; i < raw.size(); ++i)
+    raw[i] = (int16_t) ((i * 7919) % 65536 - 32768);
+
+  std::vector<float> simd(6 * SAMPLES), scalar(6 * SAMPLES), ref(6 * SAMPLES);
+  imu_soa out_simd = {{&simd[0], &simd[SAMPLES], &simd[2 * SAMPLES]},
+                      {&simd[3 * SAMPLES], &simd[4 * SAMPLES], &simd[5 * SAMPLES]}};
+  imu_soa out_scalar = {{&scalar[0], &scalar[SAMPLES], &scalar[2 * SAMPLES]},
+                        {&scalar[3 * SAMPLES], &scalar[4 * SAMPLES], &scalar[5 * SAMPLES]}};
+
+  // per sample: vector in, vector out
+  Clock::time_point t0 = Clock::now();
+  for (int r = 0; r < RUNS; ++r) {
+    std::vector<int16_t> sample(7, 0);
+    for (size_t i = 0; i < n; ++i) {
+      sample.assign(raw.begin() + 6 * i, raw.begin() + 6 * i + 6);
+      sample.push_back(0);
+      std::vector<float> data = imu.toReadable(sample);
+      for (int j = 0; j < 6; ++j)
+        ref[j * SAMPLES + i] = data[j];
+    }
+  }
+  report("vector", usSince(t0));
+
+  t0 = Clock::now();
+  for (int r = 0; r < RUNS; ++r)
+    conv.convertScalar(raw.data(), n, out_scalar);
+  report("scalar", usSince(t0));
+
+  t0 = Clock::now();
+  for (int r = 0; r < RUNS; ++r)
+    conv.convert(raw.data(), n, out_simd);
+#ifdef __SSE2__
+  report("sse2", usSince(t0));
+#else
+  report("batch", usSince(t0));
+#endif
+
+  bool same = true, close = true;
+  for (int j = 0; j < 6; ++j) {
+    for (size_t i = 0; i < n; ++i) {
+      size_t k = j * SAMPLES + i;
+      same &= (simd[k] == scalar[k]);
+      close &= (fabs(scalar[k] - ref[k]) <= 1e-5 * fabs(ref[k]) + 1e-6);
+    }
+  }
+  if (!same) {
+    printf("[BENCH] FAILED: SIMD and scalar conversion differ\n");
+    return 1;
+  }
+  if (!close) {
+    printf("[BENCH] FAILED: batch conversion differs from toReadable()\n");
+    return 1;
+  }
+
+  printf("[BENCH] OK\n");
+  return 0;
+}
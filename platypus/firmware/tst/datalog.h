@@ -0,0 +1,48 @@
+/*
+* Reader for the datalogXXXX.bin files written by the platypus logger
+* a 20 byte header (time, light, temperature, pressure, humidity) before every page
+* of 600 samples, samples are ACCEL XYZ, GYRO XYZ as 16Bit big endian
+* (same layout as software/pps_io/pps_import.py); files of version 2 see log_format
+*
+*/
+
+#ifndef datalog_h
+#define datalog_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+#define DATALOG_HEADER_SIZE 20
+#define DATALOG_PAGE_SAMPLES 600
+#define DATALOG_SAMPLE_SIZE 12
+#define DATALOG_SAMPLE_RATE 25.0
+
+
+// appends [n] samples of a page at [data] to [raw]
+inline void readDatalogPage(const uint8_t* data, size_t n, std::vector<int16_t> &raw) {
+  for (size_t i = 0; i < 6 * n; ++i)
+    raw.push_back((int16_t) ((data[2 * i] << 8) | data[2 * i + 1]));
+}
+
+// appends the samples of [path] to [raw] (6 values per sample), returns the number of samples read
+inline size_t readDatalog(const char* path, std::vector<int16_t> &raw) {
+  FILE* f = fopen(path, "rb");
+  if (f == NULL)
+    return 0;
+
+  size_t n = 0;
+  uint8_t buf[DATALOG_PAGE_SAMPLES * DATALOG_SAMPLE_SIZE];
+  while (fseek(f, DATALOG_HEADER_SIZE, SEEK_CUR) == 0) {
+    size_t len = fread(buf, 1, sizeof(buf), f);
+    readDatalogPage(buf, len / DATALOG_SAMPLE_SIZE, raw);
+    n += len / DATALOG_SAMPLE_SIZE;
+    if (len < sizeof(buf))
+      break;
+  }
+
+  fclose(f);
+  return n;
+}
+
+#endif // datalog_h
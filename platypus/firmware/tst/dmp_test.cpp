@@ -0,0 +1,150 @@
+/*
+* Host test: DMP mode
+* a firmware image is uploaded into the memory banks of the simulated MPU and verified,
+* the DMP emits quaternions of a turn about Z at 200Hz divided down to the configured rate,
+* readDMP() drains and parses them, a FIFO out of sync is detected and recovered
+* build via build_sim.sh
+*
+*/
+
+#include <chrono>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#include "imu_edison.h"
+#include "imu_dmp.h"
+#include "sim/mpu_sim.h"
+#include "check.h"
+
+#define RATE 25 // [Hz] quaternion output
+#define TURN 90.0 // [deg/s] about Z
+#define DURATION 10.0 // [s]
+#define IMAGE_FILE "dmp_test.bin"
+
+typedef std::chrono::steady_clock Clock;
+
+
+//_______________________________________________________________________________________________________
+void truth(unsigned long tick, int32_t* q) {
+  double angle = TURN * M_PI / 180.0 * tick / DMP_SAMPLE_RATE;
+  q[0] = (int32_t) lround(cos(angle / 2.0) * (1 << 30));
+  q[1] = 0;
+  q[2] = 0;
+  q[3] = (int32_t) lround(sin(angle / 2.0) * (1 << 30));
+}
+
+
+//_______________________________________________________________________________________________________
+int main(int argc, char** argv) {
+  srand(1);
+  mpu_sim mpu;
+  imu_edison imu;
+  imu.setupIMU();
+
+  // firmware upload, read back chunk by chunk
+  std::vector<uint8_t> image(DMP_CODE_SIZE);
+  for (size_t i = 0; i < image.size(); ++i)
+    image[i] = rand() & 0xFF;
+  check(!imu.enableDMP(true), "no DMP mode without firmware");
+  check(!imu.loadDMP(image.data(), DMP_MEM_SIZE + 1), "image larger than the DMP memory rejected");
+
+  FILE* file = fopen(IMAGE_FILE, "wb");
+  fwrite(image.data(), 1, image.size(), file);
+  fclose(file);
+  sim::bus::instance().stats.transactions = 0;
+  bool loaded = imu.loadDMP(IMAGE_FILE);
+  remove(IMAGE_FILE);
+  printf("       upload: %lu I2C transactions for %lu bytes\n", sim::bus::instance().stats.transactions, image.size());
+  check(loaded, "firmware loaded from file and verified");
+  check(!imu.loadDMP("does/not/exist.bin"), "missing firmware file");
+  check(imu.loadDMP(image.data(), image.size()), "firmware loaded again");
+
+  // the image with the rate and quaternion configuration on top
+  std::vector<uint8_t> expect(image);
+  expect[DMP_D_0_22] = 0;
+  expect[DMP_D_0_22 + 1] = DMP_SAMPLE_RATE / RATE - 1;
+  memcpy(&expect[DMP_CFG_6], imu_dmp::s_rate_end, sizeof(imu_dmp::s_rate_end));
+  memcpy(&expect[DMP_CFG_LP_QUAT], imu_dmp::s_quat3_off, sizeof(imu_dmp::s_quat3_off));
+  memcpy(&expect[DMP_CFG_8], imu_dmp::s_quat6_on, sizeof(imu_dmp::s_quat6_on));
+  check(memcmp(mpu.m_mem, expect.data(), expect.size()) == 0, "memory holds the image and the configuration");
+  check(mpu.m_reg[MPU_PRGM_START_H] == (DMP_START_ADDR >> 8) && mpu.m_reg[MPU_PRGM_START_L] == (DMP_START_ADDR & 0xFF),
+    "program start set");
+
+  // output rate
+  check(fabs(imu.setDMPRate(30) - 200.0 / 6.0) < 1e-3 && fabs(mpu.getDMPRate() - 200.0 / 6.0) < 1e-3,
+    "rate rounded to a divider of 200Hz");
+  check(imu.setDMPRate(RATE) == RATE && mpu.getDMPRate() == RATE, "rate written to the DMP");
+
+  check(imu.enableDMP(true), "DMP mode on");
+  check(imu.isDMP() && imu.getSampleRate() == RATE && mpu.m_reg[MPU_SMPLRT_DIV] == DMP_SMPLRT_DIV &&
+    mpu.m_reg[MPU_FIFO_EN] == 0x00 && (mpu.m_reg[MPU_USER_CTRL] & (MPU_USER_DMP_EN | MPU_USER_FIFO_EN)) ==
+    (MPU_USER_DMP_EN | MPU_USER_FIFO_EN), "registers in DMP mode");
+
+  // the turn, drained every half second
+  std::vector<int32_t> q(MPU_FIFO_SIZE / 4);
+  unsigned long tick = 0, packets = 0;
+  double err_max = 0.0, ns = 0.0;
+  bool in_order = true;
+  while (tick < DURATION * DMP_SAMPLE_RATE) {
+    for (int i = 0; i < DMP_SAMPLE_RATE / 2; ++i, ++tick) {
+      int32_t t[4];
+      truth(tick, t);
+      mpu.tickDMP(t);
+    }
+
+    Clock::time_point t0 = Clock::now();
+    size_t n = imu.readDMP(q.data(), q.size());
+    ns += std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+    in_order = in_order && imu.getFIFOCount() == n / 4;
+
+    for (size_t i = 0; i < n; i += 4, ++packets) {
+      int32_t t[4];
+      truth(packets * (DMP_SAMPLE_RATE / RATE), t);
+      for (int j = 0; j < 4; ++j) {
+        double e = fabs((q[i + j] - t[j]) / (double) (1 << 30));
+        err_max = e > err_max ? e : err_max;
+      }
+    }
+  }
+  printf("       %lu packets, max error %.1e, %.0f ns/packet incl. the simulated bus\n", packets, err_max, ns / packets);
+  check(packets == DURATION * RATE && in_order, "one packet per output period");
+  check(err_max < 1e-9, "quaternions parsed exactly");
+
+  quaternion<float> rot;
+  int32_t t[4];
+  truth(DMP_SAMPLE_RATE, t); // 90deg
+  imu_dmp::toQuaternion(t, rot);
+  float roll, pitch, yaw;
+  rot.toEuler(roll, pitch, yaw);
+  check(fabs(fabs(yaw) - M_PI / 2.0) < 1e-3, "converted to a quaternion");
+
+  // a stray byte puts the FIFO out of sync, the next read drops it and starts over
+  uint8_t stray = 0x5A;
+  mpu.write(MPU_FIFO_R_W, &stray, 1);
+  for (int i = 0; i < DMP_SAMPLE_RATE / 2; ++i, ++tick) {
+    int32_t t[4];
+    truth(tick, t);
+    mpu.tickDMP(t);
+  }
+  size_t n = imu.readDMP(q.data(), q.size());
+  check(n == 0 && imu.getDMPErrors() == 1 && mpu.FIFOcnt() == 0, "corrupt packet resets the FIFO");
+  for (int i = 0; i < DMP_SAMPLE_RATE / 2; ++i, ++tick) {
+    int32_t t[4];
+    truth(tick, t);
+    mpu.tickDMP(t);
+  }
+  n = imu.readDMP(q.data(), q.size());
+  // the DMP reset restarts the divider with a packet
+  check(n == 4 * (RATE / 2 + 1) && imu.getDMPErrors() == 1, "packets in sync after the reset");
+
+  // back to raw samples
+  check(imu.enableDMP(false) && !imu.isDMP() && imu.getSampleRate() == 25.0 && mpu.m_reg[MPU_FIFO_EN] == 0x78 &&
+    !(mpu.m_reg[MPU_USER_CTRL] & MPU_USER_DMP_EN) && !mpu.tickDMP(t), "DMP mode off");
+  imu.setupIMU();
+  check(!imu.enableDMP(true), "firmware gone after setupIMU()");
+
+  return m_failed ? 1 : 0;
+}
@@ -0,0 +1,202 @@
+/*
+* Host test: BME280 compensation and measurement profiles
+* a simulated BME behind the MPU provides the calibration, checks the single pass against the
+* datasheet example and the floating point formulas, the batch speed against three passes
+* and the profile writes through I2C slave 4
+* build via build_sim.sh
+*
+*/
+
+#include <chrono>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#include "imu_edison.h"
+#include "bme_comp.h"
+#include "sim/mpu_sim.h"
+#include "check.h"
+
+#define READINGS 200000
+#define RUNS 10
+
+typedef std::chrono::steady_clock Clock;
+
+// BMP280 datasheet sec 3.12 example, with typical humidity coefficients
+static const BME_calibration CALIB = {27504, 26435, -1000,
+  36477, -10685, 3024, 2855, 140, -7, 15500, -14600, 6000,
+  75, 362, 0, 313, 50, 30};
+
+
+// register file of the BME280, with CALIB in the calibration registers
+class bme_sim : public sim::device {
+ public:
+  bme_sim() {
+    memset(m_reg, 0, sizeof(m_reg));
+    m_reg[BME_ID] = 0x60;
+    const BME_calibration &c = CALIB;
+    const int16_t tp[12] = {(int16_t) c.dig_T1, c.dig_T2, c.dig_T3, (int16_t) c.dig_P1, c.dig_P2, c.dig_P3,
+      c.dig_P4, c.dig_P5, c.dig_P6, c.dig_P7, c.dig_P8, c.dig_P9};
+    for (int i = 0; i < 12; ++i) {
+      m_reg[BME_CALIB00 + 2*i] = tp[i] & 0xFF;
+      m_reg[BME_CALIB00 + 2*i + 1] = (tp[i] >> 8) & 0xFF;
+    }
+    m_reg[BME_CALIB25] = c.dig_H1;
+    m_reg[BME_CALIB26] = c.dig_H2 & 0xFF;
+    m_reg[BME_CALIB26 + 1] = (c.dig_H2 >> 8) & 0xFF;
+    m_reg[BME_CALIB26 + 2] = c.dig_H3;
+    m_reg[BME_CALIB26 + 3] = (c.dig_H4 >> 4) & 0xFF;
+    m_reg[BME_CALIB26 + 4] = (c.dig_H4 & 0x0F) | ((c.dig_H5 & 0x0F) << 4);
+    m_reg[BME_CALIB26 + 5] = (c.dig_H5 >> 4) & 0xFF;
+    m_reg[BME_CALIB26 + 6] = c.dig_H6;
+    sim::bus::instance().attach(BME_I2C_ADDR, this);
+  }
+  ~bme_sim() {sim::bus::instance().detach(BME_I2C_ADDR);}
+
+  int read(uint8_t reg, uint8_t* data, int len) {
+    for (int i = 0; i < len; ++i)
+      data[i] = m_reg[(uint8_t) (reg + i)];
+    return len;
+  }
+  void write(uint8_t reg, const uint8_t* data, int len) {
+    for (int i = 0; i < len; ++i)
+      m_reg[(uint8_t) (reg + i)] = data[i];
+  }
+
+  uint8_t m_reg[256];
+};
+
+
+//_______________________________________________________________________________________________________
+bool sameCalib(const BME_calibration &a, const BME_calibration &b) {
+  return a.dig_T1 == b.dig_T1 && a.dig_T2 == b.dig_T2 && a.dig_T3 == b.dig_T3 &&
+    a.dig_P1 == b.dig_P1 && a.dig_P2 == b.dig_P2 && a.dig_P3 == b.dig_P3 && a.dig_P4 == b.dig_P4 &&
+    a.dig_P5 == b.dig_P5 && a.dig_P6 == b.dig_P6 && a.dig_P7 == b.dig_P7 && a.dig_P8 == b.dig_P8 &&
+    a.dig_P9 == b.dig_P9 && a.dig_H1 == b.dig_H1 && a.dig_H2 == b.dig_H2 && a.dig_H3 == b.dig_H3 &&
+    a.dig_H4 == b.dig_H4 && a.dig_H5 == b.dig_H5 && a.dig_H6 == b.dig_H6;
+}
+
+//_______________________________________________________________________________________________________
+double usSince(Clock::time_point t0) {
+  return std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+}
+
+//_______________________________________________________________________________________________________
+// floating point compensation, BME280 datasheet sec 8.1, T [DegC], P [Pa], H [%RH]
+void compensateDouble(const BME_raw &raw, double &T, double &P, double &H) {
+  const BME_calibration &c = CALIB;
+  double var1 = (raw.adc_T / 16384.0 - c.dig_T1 / 1024.0) * c.dig_T2;
+  double var2 = (raw.adc_T / 131072.0 - c.dig_T1 / 8192.0) * (raw.adc_T / 131072.0 - c.dig_T1 / 8192.0) * c.dig_T3;
+  double t_fine = var1 + var2;
+  T = t_fine / 5120.0;
+
+  var1 = t_fine / 2.0 - 64000.0;
+  var2 = var1 * var1 * c.dig_P6 / 32768.0;
+  var2 = var2 + var1 * c.dig_P5 * 2.0;
+  var2 = var2 / 4.0 + c.dig_P4 * 65536.0;
+  var1 = (c.dig_P3 * var1 * var1 / 524288.0 + c.dig_P2 * var1) / 524288.0;
+  var1 = (1.0 + var1 / 32768.0) * c.dig_P1;
+  P = 1048576.0 - raw.adc_P;
+  P = (P - var2 / 4096.0) * 6250.0 / var1;
+  var1 = c.dig_P9 * P * P / 2147483648.0;
+  var2 = P * c.dig_P8 / 32768.0;
+  P = P + (var1 + var2 + c.dig_P7) / 16.0;
+
+  H = t_fine - 76800.0;
+  H = (raw.adc_H - (c.dig_H4 * 64.0 + c.dig_H5 / 16384.0 * H)) *
+    (c.dig_H2 / 65536.0 * (1.0 + c.dig_H6 / 67108864.0 * H * (1.0 + c.dig_H3 / 67108864.0 * H)));
+  H = H * (1.0 - c.dig_H1 * H / 524288.0);
+  H = H > 100.0 ? 100.0 : (H < 0.0 ? 0.0 : H);
+}
+
+//_______________________________________________________________________________________________________
+// writes [raw] to the slave 0 registers of the MPU, as read from BME_PRESS_MSB on
+void setRaw(mpu_sim &mpu, const BME_raw &raw) {
+  uint8_t* d = &mpu.m_reg[MPU_EXT_SENS_DATA_00];
+  d[0] = raw.adc_P >> 12; d[1] = raw.adc_P >> 4; d[2] = (raw.adc_P << 4) & 0xF0;
+  d[3] = raw.adc_T >> 12; d[4] = raw.adc_T >> 4; d[5] = (raw.adc_T << 4) & 0xF0;
+  d[6] = raw.adc_H >> 8; d[7] = raw.adc_H & 0xFF;
+}
+
+
+//_______________________________________________________________________________________________________
+int main(int argc, char** argv) {
+  mpu_sim mpu;
+  bme_sim bme;
+  imu_edison imu(1, MPU_I2C_ADDR, true);
+  srand(1);
+
+  // default setup as before: x1, IIR off, 1s standby, read once every 25 samples
+  imu.setupIMU();
+  check(bme.m_reg[BME_CTRL_HUM] == 0x01 && bme.m_reg[BME_CONFIG] == 0xA0 && bme.m_reg[BME_CTRL_MEAS] == 0x27,
+    "weather profile written by setupIMU()");
+  check(imu.getESDelay() == 0x18, "BME read once per second at 25Hz");
+  check(sameCalib(imu.getEnvComp().getCalibration(), CALIB), "calibration read from the BME");
+
+  // BMP280 datasheet example: 25.08 DegC, 100653.27 Pa (floating point, the integer formula gives .25)
+  BME_raw ex = {519888, 415148, 30000};
+  setRaw(mpu, ex);
+  imu.invalidateESData();
+  int32_t T;
+  uint32_t P, H;
+  imu.getEnvData(T, P, H);
+  printf("       %d [0.01 DegC], %.2f [Pa], %.2f [%%RH]\n", T, P / 256.0, H / 1024.0);
+  check(T == 2508 && fabs(P / 256.0 - 100653.27) < 0.05, "datasheet example");
+
+  // random readings around room conditions
+  std::vector<BME_raw> raw(READINGS);
+  for (size_t i = 0; i < raw.size(); ++i) {
+    raw[i].adc_T = 480000 + rand() % 80000;
+    raw[i].adc_P = 300000 + rand() % 200000;
+    raw[i].adc_H = 20000 + rand() % 20000;
+  }
+
+  // three passes as getEnvData() did before
+  std::vector<BME_data> three(READINGS), single(READINGS);
+  Clock::time_point t0 = Clock::now();
+  for (int r = 0; r < RUNS; ++r) {
+    for (size_t i = 0; i < raw.size(); ++i) {
+      three[i].T = imu.compT(raw[i].adc_T);
+      three[i].P = imu.compP(raw[i].adc_P, raw[i].adc_T);
+      three[i].H = imu.compH(raw[i].adc_H, raw[i].adc_T);
+    }
+  }
+  double us_three = usSince(t0);
+
+  t0 = Clock::now();
+  for (int r = 0; r < RUNS; ++r)
+    imu.getEnvComp().compensate(&raw[0], &single[0], raw.size());
+  double us_single = usSince(t0);
+  printf("       three passes %.1f ns/reading, single pass batch %.1f ns/reading\n",
+    1e3 * us_three / (RUNS * READINGS), 1e3 * us_single / (RUNS * READINGS));
+  check(memcmp(&three[0], &single[0], READINGS * sizeof(BME_data)) == 0, "single pass identical to three passes");
+
+  double err[3] = {0.0, 0.0, 0.0};
+  for (size_t i = 0; i < raw.size(); ++i) {
+    double t, p, h;
+    compensateDouble(raw[i], t, p, h);
+    err[0] = fmax(err[0], fabs(single[i].T / 100.0 - t));
+    err[1] = fmax(err[1], fabs(single[i].P / 256.0 - p));
+    err[2] = fmax(err[2], fabs(single[i].H / 1024.0 - h));
+  }
+  printf("       max deviation from floating point: %.4f DegC, %.3f Pa, %.4f %%RH\n", err[0], err[1], err[2]);
+  check(err[0] <= 0.01 && err[1] < 1.0 && err[2] < 0.01, "integer compensation within resolution");
+
+  // breath profile at runtime: sleep, CTRL_HUM, CONFIG, normal mode through slave 4
+  mpu.m_slave_writes.clear();
+  bool ok = imu.setEnvProfile(BME_PROFILE_BREATH);
+  const std::vector<mpu_sim::slave_write> &w = mpu.m_slave_writes;
+  check(ok && w.size() == 4 && w[0].addr == BME_I2C_ADDR && w[0].reg == BME_CTRL_MEAS && (w[0].data & 0x03) == 0 &&
+    w[1].reg == BME_CTRL_HUM && w[1].data == BME_OSRS_X4 && w[2].reg == BME_CONFIG && w[2].data == 0x28 &&
+    w[3].reg == BME_CTRL_MEAS && w[3].data == 0x27, "breath profile written through slave 4");
+  printf("       breath profile %.1f Hz, read every %d samples\n", bme_comp::getRate(BME_PROFILE_BREATH), imu.getESDelay() + 1);
+  check(bme_comp::getRate(BME_PROFILE_BREATH) > 10.0 && imu.getESDelay() == 0, "BME read every sample");
+
+  // kept for the next setupIMU()
+  imu.setupIMU();
+  check(bme.m_reg[BME_CTRL_HUM] == BME_OSRS_X4 && bme.m_reg[BME_CONFIG] == 0x28, "profile kept over setupIMU()");
+
+  return m_failed ? 1 : 0;
+}
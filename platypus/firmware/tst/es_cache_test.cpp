@@ -0,0 +1,76 @@
+/*
+* Host test: shared snapshot of the external sensor data
+* a loop reading environment, compass and one Madgwick step, once reading EXT_SENS_DATA per
+* accessor as before and once through the snapshot, plus the freshness of the snapshot
+* build via build_sim.sh
+*
+*/
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "imu_edison.h"
+#include "sim/mpu_sim.h"
+#include "check.h"
+
+#define LOOPS 20
+#define LOOP_MS 45 // a bit more than one sample period @ 25Hz
+
+
+//_______________________________________________________________________________________________________
+void setMag(mpu_sim &mpu, int offset, int16_t x) {
+  const int16_t mag[3] = {x, -90, -410};
+  for (int i = 0; i < 3; ++i) {
+    mpu.m_reg[MPU_EXT_SENS_DATA_00 + offset + 2*i] = mag[i] & 0xFF;
+    mpu.m_reg[MPU_EXT_SENS_DATA_00 + offset + 1 + 2*i] = (mag[i] >> 8) & 0xFF;
+  }
+}
+
+
+//_______________________________________________________________________________________________________
+int main(int argc, char** argv) {
+  mpu_sim mpu;
+  imu_edison imu;
+  sim::bus &bus = sim::bus::instance();
+  setMag(mpu, imu.getAuxPlan().mag_offset, 220);
+
+  std::vector<float> data(6, 0.0);
+  data[2] = 9.807;
+  quaternion<float> q;
+
+  // as before: every accessor reads the 24 registers itself
+  bus.stats.reset();
+  for (int i = 0; i < LOOPS; ++i) {
+    imu.readESData(); // getEnvData()
+    imu.readESData(); // getCompassData()
+    imu.readESData(); // MadgwickFilterStep()
+  }
+  unsigned long before = bus.stats.transactions;
+
+  // snapshot: one read per loop, the loop is slower than the slave sampling period
+  bus.stats.reset();
+  for (int i = 0; i < LOOPS; ++i) {
+    float T, P, H, mx, my, mz;
+    imu.getEnvData(T, P, H);
+    imu.getCompassData(mx, my, mz);
+    imu.MadgwickFilterStep(data, 0.04, 5.0, q);
+    std::this_thread::sleep_for(std::chrono::milliseconds(LOOP_MS));
+  }
+  unsigned long after = bus.stats.transactions;
+  printf("       %.1f vs %.1f I2C transactions per loop, %lu snapshot reads, %lu hits\n",
+    before / (float) LOOPS, after / (float) LOOPS, imu.getESReads(), imu.getESHits());
+  check(after * 3 <= before && imu.getESReads() >= LOOPS, "one snapshot read per loop instead of three");
+
+  // freshness: within a sample period the snapshot is reused, after it the bus is read again
+  float mx0, mx1, my, mz;
+  imu.getCompassData(mx0, my, mz);
+  setMag(mpu, imu.getAuxPlan().mag_offset, 300);
+  imu.getCompassData(mx1, my, mz);
+  check(mx0 == mx1, "snapshot reused within a sample period");
+  std::this_thread::sleep_for(std::chrono::milliseconds(LOOP_MS));
+  imu.getCompassData(mx1, my, mz);
+  check(mx0 != mx1, "snapshot read again after a sample period");
+
+  return m_failed ? 1 : 0;
+}
@@ -0,0 +1,149 @@
+/*
+* Host benchmark: draining a full MPU FIFO on the simulated I2C bus
+* compares the old word-by-word access with imu_edison::readFIFO(),
+* and the old per-register readRawIMU() with the ImuSample block read
+* build via build_sim.sh
+*
+*/
+
+#include <chrono>
+#include <algorithm>
+#include <vector>
+
+#include "imu_edison.h"
+#include "sim/mpu_sim.h"
+
+#define RUNS 1000
+
+
+//_______________________________________________________________________________________________________
+void fillFIFO(mpu_sim &mpu) {
+  int16_t sample[6];
+  for (int i = 0; mpu.FIFOcnt() + MPU_FIFO_SAMPLE_SIZE <= MPU_FIFO_SIZE; ++i) {
+    for (int j = 0; j < 6; ++j)
+      sample[j] = (int16_t)(i * 100 + j - 3000);
+    mpu.pushFIFO(sample);
+  }
+}
+
+//_______________________________________________________________________________________________________
+// the way readFIFO() drained the FIFO before: count via two register reads,
+// then two single register reads per 16Bit value, re-setting the slave address every time
+size_t legacyReadFIFO(mraa::I2c &i2c, int16_t* data) {
+  i2c.address(MPU_I2C_ADDR);
+  int cnt = (i2c.readReg(MPU_FIFO_COUNTH) << 8) + i2c.readReg(MPU_FIFO_COUNTL);
+
+  size_t n = 0;
+  for (int i = 0; i < cnt/12; ++i) {
+    for (int j = 0; j < 6; ++j) {
+      i2c.address(MPU_I2C_ADDR);
+      uint8_t H = i2c.readReg(MPU_FIFO_R_W);
+      uint8_t L = i2c.readReg(MPU_FIFO_R_W);
+      data[n++] = (int16_t)((H<<8)+L);
+    }
+  }
+  return n;
+}
+
+//_______________________________________________________________________________________________________
+// the way readRawIMU() read the output registers before: one readReg per byte, 7 vector pushes
+std::vector<int16_t> legacyReadRawIMU(mraa::I2c &i2c) {
+  static const uint8_t regs[7] = {MPU_ACCEL_XOUT_H, MPU_ACCEL_YOUT_H, MPU_ACCEL_ZOUT_H,
+    MPU_GYRO_XOUT_H, MPU_GYRO_YOUT_H, MPU_GYRO_ZOUT_H, MPU_TEMP_OUT_H};
+  std::vector<int16_t> data;
+  for (int i = 0; i < 7; ++i) {
+    i2c.address(MPU_I2C_ADDR);
+    uint8_t H = i2c.readReg(regs[i]);
+    uint8_t L = i2c.readReg(regs[i] + 1);
+    data.push_back((int16_t)((H<<8)+L));
+  }
+  return data;
+}
+
+//_______________________________________________________________________________________________________
+void report(const char* name, const sim::bus_stats &st, double cpu_us, size_t values) {
+  printf("%-8s %6lu transactions  %6lu bytes  %6lu address sets  %8.2f ms @400kHz  %7.2f us cpu  (%zu values)\n",
+    name, st.transactions / RUNS, st.bytes / RUNS, st.selects / RUNS,
+    st.busTime(400000.0) * 1000.0 / RUNS, cpu_us / RUNS, values);
+}
+
+
+//_______________________________________________________________________________________________________
+int main(int argc, char** argv) {
+  mpu_sim mpu;
+  imu_edison imu;
+  mraa::I2c i2c(1);
+  sim::bus &bus = sim::bus::instance();
+
+  std::vector<int16_t> ref(MPU_FIFO_SIZE / 2), out(MPU_FIFO_SIZE / 2);
+  size_t n_ref = 0, n_out = 0;
+
+  // old word-by-word drain
+  bus.stats.reset();
+  double us = 0;
+  for (int r = 0; r < RUNS; ++r) {
+    fillFIFO(mpu);
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    n_ref = legacyReadFIFO(i2c, ref.data());
+    us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+  }
+  report("legacy", bus.stats, us, n_ref);
+
+  // block read drain
+  bus.stats.reset();
+  us = 0;
+  for (int r = 0; r < RUNS; ++r) {
+    fillFIFO(mpu);
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    n_out = imu.readFIFO(out.data(), out.size());
+    us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+  }
+  report("burst", bus.stats, us, n_out);
+
+  if (n_ref != n_out || !std::equal(ref.begin(), ref.begin() + n_ref, out.begin())) {
+    printf("[BENCH] FAILED: burst read returned different data\n");
+    return 1;
+  }
+
+  // a buffer smaller than the FIFO content only takes complete samples that fit
+  fillFIFO(mpu);
+  int16_t small[15];
+  if (imu.readFIFO(small, 15) != 12 || mpu.FIFOcnt() != MPU_FIFO_BURST_SIZE - 2 * MPU_FIFO_SAMPLE_SIZE) {
+    printf("[BENCH] FAILED: partial drain\n");
+    return 1;
+  }
+
+  // single output sample
+  const int16_t raw[7] = {-1200, 350, 8100, -17, 42, 31000, 1500};
+  mpu.setOutput(raw);
+
+  bus.stats.reset();
+  us = 0;
+  std::vector<int16_t> raw_ref;
+  for (int r = 0; r < RUNS; ++r) {
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    raw_ref = legacyReadRawIMU(i2c);
+    us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+  }
+  report("raw", bus.stats, us, raw_ref.size());
+
+  bus.stats.reset();
+  us = 0;
+  ImuSample s;
+  bool ok = true;
+  for (int r = 0; r < RUNS; ++r) {
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    ok &= imu.readRawIMU(s);
+    us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+  }
+  report("sample", bus.stats, us, 7);
+
+  const int16_t expect[7] = {s.accel[0], s.accel[1], s.accel[2], s.gyro[0], s.gyro[1], s.gyro[2], s.temp};
+  if (!ok || !std::equal(raw_ref.begin(), raw_ref.end(), expect) || imu.readRawIMU() != raw_ref) {
+    printf("[BENCH] FAILED: ImuSample differs from the register values\n");
+    return 1;
+  }
+
+  printf("[BENCH] OK\n");
+  return 0;
+}
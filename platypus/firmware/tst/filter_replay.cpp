@@ -0,0 +1,232 @@
+/*
+* Host benchmark: replays recorded datalogXXXX.bin files through the orientation filters
+* reports cycles per update and the divergence from a reference orientation
+* (Madgwick on recorded data, the true orientation on synthetic data),
+* the fixed-point Madgwick is also checked against the float one
+* usage: filter_replay [-r rate] [datalog0000.bin ...], without files synthetic motion is used
+* build via build_sim.sh
+*
+*/
+
+#include <chrono>
+#include <vector>
+#include <string.h>
+#include <stdlib.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include "imu_convert.h"
+#include "imu_fusion.h"
+#include "imu_fusion_q.h"
+#include "datalog.h"
+
+#define BLOCK 42 // full FIFO
+
+typedef std::chrono::steady_clock Clock;
+
+
+struct replay {
+  size_t n;
+  std::vector<int16_t> raw;
+  std::vector<float> buf;
+  imu_soa in;
+  float dT;
+  // reference orientation at the end of every block
+  std::vector<quaternion<float> > ref;
+};
+
+
+//_______________________________________________________________________________________________________
+uint64_t cycles() {
+#if defined(__i386__) || defined(__x86_64__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+#endif
+}
+
+//_______________________________________________________________________________________________________
+// angle between two orientations and between their gravity directions [deg]
+void divergence(const quaternion<float> &a, const quaternion<float> &b, float &angle, float &tilt) {
+  float d = fabs(a.m_w*b.m_w + a.m_x*b.m_x + a.m_y*b.m_y + a.m_z*b.m_z);
+  angle = 2.0 * acos(d > 1.0 ? 1.0 : d) * 180.0 / M_PI;
+
+  float va[3] = {2.0f * (a.m_x*a.m_z - a.m_w*a.m_y), 2.0f * (a.m_w*a.m_x + a.m_y*a.m_z), 1.0f - 2.0f * (a.m_x*a.m_x + a.m_y*a.m_y)};
+  float vb[3] = {2.0f * (b.m_x*b.m_z - b.m_w*b.m_y), 2.0f * (b.m_w*b.m_x + b.m_y*b.m_z), 1.0f - 2.0f * (b.m_x*b.m_x + b.m_y*b.m_y)};
+  float c = va[0]*vb[0] + va[1]*vb[1] + va[2]*vb[2];
+  tilt = acos(c > 1.0 ? 1.0 : (c < -1.0 ? -1.0 : c)) * 180.0 / M_PI;
+}
+
+//_______________________________________________________________________________________________________
+// mean / max divergence of [q] from [ref] and the [c] cycles per update unless negative,
+// returns the max orientation divergence
+float report(const char* name, double c, const std::vector<quaternion<float> > &q,
+  const std::vector<quaternion<float> > &ref, const replay &r)
+{
+  // skip the first second, all filters start at identity
+  float mean = 0.0, max = 0.0, mean_tilt = 0.0, max_tilt = 0.0;
+  size_t skip = (size_t) (1.0 / r.dT / BLOCK), cnt = 0;
+  for (size_t k = skip; k < q.size() && k < ref.size(); ++k, ++cnt) {
+    float angle, tilt;
+    divergence(q[k], ref[k], angle, tilt);
+    mean += angle;
+    mean_tilt += tilt;
+    max = angle > max ? angle : max;
+    max_tilt = tilt > max_tilt ? tilt : max_tilt;
+  }
+  if (cnt > 0) {
+    mean /= cnt;
+    mean_tilt /= cnt;
+  }
+
+  printf("%-14s ", name);
+  if (c >= 0.0)
+#if defined(__i386__) || defined(__x86_64__)
+    printf("%8.1f cycles/update", c / r.n);
+#else
+    printf("%8.1f     ns/update", c / r.n);
+#endif
+  else
+    printf("%22s", "");
+  printf("  orientation %7.2f / %7.2f deg  tilt %6.2f / %6.2f deg (mean / max)\n", mean, max, mean_tilt, max_tilt);
+  return max;
+}
+
+//_______________________________________________________________________________________________________
+template <typename Filter>
+void run(const char* name, const Filter &filter, replay &r, std::vector<quaternion<float> >* out = NULL) {
+  imu_fusion<Filter> fusion(filter);
+  std::vector<quaternion<float> > q;
+
+  uint64_t c = 0;
+  for (size_t i = 0; i < r.n; i += BLOCK) {
+    size_t len = (r.n - i < BLOCK) ? r.n - i : BLOCK;
+    imu_soa block = {{r.in.accel[0] + i, r.in.accel[1] + i, r.in.accel[2] + i},
+                     {r.in.gyro[0] + i, r.in.gyro[1] + i, r.in.gyro[2] + i}};
+    uint64_t c0 = cycles();
+    fusion.update(block, len, r.dT);
+    c += cycles() - c0;
+    q.push_back(fusion.getQuaternion());
+  }
+
+  if (out != NULL)
+    *out = q;
+  report(name, c, q, r.ref, r);
+}
+
+//_______________________________________________________________________________________________________
+// fixed-point Madgwick straight from the raw values, returns the max divergence from [madgwick]
+float runFixed(replay &r, const std::vector<quaternion<float> > &madgwick) {
+  imu_fusion_q fusion(5.0, r.dT);
+  std::vector<quaternion<float> > q;
+
+  uint64_t c = 0;
+  for (size_t i = 0; i < r.n; i += BLOCK) {
+    size_t len = (r.n - i < BLOCK) ? r.n - i : BLOCK;
+    uint64_t c0 = cycles();
+    fusion.update(&r.raw[6 * i], len);
+    c += cycles() - c0;
+    quaternion<float> qi;
+    fusion.getQuaternion(qi);
+    q.push_back(qi);
+  }
+
+  report("madgwick Q30", c, q, r.ref, r);
+  return report("  vs float", -1.0, q, madgwick, r);
+}
+
+//_______________________________________________________________________________________________________
+// tumbling motion with gyro bias and noise, raw values as the MPU would deliver them
+void synthesize(std::vector<int16_t> &raw, replay &r, float seconds, imu_convert &conv) {
+  const int sub = 10;
+  size_t n = (size_t) (seconds / r.dT);
+  float q0 = 1.0, q1 = 0.0, q2 = 0.0, q3 = 0.0;
+  srand(1);
+
+  for (size_t i = 0; i < n; ++i) {
+    float t = i * r.dT;
+    float w[3] = {(float) (0.6 * sin(0.5 * t)), (float) (0.4 * cos(0.3 * t)), (float) (0.3 * sin(0.2 * t + 1.0))}; // [rad/s]
+
+    // true orientation, integrated finely
+    for (int s = 0; s < sub; ++s) {
+      float h = 0.5f * r.dT / sub;
+      float a = q0, b = q1, c = q2;
+      q0 += h * (-b * w[0] - c * w[1] - q3 * w[2]);
+      q1 += h * (a * w[0] + c * w[2] - q3 * w[1]);
+      q2 += h * (a * w[1] - b * w[2] + q3 * w[0]);
+      q3 += h * (a * w[2] + b * w[1] - c * w[0]);
+      float norm = 1.0f / sqrtf(q0*q0 + q1*q1 + q2*q2 + q3*q3);
+      q0 *= norm; q1 *= norm; q2 *= norm; q3 *= norm;
+    }
+
+    // gravity in the sensor frame and the measured rates
+    float g[3] = {2.0f * (q1*q3 - q0*q2), 2.0f * (q0*q1 + q2*q3), q0*q0 - q1*q1 - q2*q2 + q3*q3};
+    for (int j = 0; j < 3; ++j) {
+      float noise = (rand() / (float) RAND_MAX - 0.5f);
+      raw.push_back((int16_t) ((9.807f * g[j] + 0.2f * noise) / conv.getAccelScale()));
+    }
+    for (int j = 0; j < 3; ++j) {
+      float noise = (rand() / (float) RAND_MAX - 0.5f);
+      raw.push_back((int16_t) ((w[j] * 180.0 / M_PI + 0.5f + 0.5f * noise) / conv.getGyroScale()));
+    }
+
+    if ((i + 1) % BLOCK == 0 || i + 1 == n) {
+      quaternion<float> q;
+      q.m_w = q0; q.m_x = q1; q.m_y = q2; q.m_z = q3;
+      r.ref.push_back(q);
+    }
+  }
+}
+
+
+//_______________________________________________________________________________________________________
+int main(int argc, char** argv) {
+  imu_convert conv;
+  replay r;
+  r.dT = 1.0 / DATALOG_SAMPLE_RATE;
+
+  std::vector<int16_t> &raw = r.raw;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      r.dT = 1.0 / atof(argv[++i]);
+      continue;
+    }
+    size_t cnt = readDatalog(argv[i], raw);
+    printf("[REPLAY] %s: %zu samples\n", argv[i], cnt);
+  }
+
+  bool synthetic = raw.empty();
+  if (synthetic) {
+    synthesize(raw, r, 600.0, conv);
+    printf("[REPLAY] no log files given, 10 minutes of synthetic motion\n");
+  }
+
+  r.n = raw.size() / 6;
+  r.buf.resize(6 * r.n);
+  for (int j = 0; j < 3; ++j) {
+    r.in.accel[j] = &r.buf[j * r.n];
+    r.in.gyro[j] = &r.buf[(j + 3) * r.n];
+  }
+  conv.convert(raw.data(), r.n, r.in);
+  printf("[REPLAY] %zu samples @ %.1f Hz\n", r.n, 1.0 / r.dT);
+
+  // without ground truth Madgwick is the reference
+  std::vector<quaternion<float> > madgwick;
+  run("madgwick", madgwick_filter<float>(5.0), r, &madgwick);
+  if (!synthetic)
+    r.ref = madgwick;
+  run("mahony", mahony_filter<float>(1.0, 0.0), r);
+  run("mahony PI", mahony_filter<float>(1.0, 0.05), r);
+  run("complementary", complementary_filter<float>(0.98), r);
+
+  // error bound documented in imu_fusion_q.h
+  if (runFixed(r, madgwick) > 0.1) {
+    printf("[REPLAY] FAILED: fixed-point filter exceeds its error bound\n");
+    return 1;
+  }
+
+  printf("[REPLAY] OK\n");
+  return 0;
+}
@@ -0,0 +1,133 @@
+/*
+* Host test: versioned file format of the sample log
+* CRC32C against its check value, SSE4.2 against the table, the file header written and read back
+* and rejected when damaged or missing, pages packed with their codec and sequence number and
+* unpacked, raw where the codec does not pay off, damaged pages rejected and skipped by seek()
+* build via build_sim.sh
+*
+*/
+
+#include <chrono>
+#include <vector>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "log_format.h"
+#include "check.h"
+
+#define ROUNDS 2000 // pages for the timing
+
+typedef std::chrono::steady_clock Clock;
+
+
+//_______________________________________________________________________________________________________
+// a page of [n] samples with a header as the logger writes it, smooth or noise over the full range
+void fill(log_page &page, size_t n, bool smooth, int64_t stamp) {
+  page.size = LOG_HEADER_SIZE;
+  page.stamp = stamp;
+  for (int i = 0; i < LOG_HEADER_SIZE; ++i)
+    page.header()[i] = (uint8_t) (i * 7 + 1);
+  for (size_t i = 0; i < n; ++i) {
+    int16_t s[6];
+    for (int c = 0; c < 6; ++c)
+      s[c] = smooth ? (int16_t) lrint(300.0 * sin(0.05 * i + c) + rand() % 9 - 4) : (int16_t) (rand() & 0xFFFF);
+    page.append(s, 1);
+  }
+}
+
+
+//_______________________________________________________________________________________________________
+int main(int argc, char** argv) {
+  srand(24);
+
+  // CRC32C
+  const char* digits = "123456789";
+  check(log_format::crc32c((const uint8_t*) digits, 9) == 0xE3069283 &&
+    log_format::crc32cScalar((const uint8_t*) digits, 9) == 0xE3069283, "CRC32C check value");
+  std::vector<uint8_t> bytes(LOG_PAGE_SIZE);
+  for (size_t i = 0; i < bytes.size(); ++i)
+    bytes[i] = (uint8_t) rand();
+  bool same = true;
+  for (size_t off = 0; off < 8; ++off)
+    for (size_t n = 0; n < 100; ++n)
+      same = same && log_format::crc32c(&bytes[off], n) == log_format::crc32cScalar(&bytes[off], n);
+  uint32_t part = log_format::crc32c(bytes.data(), 1000);
+  same = same && log_format::crc32c(&bytes[1000], bytes.size() - 1000, part) ==
+    log_format::crc32cScalar(bytes.data(), bytes.size());
+  check(same, "CRC32C at any alignment and continued");
+
+  double t[2];
+  volatile uint32_t crc = 0;
+  for (int mode = 0; mode < 2; ++mode) {
+    Clock::time_point t0 = Clock::now();
+    for (int r = 0; r < ROUNDS; ++r)
+      crc = mode == 0 ? log_format::crc32c(bytes.data(), bytes.size()) : log_format::crc32cScalar(bytes.data(), bytes.size());
+    t[mode] = std::chrono::duration<double, std::micro>(Clock::now() - t0).count() / ROUNDS;
+  }
+  (void) crc;
+  printf("       CRC32C per page: %.2f us (table %.2f)%s\n", t[0], t[1],
+#ifdef __SSE4_2__
+    ", SSE4.2"
+#else
+    ", no SSE4.2"
+#endif
+  );
+
+  // file header
+  log_file_header header;
+  strncpy(header.device, "platypus-17", sizeof(header.device) - 1);
+  header.afs = 4;
+  header.gfs = 250;
+  header.rate = 25.0;
+  header.bandwidth = 5.0;
+  uint8_t buf[LOG_FILE_HEADER_SIZE];
+  log_format::writeHeader(header, buf);
+  log_file_header back;
+  check(log_format::readHeader(buf, sizeof(buf), back) && back.version == LOG_FORMAT_VERSION &&
+    strcmp(back.device, "platypus-17") == 0 && back.afs == 4 && back.gfs == 250 && back.rate == 25.0 &&
+    back.bandwidth == 5.0 && back.channels == 6 && back.value_size == 2 && strcmp(back.schema, LOG_SCHEMA) == 0,
+    "file header read back");
+  buf[33] ^= 0x10;
+  check(!log_format::readHeader(buf, sizeof(buf), back), "damaged file header rejected");
+  log_page page, out;
+  fill(page, LOG_PAGE_SAMPLES, true, 0);
+  check(!log_format::readHeader(page.data, page.size, back), "datalog page is no file header");
+
+  // pages
+  log_format format;
+  log_page_info info;
+  std::vector<uint8_t> packed(3 * LOG_FORMAT_PAGE_BOUND);
+  fill(page, LOG_PAGE_SAMPLES, true, 123456789012345LL);
+  size_t len = format.pack(&page, Codec::DELTA, 41, packed.data());
+  printf("       smooth page: %lu bytes of %d\n", len, LOG_PAGE_SIZE);
+  check(format.unpack(packed.data(), len, &out, &info) == len && info.codec == Codec::DELTA &&
+    info.sequence == 41 && info.stamp == 123456789012345LL && info.samples == LOG_PAGE_SAMPLES &&
+    out.size == page.size && out.stamp == page.stamp && memcmp(out.data, page.data, page.size) == 0,
+    "page packed and unpacked with its header");
+  check(len < LOG_PAGE_SIZE / 2, "smooth page packed below half its size");
+  check(format.unpack(packed.data(), len - 1, &out) == 0, "truncated page rejected");
+  packed[LOG_PAGE_HEADER_SIZE + LOG_HEADER_SIZE + 100] ^= 0x04;
+  check(format.unpack(packed.data(), len, &out) == 0, "damaged page rejected");
+  packed[LOG_PAGE_HEADER_SIZE + LOG_HEADER_SIZE + 100] ^= 0x04;
+
+  fill(out, LOG_PAGE_SAMPLES, false, 5);
+  size_t noise = format.pack(&out, Codec::DELTA, 42, packed.data() + len);
+  check(packed[len + 2] == (uint8_t) Codec::RAW && noise == LOG_PAGE_HEADER_SIZE + LOG_PAGE_SIZE &&
+    memcmp(packed.data() + len + LOG_PAGE_HEADER_SIZE, out.data, out.size) == 0, "noise page stays raw");
+
+  fill(page, 100, true, 6);
+  size_t partial = format.pack(&page, Codec::DELTA, 43, packed.data() + len + noise);
+  check(format.unpack(packed.data() + len + noise, partial, &out, &info) == partial && info.samples == 100 &&
+    out.size == page.size && memcmp(out.data, page.data, page.size) == 0, "partial page packed and unpacked");
+
+  // pages found on their own behind a damaged one
+  packed[len + 10] ^= 0x01;
+  size_t next = log_format::seek(packed.data() + 1, len + noise + partial - 1);
+  check(next + 1 == len + noise && log_format::check(packed.data() + len + noise, partial, info) &&
+    info.sequence == 43, "seek() skips to the next intact page");
+  check(log_format::seek(packed.data() + len + 1, noise - 1) == noise - 1, "seek() finds none");
+
+  return m_failed ? 1 : 0;
+}
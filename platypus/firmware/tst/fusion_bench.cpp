@@ -0,0 +1,131 @@
+/*
+* Host benchmark: orientation filter steps per second
+* compares imu_edison::Madgwick*FilterStep() per sample with imu_fusion on FIFO blocks; the
+* EXT_SENS_DATA snapshot is dropped before every magnetometer access, as on the device where the
+* steps are a sample period apart and the snapshot is always stale
+* build via build_sim.sh
+*
+*/
+
+#include <chrono>
+#include <vector>
+
+#include "imu_edison.h"
+#include "imu_fusion.h"
+#include "sim/mpu_sim.h"
+
+#define SAMPLES 2000
+#define BLOCK 42 // full FIFO
+#define RUNS 20
+#define DT 0.01f
+#define ERROR 5.0f
+
+typedef std::chrono::steady_clock Clock;
+
+
+//_______________________________________________________________________________________________________
+double usSince(Clock::time_point t0) {
+  return std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+}
+
+//_______________________________________________________________________________________________________
+void report(const char* name, double us, const sim::bus_stats &st) {
+  printf("%-12s %10.0f steps/s  %6.1f I2C transactions per 1000 steps\n",
+    name, RUNS * SAMPLES / us * 1e6, st.transactions * 1000.0 / (RUNS * SAMPLES));
+}
+
+//_______________________________________________________________________________________________________
+float qdiff(const quaternion<float> &a, const quaternion<float> &b) {
+  // q and -q are the same rotation
+  float d = fabs(a.m_w*b.m_w + a.m_x*b.m_x + a.m_y*b.m_y + a.m_z*b.m_z);
+  return 1.0 - (d > 1.0 ? 1.0 : d);
+}
+
+
+//_______________________________________________________________________________________________________
+int main(int argc, char** argv) {
+  mpu_sim mpu;
+  imu_edison imu;
+  sim::bus &bus = sim::bus::instance();
+
+  // magnetometer where the aux plan puts it in EXT_SENS_DATA (little endian), status 2 behind it without overflow
+  const int16_t mag[3] = {220, -90, -410};
+  const int offset = imu.getAuxPlan().mag_offset;
+  for (int i = 0; i < 3; ++i) {
+    mpu.m_reg[MPU_EXT_SENS_DATA_00 + offset + 2*i] = mag[i] & 0xFF;
+    mpu.m_reg[MPU_EXT_SENS_DATA_00 + offset + 1 + 2*i] = (mag[i] >> 8) & 0xFF;
+  }
+  float mx, my, mz;
+  imu.getCompassData(mx, my, mz);
+
+  // slow tumbling with gravity and some noise
+  // (not starting level, the per-call filter divides by a zero step there)
+  std::vector<float> buf(6 * SAMPLES);
+  imu_soa in = {{&buf[0], &buf[SAMPLES], &buf[2 * SAMPLES]},
+                {&buf[3 * SAMPLES], &buf[4 * SAMPLES], &buf[5 * SAMPLES]}};
+  for (int i = 0; i < SAMPLES; ++i) {
+    float t = 1.0 + i * DT;
+    in.accel[0][i] = 9.807 * sin(0.3 * t) + 0.05 * sin(17.0 * t);
+    in.accel[1][i] = 9.807 * sin(0.2 * t) * cos(0.3 * t);
+    in.accel[2][i] = 9.807 * cos(0.2 * t) * cos(0.3 * t);
+    in.gyro[0][i] = 11.5 * cos(0.2 * t) + 0.3 * sin(23.0 * t);
+    in.gyro[1][i] = 17.2 * cos(0.3 * t);
+    in.gyro[2][i] = 5.0 + 0.2 * cos(29.0 * t);
+  }
+
+  for (int with_mag = 0; with_mag < 2; ++with_mag) {
+    const char* name[2][2] = {{"imu step", "imu block"}, {"ahrs step", "ahrs block"}};
+
+    // per call: vector by value, magnetometer read from the bus on every step
+    // (the host runs the steps within one sample period, the device does not)
+    quaternion<float> q_ref;
+    bus.stats.reset();
+    Clock::time_point t0 = Clock::now();
+    for (int r = 0; r < RUNS; ++r) {
+      q_ref = quaternion<float>();
+      for (int i = 0; i < SAMPLES; ++i) {
+        std::vector<float> data(6);
+        for (int j = 0; j < 3; ++j) {
+          data[j] = in.accel[j][i];
+          data[j + 3] = in.gyro[j][i];
+        }
+        if (with_mag) {
+          imu.invalidateESData();
+          imu.MadgwickFilterStep(data, DT, ERROR, q_ref);
+        }
+        else
+          imu.MadgwickIMUFilterStep(data, DT, ERROR, q_ref);
+      }
+    }
+    report(name[with_mag][0], usSince(t0), bus.stats);
+
+    // blocks of a full FIFO, magnetometer snapshot once per block
+    imu_fusion<> fusion(madgwick_filter<float>(ERROR));
+    bus.stats.reset();
+    t0 = Clock::now();
+    for (int r = 0; r < RUNS; ++r) {
+      fusion.setQuaternion(quaternion<float>());
+      for (int i = 0; i < SAMPLES; i += BLOCK) {
+        if (with_mag) {
+          imu.invalidateESData();
+          imu.getCompassData(mx, my, mz);
+          fusion.setMag(mx, my, mz);
+        }
+        imu_soa block = {{in.accel[0] + i, in.accel[1] + i, in.accel[2] + i},
+                         {in.gyro[0] + i, in.gyro[1] + i, in.gyro[2] + i}};
+        fusion.update(block, (SAMPLES - i < BLOCK) ? SAMPLES - i : BLOCK, DT);
+      }
+    }
+    report(name[with_mag][1], usSince(t0), bus.stats);
+
+    float d = qdiff(q_ref, fusion.getQuaternion());
+    printf("             orientation difference 1-|<q,q'>| = %g\n", d);
+    if (!(d <= 1e-5)) {
+      printf("[BENCH] FAILED: block filter diverges from the per-call filter\n");
+      return 1;
+    }
+  }
+
+  printf("[BENCH] OK\n");
+  return 0;
+}
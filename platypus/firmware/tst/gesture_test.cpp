@@ -0,0 +1,128 @@
+/*
+* Host test: streaming gesture recognition
+* a synthetic FIFO stream with a tap, a double tap, a shake and a flip face down and back,
+* fed in blocks of one watermark, checks the events, their order and latency, and the cost
+* build via build_sim.sh
+*
+*/
+
+#include <chrono>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+
+#include "imu_gesture.h"
+#include "imu_convert.h"
+#include "check.h"
+
+#define RATE 25.0 // [Hz]
+#define BLOCK 25 // watermark
+#define RUNS 200
+
+typedef std::chrono::steady_clock Clock;
+
+// when the gestures happen [s]
+#define T_TAP 3.0
+#define T_DOUBLE 6.0
+#define T_DOUBLE2 6.3
+#define T_SHAKE 9.0
+#define T_DOWN 13.0
+#define T_UP 17.0
+#define T_END 21.0
+#define FLIP 1.0 // [s] for half a turn, 180deg/s within the +-250deg/s range
+
+
+//_______________________________________________________________________________________________________
+float noise(float amp) {
+  return amp * (2.0 * rand() / (float) RAND_MAX - 1.0);
+}
+
+//_______________________________________________________________________________________________________
+size_t at(double t) {
+  return (size_t) lround(t * RATE);
+}
+
+//_______________________________________________________________________________________________________
+void generate(std::vector<int16_t> &raw, imu_convert &conv) {
+  size_t n = at(T_END);
+  for (size_t i = 0; i < n; ++i) {
+    double t = i / RATE;
+
+    // half a turn about X face down and back
+    double angle = 0.0, rate = 0.0;
+    if (t >= T_DOWN && t < T_UP + FLIP) {
+      double p = t < T_UP ? (t - T_DOWN) / FLIP : 1.0 - (t - T_UP) / FLIP;
+      p = p > 1.0 ? 1.0 : p;
+      angle = M_PI * p;
+      if ((t < T_DOWN + FLIP) || t >= T_UP)
+        rate = (t < T_UP ? 180.0 : -180.0) / FLIP;
+    }
+    float a[3] = {noise(0.05), 9.807f * (float) sin(angle) + noise(0.05), 9.807f * (float) cos(angle) + noise(0.05)};
+    float w[3] = {(float) rate + noise(0.3), noise(0.3), noise(0.3)};
+
+    // taps ring for two samples
+    if (i == at(T_TAP) || i == at(T_DOUBLE) || i == at(T_DOUBLE2)) {
+      a[2] += 12.0;
+    } else if (i == at(T_TAP) + 1 || i == at(T_DOUBLE) + 1 || i == at(T_DOUBLE2) + 1) {
+      a[2] -= 3.0;
+    }
+    // shaking sideways at 3Hz for 2s
+    if (t >= T_SHAKE && t < T_SHAKE + 2.0)
+      a[0] += 12.0 * sin(2.0 * M_PI * 3.0 * (t - T_SHAKE));
+
+    for (int j = 0; j < 3; ++j)
+      raw.push_back((int16_t) lround(a[j] / conv.getAccelScale()));
+    for (int j = 0; j < 3; ++j)
+      raw.push_back((int16_t) lround(w[j] / conv.getGyroScale()));
+  }
+}
+
+
+//_______________________________________________________________________________________________________
+int main(int argc, char** argv) {
+  imu_convert conv;
+  imu_gesture gest(RATE);
+  srand(1);
+
+  std::vector<int16_t> raw;
+  generate(raw, conv);
+  size_t n = raw.size() / 6;
+
+  // events with the absolute sample they were recognized at
+  std::vector<imu_gesture_event> events, block;
+  for (size_t i = 0; i < n; i += BLOCK) {
+    size_t len = (n - i < BLOCK) ? n - i : BLOCK;
+    block.clear();
+    gest.update(&raw[6 * i], len, block);
+    for (size_t e = 0; e < block.size(); ++e) {
+      block[e].sample += i;
+      events.push_back(block[e]);
+      printf("       %-10s at %5.2f s\n", imu_gesture::name(block[e].type), block[e].sample / RATE);
+    }
+  }
+
+  const Gesture expect[7] = {Gesture::TAP, Gesture::TAP, Gesture::TAP, Gesture::DOUBLE_TAP,
+    Gesture::SHAKE, Gesture::FACE_DOWN, Gesture::FACE_UP};
+  // latest sample each one may be recognized at: taps right after the spike,
+  // the shake within half a second, face down/up after the turn and the hold time
+  const size_t latest[7] = {at(T_TAP) + 3, at(T_DOUBLE) + 3, at(T_DOUBLE2) + 3, at(T_DOUBLE2) + 3,
+    at(T_SHAKE + 0.5), at(T_DOWN + FLIP + IMU_GESTURE_FACE_HOLD + 0.5), at(T_UP + FLIP + IMU_GESTURE_FACE_HOLD + 0.5)};
+  bool ok = events.size() == 7;
+  for (size_t e = 0; ok && e < 7; ++e)
+    ok = events[e].type == expect[e] && events[e].sample <= latest[e];
+  check(ok, "tap, tap, tap, double-tap, shake, face-down, face-up in time");
+  check(!gest.isFaceDown() && !gest.isShaking(), "face up and still at the end");
+
+  // cost of one pass
+  Clock::time_point t0 = Clock::now();
+  for (int r = 0; r < RUNS; ++r) {
+    gest.reset();
+    events.clear();
+    gest.update(&raw[0], n, events);
+  }
+  double ns = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / (RUNS * n);
+  printf("       %.1f ns/sample\n", ns);
+
+  return m_failed ? 1 : 0;
+}
@@ -0,0 +1,134 @@
+/*
+* Host test: interrupt driven acquisition with a simulated INT pin
+* a producer thread fills the simulated FIFO and pulses the pin on wake-on-motion,
+* the reader only wakes up for the watermark or an interrupt
+* build via build_sim.sh
+*
+*/
+
+#include <chrono>
+#include <thread>
+#include <atomic>
+
+#include "imu_edison.h"
+#include "imu_irq.h"
+#include "sim/mpu_sim.h"
+#include "check.h"
+
+typedef std::chrono::steady_clock Clock;
+
+
+//_______________________________________________________________________________________________________
+double msSince(Clock::time_point t0) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+
+//_______________________________________________________________________________________________________
+int main(int argc, char** argv) {
+  mpu_sim mpu;
+  imu_edison imu;
+  imu.setInterrupts(MPU_INT_FIFO_OFLOW | MPU_INT_WOM);
+
+  gpio_irq_source src(IMU_INT_GPIO);
+  imu_irq irq(&imu, &src, 5); // 5 samples @ 25Hz -> 200ms
+  mraa::Gpio* pin = mraa::Gpio::find(IMU_INT_GPIO);
+  check(pin != NULL, "interrupt handler attached to the INT pin");
+  if (pin == NULL)
+    return 1;
+
+  // no interrupt: returns once the FIFO reached the watermark
+  Clock::time_point t0 = Clock::now();
+  uint8_t is = irq.wait();
+  double ms = msSince(t0);
+  check(is == 0 && irq.getTimeouts() == 1, "watermark wakeup without interrupt");
+  check(ms >= 190 && ms < 400, "watermark wakeup after the FIFO fill time");
+
+  // wake-on-motion: returns right after the edge with the status, latch is released
+  std::thread producer([&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    mpu.raise(MPU_INT_WOM);
+    pin->set(0);
+  });
+  t0 = Clock::now();
+  is = irq.wait();
+  ms = msSince(t0);
+  producer.join();
+  pin->set(1);
+  check(imu.hasWOMInt(is) && irq.getIntWakeups() == 1, "WoM interrupt wakes the reader");
+  check(ms < 100, "WoM wakeup latency below the watermark");
+  check(mpu.m_reg[MPU_INT_STATUS] == 0, "interrupt status cleared by the reader");
+
+  // streaming: 100 samples at ~100Hz, WoM every 25th sample, nothing may get lost
+  std::atomic<bool> done(false);
+  producer = std::thread([&] {
+    int16_t sample[6];
+    for (int i = 0; i < 100; ++i) {
+      for (int j = 0; j < 6; ++j)
+        sample[j] = (int16_t)(i * 6 + j);
+      mpu.pushFIFO(sample);
+      if (i % 25 == 24) {
+        mpu.raise(MPU_INT_WOM);
+        pin->pulse();
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    done = true;
+  });
+
+  int16_t data[MPU_FIFO_SIZE / 2];
+  int received = 0, wakeups = 0;
+  bool in_order = true;
+  while (!done || mpu.FIFOcnt() > 0) {
+    irq.wait();
+    ++wakeups;
+    size_t n = imu.readFIFO(data, MPU_FIFO_SIZE / 2);
+    for (size_t i = 0; i < n; ++i)
+      in_order &= (data[i] == received * 6 + (int) i);
+    received += n / 6;
+  }
+  producer.join();
+  check(received == 100 && in_order, "all FIFO samples drained in order");
+  check(wakeups <= 12, "reader woke only for watermark and interrupts");
+  printf("       %d wakeups for %d samples, %lu edges\n", wakeups, received, irq.getInterrupts());
+
+  // shutdown releases a waiting reader
+  producer = std::thread([&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    irq.wakeup();
+  });
+  t0 = Clock::now();
+  irq.wait();
+  producer.join();
+  check(msSince(t0) < 100, "wakeup() releases the reader");
+
+  // low-power mode: accel only cycle mode with WoM, the reader sleeps past the watermark
+  imu.lowPower(true);
+  check(mpu.m_reg[MPU_PWR_MGMT_1] == 0x20 && mpu.m_reg[MPU_PWR_MGMT_2] == 0x07 &&
+    mpu.m_reg[MPU_INT_ENABLE] == MPU_INT_WOM && mpu.m_reg[MPU_FIFO_EN] == 0x00, "low-power cycle mode with WoM only");
+  producer = std::thread([&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    mpu.raise(MPU_INT_WOM);
+    pin->pulse();
+  });
+  t0 = Clock::now();
+  unsigned long timeouts = irq.getTimeouts();
+  is = irq.waitInterrupt();
+  ms = msSince(t0);
+  producer.join();
+  check(imu.hasWOMInt(is) && ms >= 450 && irq.getTimeouts() == timeouts, "low-power reader blocks until WoM");
+  imu.lowPower(false);
+  check(mpu.m_reg[MPU_PWR_MGMT_1] == 0x00 && mpu.m_reg[MPU_PWR_MGMT_2] == 0x00 &&
+    mpu.m_reg[MPU_INT_ENABLE] == (MPU_INT_FIFO_OFLOW | MPU_INT_WOM) && mpu.m_reg[MPU_FIFO_EN] == 0x78 &&
+    mpu.FIFOcnt() == 0, "full rate FIFO capture restored");
+  check(!imu.isLowPower() && imu.getLowPowerEntries() == 1 && imu.getLowPowerExits() == 1, "transitions counted");
+
+  // software source
+  soft_irq_source soft;
+  imu_irq soft_irq(&imu, &soft, 40);
+  mpu.raise(MPU_INT_FIFO_OFLOW);
+  soft.trigger();
+  check(imu.hasFIFOInt(soft_irq.wait()), "soft_irq_source delivers interrupts");
+
+  return m_failed ? 1 : 0;
+}
@@ -0,0 +1,223 @@
+/*
+* Host test: write-ahead journal of the sample log
+* every page in the journal and synced within the window while the batch is not due, the journal
+* left by a crash recovered at start() into its segment; recover() behind a torn write, a missing
+* segment, a damaged page in the journal and a damaged journal header
+* build via build_sim.sh
+*
+*/
+
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "log_writer.h"
+#include "log_journal.h"
+#include "datalog.h"
+#include "check.h"
+
+#define LOG_DIR "/tmp/journal_test/"
+#define JOURNAL LOG_DIR "datalog.journal"
+
+
+//_______________________________________________________________________________________________________
+std::string segment(int num) {
+  char name[64];
+  snprintf(name, sizeof(name), LOG_DIR "datalog%04d.bin", num);
+  return name;
+}
+
+//_______________________________________________________________________________________________________
+// removes the files of the test and the directory
+void cleanup() {
+  for (int i = 0; i < 20; ++i)
+    remove(segment(i).c_str());
+  remove(JOURNAL);
+  remove(LOG_DIR "crash.journal");
+  rmdir(LOG_DIR);
+}
+
+//_______________________________________________________________________________________________________
+std::vector<uint8_t> readFile(const std::string &path) {
+  std::vector<uint8_t> buf;
+  FILE* f = fopen(path.c_str(), "rb");
+  if (f == NULL)
+    return buf;
+  uint8_t chunk[4096];
+  size_t len;
+  while ((len = fread(chunk, 1, sizeof(chunk), f)) > 0)
+    buf.insert(buf.end(), chunk, chunk + len);
+  fclose(f);
+  return buf;
+}
+
+//_______________________________________________________________________________________________________
+void writeFile(const std::string &path, const uint8_t* data, size_t n) {
+  FILE* f = fopen(path.c_str(), "wb");
+  fwrite(data, 1, n, f);
+  fclose(f);
+}
+
+//_______________________________________________________________________________________________________
+// page [k] of full pages, every value tells its sample and channel
+void fill(log_page &page, uint32_t k) {
+  page.size = LOG_HEADER_SIZE;
+  page.stamp = k;
+  memset(page.header(), 0, LOG_HEADER_SIZE);
+  for (size_t i = 0; i < LOG_PAGE_SAMPLES; ++i) {
+    int16_t s[6];
+    for (int c = 0; c < 6; ++c)
+      s[c] = (int16_t) (((k * LOG_PAGE_SAMPLES + i) * 6 + c) & 0xFFFF);
+    page.append(s, 1);
+  }
+}
+
+//_______________________________________________________________________________________________________
+// appends the samples of segment [num] to [raw], false if it has no valid header or a broken page
+// or the sequence numbers do not count from [sequence]; the pages found to [pages]
+bool readBack(int num, std::vector<int16_t> &raw, uint32_t sequence, size_t &pages) {
+  log_format format;
+  log_file_header header;
+  log_page_info info;
+  log_page page;
+  std::vector<uint8_t> buf = readFile(segment(num));
+  pages = 0;
+  if (!log_format::readHeader(buf.data(), buf.size(), header) || strcmp(header.device, "test") != 0)
+    return false;
+  for (size_t pos = LOG_FILE_HEADER_SIZE; pos < buf.size(); pos += info.size, ++pages) {
+    if (format.unpack(&buf[pos], buf.size() - pos, &page, &info) == 0 || info.sequence != sequence++)
+      return false;
+    readDatalogPage(page.data + LOG_HEADER_SIZE, page.getSamples(), raw);
+  }
+  return true;
+}
+
+//_______________________________________________________________________________________________________
+// the samples of the pages [first, last) as fill() makes them
+std::vector<int16_t> expected(uint32_t first, uint32_t last) {
+  std::vector<int16_t> raw;
+  for (uint64_t i = (uint64_t) first * LOG_PAGE_SAMPLES * 6; i < (uint64_t) last * LOG_PAGE_SAMPLES * 6; ++i)
+    raw.push_back((int16_t) (i & 0xFFFF));
+  return raw;
+}
+
+
+//_______________________________________________________________________________________________________
+int main(int argc, char** argv) {
+  cleanup();
+  mkdir(LOG_DIR, S_IRWXU);
+  log_file_header header;
+  strncpy(header.device, "test", sizeof(header.device) - 1);
+  log_format format;
+  std::vector<uint8_t> packed(LOG_FORMAT_PAGE_BOUND);
+  log_page page;
+
+  // the writer: pages in the journal long before their batch, the journal of a crash recovered
+  {
+    log_arena arena(16);
+    log_writer writer(&arena, LOG_DIR, "datalog", 8);
+    writer.setPolicy(16, 100.0, -1.0);
+    writer.setCodec(Codec::DELTA);
+    writer.setHeader(header);
+    writer.setJournal(0.1);
+    writer.start();
+    for (uint32_t k = 0; k < 5; ++k) {
+      log_page* p = arena.begin();
+      fill(*p, k);
+      arena.commit(p);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    log_writer_stats stats = writer.getStats();
+    printf("       %lu pages in the journal, %lu journal syncs, %lu pages in the segments\n",
+      stats.journal_pages, stats.journal_syncs, stats.pages);
+    check(stats.journal_pages == 5 && stats.journal_syncs >= 1 && stats.pages == 0 && stats.depth == 0,
+      "pages in the journal and synced within the window, the batch not due");
+
+    // what a crash leaves on the flash: the journal and no segment
+    std::vector<uint8_t> journal = readFile(JOURNAL);
+    writer.stop();
+    check(access(JOURNAL, F_OK) != 0, "no journal left after stop()");
+    remove(segment(0).c_str());
+    writeFile(JOURNAL, journal.data(), journal.size());
+
+    log_writer restart(&arena, LOG_DIR, "datalog", 8);
+    restart.setHeader(header);
+    restart.setJournal(0.1);
+    restart.start();
+    restart.stop();
+    std::vector<int16_t> back;
+    size_t pages;
+    check(restart.getStats().recovered == 5 && readBack(0, back, 0, pages) && back == expected(0, 5) &&
+      restart.getSegment() == 1, "journal recovered into its segment at start()");
+  }
+
+  // recover(): a torn write behind the pages synced, the journal overlaps the intact tail
+  {
+    std::vector<uint8_t> seg(LOG_FILE_HEADER_SIZE);
+    log_format::writeHeader(header, seg.data());
+    size_t synced = 0;
+    log_journal journal;
+    std::vector<std::vector<uint8_t> > pages;
+    for (uint32_t k = 0; k < 6; ++k) {
+      fill(page, k);
+      size_t len = format.pack(&page, Codec::DELTA, k, packed.data());
+      pages.push_back(std::vector<uint8_t>(packed.begin(), packed.begin() + len));
+      if (k < 3)
+        seg.insert(seg.end(), packed.begin(), packed.begin() + len);
+      else if (k == 3)
+        seg.insert(seg.end(), packed.begin(), packed.begin() + len / 2);
+      if (k == 1)
+        synced = seg.size();
+    }
+    writeFile(segment(3), seg.data(), seg.size());
+    journal.open(LOG_DIR "crash.journal", 3, header);
+    journal.reset(3, synced, NULL, 0);
+    for (uint32_t k = 2; k < 6; ++k) {
+      struct iovec v = {pages[k].data(), pages[k].size()};
+      journal.append(&v, 1);
+    }
+    journal.close();
+
+    size_t recovered = log_journal::recover(LOG_DIR "crash.journal", LOG_DIR, "datalog");
+    std::vector<int16_t> back;
+    size_t n;
+    check(recovered == 3 && readBack(3, back, 0, n) && n == 6 && back == expected(0, 6),
+      "torn write replaced, pages on the flash kept");
+    check(readFile(LOG_DIR "crash.journal").empty() &&
+      log_journal::recover(LOG_DIR "crash.journal", LOG_DIR, "datalog") == 0, "journal emptied");
+
+    // a missing segment is created, a damaged page ends the journal
+    journal.open(LOG_DIR "crash.journal", 4, header);
+    for (uint32_t k = 0; k < 4; ++k) {
+      std::vector<uint8_t> p = pages[k];
+      if (k == 2)
+        p[LOG_PAGE_HEADER_SIZE + LOG_HEADER_SIZE + 50] ^= 0x20;
+      struct iovec v = {p.data(), p.size()};
+      journal.append(&v, 1);
+    }
+    journal.close();
+    back.clear();
+    check(log_journal::recover(LOG_DIR "crash.journal", LOG_DIR, "datalog") == 2 && readBack(4, back, 0, n) &&
+      n == 2 && back == expected(0, 2), "missing segment created, damaged page ends the journal");
+
+    // a damaged header names no segment, the journal is ignored
+    journal.open(LOG_DIR "crash.journal", 5, header);
+    struct iovec v = {pages[0].data(), pages[0].size()};
+    journal.append(&v, 1);
+    journal.close();
+    std::vector<uint8_t> bad = readFile(LOG_DIR "crash.journal");
+    bad[5] ^= 0x01;
+    writeFile(LOG_DIR "crash.journal", bad.data(), bad.size());
+    check(log_journal::recover(LOG_DIR "crash.journal", LOG_DIR, "datalog") == 0 &&
+      access(segment(5).c_str(), F_OK) != 0 && access(segment(4).c_str(), F_OK) == 0, "damaged journal ignored");
+  }
+
+  cleanup();
+  return m_failed ? 1 : 0;
+}
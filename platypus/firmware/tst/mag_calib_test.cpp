@@ -0,0 +1,134 @@
+/*
+* Host test: streaming magnetometer calibration
+* distorts a constant field with hard/soft-iron, feeds it through the simulated compass
+* registers into mag_calib and checks the corrected field strength, the correction in
+* imu_edison::getCompassData() and the save/load round trip
+* build via build_sim.sh
+*
+*/
+
+#include <chrono>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "imu_edison.h"
+#include "mag_calib.h"
+#include "sim/mpu_sim.h"
+#include "check.h"
+
+#define SAMPLES 5000
+#define FIELD 480.0 // [mGs]
+#define LSB (10.0 * 4912.0 / 32760.0) // [mGs], see imu_edison::getCompassData()
+#define CALIB_FILE "/tmp/magcalib.txt"
+
+typedef std::chrono::steady_clock Clock;
+
+// offset of the compass data in EXT_SENS_DATA
+int m_mag = 0;
+
+
+//_______________________________________________________________________________________________________
+double usSince(Clock::time_point t0) {
+  return std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+}
+
+//_______________________________________________________________________________________________________
+// field of magnitude FIELD in a random direction, distorted and written to the compass registers
+void setField(mpu_sim &mpu) {
+  // soft-iron (symmetric, 0.8 .. 1.25 along the axes) and hard-iron [mGs]
+  static const float S[9] = {1.20, 0.08, -0.05,
+                             0.08, 0.85, 0.04,
+                            -0.05, 0.04, 1.02};
+  static const float B[3] = {150.0, -320.0, 75.0};
+
+  float h[3], n = 0.0;
+  do {
+    n = 0.0;
+    for (int i = 0; i < 3; ++i) {
+      h[i] = 2.0 * rand() / (float) RAND_MAX - 1.0;
+      n += h[i] * h[i];
+    }
+  } while (n > 1.0 || n < 1e-3);
+  n = FIELD / sqrt(n);
+
+  for (int i = 0; i < 3; ++i) {
+    float m = B[i] + n * (S[3*i] * h[0] + S[3*i + 1] * h[1] + S[3*i + 2] * h[2]);
+    int16_t raw = (int16_t) lround(m / LSB);
+    mpu.m_reg[MPU_EXT_SENS_DATA_00 + m_mag + 2*i] = raw & 0xFF;
+    mpu.m_reg[MPU_EXT_SENS_DATA_00 + m_mag + 1 + 2*i] = (raw >> 8) & 0xFF;
+  }
+}
+
+//_______________________________________________________________________________________________________
+// max relative deviation of the corrected field strength from [field]
+float fieldError(mpu_sim &mpu, imu_edison &imu, float field) {
+  float max = 0.0;
+  for (int i = 0; i < 1000; ++i) {
+    setField(mpu);
+    imu.invalidateESData();
+    float x, y, z;
+    imu.getCompassData(x, y, z);
+    float d = fabs(sqrt(x*x + y*y + z*z) / field - 1.0);
+    max = d > max ? d : max;
+  }
+  return max;
+}
+
+
+//_______________________________________________________________________________________________________
+int main(int argc, char** argv) {
+  mpu_sim mpu;
+  imu_edison imu;
+  mag_calib calib;
+  srand(1);
+
+  // compass data where the aux plan puts it, status 2 behind it without overflow
+  m_mag = imu.getAuxPlan().mag_offset;
+  mpu.m_reg[MPU_EXT_SENS_DATA_00 + m_mag + 6] = 0;
+
+  float before = fieldError(mpu, imu, FIELD);
+  printf("       uncalibrated: field strength off by up to %.1f%%\n", 100.0 * before);
+
+  double us_add = 0.0;
+  for (int i = 0; i < SAMPLES; ++i) {
+    setField(mpu);
+    imu.invalidateESData();
+    float x, y, z;
+    imu.getCompassData(x, y, z, false);
+    Clock::time_point t0 = Clock::now();
+    calib.add(x, y, z);
+    us_add += usSince(t0);
+  }
+
+  Clock::time_point t0 = Clock::now();
+  bool ok = calib.fit();
+  double us_fit = usSince(t0);
+  printf("       %zu of %d samples accepted, add %.3f us/sample, fit %.1f us\n",
+    calib.getCount(), SAMPLES, us_add / SAMPLES, us_fit);
+  check(ok, "fit");
+  if (!ok)
+    return 1;
+
+  const float* o = calib.getOffset();
+  printf("       offset %.1f %.1f %.1f mGs, field %.1f mGs\n", o[0], o[1], o[2], calib.getFieldStrength());
+
+  imu.setCompassCalib(calib.getOffset(), calib.getMatrix());
+  float after = fieldError(mpu, imu, calib.getFieldStrength());
+  printf("       calibrated: field strength off by up to %.2f%%\n", 100.0 * after);
+
+  // the soft-iron matrix keeps the volume, so the radius is FIELD * det(S)^(1/3), not FIELD
+  check(after < 0.005, "corrected field is a sphere");
+
+  // persist and restore
+  mag_calib restored;
+  check(calib.save(CALIB_FILE) && restored.load(CALIB_FILE) && restored.isValid(), "saved and loaded");
+  remove(CALIB_FILE);
+  bool same = restored.isValid();
+  for (int i = 0; i < 3; ++i)
+    same = same && fabs(restored.getOffset()[i] - calib.getOffset()[i]) <= 1e-3;
+  for (int i = 0; i < 9; ++i)
+    same = same && fabs(restored.getMatrix()[i] - calib.getMatrix()[i]) <= 1e-6;
+  check(same, "offset and matrix the same after load");
+
+  return m_failed ? 1 : 0;
+}
@@ -0,0 +1,196 @@
+/*
+* Register model of the MPU 9250 for the simulated I2C bus
+* covers the output registers, interrupt status, the FIFO, slave 4 writes of the I2C master
+* and the DMP memory banks
+*
+*/
+
+#include <string.h>
+
+#include "./mpu_sim.h"
+
+
+//_______________________________________________________________________________________________________
+mpu_sim::mpu_sim(uint8_t addr) : m_addr(addr), m_dmp_ticks(0) {
+  memset(m_reg, 0, sizeof(m_reg));
+  memset(m_mem, 0, sizeof(m_mem));
+  m_reg[MPU_WHO_AM_I] = 0x71;
+  m_reg[MPU_PWR_MGMT_1] = 0x01;
+  sim::bus::instance().attach(m_addr, this);
+}
+
+//_______________________________________________________________________________________________________
+mpu_sim::~mpu_sim() {
+  sim::bus::instance().detach(m_addr);
+}
+
+//_______________________________________________________________________________________________________
+int mpu_sim::read(uint8_t reg, uint8_t* data, int len) {
+  std::lock_guard<std::recursive_mutex> lock(m_mtx);
+
+  for (int i = 0; i < len; ++i) {
+    // the FIFO port does not auto-increment, every read pops the next byte
+    if (reg == MPU_FIFO_R_W) {
+      if (m_fifo.empty()) {
+        data[i] = 0xFF;
+      } else {
+        data[i] = m_fifo.front();
+        m_fifo.pop_front();
+      }
+      continue;
+    }
+    // so does the memory port, the memory address does
+    if (reg == MPU_MEM_R_W) {
+      data[i] = memByte();
+      continue;
+    }
+
+    if (reg == MPU_FIFO_COUNTH)
+      data[i] = (m_fifo.size() >> 8) & 0x1F;
+    else if (reg == MPU_FIFO_COUNTL)
+      data[i] = m_fifo.size() & 0xFF;
+    else
+      data[i] = m_reg[reg & 0x7F];
+
+    // interrupt and I2C master status are cleared by reading them
+    if (reg == MPU_INT_STATUS || reg == MPU_I2C_MST_STATUS)
+      m_reg[reg] = 0x00;
+
+    ++reg;
+  }
+  return len;
+}
+
+//_______________________________________________________________________________________________________
+void mpu_sim::write(uint8_t reg, const uint8_t* data, int len) {
+  std::lock_guard<std::recursive_mutex> lock(m_mtx);
+
+  // the FIFO and memory ports do not auto-increment
+  for (int i = 0; i < len; ++i, reg += (reg == MPU_FIFO_R_W || reg == MPU_MEM_R_W) ? 0 : 1) {
+    switch (reg) {
+      case MPU_PWR_MGMT_1:
+        if (data[i] & 0x80) { // device reset
+          memset(m_reg, 0, sizeof(m_reg));
+          memset(m_mem, 0, sizeof(m_mem));
+          m_reg[MPU_WHO_AM_I] = 0x71;
+          m_reg[MPU_PWR_MGMT_1] = 0x40;
+          m_fifo.clear();
+          continue;
+        }
+        break;
+      case MPU_USER_CTRL:
+        if (data[i] & MPU_USER_FIFO_RST) // FIFO reset, bit clears itself
+          m_fifo.clear();
+        if (data[i] & MPU_USER_DMP_RST) // so does the DMP reset
+          m_dmp_ticks = 0;
+        m_reg[reg] = data[i] & ~0x0F;
+        continue;
+      case MPU_MEM_R_W:
+        memByte() = data[i];
+        continue;
+      case MPU_FIFO_R_W:
+        if (m_fifo.size() < MPU_SIM_FIFO_SIZE)
+          m_fifo.push_back(data[i]);
+        continue;
+      case MPU_I2C_SLV4_CTRL:
+        if ((data[i] & 0x80) && !(m_reg[MPU_I2C_SLV4_ADDR] & 0x80)) { // slave 4 write, enable bit clears itself
+          slave_write w = {m_reg[MPU_I2C_SLV4_ADDR], m_reg[MPU_I2C_SLV4_REG], m_reg[MPU_I2C_SLV4_DO]};
+          m_slave_writes.push_back(w);
+          m_reg[MPU_I2C_MST_STATUS] |= 0x40; // I2C_SLV4_DONE
+        }
+        m_reg[reg] = data[i] & ~0x80;
+        continue;
+      case MPU_WHO_AM_I:
+      case MPU_INT_STATUS:
+      case MPU_I2C_MST_STATUS:
+        continue; // read only
+      default:
+        break;
+    }
+    m_reg[reg & 0x7F] = data[i];
+  }
+}
+
+//_______________________________________________________________________________________________________
+void mpu_sim::setOutput(const int16_t* sample) {
+  std::lock_guard<std::recursive_mutex> lock(m_mtx);
+
+  putWord(MPU_ACCEL_XOUT_H, sample[0]);
+  putWord(MPU_ACCEL_YOUT_H, sample[1]);
+  putWord(MPU_ACCEL_ZOUT_H, sample[2]);
+  putWord(MPU_GYRO_XOUT_H, sample[3]);
+  putWord(MPU_GYRO_YOUT_H, sample[4]);
+  putWord(MPU_GYRO_ZOUT_H, sample[5]);
+  putWord(MPU_TEMP_OUT_H, sample[6]);
+}
+
+//_______________________________________________________________________________________________________
+void mpu_sim::pushFIFO(const int16_t* sample) {
+  std::lock_guard<std::recursive_mutex> lock(m_mtx);
+
+  if (m_fifo.size() + 12 > MPU_SIM_FIFO_SIZE) {
+    m_reg[MPU_INT_STATUS] |= 0x10; // FIFO overflow
+    return;
+  }
+  for (int i = 0; i < 6; ++i) {
+    m_fifo.push_back((sample[i] >> 8) & 0xFF);
+    m_fifo.push_back(sample[i] & 0xFF);
+  }
+}
+
+//_______________________________________________________________________________________________________
+int mpu_sim::FIFOcnt() {
+  std::lock_guard<std::recursive_mutex> lock(m_mtx);
+  return m_fifo.size();
+}
+
+//_______________________________________________________________________________________________________
+void mpu_sim::raise(uint8_t int_status) {
+  std::lock_guard<std::recursive_mutex> lock(m_mtx);
+  m_reg[MPU_INT_STATUS] |= int_status;
+}
+
+//_______________________________________________________________________________________________________
+bool mpu_sim::tickDMP(const int32_t* q) {
+  std::lock_guard<std::recursive_mutex> lock(m_mtx);
+
+  uint16_t start = (m_reg[MPU_PRGM_START_H] << 8) | m_reg[MPU_PRGM_START_L];
+  if (!(m_reg[MPU_USER_CTRL] & MPU_USER_DMP_EN) || start != DMP_START_ADDR ||
+      memcmp(m_mem + DMP_CFG_8, imu_dmp::s_quat6_on, sizeof(imu_dmp::s_quat6_on)) != 0)
+    return false;
+
+  unsigned long div = ((m_mem[DMP_D_0_22] << 8) | m_mem[DMP_D_0_22 + 1]) + 1;
+  if (m_dmp_ticks++ % div != 0)
+    return false;
+
+  if (!(m_reg[MPU_USER_CTRL] & MPU_USER_FIFO_EN))
+    return false;
+  if (m_fifo.size() + DMP_PACKET_SIZE > MPU_SIM_FIFO_SIZE) {
+    m_reg[MPU_INT_STATUS] |= 0x10; // FIFO overflow
+    return false;
+  }
+  for (int i = 0; i < 4; ++i) {
+    for (int b = 3; b >= 0; --b)
+      m_fifo.push_back((q[i] >> (8 * b)) & 0xFF);
+  }
+  return true;
+}
+
+//_______________________________________________________________________________________________________
+float mpu_sim::getDMPRate() {
+  std::lock_guard<std::recursive_mutex> lock(m_mtx);
+  return DMP_SAMPLE_RATE / (float) (((m_mem[DMP_D_0_22] << 8) | m_mem[DMP_D_0_22 + 1]) + 1);
+}
+
+//_______________________________________________________________________________________________________
+uint8_t& mpu_sim::memByte() {
+  uint8_t &b = m_mem[((m_reg[MPU_BANK_SEL] << 8) | m_reg[MPU_MEM_START_ADDR]) % DMP_MEM_SIZE];
+  ++m_reg[MPU_MEM_START_ADDR];
+  return b;
+}
+
+//_______________________________________________________________________________________________________
+void mpu_sim::putWord(uint8_t reg, int16_t v) {
+  m_reg[reg] = (v >> 8) & 0xFF;
+  m_reg[reg + 1] = v & 0xFF;
+}
@@ -0,0 +1,73 @@
+/*
+* Register model of the MPU 9250 for the simulated I2C bus
+* covers the output registers, interrupt status, the FIFO, slave 4 writes of the I2C master
+* and the DMP memory banks with a DMP that emits quaternion packets at its FIFO rate
+*
+*/
+
+#ifndef mpu_sim_h
+#define mpu_sim_h
+
+#include <deque>
+#include <vector>
+#include <mutex>
+
+#include "./mraa.hpp"
+#include "imu_edison.h"
+
+#define MPU_SIM_FIFO_SIZE 512
+
+
+class mpu_sim : public sim::device {
+ public:
+  // creates the model and attaches it to the simulated bus at [addr]
+  mpu_sim(uint8_t addr = MPU_I2C_ADDR);
+  ~mpu_sim();
+
+  int read(uint8_t reg, uint8_t* data, int len);
+  void write(uint8_t reg, const uint8_t* data, int len);
+
+  // sets the output registers [ACCEL_X, ACCEL_Y, ACCEL_Z, GYRO_X, GYRO_Y, GYRO_Z, TEMP]
+  void setOutput(const int16_t* sample);
+  // appends one sample [ACCEL XYZ, GYRO XYZ] to the FIFO, drops it if the FIFO is full
+  void pushFIFO(const int16_t* sample);
+  // number of bytes in the FIFO
+  int FIFOcnt();
+  // sets interrupt status bits, as the chip does before asserting the INT pin
+  void raise(uint8_t int_status);
+
+  // one 200Hz step of the DMP with the orientation [q] [w, x, y, z] in Q30
+  // pushes a packet every (D_0_22 + 1) steps if the DMP is enabled, the program start is set
+  // and the 6-axis quaternion is configured
+  // returns true if a packet was pushed
+  bool tickDMP(const int32_t* q);
+  // FIFO rate as configured in the DMP memory [Hz]
+  float getDMPRate();
+
+  // DMP memory as written through the banks
+  uint8_t m_mem[DMP_MEM_SIZE];
+
+  // register file as seen by the host
+  uint8_t m_reg[128];
+
+  // single byte writes the I2C master did through slave 4, completed at once
+  struct slave_write {
+    uint8_t addr;
+    uint8_t reg;
+    uint8_t data;
+  };
+  std::vector<slave_write> m_slave_writes;
+
+ private:
+  void putWord(uint8_t reg, int16_t v);
+
+  // position in MPU_MEM_R_W, auto-increments within the bank
+  uint8_t& memByte();
+
+  uint8_t m_addr;
+  std::deque<uint8_t> m_fifo;
+  unsigned long m_dmp_ticks;
+  std::recursive_mutex m_mtx;
+};
+
+#endif // mpu_sim_h
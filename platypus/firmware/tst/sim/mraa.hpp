@@ -0,0 +1,252 @@
+/*
+* Simulated subset of the mraa C++ API for host-side tests and benchmarks
+* Put this directory first on the include path instead of libmraa,
+* devices are attached to the simulated bus via sim::bus::instance().attach()
+*
+*/
+
+#ifndef sim_mraa_hpp
+#define sim_mraa_hpp
+
+#include <map>
+#include <string>
+#include <stdexcept>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+
+
+namespace sim {
+
+// a device on the simulated I2C bus
+class device {
+ public:
+  virtual ~device() {}
+
+  // read [len] bytes starting at register [reg], returns number of bytes read
+  virtual int read(uint8_t reg, uint8_t* data, int len) = 0;
+  // write [len] bytes starting at register [reg]
+  virtual void write(uint8_t reg, const uint8_t* data, int len) = 0;
+};
+
+// bus usage counters, bytes include address and register bytes
+struct bus_stats {
+  bus_stats() {reset();}
+  void reset() {transactions = 0; bytes = 0; selects = 0;}
+
+  // estimated time on the wire in seconds at the given SCL frequency
+  // (9 clocks per byte incl. ACK, ~2 clocks for START/STOP per transaction)
+  double busTime(double scl_hz) const {return (bytes * 9.0 + transactions * 2.0) / scl_hz;}
+
+  unsigned long transactions;
+  unsigned long bytes;
+  unsigned long selects;
+};
+
+// the simulated I2C bus all mraa::I2c objects talk to
+class bus {
+ public:
+  static bus& instance() {static bus b; return b;}
+
+  void attach(uint8_t addr, device* dev) {m_devices[addr] = dev;}
+  void detach(uint8_t addr) {m_devices.erase(addr);}
+  device* find(uint8_t addr) {
+    std::map<uint8_t, device*>::iterator it = m_devices.find(addr);
+    return it == m_devices.end() ? NULL : it->second;
+  }
+
+  bus_stats stats;
+
+ private:
+  std::map<uint8_t, device*> m_devices;
+};
+
+} // namespace sim
+
+
+namespace mraa {
+
+typedef enum {
+  SUCCESS = 0,
+  ERROR_FEATURE_NOT_IMPLEMENTED = 1,
+  ERROR_FEATURE_NOT_SUPPORTED = 2,
+  ERROR_INVALID_VERBOSITY_LEVEL = 3,
+  ERROR_INVALID_PARAMETER = 4,
+  ERROR_INVALID_HANDLE = 5,
+  ERROR_NO_RESOURCES = 6,
+  ERROR_INVALID_RESOURCE = 7,
+  ERROR_INVALID_QUEUE_TYPE = 8,
+  ERROR_NO_DATA_AVAILABLE = 9,
+  ERROR_INVALID_PLATFORM = 10,
+  ERROR_PLATFORM_NOT_INITIALISED = 11,
+  ERROR_UNSPECIFIED = 99
+} Result;
+
+typedef enum {
+  MODE_STRONG = 0,
+  MODE_PULLUP = 1,
+  MODE_PULLDOWN = 2,
+  MODE_HIZ = 3
+} Mode;
+
+typedef enum {
+  DIR_OUT = 0,
+  DIR_IN = 1,
+  DIR_OUT_HIGH = 2,
+  DIR_OUT_LOW = 3
+} Dir;
+
+typedef enum {
+  EDGE_NONE = 0,
+  EDGE_BOTH = 1,
+  EDGE_RISING = 2,
+  EDGE_FALLING = 3
+} Edge;
+
+inline void printError(Result r) {printf("[SIM] mraa error %d\n", r);}
+
+
+class I2c {
+ public:
+  I2c(int bus, bool raw = false) : m_addr(0), m_reg(0) {}
+
+  Result address(uint8_t address) {
+    m_addr = address;
+    ++sim::bus::instance().stats.selects;
+    return SUCCESS;
+  }
+
+  uint8_t readByte() {
+    uint8_t data;
+    if (read(&data, 1) != 1)
+      throw std::invalid_argument("I2c::readByte(): error reading from simulated bus");
+    return data;
+  }
+
+  // plain read, continues at the register pointer set by the last write
+  int read(uint8_t* data, int length) {
+    sim::device* dev = transfer(1 + length);
+    if (!dev)
+      return -1;
+    int n = dev->read(m_reg, data, length);
+    m_reg += n;
+    return n;
+  }
+
+  uint8_t readReg(uint8_t reg) {
+    uint8_t data;
+    if (readBytesReg(reg, &data, 1) != 1)
+      throw std::invalid_argument("I2c::readReg(): error reading from simulated bus");
+    return data;
+  }
+
+  uint16_t readWordReg(uint8_t reg) {
+    uint8_t data[2];
+    if (readBytesReg(reg, data, 2) != 2)
+      throw std::invalid_argument("I2c::readWordReg(): error reading from simulated bus");
+    return (data[1] << 8) | data[0];
+  }
+
+  // combined write register / repeated start / read transaction
+  int readBytesReg(uint8_t reg, uint8_t* data, int length) {
+    sim::device* dev = transfer(3 + length);
+    if (!dev)
+      return -1;
+    return dev->read(reg, data, length);
+  }
+
+  Result writeByte(uint8_t data) {
+    if (!transfer(2))
+      return ERROR_UNSPECIFIED;
+    m_reg = data;
+    return SUCCESS;
+  }
+
+  Result write(const uint8_t* data, int length) {
+    sim::device* dev = transfer(1 + length);
+    if (!dev)
+      return ERROR_UNSPECIFIED;
+    if (length > 0) {
+      m_reg = data[0];
+      dev->write(data[0], data + 1, length - 1);
+    }
+    return SUCCESS;
+  }
+
+  Result writeReg(uint8_t reg, uint8_t data) {
+    uint8_t buf[2] = {reg, data};
+    return write(buf, 2);
+  }
+
+ private:
+  // account for one transaction on the bus, returns the addressed device or NULL on NACK
+  sim::device* transfer(int bytes) {
+    sim::bus& b = sim::bus::instance();
+    ++b.stats.transactions;
+    b.stats.bytes += bytes;
+    return b.find(m_addr);
+  }
+
+  uint8_t m_addr;
+  uint8_t m_reg;
+};
+
+// simulated pin, the level is driven by the test via set() / pulse()
+// an isr is called synchronously in the thread that changes the level
+class Gpio {
+ public:
+  Gpio(int pin, bool owner = true, bool raw = false)
+   : m_pin(pin), m_level(1), m_edge(EDGE_NONE), m_fptr(NULL), m_args(NULL) {
+    pins()[m_pin] = this;
+  }
+  ~Gpio() {
+    if (pins()[m_pin] == this)
+      pins().erase(m_pin);
+  }
+
+  // returns the open pin with number [pin], NULL if there is none
+  static Gpio* find(int pin) {
+    std::map<int, Gpio*>::iterator it = pins().find(pin);
+    return it == pins().end() ? NULL : it->second;
+  }
+
+  Result dir(Dir dir) {return SUCCESS;}
+  Result mode(Mode mode) {return SUCCESS;}
+  Result edge(Edge mode) {m_edge = mode; return SUCCESS;}
+
+  Result isr(Edge mode, void (*fptr)(void*), void* args) {
+    m_edge = mode;
+    m_fptr = fptr;
+    m_args = args;
+    return SUCCESS;
+  }
+  Result isrExit() {m_fptr = NULL; return SUCCESS;}
+
+  int read() {return m_level;}
+
+  // set the pin level, calls the isr on a matching edge
+  void set(int level) {
+    int prev = m_level;
+    m_level = level ? 1 : 0;
+    if (m_fptr == NULL || prev == m_level)
+      return;
+    if (m_edge == EDGE_BOTH || (m_edge == EDGE_RISING && m_level) || (m_edge == EDGE_FALLING && !m_level))
+      m_fptr(m_args);
+  }
+  // pulse the pin away from its current level and back
+  void pulse() {set(!m_level); set(!m_level);}
+
+ private:
+  static std::map<int, Gpio*>& pins() {static std::map<int, Gpio*> p; return p;}
+
+  int m_pin;
+  int m_level;
+  Edge m_edge;
+  void (*m_fptr)(void*);
+  void* m_args;
+};
+
+} // namespace mraa
+
+#endif // sim_mraa_hpp
@@ -0,0 +1,198 @@
+/*
+* Host test: vibration spectrum of the acceleration
+* the FFT against a plain DFT and the SSE butterflies against the scalar ones, Parseval over the
+* band energies, the peak of a vibration between the bins, windows with overlap over FIFO blocks,
+* and a slow tilt against a small periodic vibration, which a min/max band around the
+* calibrated acceleration gets the wrong way round
+* build via build_sim.sh
+*
+*/
+
+#include <chrono>
+#include <vector>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "imu_spectrum.h"
+#include "check.h"
+
+#define RATE 25.0 // [Hz]
+#define BLOCK 25 // samples per FIFO block
+#define G 9.807
+#define LSB (G / 8192.0) // [m/s^2] at AFS_SEL 1
+#define TOLERANCE 1.5 // [m/s^2] half width of a min/max band as SensorNodeMain used
+
+typedef std::chrono::steady_clock Clock;
+
+
+//_______________________________________________________________________________________________________
+double uniform(double a, double b) {
+  return a + (b - a) * rand() / (double) RAND_MAX;
+}
+
+//_______________________________________________________________________________________________________
+// [seconds] of FIFO data: gravity tilted by [tilt] [rad] at [tilt_hz], a vibration of [amp] [m/s^2]
+// at [hz] along X and Y
+std::vector<int16_t> stream(double seconds, double tilt, double tilt_hz, double amp, double hz) {
+  size_t n = (size_t) (seconds * RATE);
+  std::vector<int16_t> raw(6 * n, 0);
+  for (size_t i = 0; i < n; ++i) {
+    double t = i / RATE;
+    double a = tilt * sin(2.0 * M_PI * tilt_hz * t);
+    double v = amp * sin(2.0 * M_PI * hz * t + 0.3);
+    raw[6 * i + 0] = (int16_t) lround((G * sin(a) + v) / LSB);
+    raw[6 * i + 1] = (int16_t) lround(0.5 * v / LSB);
+    raw[6 * i + 2] = (int16_t) lround(G * cos(a) / LSB);
+  }
+  return raw;
+}
+
+//_______________________________________________________________________________________________________
+// windows over [raw] fed in FIFO blocks
+std::vector<imu_spectrum_window> analyze(imu_spectrum &spec, const std::vector<int16_t> &raw) {
+  std::vector<imu_spectrum_window> windows;
+  for (size_t i = 0; i < raw.size() / 6; i += BLOCK) {
+    size_t n = raw.size() / 6 - i < BLOCK ? raw.size() / 6 - i : BLOCK;
+    spec.update(&raw[6 * i], n, windows);
+  }
+  return windows;
+}
+
+//_______________________________________________________________________________________________________
+// energy above the lowest band, summed over all windows
+double vibration(const std::vector<imu_spectrum_window> &windows) {
+  double e = 0.0;
+  for (size_t i = 0; i < windows.size(); ++i)
+    for (int b = 1; b < windows[i].bands; ++b)
+      e = windows[i].energy[b] > e ? windows[i].energy[b] : e;
+  return e;
+}
+
+//_______________________________________________________________________________________________________
+// a reading leaves the min/max band recorded at rest
+bool outOfBand(const std::vector<int16_t> &raw) {
+  for (size_t i = 0; i < raw.size() / 6; ++i)
+    for (int j = 0; j < 3; ++j) {
+      double rest = j == 2 ? G : 0.0;
+      if (fabs(raw[6 * i + j] * LSB - rest) > TOLERANCE)
+        return true;
+    }
+  return false;
+}
+
+
+//_______________________________________________________________________________________________________
+int main(int argc, char** argv) {
+  srand(1);
+
+  // FFT of random windows against a DFT in double precision, SSE against scalar
+  const size_t sizes[3] = {16, 64, 256};
+  for (int s = 0; s < 3; ++s) {
+    imu_spectrum spec(RATE, sizes[s], sizes[s] / 2);
+    const size_t N = spec.getSize(), K = spec.getBins(), LANES = IMU_SPECTRUM_LANES;
+    std::vector<float> in(N * LANES), out(K * LANES), ref(K * LANES);
+    for (size_t i = 0; i < in.size(); ++i)
+      in[i] = (float) uniform(-1.0, 1.0);
+
+    spec.power(in.data(), out.data());
+    spec.powerScalar(in.data(), ref.data());
+    double err_dft = 0.0, err_simd = 0.0, scale = 0.0;
+    for (size_t k = 0; k < K; ++k) {
+      for (size_t l = 0; l < LANES; ++l) {
+        double re = 0.0, im = 0.0;
+        for (size_t i = 0; i < N; ++i) {
+          re += in[i * LANES + l] * cos(2.0 * M_PI * k * i / N);
+          im -= in[i * LANES + l] * sin(2.0 * M_PI * k * i / N);
+        }
+        double p = re * re + im * im;
+        scale = p > scale ? p : scale;
+        err_dft = fabs(out[k * LANES + l] - p) > err_dft ? fabs(out[k * LANES + l] - p) : err_dft;
+        double d = fabs(out[k * LANES + l] - ref[k * LANES + l]);
+        err_simd = d > err_simd ? d : err_simd;
+      }
+    }
+    printf("       %3lu points: error %.1e against the DFT, %.1e SSE against scalar (of %.1f)\n",
+      N, err_dft / scale, err_simd / scale, scale);
+    check(err_dft < 1e-5 * scale && err_simd < 1e-5 * scale, "power spectrum as the DFT");
+  }
+
+  // white noise: the energies add up to the mean square of the windowed signal
+  {
+    imu_spectrum spec(RATE);
+    std::vector<int16_t> raw(6 * IMU_SPECTRUM_SIZE);
+    for (size_t i = 0; i < raw.size(); ++i)
+      raw[i] = (int16_t) lround(uniform(-2000.0, 2000.0));
+    std::vector<imu_spectrum_window> w;
+    spec.update(raw.data(), IMU_SPECTRUM_SIZE, w);
+
+    double ms = 0.0, sw = 0.0;
+    for (int j = 0; j < 3; ++j) {
+      double mean = 0.0;
+      for (size_t i = 0; i < IMU_SPECTRUM_SIZE; ++i)
+        mean += raw[6 * i + j] * LSB / IMU_SPECTRUM_SIZE;
+      for (size_t i = 0; i < IMU_SPECTRUM_SIZE; ++i) {
+        double h = 0.5 - 0.5 * cos(2.0 * M_PI * i / IMU_SPECTRUM_SIZE);
+        ms += (raw[6 * i + j] * LSB - mean) * (raw[6 * i + j] * LSB - mean) * h * h;
+        if (j == 0)
+          sw += h * h;
+      }
+    }
+    check(w.size() == 1 && fabs(w[0].rms * w[0].rms - ms / sw) < 1e-4 * ms / sw, "Parseval over all bins");
+  }
+
+  // vibration between two bins on top of gravity
+  {
+    imu_spectrum spec(RATE);
+    std::vector<imu_spectrum_window> w = analyze(spec, stream(60.0, 0.0, 0.0, 2.0, 5.1));
+    size_t expect = (60 * (size_t) RATE - IMU_SPECTRUM_SIZE) / IMU_SPECTRUM_HOP + 1;
+    double peak_err = 0.0, rms_err = 0.0;
+    bool band = true;
+    for (size_t i = 0; i < w.size(); ++i) {
+      peak_err = fabs(w[i].peak - 5.1) > peak_err ? fabs(w[i].peak - 5.1) : peak_err;
+      // X and half of it on Y: 2.0 * sqrt(1.25) / sqrt(2)
+      rms_err = fabs(w[i].rms - 2.0 * sqrt(1.25 / 2.0)) > rms_err ? fabs(w[i].rms - 2.0 * sqrt(1.25 / 2.0)) : rms_err;
+      band = band && w[i].energy[2] > 0.9 * w[i].rms * w[i].rms;
+    }
+    printf("       %lu windows of %.2fs every %.2fs, bins %.2fHz apart: peak off by %.3fHz, rms by %.3f m/s^2\n",
+      w.size(), IMU_SPECTRUM_SIZE / RATE, IMU_SPECTRUM_HOP / RATE, RATE / IMU_SPECTRUM_SIZE, peak_err, rms_err);
+    check(w.size() == expect && w.back().window == expect - 1, "one window per hop once the first is full");
+    check(peak_err < 0.1 && rms_err < 0.05, "peak frequency and rms of the vibration");
+    check(band, "energy in the band of the vibration");
+  }
+
+  // slow tilt by 30deg vs. a small periodic vibration
+  {
+    std::vector<int16_t> tilt = stream(30.0, M_PI / 6, 0.1, 0.0, 0.0);
+    std::vector<int16_t> vib = stream(30.0, 0.0, 0.0, 0.5, 8.0);
+    imu_spectrum spec_tilt(RATE), spec_vib(RATE);
+    double e_tilt = vibration(analyze(spec_tilt, tilt));
+    double e_vib = vibration(analyze(spec_vib, vib));
+    printf("       energy above %.2fHz: tilt %.4f, vibration %.4f (m/s^2)^2; min/max band: tilt %s, vibration %s\n",
+      RATE / 2 / (1 << (IMU_SPECTRUM_BANDS - 1)), e_tilt, e_vib, outOfBand(tilt) ? "out" : "in", outOfBand(vib) ? "out" : "in");
+    check(e_vib > 20.0 * e_tilt && outOfBand(tilt) && !outOfBand(vib), "vibration told from a slow tilt");
+  }
+
+  // cost per window, SSE and scalar
+  {
+    const size_t sizes[2] = {64, 256};
+    for (int s = 0; s < 2; ++s) {
+      imu_spectrum spec(RATE, sizes[s], sizes[s]);
+      std::vector<float> in(spec.getSize() * IMU_SPECTRUM_LANES), out(spec.getBins() * IMU_SPECTRUM_LANES);
+      for (size_t i = 0; i < in.size(); ++i)
+        in[i] = (float) uniform(-1.0, 1.0);
+      const int loops = 20000;
+      Clock::time_point t0 = Clock::now();
+      for (int i = 0; i < loops; ++i)
+        spec.power(in.data(), out.data());
+      double simd = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / loops;
+      t0 = Clock::now();
+      for (int i = 0; i < loops; ++i)
+        spec.powerScalar(in.data(), out.data());
+      double scalar = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / loops;
+      printf("       %3lu points, 3 axes: %.0f ns SSE, %.0f ns scalar\n", spec.getSize(), simd, scalar);
+    }
+  }
+
+  return m_failed ? 1 : 0;
+}
@@ -0,0 +1,223 @@
+/*
+* Host test: writer thread of the sample log
+* the segment number continues after the files found at start(), batches of pages, segments
+* rolled over at their size, a flush ends a segment with the page being filled, all samples
+* read back in order with their file headers and page sequence numbers; the IMU thread against
+* a writer with fdatasync() after every batch; packed pages read back to the same samples
+* build via build_sim.sh
+*
+*/
+
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "log_writer.h"
+#include "datalog.h"
+#include "check.h"
+
+#define LOG_DIR "/tmp/writer_test/"
+#define BLOCK 25 // samples per FIFO block
+#define SEGMENT 8 // pages per segment
+#define THREADED 600000 // samples through the writer, 1000 pages
+
+typedef std::chrono::steady_clock Clock;
+
+
+//_______________________________________________________________________________________________________
+std::string segment(int num) {
+  char name[64];
+  snprintf(name, sizeof(name), LOG_DIR "datalog%04d.bin", num);
+  return name;
+}
+
+//_______________________________________________________________________________________________________
+// removes the segments of the test and the directory
+void cleanup() {
+  for (int i = 0; i < 200; ++i)
+    remove(segment(i).c_str());
+  remove(LOG_DIR "notes.txt");
+  rmdir(LOG_DIR);
+}
+
+//_______________________________________________________________________________________________________
+// [n] samples from sample [k] on, every value tells its sample and channel
+void samples(uint64_t k, size_t n, int16_t* raw) {
+  for (size_t i = 0; i < n; ++i)
+    for (int c = 0; c < 6; ++c)
+      raw[6 * i + c] = (int16_t) (((k + i) * 6 + c) & 0xFFFF);
+}
+
+//_______________________________________________________________________________________________________
+// appends [n] samples to [page] of [arena] as the logger does, returns the samples left over
+size_t log(log_arena &arena, log_page* &page, const int16_t* raw, size_t n) {
+  while (n > 0) {
+    if (page == NULL) {
+      page = arena.begin();
+      if (page == NULL)
+        return n;
+      memset(page->header(), 0, LOG_HEADER_SIZE);
+    }
+    size_t k = page->append(raw, n);
+    raw += 6 * k;
+    n -= k;
+    if (page->isFull()) {
+      arena.commit(page);
+      page = NULL;
+    }
+  }
+  return 0;
+}
+
+//_______________________________________________________________________________________________________
+// appends the samples of the segments [first, last) to [raw] in order, false if a file has no
+// valid header or a broken page, or the sequence numbers do not count on from [sequence]
+bool readBack(int first, int last, std::vector<int16_t> &raw, uint32_t sequence = 0) {
+  log_format format;
+  log_file_header header;
+  log_page_info info;
+  log_page page;
+  for (int i = first; i < last; ++i) {
+    FILE* f = fopen(segment(i).c_str(), "rb");
+    if (f == NULL)
+      return false;
+    std::vector<uint8_t> buf;
+    uint8_t chunk[4096];
+    size_t len;
+    while ((len = fread(chunk, 1, sizeof(chunk), f)) > 0)
+      buf.insert(buf.end(), chunk, chunk + len);
+    fclose(f);
+
+    if (!log_format::readHeader(buf.data(), buf.size(), header) || strcmp(header.device, "test") != 0)
+      return false;
+    for (size_t pos = LOG_FILE_HEADER_SIZE; pos < buf.size(); pos += info.size) {
+      if (format.unpack(&buf[pos], buf.size() - pos, &page, &info) == 0 || info.sequence != sequence++)
+        return false;
+      readDatalogPage(page.data + LOG_HEADER_SIZE, page.getSamples(), raw);
+    }
+  }
+  return true;
+}
+
+//_______________________________________________________________________________________________________
+int main(int argc, char** argv) {
+  cleanup();
+  mkdir(LOG_DIR, S_IRWXU);
+  fclose(fopen(segment(6).c_str(), "wb"));
+  fclose(fopen(LOG_DIR "notes.txt", "wb"));
+  log_file_header header;
+  strncpy(header.device, "test", sizeof(header.device) - 1);
+
+  // segments of SEGMENT pages, batches of 4, a flush in between
+  {
+    log_arena arena(64);
+    log_writer writer(&arena, LOG_DIR, "datalog", SEGMENT);
+    writer.setPolicy(4, 0.5, -1.0);
+    writer.setHeader(header);
+    check(writer.start() && writer.getSegment() == 7, "segment number after the files found");
+
+    const size_t first = 20 * LOG_PAGE_SAMPLES + 100, second = 3 * LOG_PAGE_SAMPLES;
+    std::vector<int16_t> raw(6 * (first + second));
+    samples(0, first + second, raw.data());
+    log_page* page = NULL;
+    for (size_t i = 0; i < first; i += BLOCK)
+      log(arena, page, &raw[6 * i], first - i < BLOCK ? first - i : BLOCK);
+    // forced save: the page being filled goes out and ends its segment
+    arena.commit(page);
+    page = NULL;
+    writer.flush();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    log_writer_stats stats = writer.getStats();
+    printf("       %lu pages in %lu batches, %lu segments, %lu syncs, %.2f ms per batch (max %.2f)\n",
+      stats.pages, stats.batches, stats.segments, stats.syncs, stats.mean_write_ms, stats.max_write_ms);
+    check(stats.pages == 21 && stats.depth == 0 && stats.errors == 0 && writer.getSegment() == 10 &&
+      stats.syncs == stats.segments, "flushed, segments closed and synced");
+
+    for (size_t i = first; i < first + second; i += BLOCK)
+      log(arena, page, &raw[6 * i], BLOCK);
+    writer.stop();
+    stats = writer.getStats();
+    std::vector<int16_t> back;
+    bool valid = readBack(7, 11, back);
+    struct stat st;
+    check(stat(segment(7).c_str(), &st) == 0 &&
+      st.st_size == LOG_FILE_HEADER_SIZE + SEGMENT * (LOG_PAGE_HEADER_SIZE + LOG_PAGE_SIZE), "full segment");
+    check(stat(segment(9).c_str(), &st) == 0 && st.st_size == LOG_FILE_HEADER_SIZE +
+      5 * LOG_PAGE_HEADER_SIZE + 4 * LOG_PAGE_SIZE + LOG_HEADER_SIZE + 100 * LOG_SAMPLE_SIZE,
+      "partial page ends the segment");
+    check(stats.pages == 24 && valid && back == raw, "samples read back in order after stop()");
+  }
+
+  // the IMU thread against the writer, fdatasync() after every batch
+  {
+    log_arena arena(32);
+    log_writer writer(&arena, LOG_DIR, "datalog", 64);
+    writer.setPolicy(8, 0.2, 0.0);
+    writer.setHeader(header);
+    writer.start();
+    int start = writer.getSegment();
+
+    std::vector<int16_t> raw(6 * BLOCK);
+    log_page* page = NULL;
+    double max_us = 0.0;
+    for (uint64_t k = 0; k < THREADED; k += BLOCK) {
+      samples(k, BLOCK, raw.data());
+      Clock::time_point t0 = Clock::now();
+      // faster than any IMU, the rest of a block waits for a free page
+      size_t left = BLOCK;
+      while ((left = log(arena, page, &raw[6 * (BLOCK - left)], left)) > 0)
+        std::this_thread::yield();
+      double us = std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+      max_us = us > max_us ? us : max_us;
+    }
+    writer.stop();
+    log_writer_stats stats = writer.getStats();
+    printf("       %lu pages, queue up to %lu of %lu pages, %lu times no free page, %.2f ms per batch (max %.2f)\n",
+      stats.pages, stats.max_depth, arena.getPages(), stats.exhausted, stats.mean_write_ms, stats.max_write_ms);
+    printf("       IMU thread: %.1f us at most per block\n", max_us);
+
+    std::vector<int16_t> back;
+    bool ordered = readBack(start, writer.getSegment(), back) && back.size() == 6 * THREADED;
+    for (size_t i = 0; ordered && i < back.size(); ++i)
+      ordered = back[i] == (int16_t) (i & 0xFFFF);
+    check(stats.pages == THREADED / LOG_PAGE_SAMPLES && stats.syncs >= stats.batches && ordered,
+      "all pages written in order, synced");
+  }
+
+  // packed pages, a partial one at the end
+  {
+    log_arena arena(16);
+    log_writer writer(&arena, LOG_DIR, "datalog", SEGMENT);
+    writer.setPolicy(4, 0.5, -1.0);
+    writer.setCodec(Codec::DELTA);
+    writer.setHeader(header);
+    writer.start();
+    int start = writer.getSegment();
+
+    const size_t n = 10 * LOG_PAGE_SAMPLES + 250;
+    std::vector<int16_t> raw(6 * n);
+    for (size_t i = 0; i < n; ++i)
+      for (int c = 0; c < 6; ++c)
+        raw[6 * i + c] = (int16_t) (1000 * c + (i % 64) - 32 + (rand() % 5));
+    log_page* page = NULL;
+    for (size_t i = 0; i < n; i += BLOCK)
+      log(arena, page, &raw[6 * i], n - i < BLOCK ? n - i : BLOCK);
+    arena.commit(page);
+    writer.stop();
+
+    log_writer_stats stats = writer.getStats();
+    printf("       %lu pages packed to %lu of %lu bytes\n", stats.pages, stats.bytes, stats.raw_bytes);
+    std::vector<int16_t> back;
+    check(readBack(start, writer.getSegment(), back) && back == raw, "packed pages read back");
+    check(stats.bytes * 2 < stats.raw_bytes, "packed below half the size");
+  }
+
+  cleanup();
+  return m_failed ? 1 : 0;
+}
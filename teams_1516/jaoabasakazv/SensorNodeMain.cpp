@@ -16,6 +16,7 @@
 #include <vector>
 #include <iomanip>
 #include "./imu_edison.h"
+#include "./imu_spectrum.h"
 #include "./batgauge_edison.h"
 #include "./ldc_edison.h"
 
@@ -64,22 +65,15 @@ int m_imuID = 0x71;
 int m_batID = 3;
 
 //*************** Accelerometer declarations***************
-int tolerance = 3; 			// Sensitivity of the sensor
-bool calibrated = false; 	// When accelerometer is calibrated - changes to true 
 bool moveDetected = false; 	// When motion is detected - changes to true
-	
-//Accelerometer limits
-float xMin; //Minimum x Value
-float xMax; //Maximum x Value
-float xVal; //Current x Value
-
-float yMin; //Minimum y Value
-float yMax; //Maximum y Value
-float yVal; //Current y Value
-
-float zMin; //Minimum z Value
-float zMax; //Maximum z Value
-float zVal; //Current z Value
+
+// Vibration spectrum over the FIFO, 2.56s windows every 1.28s (@ 25Hz)
+// vibrating if a window has more energy above its lowest band (slow tilts) than this [(m/s^2)^2]
+#define VIB_ENERGY 0.05
+imu_spectrum *m_spectrum;
+std::vector<imu_spectrum_window> m_windows;
+imu_spectrum_window m_vib;	// features of the window that detected the vibration
+int16_t fifo_buf[MPU_FIFO_SIZE / 2];
 //*********************************************************
 
 
@@ -90,9 +84,7 @@ void Initializations();		//Setup IMU, battery gauge
 void BatteryGauge();  		//Battery gauge
 void readIMU();				//IMU
 void getEnvSensors();		//Envornmental Sensors
-void printValues();			//Print Accelerometer after calibration
-void calibrateAccel();  	//Calibrate Accelerometer
-bool checkMotion();			//Check for motion
+bool checkMotion();			//Check for vibration
 void INT_HANDLER(int sig);	//Ctrl-C interrupt
 
 
@@ -102,7 +94,9 @@ void Initializations()
 	//Setup IMU
 	if (m_start_imu){
 		m_imu = new imu_edison(m_i2c_bus, m_mpu_i2c_addr, m_start_env);
+		m_imu->setEnvProfile(BME_PROFILE_BREATH);	// ~13Hz, oversampled humidity for the blow detection
 		m_imu->setupIMU();
+		m_spectrum = new imu_spectrum(m_imu->getSampleRate());
 	}
 
 	//Setup battery gauge
@@ -313,9 +307,6 @@ int main (int argc, char** argv)
 	readIMU();
 	printf("\n-------------------------------\n");
 	
-	//initialise and recalibrate the Accelerometer limits.
-	calibrateAccel();
-		
 
 	LOOP_FOREVER
 	{					
@@ -331,7 +322,7 @@ int main (int argc, char** argv)
 				break;
 			}
 			
-			// Once the accelerometer is calibrated - check for movement 
+			// Check for movement, the FIFO is checked in windows of samples
 			if(checkMotion()){
 				moveDetected = true;
 				//strcpy(IMU_xyz, "VIB");
@@ -391,8 +382,11 @@ int main (int argc, char** argv)
 		
 	//Accelerometer		
 		if(moveDetected == true){
-			strcpy(sendbuffer, "A");
-			printf("%s | VIBRATION\n",time_buf);
+			// spectral features instead of the bare event: peak [Hz], rms [m/s^2], band energies
+			int len = sprintf(sendbuffer, "A|%.2f|%.3f", m_vib.peak, m_vib.rms);
+			for (int b = 0; b < m_vib.bands; b++)
+				len += sprintf(sendbuffer + len, "|%.4f", m_vib.energy[b]);
+			printf("%s | VIBRATION %s\n",time_buf, sendbuffer);
 
 			//now send a datagram 
 			if (sendto(sock, sendbuffer, sizeof(sendbuffer), 0,(struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
@@ -476,8 +470,10 @@ void  INT_HANDLER(int sig)
 			delete m_batgauge;
 		if (m_start_ldc)
 			delete m_ldc;
-		if (m_start_imu)
-			delete m_imu;				   
+		if (m_start_imu){
+			delete m_spectrum;
+			delete m_imu;
+		}
 		exit(0);
 	}
      	else{
@@ -486,101 +482,33 @@ void  INT_HANDLER(int sig)
 	}
 }
 
-// Function used to calibrate the Accelerometer
-void calibrateAccel()
-{
- 	// reset Detection
- 	moveDetected=false;
- 
- 	//initialise x,y,z variables
-	vector<float> data = m_imu->toReadable(m_imu->readRawIMU());
-	xMin = data[0];
-	xMax = data[0];
-	yMin = data[1];
-	yMax = data[1];
-	zMin = data[2];
-	zMax = data[2];
-	 
- 	// Calibration sequence initialisation sound - 3 seconds before calibration begins
- 	printf("\nCalibrating Accelerometer Sensor...\n");
- 
- 	//calibrate the Accelerometer (should take about 0.5 seconds)
- 	for (int i=0; i<50; i++)
-	{  
- 		vector<float> data = m_imu->toReadable(m_imu->readRawIMU());
-
- 		// Calibrate X Values
- 		xVal = data[0];
- 		if(xVal>xMax){
- 			xMax=xVal;
- 		}else if (xVal < xMin){
- 			xMin=xVal;
- 		}
-
- 		// Calibrate Y Values
- 		yVal = data[1];
- 		if(yVal>yMax){
- 			yMax=yVal;
- 		}else if (yVal < yMin){
- 			yMin=yVal;
- 		}
-
- 		// Calibrate Z Values
- 		zVal = data[2];
- 		if(zVal>zMax){
- 			zMax=zVal;
- 		}else if (zVal < zMin){
- 			zMin=zVal;
- 		}
-
- 		//Delay 10msec between readings
- 		usleep(10000);
- 	}
- 	//End of calibration.
-	
-	printf("Accelerometer is Calibrated.\n");
- 	printValues();
- 	calibrated = true;
-}
-
-
-// Prints the Sensor limits identified during Accelerometer calibration.
-void printValues()
-{
- 	printf("xMin= %f\t", xMin);
- 	printf(", xMax= %f\n", xMax);
- 	printf("yMin= %f\t", yMin);
- 	printf(", yMax= %f\n", yMax);
- 	printf("zMin= %f\t", zMin);
- 	printf(", zMax= %f\n", zMax);
-	printf("\n-------------------------------\n");
-}
-
-//Function used to detect motion. Tolerance variable adjusts the sensitivity of movement detected.
+//Function used to detect vibration. VIB_ENERGY adjusts the sensitivity.
 bool checkMotion()
 {
-	bool tempB=false;
-
- 	vector<float> data = m_imu->toReadable(m_imu->readRawIMU());
+	// the FIFO ran over while we were waiting, start over
+	if (m_imu->FIFOcnt() + MPU_FIFO_SAMPLE_SIZE > MPU_FIFO_SIZE){
+		m_imu->FIFOrst();
+		m_spectrum->reset();
+		return false;
+	}
 
- 	xVal = data[0];
- 	yVal = data[1];
- 	zVal = data[2];
- 
- 	if(xVal >(xMax+tolerance)||xVal < (xMin-tolerance)){
- 		tempB=true;
- 		printf("Motion detected in X-direction\n");
- 	}
- 
-	if(yVal >(yMax+tolerance)||yVal < (yMin-tolerance)){
-	 	tempB=true;
-	 	printf("Motion detected in Y-direction\n");
+	// drain the FIFO in block reads
+	size_t n = m_imu->readFIFO(fifo_buf, sizeof(fifo_buf) / sizeof(int16_t));
+	if (n == 0)
+		return false;
+	m_windows.clear();
+	m_spectrum->update(fifo_buf, n / 6, m_windows);
+
+	// periodic vibration shows above the lowest band, slow tilts stay in it
+	for (size_t i = 0; i < m_windows.size(); i++){
+		float energy = 0.0;
+		for (int b = 1; b < m_windows[i].bands; b++)
+			energy += m_windows[i].energy[b];
+		if (energy > VIB_ENERGY){
+			m_vib = m_windows[i];
+			printf("Vibration detected: %.2fHz, %.3fm/s^2 rms\n", m_vib.peak, m_vib.rms);
+			return true;
+		}
 	}
- 
- 	if(zVal >(zMax+tolerance)||zVal < (zMin-tolerance)){
- 		tempB=true;
- 		printf("Motion detected in Z-direction\n");
- 	}
-   return tempB;
+	return false;
 }
-
@@ -0,0 +1,123 @@
+/*
+* Bosch BME280 compensation and measurement profiles
+* temperature, pressure and humidity in one pass from a shared t_fine,
+* without I2C access, so offline tools can compensate logged raw readings
+*
+*/
+
+#ifndef bme_comp_h
+#define bme_comp_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// oversampling (osrs_t, osrs_p, osrs_h), a skipped measurement reads 0x80000 (T, P) or 0x8000 (H)
+#define BME_OSRS_SKIP 0x00
+#define BME_OSRS_X1   0x01
+#define BME_OSRS_X2   0x02
+#define BME_OSRS_X4   0x03
+#define BME_OSRS_X8   0x04
+#define BME_OSRS_X16  0x05
+
+// IIR filter coefficient, acts on temperature and pressure only
+#define BME_FILTER_OFF 0x00
+#define BME_FILTER_2   0x01
+#define BME_FILTER_4   0x02
+#define BME_FILTER_8   0x03
+#define BME_FILTER_16  0x04
+
+// standby between two measurements in normal mode (t_sb)
+#define BME_STANDBY_0_5MS  0x00
+#define BME_STANDBY_62_5MS 0x01
+#define BME_STANDBY_125MS  0x02
+#define BME_STANDBY_250MS  0x03
+#define BME_STANDBY_500MS  0x04
+#define BME_STANDBY_1000MS 0x05
+#define BME_STANDBY_10MS   0x06
+#define BME_STANDBY_20MS   0x07
+
+struct BME_calibration {
+  uint16_t dig_T1;
+  int16_t  dig_T2;
+  int16_t  dig_T3;
+
+  uint16_t dig_P1;
+  int16_t  dig_P2;
+  int16_t  dig_P3;
+  int16_t  dig_P4;
+  int16_t  dig_P5;
+  int16_t  dig_P6;
+  int16_t  dig_P7;
+  int16_t  dig_P8;
+  int16_t  dig_P9;
+
+  uint8_t  dig_H1;
+  int16_t  dig_H2;
+  uint8_t  dig_H3;
+  int16_t  dig_H4;
+  int16_t  dig_H5;
+  int8_t   dig_H6;
+};
+
+// measurement setup, written to CTRL_HUM, CTRL_MEAS and CONFIG
+struct BME_profile {
+  uint8_t osrs_t;
+  uint8_t osrs_p;
+  uint8_t osrs_h;
+  uint8_t filter;
+  uint8_t t_sb;
+};
+
+// x1 oversampling, IIR off, 1s standby (~1Hz), the setup so far
+static const BME_profile BME_PROFILE_WEATHER = {BME_OSRS_X1, BME_OSRS_X1, BME_OSRS_X1, BME_FILTER_OFF, BME_STANDBY_1000MS};
+// breath/humidity detection: humidity x4 against the noise (the IIR does not act on it),
+// T/P through IIR 4, 62.5ms standby (~13Hz)
+static const BME_profile BME_PROFILE_BREATH = {BME_OSRS_X1, BME_OSRS_X1, BME_OSRS_X4, BME_FILTER_4, BME_STANDBY_62_5MS};
+// indoor navigation, BME280 datasheet sec 3.5.3 (~22Hz)
+static const BME_profile BME_PROFILE_INDOOR = {BME_OSRS_X2, BME_OSRS_X16, BME_OSRS_X1, BME_FILTER_16, BME_STANDBY_0_5MS};
+
+// adc values of one measurement, as read from BME_PRESS_MSB on
+struct BME_raw {
+  int32_t adc_T;
+  int32_t adc_P;
+  int32_t adc_H;
+};
+
+// compensated values: T [0.01 DegC], P [Pa/256], H [%RH/1024]
+struct BME_data {
+  int32_t T;
+  uint32_t P;
+  uint32_t H;
+};
+
+
+class bme_comp {
+ public:
+  bme_comp();
+  bme_comp(const BME_calibration &calib);
+
+  void setCalibration(const BME_calibration &calib);
+  inline const BME_calibration& getCalibration() {return m_calib;}
+
+  // parses the 8 data bytes (PRESS_MSB .. HUM_LSB, EXT_SENS_DATA 00 .. 07 of the MPU)
+  static void parse(const uint8_t* data, BME_raw &raw);
+
+  // integer compensation via BME280 datasheet sec 4.2.3, P and H take the t_fine of the same measurement
+  int32_t tfine(int32_t adc_T);
+  int32_t compT(int32_t t_fine);
+  uint32_t compP(int32_t adc_P, int32_t t_fine);
+  uint32_t compH(int32_t adc_H, int32_t t_fine);
+
+  // all three channels from a single t_fine
+  void compensate(const BME_raw &raw, BME_data &data);
+  // same as above for [n] readings, e.g. a log replayed offline
+  void compensate(const BME_raw* raw, BME_data* data, size_t n);
+
+  // output data rate [Hz] in normal mode, from the max measurement time, datasheet sec 9.1
+  static float getRate(const BME_profile &profile);
+
+ private:
+  BME_calibration m_calib;
+};
+
+#endif // bme_comp_h
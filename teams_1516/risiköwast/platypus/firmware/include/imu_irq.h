@@ -0,0 +1,117 @@
+/*
+* Interrupt driven IMU acquisition
+* wakes a reader thread on edges of the MPU INT pin instead of sleeping for fixed intervals
+*
+*/
+
+#ifndef imu_irq_h
+#define imu_irq_h
+
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+#include "mraa.hpp"
+
+#include "./imu_edison.h"
+
+// Edison GPIO the MPU INT pin is wired to
+#define IMU_INT_GPIO 36
+
+
+// source of interrupt edges, pluggable so the acquisition also runs without the real pin
+class irq_source {
+ public:
+  virtual ~irq_source() {}
+
+  // calls [handler]([arg]) on every interrupt edge, returns false if that is not possible
+  virtual bool attach(void (*handler)(void*), void* arg) = 0;
+  // stops calling the handler
+  virtual void detach() = 0;
+};
+
+
+// the MPU INT pin on a GPIO, edges are handled by the mraa isr thread
+class gpio_irq_source : public irq_source {
+ public:
+  gpio_irq_source(int pin = IMU_INT_GPIO, mraa::Edge edge = mraa::EDGE_FALLING);
+  ~gpio_irq_source();
+
+  bool attach(void (*handler)(void*), void* arg);
+  void detach();
+
+ private:
+  int m_pin;
+  mraa::Edge m_edge;
+  mraa::Gpio* m_gpio;
+};
+
+
+// interrupts triggered in software, e.g. by a timer or a test
+class soft_irq_source : public irq_source {
+ public:
+  soft_irq_source() : m_handler(NULL), m_arg(NULL) {}
+
+  bool attach(void (*handler)(void*), void* arg);
+  void detach();
+
+  // calls the attached handler in the calling thread
+  void trigger();
+
+ private:
+  std::mutex m_mtx;
+  void (*m_handler)(void*);
+  void* m_arg;
+};
+
+
+class imu_irq {
+ public:
+  // attaches to [src], the pin has to be latched (see imu_edison::setInterrupts)
+  // [watermark] is the FIFO fill level in samples after which wait() returns at the latest
+  imu_irq(imu_edison* imu, irq_source* src, size_t watermark = 25);
+  // detaches from the source and releases a waiting thread
+  ~imu_irq();
+
+  // blocks until an interrupt edge arrives or the FIFO reached the watermark
+  // returns the interrupt status register, 0 if woken by the watermark
+  // the MPU 9250 has no FIFO watermark interrupt, so the watermark is derived from the
+  // sample rate; the FIFO overflow interrupt is the backstop if that gets out of step
+  uint8_t wait();
+  // same as above, but without the watermark, e.g. while the IMU is in low-power mode
+  // returns 0 if released by wakeup()
+  uint8_t waitInterrupt();
+
+  // releases a waiting thread without an interrupt, e.g. on shutdown
+  void wakeup();
+
+  // set the watermark in samples, the FIFO holds MPU_FIFO_SIZE / MPU_FIFO_SAMPLE_SIZE at most
+  void setWatermark(size_t samples);
+  inline size_t getWatermark() {return m_watermark;}
+
+  // counters: interrupt edges seen, returns of wait() due to an edge or due to the watermark
+  inline unsigned long getInterrupts() {return m_interrupts;}
+  inline unsigned long getIntWakeups() {return m_int_wakeups;}
+  inline unsigned long getTimeouts() {return m_timeouts;}
+
+ private:
+  // edge handler, [arg] is the imu_irq object
+  static void isr(void* arg);
+
+  imu_edison* m_imu;
+  irq_source* m_src;
+
+  std::mutex m_mtx;
+  std::condition_variable m_cv;
+  unsigned int m_pending;
+  bool m_wake;
+
+  size_t m_watermark;
+  int m_timeout_ms;
+
+  std::atomic<unsigned long> m_interrupts;
+  std::atomic<unsigned long> m_int_wakeups;
+  std::atomic<unsigned long> m_timeouts;
+};
+
+#endif // imu_irq_h
@@ -0,0 +1,88 @@
+/*
+* Preallocated pages for the in-RAM sample log
+* all pages are allocated once; the IMU thread fills one page at a time with the room for its
+* header reserved up front, full pages go to the writer by pointer and come back to the free
+* pages once written, so logging neither allocates nor copies a growing buffer
+*
+*/
+
+#ifndef log_arena_h
+#define log_arena_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+// page layout of the datalogXXXX.bin files: the header (time, light, temperature, pressure,
+// humidity), then samples of ACCEL XYZ, GYRO XYZ as 16Bit big endian
+#define LOG_HEADER_SIZE 20
+#define LOG_PAGE_SAMPLES 600
+#define LOG_SAMPLE_SIZE 12
+#define LOG_PAGE_SIZE (LOG_HEADER_SIZE + LOG_PAGE_SAMPLES * LOG_SAMPLE_SIZE)
+// pages in RAM by default, 7.4 MB or 6.8h at 25Hz
+#define LOG_ARENA_PAGES 1024
+
+
+struct log_page {
+  // bytes used in data, the header included
+  uint32_t size;
+  // first sample [ns CLOCK_MONOTONIC], see imu_clock::sampleTime(), 0 if unknown
+  int64_t stamp;
+  uint8_t data[LOG_PAGE_SIZE];
+
+  inline uint8_t* header() {return data;}
+  inline bool isFull() {return size == LOG_PAGE_SIZE;}
+  inline size_t getSamples() {return (size - LOG_HEADER_SIZE) / LOG_SAMPLE_SIZE;}
+
+  // appends up to [n] samples of [raw] as delivered by imu_edison::readFIFO()
+  // (6 values per sample, ACCEL XYZ, GYRO XYZ), returns the number of samples that fit
+  size_t append(const int16_t* raw, size_t n);
+};
+
+
+class log_arena {
+ public:
+  // allocates [pages] pages
+  log_arena(size_t pages = LOG_ARENA_PAGES);
+
+  // IMU thread: a free page with its header reserved (to be written at header()),
+  // NULL if all pages wait for the writer
+  log_page* begin();
+  // IMU thread: hands [page] to the writer, full or not
+  void commit(log_page* page);
+
+  // writer: the oldest committed page, NULL if there is none
+  log_page* take();
+  // writer: returns a written page to the free pages
+  void release(log_page* page);
+  // writer: waits up to [timeout] until [pages] pages are committed or wakeup() is called
+  // returns the number of pages committed
+  size_t wait(size_t pages, std::chrono::steady_clock::duration timeout);
+  void wakeup();
+
+  inline size_t getPages() {return m_pages.size();}
+  // pages and bytes committed and not taken yet
+  size_t getCommitted();
+  size_t getBytes();
+  // begin() found no free page, the back pressure of a slow writer
+  unsigned long getExhausted();
+
+ private:
+  std::vector<log_page> m_pages;
+
+  // free and committed pages, rings as long as there are pages
+  std::vector<log_page*> m_free;
+  size_t m_free_head, m_free_count;
+  std::vector<log_page*> m_committed;
+  size_t m_committed_head, m_committed_count;
+  size_t m_bytes;
+  unsigned long m_exhausted;
+  std::mutex m_mtx;
+  std::condition_variable m_cv;
+  bool m_wakeup;
+};
+
+#endif // log_arena_h
@@ -0,0 +1,61 @@
+/*
+* Write-ahead journal of the sample log
+* the writer appends every page to the journal as soon as it takes it and syncs the journal
+* within a bounded window, while the segments are written in large batches and synced rarely;
+* once a segment is synced the journal starts over, after a crash recover() moves the pages
+* of the journal into the segment they belong to
+*
+*/
+
+#ifndef log_journal_h
+#define log_journal_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <sys/uio.h>
+
+#include "./log_format.h"
+
+// [s] a page handed to the writer is on the flash after this at most
+#define LOG_JOURNAL_WINDOW 10.0
+
+// journal header, little endian: "PPSJ", segment number (4), bytes of the segment on the flash
+// when the journal started (4), CRC32C of the bytes before and the file header (4), the file
+// header of the segment; pages as in the segment follow
+#define LOG_JOURNAL_MAGIC "PPSJ"
+#define LOG_JOURNAL_HEADER_SIZE (16 + LOG_FILE_HEADER_SIZE)
+
+
+class log_journal {
+ public:
+  log_journal();
+  ~log_journal();
+
+  // creates the journal [path] empty for segment [segment] of [header], at 0 bytes on the flash
+  bool open(const std::string &path, int segment, const log_file_header &header);
+  void close();
+  inline bool isOpen() {return m_fd >= 0;}
+
+  // appends the [count] pages at [iov]
+  bool append(const struct iovec* iov, int count);
+  // the pages appended so far to the flash
+  bool sync();
+  // starts over once segment [segment] is on the flash with [size] bytes, the [count] pages at
+  // [iov] are not in it yet and go to the journal again; synced
+  bool reset(int segment, size_t size, const struct iovec* iov, int count);
+
+  // moves the intact pages of the journal [path] behind the intact part of their segment in
+  // [dir][prefix]XXXX.bin and empties the journal; returns the number of pages recovered
+  static size_t recover(const std::string &path, const std::string &dir, const std::string &prefix);
+
+  // writes the [count] buffers at [iov] to [fd] completely, [iov] is used up on the way
+  // returns false on an error
+  static bool writeAll(int fd, struct iovec* iov, int count);
+
+ private:
+  int m_fd;
+  log_file_header m_header;
+};
+
+#endif // log_journal_h
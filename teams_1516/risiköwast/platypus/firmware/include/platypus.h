@@ -21,6 +21,7 @@
 #include <thread>
 #include <atomic>
 #include <mutex>
+#include <condition_variable>
 #include <future>
 #include <chrono>
 
@@ -39,6 +40,15 @@
 #include "mraa.hpp"
 
 #include "./imu_edison.h"
+#include "./imu_irq.h"
+#include "./imu_bias.h"
+#include "./imu_clock.h"
+#include "./imu_gesture.h"
+#include "./imu_activity.h"
+#include "./imu_blackbox.h"
+#include "./imu_filter.h"
+#include "./log_arena.h"
+#include "./log_writer.h"
 #include "./display_edison.h"
 #include "./mcu_edison.h"
 #include "./batgauge_edison.h"
@@ -63,6 +73,32 @@ enum class DisplayStates {
 
 #define MENU_TIME 5
 
+// FIFO samples collected between two reads of the IMU thread (1s @ 25Hz)
+#define IMU_WATERMARK 25
+// consecutive windows of IMU_WATERMARK samples at rest before the IMU goes to low-power mode (30s)
+#define IMU_IDLE_WINDOWS 30
+
+// black box: the data log keeps this rate [Hz] while the IMU samples faster for the events
+#define IMU_LOG_RATE 25.0
+// event windows before / after a trigger [s], acceleration that triggers [g]
+#define IMU_CAPTURE_PRE 4.0
+#define IMU_CAPTURE_POST 2.0
+#define IMU_CAPTURE_G 3.0
+// the on-chip DLPF is opened up to the Nyquist frequency for the black box and the gestures,
+// the data log, the stillness and the activity get these low-pass bandwidths [Hz] in software
+#define IMU_LOG_BANDWIDTH 5.0
+#define IMU_ACTIVITY_BANDWIDTH 4.0
+
+// data log pages in RAM (7.4 MB), written to datalogXXXX.bin segments in this directory
+// (log_format version 2)
+#define LOG_PAGES LOG_ARENA_PAGES
+#define LOG_DIR "/home/root/pps_logs/"
+// the pages packed losslessly on the writer thread, Codec::RAW for the plain layout
+#define LOG_CODEC Codec::DELTA
+// [s] every committed page is in the journal on the flash after this, recovered at the next start
+// after a crash or power loss; negative for none
+#define LOG_JOURNAL LOG_JOURNAL_WINDOW
+
 
 class platypus {
  public:
@@ -77,7 +113,12 @@ class platypus {
 
   // init
   void display_init(uint8_t res, uint8_t clk_hands);
-  imu_edison* imu_init(int i2c_bus, uint8_t i2c_addr, bool env_init);
+  // if [irq_src] is given, the IMU thread is woken by interrupts instead of polling
+  imu_edison* imu_init(int i2c_bus, uint8_t i2c_addr, bool env_init, irq_source* irq_src = NULL);
+  // samples the IMU at [rate] and keeps the last seconds in the black box, WoM interrupts, impacts
+  // and gestures save them as event records; the data log is decimated to IMU_LOG_RATE
+  // call after imu_init() and before spawn_threads()
+  void blackbox_init(float rate);
   void mcu_init();
   void ldc_init(int i2c_bus);
   batgauge_edison* bat_init(int i2c_bus);
@@ -111,6 +152,14 @@ class platypus {
 
   void t_mcu();
 
+  // handle the interrupt status and the gestures of a FIFO block in the IMU thread
+  // taps drive the display menu and the game, the others go to pollIMU()
+  void imu_event(uint8_t int_status, const std::vector<imu_gesture_event> &gestures);
+  // low-power accel mode until a WoM interrupt, then back to full rate capture
+  void imu_low_power();
+  // triggers the black box for a FIFO block of [n] samples, see imu_event()
+  void imu_capture(uint8_t int_status, size_t n, const std::vector<imu_gesture_event> &gestures);
+
   // get current system (local) time as time structure
   struct tm * getTimeAndDate();
   
@@ -126,18 +175,20 @@ class platypus {
   // get ips of network interfaces in a map <interface name, ip string>
   std::map<std::string, std::string> getIPs();
 
-  // write the header to memory with time, light, temperature, pressure, humidity
-  void writeHeader();
-  // write sensor data (IMU) to memory, given certain formats
-  void writeData(std::vector<uint8_t> data);
-  void writeData(std::vector<int16_t> data);
-  void writeData(uint8_t data);
-  void writeData(int16_t data);
-
-  // save the current memory data buffer to the NAND-Flash
-  // make sure to call this as async as it will lock until all data is written
-  void writeDataToFlashIDX(uint8_t idx);
-  void writeDataToFlash(std::vector<uint8_t> &data);
+  // write the header with time, light, temperature, pressure, humidity to the LOG_HEADER_SIZE bytes at [header]
+  void writeHeader(uint8_t* header);
+  // write [n] samples of [raw] (IMU, 6 values per sample) to the log pages in memory, [raw] is
+  // sample [first] of the FIFO [block], which stamps every page with the time of its first sample;
+  // samples are dropped while all pages wait for the flash
+  void writeData(const int16_t* raw, size_t n, const imu_block_time &block, size_t first);
+  // the file header of the data log: device, full scales, log rate and bandwidth
+  log_file_header logHeader();
+
+  // append a minute of activity to activity.csv next to the data logs
+  void writeActivity(const imu_activity_summary &summary);
+  // save the completed black box event as eventYYYYMMDD-hhmmss_cause.bin next to the data logs
+  // call as async, it copies the event out of the ring while the IMU thread keeps going
+  void writeEvent();
 
   // print some sensor data etc. to console
   void printDebug(int &last_min, std::vector<float> data);
@@ -150,6 +201,7 @@ class platypus {
   //________________________________________________________________________________
   display_edison* m_dsp;
   imu_edison* m_imu;
+  imu_irq* m_irq;
   mcu_edison* m_mcu;
   ldc_edison* m_ldc;
   batgauge_edison* m_bat;
@@ -163,15 +215,45 @@ class platypus {
 
   std::vector<std::thread> m_threads;
   std::recursive_mutex m_mtx_time;
-  std::recursive_mutex m_mtx_write;
 
   std::atomic<bool> m_force_save;
-  std::atomic<bool> m_saving;
 
   std::vector<int16_t> m_imu_data;
-
-  std::array<std::vector<uint8_t>, 2> m_data_memory;
-  uint8_t m_data_idx;
+  // guards m_imu_data, signals new IMU data to pollIMU()
+  std::mutex m_mtx_imu;
+  std::condition_variable m_cv_imu;
+  unsigned long m_imu_seq;
+  // gestures on the FIFO stream, face down/up are passed on to pollIMU() under m_mtx_imu
+  imu_gesture m_gestures;
+  std::vector<imu_gesture_event> m_gesture_events;
+  // stillness over the FIFO data, consecutive windows at rest
+  imu_bias m_imu_still;
+  int m_imu_idle;
+  // the last FIFO block, room for a full FIFO so that t_imu() reads without allocating
+  int16_t m_fifo_data[MPU_FIFO_SIZE / 2];
+  // sample times of the FIFO blocks, the last block is guarded by m_mtx_imu
+  imu_clock m_imu_clock;
+  imu_block_time m_imu_time;
+  // steps and activity over the FIFO data, summed up per minute
+  imu_activity m_activity;
+  // low-pass filters of the data log (also the stillness) and of the activity
+  imu_filter m_log_filter;
+  imu_filter m_activity_filter;
+  // high-rate samples around events, NULL if off; every m_log_div-th sample goes to the data log,
+  // the next one at m_log_phase of the next block
+  imu_blackbox* m_blackbox;
+  size_t m_log_div;
+  size_t m_log_phase;
+  // the IMU left low-power mode, the next block triggers the black box
+  bool m_imu_woken;
+
+  // data log: the page being filled by the IMU thread, the low-passed samples of the last block,
+  // the thread that writes the committed pages to the NAND-Flash
+  log_arena m_log_arena;
+  log_page* m_log_page;
+  std::vector<int16_t> m_log_data;
+  unsigned long m_log_dropped;
+  log_writer m_log_writer;
 
   int m_debug;
 
@@ -0,0 +1,156 @@
+/*
+* Step counting and activity classification on raw FIFO blocks
+* the peaks of a window only count as steps once the window is classified walking or running
+*
+*/
+
+#include "./imu_activity.h"
+
+// m_since_peak without a peak
+#define NO_PEAK ((size_t) -1)
+
+
+//_______________________________________________________________________________________________________
+imu_activity::imu_activity(float rate, int afs_sel)
+ : m_rate(rate)
+{
+  // see imu_convert::setRange()
+  float scale = (1 << afs_sel) * 9.807 / 16384.0;
+  m_accel_sq = scale * scale;
+  m_k = 1.0 - exp(-1.0 / (rate * IMU_ACTIVITY_TAU));
+
+  m_window = (size_t) lround(IMU_ACTIVITY_WINDOW * rate);
+  m_window = m_window > 0 ? m_window : 1;
+  m_step_min = (size_t) lround(IMU_ACTIVITY_STEP_MIN * rate);
+  m_step = IMU_ACTIVITY_STEP;
+  m_still_sq = IMU_ACTIVITY_STILL * IMU_ACTIVITY_STILL;
+  m_shake_sq = IMU_ACTIVITY_SHAKE * IMU_ACTIVITY_SHAKE;
+  m_run_sq = IMU_ACTIVITY_RUN * IMU_ACTIVITY_RUN;
+
+  reset();
+}
+
+//_______________________________________________________________________________________________________
+void imu_activity::reset() {
+  m_gravity = 0.0;
+  m_init = false;
+
+  m_peak = false;
+  m_since_peak = NO_PEAK;
+
+  m_n = 0;
+  m_sq = 0.0;
+  m_peaks = 0;
+  m_fast = false;
+
+  m_activity = Activity::STILL;
+  m_steps = 0;
+
+  m_minute = imu_activity_summary();
+  m_minute_windows = 0;
+  m_summary = imu_activity_summary();
+  m_summary_new = false;
+}
+
+//_______________________________________________________________________________________________________
+size_t imu_activity::update(const int16_t* raw, size_t n) {
+  size_t windows = 0;
+
+  for (size_t i = 0; i < n; ++i, raw += 6) {
+    // the magnitude does not depend on the orientation
+    float a = sqrt(((float) raw[0] * raw[0] + (float) raw[1] * raw[1] + (float) raw[2] * raw[2]) * m_accel_sq);
+    if (!m_init) {
+      m_gravity = a;
+      m_init = true;
+    }
+    float d = a - m_gravity;
+    m_gravity += m_k * d;
+
+    // a peak is counted when the magnitude falls back to gravity
+    if (m_since_peak != NO_PEAK)
+      ++m_since_peak;
+    if (d > m_step) {
+      m_peak = true;
+    } else if (d < 0.0 && m_peak) {
+      m_peak = false;
+      if (m_since_peak != NO_PEAK && m_since_peak < m_step_min)
+        m_fast = true;
+      m_since_peak = 0;
+      ++m_peaks;
+    }
+
+    m_sq += d * d;
+    if (++m_n >= m_window) {
+      closeWindow();
+      ++windows;
+    }
+  }
+
+  return windows;
+}
+
+//_______________________________________________________________________________________________________
+void imu_activity::closeWindow() {
+  float ms = m_sq / m_n;
+  float cadence = m_peaks * m_rate / m_n;
+
+  if (ms < m_still_sq) {
+    m_activity = Activity::STILL;
+  } else if (m_fast || (m_peaks < 2 && ms > m_shake_sq)) {
+    m_activity = Activity::SHAKING;
+  } else if (m_peaks < 2) {
+    m_activity = Activity::STILL; // moving without steps, e.g. fidgeting
+  } else if (ms > m_run_sq || cadence > IMU_ACTIVITY_RUN_CADENCE) {
+    m_activity = Activity::RUNNING;
+  } else {
+    m_activity = Activity::WALKING;
+  }
+
+  if (m_activity == Activity::WALKING || m_activity == Activity::RUNNING) {
+    m_steps += m_peaks;
+    m_minute.steps += m_peaks;
+  }
+  ++m_minute.windows[(int) m_activity];
+
+  m_n = 0;
+  m_sq = 0.0;
+  m_peaks = 0;
+  m_fast = false;
+
+  if (++m_minute_windows >= IMU_ACTIVITY_MINUTE) {
+    int best = 0;
+    for (int c = 1; c < IMU_ACTIVITY_CLASSES; ++c) {
+      if (m_minute.windows[c] > m_minute.windows[best])
+        best = c;
+    }
+    m_minute.activity = (Activity) best;
+    m_summary = m_minute;
+    m_summary_new = true;
+
+    uint32_t next = m_minute.minute + 1;
+    m_minute = imu_activity_summary();
+    m_minute.minute = next;
+    m_minute_windows = 0;
+  }
+}
+
+//_______________________________________________________________________________________________________
+bool imu_activity::getSummary(imu_activity_summary &summary) {
+  if (!m_summary_new)
+    return false;
+
+  summary = m_summary;
+  m_summary_new = false;
+  return true;
+}
+
+//_______________________________________________________________________________________________________
+const char* imu_activity::name(Activity type) {
+  switch (type) {
+    case Activity::STILL: return "still";
+    case Activity::WALKING: return "walking";
+    case Activity::RUNNING: return "running";
+    case Activity::SHAKING: return "shaking";
+  }
+  return "unknown";
+}
@@ -0,0 +1,73 @@
+/*
+* Sample timestamps for FIFO blocks
+* exponentially weighted least squares of sample index vs. time, one observation per block:
+* the newest sample in the FIFO was taken within the last period before the count was read
+*
+*/
+
+#include "./imu_clock.h"
+
+
+//_______________________________________________________________________________________________________
+imu_clock::imu_clock(float rate, double forget)
+ : m_forget(forget)
+{
+  resync(rate);
+}
+
+//_______________________________________________________________________________________________________
+void imu_clock::resync(float rate) {
+  if (rate > 0.0) {
+    m_nominal = 1e9 / rate;
+    m_period = m_nominal;
+  }
+  m_k = 0;
+  m_blocks = 0;
+  m_x0 = 0;
+  m_t0 = 0;
+  m_w = m_sx = m_sy = m_sxx = m_sxy = 0.0;
+}
+
+//_______________________________________________________________________________________________________
+void imu_clock::stamp(size_t count, size_t n, int64_t t, imu_block_time &block) {
+  if (count < n)
+    count = n;
+
+  // the newest sample [x] was taken within (t - period, t], take the middle
+  uint64_t x = m_k + count - 1;
+  int64_t y = t - (int64_t) (m_period / 2.0);
+
+  // move the origin to the new observation, then add it at (0, 0)
+  if (m_blocks > 0) {
+    double dx = (double) (x - m_x0), dy = (double) (y - m_t0);
+    m_sxx += -2.0 * dx * m_sx + m_w * dx * dx;
+    m_sxy += -dx * m_sy - dy * m_sx + m_w * dx * dy;
+    m_sx -= m_w * dx;
+    m_sy -= m_w * dy;
+  }
+  m_x0 = x;
+  m_t0 = y;
+  m_w = m_forget * m_w + 1.0;
+  m_sx *= m_forget;
+  m_sy *= m_forget;
+  m_sxx *= m_forget;
+  m_sxy *= m_forget;
+  ++m_blocks;
+
+  // slope = period, needs some spread in the sample index
+  double mx = m_sx / m_w, my = m_sy / m_w;
+  double var = m_sxx / m_w - mx * mx;
+  if (m_blocks > 1 && var > 1.0) {
+    double period = (m_sxy / m_w - mx * my) / var;
+    if (period > m_nominal * (1.0 - IMU_CLOCK_MAX_DRIFT) && period < m_nominal * (1.0 + IMU_CLOCK_MAX_DRIFT))
+      m_period = period;
+  }
+  double b = my - m_period * mx; // fitted time of sample x [ns since m_t0]
+
+  block.first = m_t0 + (int64_t) (b - (double) (x - m_k) * m_period + 0.5);
+  block.drain = t;
+  block.period = m_period;
+  block.n = n;
+
+  m_k += n;
+}
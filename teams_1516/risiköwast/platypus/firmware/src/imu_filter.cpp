@@ -0,0 +1,217 @@
+/*
+* Biquad filter bank for raw FIFO blocks
+* sections from the audio EQ cookbook (R. Bristow-Johnson) with the qualities of a Butterworth
+* cascade; the recursion runs sample by sample, the six channels of a sample side by side in
+* two registers, so a section is a handful of vector operations per sample
+*
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include "./imu_filter.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define LANES IMU_FILTER_LANES
+
+
+//_______________________________________________________________________________________________________
+// lane of channel [c] of a sample (ACCEL XYZ, GYRO XYZ)
+static inline int lane(int c) {
+  return c < 3 ? c : c + 2;
+}
+
+//_______________________________________________________________________________________________________
+// rounded to LSB as _mm_cvtps_epi32() and _mm_packs_epi32() do
+static inline int16_t toRaw(float v) {
+  long r = lrintf(v);
+  return (int16_t) (r > 32767 ? 32767 : (r < -32768 ? -32768 : r));
+}
+
+
+//_______________________________________________________________________________________________________
+imu_filter::imu_filter(float rate) : m_rate(rate), m_type(Filter::NONE), m_sections(0) {
+  reset();
+}
+
+//_______________________________________________________________________________________________________
+bool imu_filter::design(Filter type, float f1, float f2, int order) {
+  const float nyquist = m_rate / 2.0;
+  if (order < 2 || order % 2 != 0 || f1 <= 0.0 || f1 >= nyquist)
+    return false;
+  size_t sections = order / 2;
+  if (type == Filter::BANDPASS) {
+    if (f2 <= f1 || f2 >= nyquist)
+      return false;
+    sections *= 2;
+  }
+  if (type == Filter::NONE || sections > IMU_FILTER_SECTIONS)
+    return false;
+
+  m_type = type;
+  m_sections = 0;
+  // pole pairs of the Butterworth polynomial, Q = 1 / (2 cos(theta))
+  for (int k = 0; k < order / 2; ++k) {
+    double q = 1.0 / (2.0 * cos((2 * k + 1) * M_PI / (2 * order)));
+    if (type == Filter::BANDPASS) {
+      section(Filter::HIGHPASS, f1, q);
+      section(Filter::LOWPASS, f2, q);
+    } else {
+      section(type, f1, q);
+    }
+  }
+  reset();
+  return true;
+}
+
+//_______________________________________________________________________________________________________
+void imu_filter::section(Filter type, float hz, double q) {
+  const double w0 = 2.0 * M_PI * hz / m_rate;
+  const double c = cos(w0), alpha = sin(w0) / (2.0 * q), a0 = 1.0 + alpha;
+  const size_t i = m_sections++;
+  if (type == Filter::LOWPASS) {
+    m_b0[i] = (float) ((1.0 - c) / 2.0 / a0);
+    m_b1[i] = (float) ((1.0 - c) / a0);
+  } else {
+    m_b0[i] = (float) ((1.0 + c) / 2.0 / a0);
+    m_b1[i] = (float) (-(1.0 + c) / a0);
+  }
+  m_b2[i] = m_b0[i];
+  m_a1[i] = (float) (-2.0 * c / a0);
+  m_a2[i] = (float) ((1.0 - alpha) / a0);
+}
+
+//_______________________________________________________________________________________________________
+double imu_filter::response(float hz) {
+  const double w = 2.0 * M_PI * hz / m_rate;
+  double gain = 1.0;
+  for (size_t i = 0; i < m_sections; ++i) {
+    // H(z) at z = e^jw, numerator and denominator in powers of z^-1
+    double nr = m_b0[i] + m_b1[i] * cos(w) + m_b2[i] * cos(2 * w);
+    double ni = -m_b1[i] * sin(w) - m_b2[i] * sin(2 * w);
+    double dr = 1.0 + m_a1[i] * cos(w) + m_a2[i] * cos(2 * w);
+    double di = -m_a1[i] * sin(w) - m_a2[i] * sin(2 * w);
+    gain *= sqrt((nr * nr + ni * ni) / (dr * dr + di * di));
+  }
+  return gain;
+}
+
+//_______________________________________________________________________________________________________
+void imu_filter::reset() {
+  memset(m_s1, 0, sizeof(m_s1));
+  memset(m_s2, 0, sizeof(m_s2));
+  m_primed = false;
+}
+
+//_______________________________________________________________________________________________________
+void imu_filter::prime(const int16_t* s) {
+  for (int c = 0; c < 6; ++c) {
+    float x = s[c];
+    for (size_t i = 0; i < m_sections; ++i) {
+      // the output a constant input settles at, the DC gain of the section
+      float y = x * (m_b0[i] + m_b1[i] + m_b2[i]) / (1.0f + m_a1[i] + m_a2[i]);
+      m_s1[i][lane(c)] = y - m_b0[i] * x;
+      m_s2[i][lane(c)] = m_b2[i] * x - m_a2[i] * y;
+      x = y;
+    }
+  }
+  m_primed = true;
+}
+
+//_______________________________________________________________________________________________________
+void imu_filter::filter(const int16_t* raw, size_t n, int16_t* out) {
+#ifdef __SSE2__
+  if (m_sections == 0) {
+    if (out != raw)
+      memmove(out, raw, n * 6 * sizeof(int16_t));
+    return;
+  }
+  if (n > 0 && !m_primed)
+    prime(raw);
+
+  // idle lanes stay at zero
+  const __m128 mask_a = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+  const __m128 mask_g = _mm_castsi128_ps(_mm_set_epi32(-1, -1, -1, 0));
+  __m128 s1[IMU_FILTER_SECTIONS][2], s2[IMU_FILTER_SECTIONS][2];
+  for (size_t i = 0; i < m_sections; ++i) {
+    s1[i][0] = _mm_loadu_ps(&m_s1[i][0]);
+    s1[i][1] = _mm_loadu_ps(&m_s1[i][4]);
+    s2[i][0] = _mm_loadu_ps(&m_s2[i][0]);
+    s2[i][1] = _mm_loadu_ps(&m_s2[i][4]);
+  }
+
+  int16_t packed[8];
+  for (size_t k = 0; k < n; ++k, raw += 6, out += 6) {
+    // ACCEL XYZ and GYRO X, ACCEL Z and GYRO XYZ, sign extended, the other sensor masked
+    __m128i va = _mm_loadl_epi64((const __m128i*) raw);
+    __m128i vg = _mm_loadl_epi64((const __m128i*) (raw + 2));
+    __m128 x[2];
+    x[0] = _mm_and_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(va, va), 16)), mask_a);
+    x[1] = _mm_and_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(vg, vg), 16)), mask_g);
+
+    for (size_t i = 0; i < m_sections; ++i) {
+      const __m128 b0 = _mm_set1_ps(m_b0[i]), b1 = _mm_set1_ps(m_b1[i]), b2 = _mm_set1_ps(m_b2[i]);
+      const __m128 a1 = _mm_set1_ps(m_a1[i]), a2 = _mm_set1_ps(m_a2[i]);
+      for (int r = 0; r < 2; ++r) {
+        __m128 y = _mm_add_ps(_mm_mul_ps(b0, x[r]), s1[i][r]);
+        s1[i][r] = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, x[r]), _mm_mul_ps(a1, y)), s2[i][r]);
+        s2[i][r] = _mm_sub_ps(_mm_mul_ps(b2, x[r]), _mm_mul_ps(a2, y));
+        x[r] = y;
+      }
+    }
+
+    // [ACCEL X, Y, Z, 0, 0, GYRO X, Y, Z]
+    _mm_storeu_si128((__m128i*) packed, _mm_packs_epi32(_mm_cvtps_epi32(x[0]), _mm_cvtps_epi32(x[1])));
+    memcpy(out, packed, 3 * sizeof(int16_t));
+    memcpy(out + 3, packed + 5, 3 * sizeof(int16_t));
+  }
+
+  for (size_t i = 0; i < m_sections; ++i) {
+    _mm_storeu_ps(&m_s1[i][0], s1[i][0]);
+    _mm_storeu_ps(&m_s1[i][4], s1[i][1]);
+    _mm_storeu_ps(&m_s2[i][0], s2[i][0]);
+    _mm_storeu_ps(&m_s2[i][4], s2[i][1]);
+  }
+#else
+  filterScalar(raw, n, out);
+#endif
+}
+
+//_______________________________________________________________________________________________________
+void imu_filter::filterScalar(const int16_t* raw, size_t n, int16_t* out) {
+  if (m_sections == 0) {
+    if (out != raw)
+      memmove(out, raw, n * 6 * sizeof(int16_t));
+    return;
+  }
+  if (n > 0 && !m_primed)
+    prime(raw);
+
+  for (size_t k = 0; k < n; ++k, raw += 6, out += 6) {
+    for (int c = 0; c < 6; ++c) {
+      const int l = lane(c);
+      float x = raw[c];
+      for (size_t i = 0; i < m_sections; ++i) {
+        float y = m_b0[i] * x + m_s1[i][l];
+        m_s1[i][l] = (m_b1[i] * x - m_a1[i] * y) + m_s2[i][l];
+        m_s2[i][l] = m_b2[i] * x - m_a2[i] * y;
+        x = y;
+      }
+      out[c] = toRaw(x);
+    }
+  }
+}
+
+//_______________________________________________________________________________________________________
+const char* imu_filter::name(Filter type) {
+  switch (type) {
+    case Filter::NONE: return "none";
+    case Filter::LOWPASS: return "low-pass";
+    case Filter::HIGHPASS: return "high-pass";
+    case Filter::BANDPASS: return "band-pass";
+  }
+  return "unknown";
+}
@@ -0,0 +1,153 @@
+/*
+* Streaming gesture recognition on raw FIFO blocks
+* the state carries over between blocks, so a gesture may span two of them
+*
+*/
+
+#include "./imu_gesture.h"
+
+// the energy of a single spike is clipped, so strong taps do not count as a shake
+#define ENERGY_CLIP (4.0 * IMU_GESTURE_SHAKE * IMU_GESTURE_SHAKE)
+// m_since_tap without a tap
+#define NO_TAP ((size_t) -1)
+
+
+//_______________________________________________________________________________________________________
+imu_gesture::imu_gesture(float rate, int afs_sel, int gfs_sel) {
+  // see imu_convert::setRange()
+  m_accel_scale = (1 << afs_sel) * 9.807 / 16384.0;
+  m_gyro_scale = (1 << gfs_sel) / 131.0;
+
+  m_tap_len = (size_t) lround(IMU_GESTURE_TAP_LEN * rate);
+  m_tap_len = m_tap_len > 0 ? m_tap_len : 1;
+  m_double = (size_t) lround(IMU_GESTURE_DOUBLE * rate);
+  m_face_hold = (size_t) lround(IMU_GESTURE_FACE_HOLD * rate);
+  m_tap_sq = IMU_GESTURE_TAP * IMU_GESTURE_TAP;
+  m_quiet_sq = IMU_GESTURE_QUIET * IMU_GESTURE_QUIET;
+  m_gyro_sq = IMU_GESTURE_TAP_GYRO * IMU_GESTURE_TAP_GYRO;
+  m_shake_on = IMU_GESTURE_SHAKE * IMU_GESTURE_SHAKE;
+  m_shake_off = m_shake_on / 4.0;
+  m_face_z = IMU_GESTURE_FACE * 9.807;
+  m_k = 1.0 - exp(-1.0 / (rate * IMU_GESTURE_TAU));
+  m_dt = M_PI / 180.0 / rate; // deg/s to rad per sample
+
+  reset();
+}
+
+//_______________________________________________________________________________________________________
+void imu_gesture::reset() {
+  for (int j = 0; j < 3; ++j)
+    m_gravity[j] = 0.0;
+  m_init = false;
+
+  m_spike = 0;
+  m_quiet = 0;
+  m_since_tap = NO_TAP;
+  m_spike_ok = false;
+
+  m_energy = 0.0;
+  m_shaking = false;
+
+  m_face = 1;
+  m_face_cnt = 0;
+}
+
+//_______________________________________________________________________________________________________
+size_t imu_gesture::update(const int16_t* raw, size_t n, std::vector<imu_gesture_event> &events) {
+  size_t found = events.size();
+
+  for (size_t i = 0; i < n; ++i, raw += 6) {
+    float a[3], w[3], d2 = 0.0, w2 = 0.0;
+    for (int j = 0; j < 3; ++j) {
+      a[j] = raw[j] * m_accel_scale;
+      w[j] = raw[j + 3] * m_gyro_scale;
+      w2 += w[j] * w[j];
+    }
+    if (!m_init) {
+      for (int j = 0; j < 3; ++j)
+        m_gravity[j] = a[j];
+      m_init = true;
+    }
+
+    // the gravity turns with the board: dg/dt = -w x g
+    float g[3] = {m_gravity[0], m_gravity[1], m_gravity[2]};
+    m_gravity[0] -= m_dt * (w[1] * g[2] - w[2] * g[1]);
+    m_gravity[1] -= m_dt * (w[2] * g[0] - w[0] * g[2]);
+    m_gravity[2] -= m_dt * (w[0] * g[1] - w[1] * g[0]);
+    for (int j = 0; j < 3; ++j)
+      d2 += (a[j] - m_gravity[j]) * (a[j] - m_gravity[j]);
+    if (m_since_tap != NO_TAP)
+      ++m_since_tap;
+
+    // tap: quiet, a spike of at most m_tap_len samples without rotation, quiet again
+    if (d2 > m_tap_sq) {
+      if (m_spike == 0)
+        m_spike_ok = m_quiet > 0 && !m_shaking;
+      ++m_spike;
+      m_quiet = 0;
+    } else if (d2 < m_quiet_sq) {
+      if (m_spike > 0 && m_spike_ok && m_spike <= m_tap_len) {
+        imu_gesture_event ev = {Gesture::TAP, i};
+        events.push_back(ev);
+        if (m_since_tap != NO_TAP && m_since_tap <= m_double) {
+          ev.type = Gesture::DOUBLE_TAP;
+          events.push_back(ev);
+          m_since_tap = NO_TAP; // a third tap starts over
+        } else {
+          m_since_tap = 0;
+        }
+      }
+      m_spike = 0;
+      ++m_quiet;
+    } else {
+      if (m_spike > 0)
+        ++m_spike;
+      m_quiet = 0;
+    }
+    if (m_spike > 0 && w2 > m_gyro_sq)
+      m_spike_ok = false;
+
+    // a possible tap does not move the gravity estimate, longer motion does
+    if (m_spike == 0 || m_spike > m_tap_len) {
+      for (int j = 0; j < 3; ++j)
+        m_gravity[j] += m_k * (a[j] - m_gravity[j]);
+    }
+
+    // shake: energy with hysteresis
+    m_energy += m_k * ((d2 < ENERGY_CLIP ? d2 : ENERGY_CLIP) - m_energy);
+    if (!m_shaking && m_energy > m_shake_on) {
+      m_shaking = true;
+      imu_gesture_event ev = {Gesture::SHAKE, i};
+      events.push_back(ev);
+    } else if (m_shaking && m_energy < m_shake_off) {
+      m_shaking = false;
+    }
+
+    // face down/up: gravity along Z held beyond the threshold
+    int face = m_gravity[2] < -m_face_z ? -1 : (m_gravity[2] > m_face_z ? 1 : 0);
+    if (face != 0 && face != m_face) {
+      if (++m_face_cnt >= m_face_hold) {
+        m_face = face;
+        m_face_cnt = 0;
+        imu_gesture_event ev = {face < 0 ? Gesture::FACE_DOWN : Gesture::FACE_UP, i};
+        events.push_back(ev);
+      }
+    } else {
+      m_face_cnt = 0;
+    }
+  }
+
+  return events.size() - found;
+}
+
+//_______________________________________________________________________________________________________
+const char* imu_gesture::name(Gesture type) {
+  switch (type) {
+    case Gesture::TAP: return "tap";
+    case Gesture::DOUBLE_TAP: return "double-tap";
+    case Gesture::SHAKE: return "shake";
+    case Gesture::FACE_DOWN: return "face-down";
+    case Gesture::FACE_UP: return "face-up";
+  }
+  return "unknown";
+}
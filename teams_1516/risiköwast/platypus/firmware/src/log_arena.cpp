@@ -0,0 +1,119 @@
+/*
+* Preallocated pages for the in-RAM sample log
+* the free and the committed pages are rings of pointers sized for all pages, both sides only
+* hold the lock to move a pointer
+*
+*/
+
+#include "./log_arena.h"
+
+
+//_______________________________________________________________________________________________________
+size_t log_page::append(const int16_t* raw, size_t n) {
+  size_t room = (LOG_PAGE_SIZE - size) / LOG_SAMPLE_SIZE;
+  n = n < room ? n : room;
+
+  uint8_t* out = data + size;
+  for (size_t i = 0; i < 6 * n; ++i) {
+    out[2 * i] = (uint8_t) ((uint16_t) raw[i] >> 8);
+    out[2 * i + 1] = (uint8_t) (raw[i] & 0xFF);
+  }
+  size += n * LOG_SAMPLE_SIZE;
+  return n;
+}
+
+
+//_______________________________________________________________________________________________________
+log_arena::log_arena(size_t pages)
+    : m_pages(pages > 0 ? pages : 1), m_free(m_pages.size()), m_free_head(0), m_free_count(m_pages.size()),
+      m_committed(m_pages.size()), m_committed_head(0), m_committed_count(0), m_bytes(0), m_exhausted(0),
+      m_wakeup(false) {
+  for (size_t i = 0; i < m_pages.size(); ++i) {
+    m_pages[i].size = 0;
+    m_pages[i].stamp = 0;
+    m_free[i] = &m_pages[i];
+  }
+}
+
+//_______________________________________________________________________________________________________
+log_page* log_arena::begin() {
+  std::lock_guard<std::mutex> lock(m_mtx);
+  if (m_free_count == 0) {
+    ++m_exhausted;
+    return NULL;
+  }
+
+  log_page* page = m_free[m_free_head];
+  m_free_head = (m_free_head + 1) % m_free.size();
+  --m_free_count;
+  page->size = LOG_HEADER_SIZE;
+  page->stamp = 0;
+  return page;
+}
+
+//_______________________________________________________________________________________________________
+void log_arena::commit(log_page* page) {
+  {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_committed[(m_committed_head + m_committed_count) % m_committed.size()] = page;
+    ++m_committed_count;
+    m_bytes += page->size;
+  }
+  m_cv.notify_one();
+}
+
+//_______________________________________________________________________________________________________
+log_page* log_arena::take() {
+  std::lock_guard<std::mutex> lock(m_mtx);
+  if (m_committed_count == 0)
+    return NULL;
+
+  log_page* page = m_committed[m_committed_head];
+  m_committed_head = (m_committed_head + 1) % m_committed.size();
+  --m_committed_count;
+  m_bytes -= page->size;
+  return page;
+}
+
+//_______________________________________________________________________________________________________
+void log_arena::release(log_page* page) {
+  std::lock_guard<std::mutex> lock(m_mtx);
+  page->size = 0;
+  m_free[(m_free_head + m_free_count) % m_free.size()] = page;
+  ++m_free_count;
+}
+
+//_______________________________________________________________________________________________________
+size_t log_arena::wait(size_t pages, std::chrono::steady_clock::duration timeout) {
+  std::unique_lock<std::mutex> lock(m_mtx);
+  m_cv.wait_for(lock, timeout, [this, pages] {return m_committed_count >= pages || m_wakeup;});
+  m_wakeup = false;
+  return m_committed_count;
+}
+
+//_______________________________________________________________________________________________________
+void log_arena::wakeup() {
+  {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_wakeup = true;
+  }
+  m_cv.notify_one();
+}
+
+//_______________________________________________________________________________________________________
+size_t log_arena::getCommitted() {
+  std::lock_guard<std::mutex> lock(m_mtx);
+  return m_committed_count;
+}
+
+//_______________________________________________________________________________________________________
+size_t log_arena::getBytes() {
+  std::lock_guard<std::mutex> lock(m_mtx);
+  return m_bytes;
+}
+
+//_______________________________________________________________________________________________________
+unsigned long log_arena::getExhausted() {
+  std::lock_guard<std::mutex> lock(m_mtx);
+  return m_exhausted;
+}
@@ -0,0 +1,285 @@
+/*
+* Lossless codec for the pages of the sample log
+* the six channels of a sample sit side by side in one SSE register, so the deltas, the zig-zag
+* folding and the minimum and maximum of a frame take a few instructions per sample for all
+* channels at once; only the bit-packing itself goes lane by lane
+*
+*/
+
+#include <string.h>
+
+#include "./log_codec.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define LANES LOG_CODEC_LANES
+#define FRAME LOG_CODEC_FRAME
+
+
+//_______________________________________________________________________________________________________
+static inline void put16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t) (v & 0xFF);
+  p[1] = (uint8_t) (v >> 8);
+}
+
+//_______________________________________________________________________________________________________
+static inline uint16_t get16(const uint8_t* p) {
+  return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+//_______________________________________________________________________________________________________
+// bits needed for [v]
+static inline int width(uint16_t v) {
+  int w = 0;
+  while (w < 16 && (v >> w) != 0)
+    ++w;
+  return w;
+}
+
+//_______________________________________________________________________________________________________
+static inline uint16_t zigzag(int16_t d) {
+  return (uint16_t) (((uint16_t) d << 1) ^ (uint16_t) (d >> 15));
+}
+
+//_______________________________________________________________________________________________________
+static inline int16_t unzigzag(uint16_t z) {
+  return (int16_t) ((z >> 1) ^ (uint16_t) -(int) (z & 1));
+}
+
+#ifdef __SSE2__
+//_______________________________________________________________________________________________________
+// the six values of a sample in lanes 0 to 5, the idle lanes zero
+static inline __m128i loadSample(const int16_t* s) {
+  int32_t g;
+  memcpy(&g, s + 4, sizeof(g));
+  return _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*) s), _mm_cvtsi32_si128(g));
+}
+
+//_______________________________________________________________________________________________________
+static inline void storeSample(int16_t* s, __m128i v) {
+  _mm_storel_epi64((__m128i*) s, v);
+  int32_t g = _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+  memcpy(s + 4, &g, sizeof(g));
+}
+#endif
+
+
+//_______________________________________________________________________________________________________
+log_codec::log_codec() {
+  memset(m_frame, 0, sizeof(m_frame));
+}
+
+//_______________________________________________________________________________________________________
+size_t log_codec::encode(const int16_t* raw, size_t n, uint8_t* out) {
+#ifdef __SSE2__
+  if (n == 0)
+    return 0;
+  uint8_t* p = out;
+  for (int c = 0; c < 6; ++c, p += 2)
+    put16(p, (uint16_t) raw[c]);
+
+  // unsigned minimum and maximum by the signed instructions on values offset by 0x8000
+  const __m128i bias = _mm_set1_epi16((short) 0x8000);
+  __m128i prev = loadSample(raw);
+  uint16_t lo[LANES], hi[LANES];
+  for (size_t f = 0; f < n; f += FRAME) {
+    const size_t m = n - f < FRAME ? n - f : FRAME;
+    __m128i vlo = _mm_set1_epi16(0x7FFF), vhi = _mm_set1_epi16((short) 0x8000);
+    for (size_t i = 0; i < m; ++i) {
+      __m128i x = loadSample(raw + 6 * (f + i));
+      __m128i d = _mm_sub_epi16(x, prev);
+      __m128i z = _mm_xor_si128(_mm_slli_epi16(d, 1), _mm_srai_epi16(d, 15));
+      prev = x;
+      _mm_storeu_si128((__m128i*) &m_frame[LANES * i], z);
+      z = _mm_xor_si128(z, bias);
+      vlo = _mm_min_epi16(vlo, z);
+      vhi = _mm_max_epi16(vhi, z);
+    }
+    vlo = _mm_xor_si128(vlo, bias);
+    vhi = _mm_xor_si128(vhi, bias);
+    for (size_t i = 0; i < m; ++i) {
+      __m128i z = _mm_loadu_si128((const __m128i*) &m_frame[LANES * i]);
+      _mm_storeu_si128((__m128i*) &m_frame[LANES * i], _mm_sub_epi16(z, vlo));
+    }
+    _mm_storeu_si128((__m128i*) lo, vlo);
+    _mm_storeu_si128((__m128i*) hi, _mm_sub_epi16(vhi, vlo));
+
+    for (int c = 0; c < 6; ++c) {
+      const int w = width(hi[c]);
+      *p++ = (uint8_t) w;
+      put16(p, lo[c]);
+      p = packLane(m_frame, m, c, w, p + 2);
+    }
+  }
+  return p - out;
+#else
+  return encodeScalar(raw, n, out);
+#endif
+}
+
+//_______________________________________________________________________________________________________
+size_t log_codec::encodeScalar(const int16_t* raw, size_t n, uint8_t* out) {
+  if (n == 0)
+    return 0;
+  uint8_t* p = out;
+  int16_t prev[6];
+  for (int c = 0; c < 6; ++c, p += 2) {
+    prev[c] = raw[c];
+    put16(p, (uint16_t) raw[c]);
+  }
+
+  for (size_t f = 0; f < n; f += FRAME) {
+    const size_t m = n - f < FRAME ? n - f : FRAME;
+    uint16_t lo[6], hi[6];
+    for (int c = 0; c < 6; ++c) {
+      lo[c] = 0xFFFF;
+      hi[c] = 0;
+    }
+    for (size_t i = 0; i < m; ++i) {
+      const int16_t* s = raw + 6 * (f + i);
+      for (int c = 0; c < 6; ++c) {
+        uint16_t z = zigzag((int16_t) (uint16_t) (s[c] - prev[c]));
+        prev[c] = s[c];
+        m_frame[LANES * i + c] = z;
+        lo[c] = z < lo[c] ? z : lo[c];
+        hi[c] = z > hi[c] ? z : hi[c];
+      }
+    }
+
+    for (int c = 0; c < 6; ++c) {
+      for (size_t i = 0; i < m; ++i)
+        m_frame[LANES * i + c] -= lo[c];
+      const int w = width((uint16_t) (hi[c] - lo[c]));
+      *p++ = (uint8_t) w;
+      put16(p, lo[c]);
+      p = packLane(m_frame, m, c, w, p + 2);
+    }
+  }
+  return p - out;
+}
+
+//_______________________________________________________________________________________________________
+size_t log_codec::decode(const uint8_t* in, size_t size, size_t n, int16_t* raw) {
+#ifdef __SSE2__
+  if (n == 0 || size < LOG_SAMPLE_SIZE)
+    return 0;
+  const uint8_t* p = in;
+  const uint8_t* end = in + size;
+  int16_t first[LANES] = {0};
+  for (int c = 0; c < 6; ++c, p += 2)
+    first[c] = (int16_t) get16(p);
+
+  const __m128i one = _mm_set1_epi16(1);
+  __m128i prev = _mm_loadu_si128((const __m128i*) first);
+  uint16_t lo[LANES] = {0};
+  for (size_t f = 0; f < n; f += FRAME) {
+    const size_t m = n - f < FRAME ? n - f : FRAME;
+    for (int c = 0; c < 6; ++c) {
+      if (end - p < 3 || *p > 16)
+        return 0;
+      const int w = *p;
+      lo[c] = get16(p + 1);
+      p = unpackLane(p + 3, end, m, c, w, m_frame);
+      if (p == NULL)
+        return 0;
+    }
+
+    // the idle lanes add zero and stay zero
+    const __m128i vlo = _mm_loadu_si128((const __m128i*) lo);
+    for (size_t i = 0; i < m; ++i) {
+      __m128i z = _mm_add_epi16(_mm_loadu_si128((const __m128i*) &m_frame[LANES * i]), vlo);
+      __m128i d = _mm_xor_si128(_mm_srli_epi16(z, 1), _mm_sub_epi16(_mm_setzero_si128(), _mm_and_si128(z, one)));
+      prev = _mm_add_epi16(prev, d);
+      storeSample(raw + 6 * (f + i), prev);
+    }
+  }
+  return p - in;
+#else
+  return decodeScalar(in, size, n, raw);
+#endif
+}
+
+//_______________________________________________________________________________________________________
+size_t log_codec::decodeScalar(const uint8_t* in, size_t size, size_t n, int16_t* raw) {
+  if (n == 0 || size < LOG_SAMPLE_SIZE)
+    return 0;
+  const uint8_t* p = in;
+  const uint8_t* end = in + size;
+  int16_t prev[6];
+  for (int c = 0; c < 6; ++c, p += 2)
+    prev[c] = (int16_t) get16(p);
+
+  uint16_t lo[6];
+  for (size_t f = 0; f < n; f += FRAME) {
+    const size_t m = n - f < FRAME ? n - f : FRAME;
+    for (int c = 0; c < 6; ++c) {
+      if (end - p < 3 || *p > 16)
+        return 0;
+      const int w = *p;
+      lo[c] = get16(p + 1);
+      p = unpackLane(p + 3, end, m, c, w, m_frame);
+      if (p == NULL)
+        return 0;
+    }
+
+    for (size_t i = 0; i < m; ++i) {
+      int16_t* s = raw + 6 * (f + i);
+      for (int c = 0; c < 6; ++c) {
+        prev[c] = (int16_t) (uint16_t) (prev[c] + unzigzag((uint16_t) (m_frame[LANES * i + c] + lo[c])));
+        s[c] = prev[c];
+      }
+    }
+  }
+  return p - in;
+}
+
+//_______________________________________________________________________________________________________
+uint8_t* log_codec::packLane(const uint16_t* frame, size_t m, int c, int width, uint8_t* out) {
+  if (width == 0)
+    return out;
+  uint64_t acc = 0;
+  int bits = 0;
+  for (size_t i = 0; i < m; ++i) {
+    acc |= (uint64_t) frame[LANES * i + c] << bits;
+    bits += width;
+    while (bits >= 8) {
+      *out++ = (uint8_t) (acc & 0xFF);
+      acc >>= 8;
+      bits -= 8;
+    }
+  }
+  if (bits > 0)
+    *out++ = (uint8_t) (acc & 0xFF);
+  return out;
+}
+
+//_______________________________________________________________________________________________________
+const uint8_t* log_codec::unpackLane(const uint8_t* in, const uint8_t* end, size_t m, int c, int width,
+    uint16_t* frame) {
+  if ((size_t) (end - in) < (m * width + 7) / 8)
+    return NULL;
+  const uint32_t mask = (1u << width) - 1;
+  uint64_t acc = 0;
+  int bits = 0;
+  for (size_t i = 0; i < m; ++i) {
+    while (bits < width) {
+      acc |= (uint64_t) *in++ << bits;
+      bits += 8;
+    }
+    frame[LANES * i + c] = (uint16_t) (acc & mask);
+    acc >>= width;
+    bits -= width;
+  }
+  return in;
+}
+
+//_______________________________________________________________________________________________________
+const char* log_codec::name(Codec codec) {
+  switch (codec) {
+    case Codec::RAW: return "raw";
+    case Codec::DELTA: return "delta";
+  }
+  return "unknown";
+}
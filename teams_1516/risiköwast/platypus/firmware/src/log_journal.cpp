@@ -0,0 +1,217 @@
+/*
+* Write-ahead journal of the sample log
+* the journal only ever holds the pages since the last sync of the current segment, so recovery
+* keeps what the segment has intact and appends the pages of the journal that come after it
+*
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <vector>
+
+#include "./log_journal.h"
+
+
+//_______________________________________________________________________________________________________
+static inline void put32(uint8_t* p, uint32_t v) {
+  for (int i = 0; i < 4; ++i)
+    p[i] = (uint8_t) (v >> (8 * i));
+}
+
+//_______________________________________________________________________________________________________
+static inline uint32_t get32(const uint8_t* p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+//_______________________________________________________________________________________________________
+// the whole file [path] to [buf], false if it cannot be read
+static bool readFile(const std::string &path, std::vector<uint8_t> &buf) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (f == NULL)
+    return false;
+  uint8_t chunk[16384];
+  size_t len;
+  while ((len = fread(chunk, 1, sizeof(chunk), f)) > 0)
+    buf.insert(buf.end(), chunk, chunk + len);
+  fclose(f);
+  return true;
+}
+
+
+//_______________________________________________________________________________________________________
+log_journal::log_journal() : m_fd(-1) {
+}
+
+//_______________________________________________________________________________________________________
+log_journal::~log_journal() {
+  close();
+}
+
+//_______________________________________________________________________________________________________
+bool log_journal::open(const std::string &path, int segment, const log_file_header &header) {
+  close();
+  m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (m_fd < 0) {
+    printf("[LOG] Cannot open the journal %s: %s\n", path.c_str(), strerror(errno));
+    fflush(stdout);
+    return false;
+  }
+  m_header = header;
+  return reset(segment, 0, NULL, 0);
+}
+
+//_______________________________________________________________________________________________________
+void log_journal::close() {
+  if (m_fd >= 0)
+    ::close(m_fd);
+  m_fd = -1;
+}
+
+//_______________________________________________________________________________________________________
+bool log_journal::append(const struct iovec* iov, int count) {
+  if (m_fd < 0)
+    return false;
+  std::vector<struct iovec> left(iov, iov + count);
+  return writeAll(m_fd, left.data(), count);
+}
+
+//_______________________________________________________________________________________________________
+bool log_journal::sync() {
+  return m_fd >= 0 && fdatasync(m_fd) == 0;
+}
+
+//_______________________________________________________________________________________________________
+bool log_journal::reset(int segment, size_t size, const struct iovec* iov, int count) {
+  if (m_fd < 0)
+    return false;
+
+  uint8_t header[LOG_JOURNAL_HEADER_SIZE];
+  memcpy(header, LOG_JOURNAL_MAGIC, 4);
+  put32(header + 4, (uint32_t) segment);
+  put32(header + 8, (uint32_t) size);
+  log_format::writeHeader(m_header, header + 16);
+  uint32_t crc = log_format::crc32c(header, 12);
+  put32(header + 12, log_format::crc32c(header + 16, LOG_FILE_HEADER_SIZE, crc));
+
+  std::vector<struct iovec> all(count + 1);
+  all[0].iov_base = header;
+  all[0].iov_len = sizeof(header);
+  for (int i = 0; i < count; ++i)
+    all[i + 1] = iov[i];
+  return ftruncate(m_fd, 0) == 0 && writeAll(m_fd, all.data(), count + 1) && fdatasync(m_fd) == 0;
+}
+
+//_______________________________________________________________________________________________________
+size_t log_journal::recover(const std::string &path, const std::string &dir, const std::string &prefix) {
+  std::vector<uint8_t> buf;
+  if (!readFile(path, buf) || buf.empty())
+    return 0;
+
+  // the header and the pages intact from the start
+  log_file_header header;
+  uint32_t crc = log_format::crc32c(buf.data(), 12);
+  if (buf.size() < LOG_JOURNAL_HEADER_SIZE || memcmp(buf.data(), LOG_JOURNAL_MAGIC, 4) != 0 ||
+      get32(&buf[12]) != log_format::crc32c(&buf[16], LOG_FILE_HEADER_SIZE, crc) ||
+      !log_format::readHeader(&buf[16], LOG_FILE_HEADER_SIZE, header)) {
+    printf("[LOG] Journal %s is broken, ignored.\n", path.c_str());
+    fflush(stdout);
+    truncate(path.c_str(), 0);
+    return 0;
+  }
+  const int segment = (int) get32(&buf[4]);
+  const size_t size = get32(&buf[8]);
+  std::vector<log_page_info> pages;
+  std::vector<size_t> offsets;
+  log_page_info info;
+  for (size_t pos = LOG_JOURNAL_HEADER_SIZE; log_format::check(buf.data() + pos, buf.size() - pos, info); pos += info.size) {
+    pages.push_back(info);
+    offsets.push_back(pos);
+  }
+  if (pages.empty()) {
+    truncate(path.c_str(), 0);
+    return 0;
+  }
+
+  char name[16];
+  snprintf(name, sizeof(name), "%04d.bin", segment);
+  std::string filename = dir + prefix + name;
+  std::vector<uint8_t> seg;
+  readFile(filename, seg);
+  int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (fd < 0) {
+    printf("[LOG] Cannot recover the journal into %s: %s\n", filename.c_str(), strerror(errno));
+    fflush(stdout);
+    return 0;
+  }
+
+  // the segment keeps what was on the flash and the intact pages behind it, a torn write goes
+  std::vector<struct iovec> iov;
+  uint8_t file_header[LOG_FILE_HEADER_SIZE];
+  size_t end = 0;
+  bool tail = false;
+  uint32_t last = 0;
+  if (seg.size() < LOG_FILE_HEADER_SIZE) {
+    log_format::writeHeader(header, file_header);
+    iov.push_back({file_header, sizeof(file_header)});
+  } else {
+    end = size > LOG_FILE_HEADER_SIZE ? size : LOG_FILE_HEADER_SIZE;
+    end = end < seg.size() ? end : seg.size();
+    while (end < seg.size() && log_format::check(seg.data() + end, seg.size() - end, info)) {
+      end += info.size;
+      last = info.sequence;
+      tail = true;
+    }
+  }
+
+  size_t recovered = 0;
+  for (size_t i = 0; i < pages.size(); ++i) {
+    if (tail && pages[i].sequence <= last)
+      continue;
+    iov.push_back({&buf[offsets[i]], pages[i].size});
+    ++recovered;
+  }
+
+  bool ok = ftruncate(fd, end) == 0 && lseek(fd, end, SEEK_SET) == (off_t) end &&
+    writeAll(fd, iov.data(), (int) iov.size()) && fdatasync(fd) == 0;
+  ::close(fd);
+  if (!ok) {
+    printf("[LOG] Recovering the journal into %s failed: %s\n", filename.c_str(), strerror(errno));
+    fflush(stdout);
+    return 0;
+  }
+  truncate(path.c_str(), 0);
+  printf("[LOG] Recovered %zu pages from the journal into %s.\n", recovered, filename.c_str());
+  fflush(stdout);
+  return recovered;
+}
+
+//_______________________________________________________________________________________________________
+bool log_journal::writeAll(int fd, struct iovec* iov, int count) {
+  size_t left = 0;
+  for (int i = 0; i < count; ++i)
+    left += iov[i].iov_len;
+
+  // writev() may stop short, the rest follows
+  while (left > 0) {
+    ssize_t w = writev(fd, iov, count);
+    if (w < 0 && errno == EINTR)
+      continue;
+    if (w <= 0)
+      return false;
+    left -= w;
+    while (count > 0 && (size_t) w >= iov->iov_len) {
+      w -= iov->iov_len;
+      ++iov;
+      --count;
+    }
+    if (count > 0) {
+      iov->iov_base = (uint8_t*) iov->iov_base + w;
+      iov->iov_len -= w;
+    }
+  }
+  return true;
+}
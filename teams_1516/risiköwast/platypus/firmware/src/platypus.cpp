@@ -11,7 +11,6 @@
 #include <unistd.h>  // Sleep
 
 int faceDown = 0;
-int triggeredHideandSeek = 0;
 int initDisplay = 0;
 int initStickman = 0;
 int drawStickman = 0;
@@ -389,29 +388,27 @@ void platypus::pollIMU() {
 
   printf("[P] Starting poll\n");
 
-  while (true && m_active) {
-    std::vector<float> data = m_imu->toReadable(m_imu->readRawIMU());
+  unsigned long seq = 0;
 
-    if (gameStarted == 0) {
-      if (data[2] < -5 && faceDown == 0) {
-        if(triggeredHideandSeek < 3)
-          triggeredHideandSeek++;
+  while (true && m_active) {
+    // take the gestures the IMU thread found in the FIFO data instead of reading the bus again
+    std::vector<imu_gesture_event> gestures;
+    {
+      std::lock_guard<std::mutex> lock(m_mtx_imu);
+      gestures.swap(m_gesture_events);
+      seq = m_imu_seq;
+    }
 
-        if (triggeredHideandSeek == 3) {
-          printf("\nICH LIEGE AUF MEINEM GESICHT!!!!\n");
-          ani->draw_empty();
-          faceDown = 1;
-        }
-      } else if (data[2] > -5 && faceDown == 1) {
-        if(triggeredHideandSeek > 0)
-          triggeredHideandSeek--;
-
-        if (triggeredHideandSeek == 0) {
-          printf("\nICH LIEGE RICHTIG HERUM\n");
-          sendThis("br:4,hideandseek");
-          //          sendThis("br:0,clearScreen");
-          faceDown = 0;
-        }
+    for (size_t i = 0; i < gestures.size() && gameStarted == 0; ++i) {
+      if (gestures[i].type == Gesture::FACE_DOWN && faceDown == 0) {
+        printf("\nICH LIEGE AUF MEINEM GESICHT!!!!\n");
+        ani->draw_empty();
+        faceDown = 1;
+      } else if (gestures[i].type == Gesture::FACE_UP && faceDown == 1) {
+        printf("\nICH LIEGE RICHTIG HERUM\n");
+        sendThis("br:4,hideandseek");
+        //          sendThis("br:0,clearScreen");
+        faceDown = 0;
       }
     }
 
@@ -441,7 +438,10 @@ void platypus::pollIMU() {
       }
       revealYourself = 0;
     }
-    usleep(800000);
+
+    // sleep until the IMU thread has new data or an interrupt was handled
+    std::unique_lock<std::mutex> lock(m_mtx_imu);
+    m_cv_imu.wait_for(lock, std::chrono::milliseconds(800), [this, seq] {return m_imu_seq != seq || !m_active;});
   }
   
 }
@@ -452,18 +452,24 @@ void platypus::pollIMU() {
 
 //_______________________________________________________________________________________________________
 platypus::platypus(int debug)
- :  m_dsp(NULL), m_imu(NULL),
+ :  m_dsp(NULL), m_imu(NULL), m_irq(NULL),
     m_dsp_init(false), m_imu_init(false), m_env_init(false), m_mcu_init(false), m_ldc_init(false), m_bat_init(false), m_active(false),
-    m_force_save(false), m_saving(false), m_data_idx(0), m_debug(debug), m_dsp_state(DisplayStates::IDLE),
+    m_force_save(false), m_imu_seq(0), m_imu_still(IMU_WATERMARK), m_imu_idle(0), m_blackbox(NULL), m_log_div(1), m_log_phase(0),
+    m_imu_woken(false), m_log_arena(LOG_PAGES), m_log_page(NULL),
+    m_log_dropped(0), m_log_writer(&m_log_arena, LOG_DIR), m_debug(debug), m_dsp_state(DisplayStates::IDLE),
     m_wifi_enabled(true), m_bt_enabled(false)
 {
   m_imu_data = std::vector<int16_t>(7, 0);
+  m_imu_time = imu_block_time();
 }
 
 
 //_______________________________________________________________________________________________________
 platypus::~platypus() {
-/*  writeDataToFlashIDX(m_data_idx); */
+  if (m_irq != NULL)
+    delete m_irq;
+  if (m_blackbox != NULL)
+    delete m_blackbox;
   if (m_imu_init)
     delete m_imu;
   if (m_dsp_init)
@@ -487,11 +493,15 @@ void platypus::display_init(uint8_t res, uint8_t clk_hands) {
 }
 
 //_______________________________________________________________________________________________________
-imu_edison* platypus::imu_init(int i2c_bus, uint8_t i2c_addr, bool env_init) {
+imu_edison* platypus::imu_init(int i2c_bus, uint8_t i2c_addr, bool env_init, irq_source* irq_src) {
   m_imu = new imu_edison(i2c_bus, i2c_addr, env_init);
 
   //m_imu->sleep(false);
   m_imu->setupIMU();
+  m_imu->setBandwidth(m_imu->getSampleRate() / 2);
+
+  if (irq_src != NULL)
+    m_irq = new imu_irq(m_imu, irq_src, IMU_WATERMARK);
 
   m_imu_init = true;
   m_env_init = env_init;
@@ -499,6 +509,34 @@ imu_edison* platypus::imu_init(int i2c_bus, uint8_t i2c_addr, bool env_init) {
   return m_imu;
 }
 
+//_______________________________________________________________________________________________________
+void platypus::blackbox_init(float rate) {
+  if (!m_imu_init)
+    return;
+
+  const imu_aux_plan &plan = m_imu->setSampleRates(rate);
+  m_imu->setBandwidth(plan.sample_rate / 2);
+  m_log_div = (size_t) lround(plan.sample_rate / IMU_LOG_RATE);
+  m_log_div = m_log_div > 0 ? m_log_div : 1;
+  m_log_phase = 0;
+
+  m_blackbox = new imu_blackbox(plan.sample_rate, IMU_CAPTURE_PRE, IMU_CAPTURE_POST);
+  m_blackbox->setThreshold(IMU_CAPTURE_G);
+
+  // the windows at rest stay as long as before, the watermark leaves room in the FIFO
+  m_imu_still = imu_bias(IMU_WATERMARK * m_log_div);
+  if (m_irq != NULL) {
+    size_t watermark = IMU_WATERMARK * m_log_div;
+    size_t max = MPU_FIFO_SIZE / MPU_FIFO_SAMPLE_SIZE * 3 / 4;
+    m_irq->setWatermark(watermark < max ? watermark : max);
+  }
+
+  printf("[PLATYPUS] Black box at %.1fHz, %.1fs before and %.1fs after a trigger (%zu kB), data log at %.1fHz.\n",
+    plan.sample_rate, IMU_CAPTURE_PRE, IMU_CAPTURE_POST,
+    m_blackbox->getCapacity() * IMU_BLACKBOX_VALUES * sizeof(int16_t) / 1024, plan.sample_rate / m_log_div);
+  fflush(stdout);
+}
+
 //_______________________________________________________________________________________________________
 void platypus::mcu_init() {
   m_mcu = new mcu_edison;
@@ -528,6 +566,10 @@ void platypus::spawn_threads() {
   printf("[PLATYPUS] Spawning threads.\n");
   fflush(stdout);
   m_active = true;
+  m_log_writer.setCodec(LOG_CODEC);
+  m_log_writer.setHeader(logHeader());
+  m_log_writer.setJournal(LOG_JOURNAL);
+  m_log_writer.start();
   m_threads.push_back(std::thread(&platypus::t_display, this));
   m_threads.push_back(std::thread(&platypus::t_imu, this));
   m_threads.push_back(std::thread(&platypus::t_mcu, this));
@@ -552,8 +594,17 @@ void platypus::join_threads() {
   fflush(stdout);
   m_active = false;
   close_socket();
+  if (m_irq != NULL)
+    m_irq->wakeup();
+  m_cv_imu.notify_all();
   for (auto& th : m_threads) th.join();
   m_threads.clear();
+  // the page being filled goes out as well, nothing is left for the journal
+  if (m_log_page != NULL) {
+    m_log_arena.commit(m_log_page);
+    m_log_page = NULL;
+  }
+  m_log_writer.stop();
 }
 
 /*
@@ -781,7 +832,7 @@ void platypus::t_display() {
           m_dsp->print("IP:", 5, 5);
           m_dsp->print(IPs["wlan0"], 15, 15);
           m_dsp->print("RAM [Bytes]:", 5, 25);
-          m_dsp->print((int)m_data_memory[m_data_idx].size(), 15, 35);
+          m_dsp->print((int)m_log_arena.getBytes(), 15, 35);
           m_dsp->flush();
           break;
         }
@@ -804,20 +855,48 @@ void platypus::t_imu() {
   std::vector<std::future<void>> handles; // collect all handles for async calls
 
   m_imu->FIFOrst();
+  m_imu_clock.resync(m_imu->getSampleRate());
+  m_gestures = imu_gesture(m_imu->getSampleRate());
+  m_activity = imu_activity(m_imu->getSampleRate());
+  m_log_filter = imu_filter(m_imu->getSampleRate());
+  m_log_filter.design(Filter::LOWPASS, IMU_LOG_BANDWIDTH, 0.0, 4);
+  m_activity_filter = imu_filter(m_imu->getSampleRate());
+  m_activity_filter.design(Filter::LOWPASS, IMU_ACTIVITY_BANDWIDTH);
 
   while (m_active) {
     if (!m_imu_init)
       break;
 
+    // nothing moved for a while, only a WoM interrupt can bring us back
+    if (m_irq != NULL && m_imu_idle >= IMU_IDLE_WINDOWS)
+      imu_low_power();
+
+    // sleep until the FIFO reached the watermark or the IMU issued an interrupt
+    uint8_t int_status = 0;
+    if (m_irq != NULL)
+      int_status = m_irq->wait();
+    else
+      std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+
+    // data in an overflown FIFO is out of alignment, start over
+    if (m_imu->hasFIFOInt(int_status)) {
+      m_imu->FIFOrst();
+      m_imu_clock.resync();
+      m_gestures.reset();
+      m_log_filter.reset();
+      m_activity_filter.reset();
+    }
+
     //m_imu_data = m_imu->readRawIMU();
 
-    // write data to flash after 1024*1024*128 = 134217728 B = 128 MiB
-    if (!m_saving && (m_force_save || m_data_memory[m_data_idx].size() >= 134217728)) {
-      // async call write function so data collection can continue while writing to flash
-      // TODO: get this to work with overloaded function writeDataToFlash(uint8_t)
-      handles.push_back(std::async(std::launch::async, &platypus::writeDataToFlashIDX, this, m_data_idx));
-      // switch to other data collection vector
-      m_data_idx = !m_data_idx;
+    // full pages go to the writer thread as they are completed, a save on request takes the page
+    // being filled along and ends the current file with it
+    if (m_force_save) {
+      if (m_log_page != NULL) {
+        m_log_arena.commit(m_log_page);
+        m_log_page = NULL;
+      }
+      m_log_writer.flush();
       m_force_save = false;
     }
 
@@ -827,22 +906,140 @@ void platypus::t_imu() {
     //writeData(std::vector<int16_t>(first, last));
 
     // read values from FIFO and save them
-    std::vector<int16_t> fifo_data = m_imu->readFIFO();
-    writeData(fifo_data);
-    if (fifo_data.size() >= 6) {
-      for (size_t i = 0; i < 6; ++i)
-        m_imu_data[i] = fifo_data[fifo_data.size() - 6 + i];
+    size_t fifo_len = m_imu->readFIFO(m_fifo_data, sizeof(m_fifo_data) / sizeof(int16_t));
+    size_t fifo_n = fifo_len / 6;
+    imu_block_time block;
+    m_imu_clock.stamp(m_imu->getFIFOCount(), fifo_n, m_imu->getFIFOTime(), block);
+
+    // the black box keeps the full rate and bandwidth, the data log every m_log_div-th sample
+    // of the low-passed data, which also keeps the decimation free of aliases
+    if (m_blackbox != NULL && m_blackbox->push(m_fifo_data, fifo_n, &block))
+      handles.push_back(std::async(std::launch::async, &platypus::writeEvent, this));
+    // finished event writes are dropped, only the running ones are joined at the end
+    for (size_t i = 0; i < handles.size();) {
+      if (handles[i].wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+        handles.erase(handles.begin() + i);
+      else
+        ++i;
+    }
+    m_log_data.resize(fifo_len);
+    m_log_filter.filter(m_fifo_data, fifo_n, m_log_data.data());
+    if (m_log_div > 1) {
+      size_t i = m_log_phase;
+      for (; i < m_log_data.size() / 6; i += m_log_div)
+        writeData(&m_log_data[6 * i], 1, block, i);
+      m_log_phase = i - m_log_data.size() / 6;
+    } else {
+      writeData(m_log_data.data(), m_log_data.size() / 6, block, 0);
+    }
+
+    // count consecutive windows at rest
+    size_t windows = m_imu_still.getWindowCount();
+    m_imu_still.update(m_log_data.data(), m_log_data.size() / 6);
+    if (m_imu_still.getWindowCount() != windows)
+      m_imu_idle = m_imu_still.isStill() ? m_imu_idle + 1 : 0;
+    int16_t temp = m_imu->readRawTemp();
+    {
+      std::lock_guard<std::mutex> lock(m_mtx_imu);
+      if (m_log_data.size() >= 6) {
+        for (size_t i = 0; i < 6; ++i)
+          m_imu_data[i] = m_log_data[m_log_data.size() - 6 + i];
+      }
+      m_imu_data[6] = temp;
+      m_imu_time = block;
     }
 
-    m_imu_data[6] = m_imu->readRawTemp();
+    std::vector<imu_gesture_event> gestures;
+    m_gestures.update(m_fifo_data, fifo_n, gestures);
+    imu_event(int_status, gestures);
+    if (m_blackbox != NULL)
+      imu_capture(int_status, fifo_n, gestures);
 
-    //usleep(100000);
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    // in place, the gestures are done with the FIFO data
+    imu_activity_summary summary;
+    m_activity_filter.filter(m_fifo_data, fifo_n, m_fifo_data);
+    m_activity.update(m_fifo_data, fifo_n);
+    if (m_activity.getSummary(summary))
+      writeActivity(summary);
+
+    // let pollIMU() look at the new data
+    {
+      std::lock_guard<std::mutex> lock(m_mtx_imu);
+      ++m_imu_seq;
+    }
+    m_cv_imu.notify_all();
   }
 
   for (auto& h : handles) h.get(); // make sure all async calls return
 }
 
+//_______________________________________________________________________________________________________
+void platypus::imu_event(uint8_t int_status, const std::vector<imu_gesture_event> &gestures) {
+  if (m_imu->hasFIFOInt(int_status))
+    printf("[PLATYPUS] FIFO interrupt\n");
+
+  // a WoM interrupt only wakes the IMU thread, the gestures come from the FIFO data
+  for (size_t i = 0; i < gestures.size(); ++i) {
+    if (m_debug > 1)
+      printf("[PLATYPUS] gesture: %s\n", imu_gesture::name(gestures[i].type));
+
+    if (gestures[i].type == Gesture::TAP) {
+      interrupt();
+      DisplayStates tap = tap_event();
+      if (tap != DisplayStates::NOCHANGE)
+        printf("[PLATYPUS] tap, new display state: %d\n", (int) tap);
+    } else if (gestures[i].type == Gesture::FACE_DOWN || gestures[i].type == Gesture::FACE_UP) {
+      std::lock_guard<std::mutex> lock(m_mtx_imu);
+      m_gesture_events.push_back(gestures[i]);
+    }
+  }
+  fflush(stdout);
+}
+
+//_______________________________________________________________________________________________________
+void platypus::imu_capture(uint8_t int_status, size_t n, const std::vector<imu_gesture_event> &gestures) {
+  if (n == 0)
+    return;
+
+  // a WoM interrupt at full rate or the wake up from low-power mode, at the first sample of the block
+  // (after low-power mode the window before it holds the samples from before)
+  if (m_imu->hasWOMInt(int_status) || m_imu_woken)
+    m_blackbox->trigger(Trigger::WOM, 0, n - 1);
+  m_imu_woken = false;
+
+  // impacts trigger in push(), taps and shakes here; turning the board over is too slow to capture
+  for (size_t i = 0; i < gestures.size(); ++i) {
+    if (gestures[i].type == Gesture::TAP || gestures[i].type == Gesture::DOUBLE_TAP || gestures[i].type == Gesture::SHAKE)
+      m_blackbox->trigger(Trigger::GESTURE, (uint8_t) gestures[i].type, n - 1 - gestures[i].sample);
+  }
+}
+
+//_______________________________________________________________________________________________________
+void platypus::imu_low_power() {
+  printf("[PLATYPUS] IMU at rest, low power mode.\n");
+  fflush(stdout);
+  m_imu->lowPower(true);
+
+  // the watermark does not apply, no FIFO data until the IMU sees motion
+  while (m_active) {
+    uint8_t int_status = m_irq->waitInterrupt();
+    if (m_imu->hasWOMInt(int_status))
+      break;
+  }
+
+  m_imu->lowPower(false);
+  m_imu_clock.resync(); // the FIFO starts over
+  m_gestures.reset();
+  m_imu_still.reset();
+  m_log_filter.reset();
+  m_activity_filter.reset();
+  m_imu_idle = 0;
+  m_imu_woken = true;
+
+  printf("[PLATYPUS] IMU motion, full rate (%lu low power phases).\n", m_imu->getLowPowerEntries());
+  fflush(stdout);
+}
+
 //_______________________________________________________________________________________________________
 void platypus::t_mcu() {
   while (m_active) {
@@ -950,10 +1147,7 @@ std::map<std::string, std::string> platypus::getIPs() {
  */
 
 //_______________________________________________________________________________________________________
-void platypus::writeHeader() {
-  if (!m_imu_init && !m_ldc_init && !m_env_init)
-    return;
-
+void platypus::writeHeader(uint8_t* header) {
   uint32_t header_time = get4ByteTimeAndDate();
   std::vector<uint16_t> LDC(2, 0);
   int32_t temp = 0;
@@ -966,148 +1160,147 @@ void platypus::writeHeader() {
   if (m_imu_init && m_env_init)
     m_imu->getEnvData(temp, press, hum);
 
-  std::vector<uint8_t> header;
-
   // header consists of:
   // 4 Byte date and time
-  header.push_back((header_time & 0xFF000000) >> 24);
-  header.push_back((header_time & 0xFF0000) >> 16);
-  header.push_back((header_time & 0xFF00) >> 8);
-  header.push_back(header_time & 0xFF);
+  header[0] = (header_time & 0xFF000000) >> 24;
+  header[1] = (header_time & 0xFF0000) >> 16;
+  header[2] = (header_time & 0xFF00) >> 8;
+  header[3] = header_time & 0xFF;
   // 2 Byte current visible/IR light value
-  header.push_back((LDC[0] & 0xFF00) >> 8);
-  header.push_back(LDC[0] & 0xFF);
+  header[4] = (LDC[0] & 0xFF00) >> 8;
+  header[5] = LDC[0] & 0xFF;
   // 2 Byte current IR light value
-  header.push_back((LDC[1] & 0xFF00) >> 8);
-  header.push_back(LDC[1] & 0xFF);
+  header[6] = (LDC[1] & 0xFF00) >> 8;
+  header[7] = LDC[1] & 0xFF;
   // 4 Byte current temperature value
-  header.push_back((temp & 0xFF000000) >> 24);
-  header.push_back((temp & 0xFF0000) >> 16);
-  header.push_back((temp & 0xFF00) >> 8);
-  header.push_back(temp & 0xFF);
+  header[8] = (temp & 0xFF000000) >> 24;
+  header[9] = (temp & 0xFF0000) >> 16;
+  header[10] = (temp & 0xFF00) >> 8;
+  header[11] = temp & 0xFF;
   // 4 Byte current pressure value
-  header.push_back((press & 0xFF000000) >> 24);
-  header.push_back((press & 0xFF0000) >> 16);
-  header.push_back((press & 0xFF00) >> 8);
-  header.push_back(press & 0xFF);
+  header[12] = (press & 0xFF000000) >> 24;
+  header[13] = (press & 0xFF0000) >> 16;
+  header[14] = (press & 0xFF00) >> 8;
+  header[15] = press & 0xFF;
   // 4 Byte current humidity value
-  header.push_back((hum & 0xFF000000) >> 24);
-  header.push_back((hum & 0xFF0000) >> 16);
-  header.push_back((hum & 0xFF00) >> 8);
-  header.push_back(hum & 0xFF);
-
-  for (size_t i = 0; i < header.size(); ++i)
-    m_data_memory[m_data_idx].push_back(header[i]);
+  header[16] = (hum & 0xFF000000) >> 24;
+  header[17] = (hum & 0xFF0000) >> 16;
+  header[18] = (hum & 0xFF00) >> 8;
+  header[19] = hum & 0xFF;
 
   if (m_debug > 2) {
-    printf("[PLATYPUS] Header written at %d Bytes.\n", m_data_memory[m_data_idx].size()-8);
+    printf("[PLATYPUS] Header written, %zu Bytes waiting for the flash.\n", m_log_arena.getBytes());
     fflush(stdout);
   }
 }
 
 //_______________________________________________________________________________________________________
-void platypus::writeData(std::vector<uint8_t> data) {
+void platypus::writeData(const int16_t* raw, size_t n, const imu_block_time &block, size_t first) {
   if (!m_imu_init)
     return;
 
-  for (size_t i = 0; i < data.size(); ++i)
-    writeData(data[i]);
-}
-//_______________________________________________________________________________________________________
-void platypus::writeData(std::vector<int16_t> data) {
-  if (!m_imu_init)
-    return;
+  while (n > 0) {
+    // a header in the beginning of every page of 600 samples (20B header + 7200B data)
+    if (m_log_page == NULL) {
+      m_log_page = m_log_arena.begin();
+      if (m_log_page == NULL) {
+        m_log_dropped += n;
+        return;
+      }
+      writeHeader(m_log_page->header());
+      m_log_page->stamp = imu_clock::sampleTime(block, first);
+    }
 
-  for (size_t i = 0; i < data.size(); ++i)
-    writeData(data[i]);
+    size_t k = m_log_page->append(raw, n);
+    raw += 6 * k;
+    n -= k;
+    first += k;
+    if (m_log_page->isFull()) {
+      m_log_arena.commit(m_log_page);
+      m_log_page = NULL;
+    }
+  }
 }
+
 //_______________________________________________________________________________________________________
-void platypus::writeData(uint8_t data) {
-  if (!m_imu_init)
-    return;
+log_file_header platypus::logHeader() {
+  log_file_header header;
+  gethostname(header.device, sizeof(header.device) - 1);
+  header.afs = 2 << AFS_SEL;
+  header.gfs = 250 << GFS_SEL;
+  if (m_imu_init) {
+    header.rate = m_imu->getSampleRate() / m_log_div;
+    header.bandwidth = IMU_LOG_BANDWIDTH;
+  }
+  return header;
+}
 
-  // write Header in the beginning and after every 600 samples of data (20B header + 7200B data)
-  if (m_data_memory[m_data_idx].size() % 7220 == 0)
-    writeHeader();
 
-  m_data_memory[m_data_idx].push_back(data);
-}
 //_______________________________________________________________________________________________________
-void platypus::writeData(int16_t data) {
-  if (!m_imu_init)
-    return;
-
-  // write Header in the beginning and after every 600 samples of data (20B header + 7200B data)
-  if (m_data_memory[m_data_idx].size() % 7220 == 0)
-    writeHeader();
+void platypus::writeActivity(const imu_activity_summary &summary) {
+  std::string dirname("/home/root/pps_logs/");
+  std::string filename = dirname + "activity.csv";
 
-  m_data_memory[m_data_idx].push_back((data & 0xFF00) >> 8);
-  m_data_memory[m_data_idx].push_back(data & 0xFF);
-}
+  DIR *dir = opendir(dirname.c_str());
+  if (dir == NULL)
+    mkdir(dirname.c_str(), S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+  else
+    closedir(dir);
 
+  struct tm * t = getTimeAndDate();
+  std::stringstream line;
+  line << std::setfill('0') << t->tm_year+1900 << "-" << std::setw(2) << t->tm_mon+1 << "-" << std::setw(2) << t->tm_mday
+    << " " << std::setw(2) << t->tm_hour << ":" << std::setw(2) << t->tm_min << ":" << std::setw(2) << t->tm_sec
+    << "," << summary.minute << "," << summary.steps;
+  for (int c = 0; c < IMU_ACTIVITY_CLASSES; ++c)
+    line << "," << summary.windows[c];
+  line << "," << imu_activity::name(summary.activity) << "\n";
+
+  // one short line per minute, cheap enough for the IMU thread
+  std::ofstream outfile;
+  outfile.open(filename, std::ofstream::out | std::ofstream::app);
+  if (outfile.tellp() == 0)
+    outfile << "time,minute,steps,still,walking,running,shaking,activity\n";
+  outfile << line.str();
+  outfile.close();
 
-//_______________________________________________________________________________________________________
-void platypus::writeDataToFlashIDX(uint8_t idx) {
-  writeDataToFlash(m_data_memory[idx]);
+  if (m_debug > 1) {
+    printf("[PLATYPUS] minute %u: %s, %u steps\n", summary.minute, imu_activity::name(summary.activity), summary.steps);
+    fflush(stdout);
+  }
 }
 
 
 //_______________________________________________________________________________________________________
-void platypus::writeDataToFlash(std::vector<uint8_t> &data) {
-  if (!m_imu_init)
+void platypus::writeEvent() {
+  imu_blackbox_header header;
+  std::vector<int16_t> data;
+  if (!m_blackbox->collect(header, data))
     return;
 
-  std::lock_guard<std::recursive_mutex> write_lock(m_mtx_write);
-
-  m_saving = true;
+  std::string dirname("/home/root/pps_logs/");
+  DIR *dir = opendir(dirname.c_str());
+  if (dir == NULL)
+    mkdir(dirname.c_str(), S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+  else
+    closedir(dir);
 
+  // one event per post window at most, the second is unique enough
   std::stringstream filename;
-  filename << "/home/root/pps_logs/";
-
-  // search for already saved data files and choose new filename
-  int filenum = 0;
-  DIR *dir;
-  struct dirent *ent;
-
-  while ((dir = opendir(filename.str().c_str())) == NULL) {
-    mkdir(filename.str().c_str(), S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
-    printf("[PLATYPUS] Created directory %s\n", filename.str().c_str());
+  {
+    std::lock_guard<std::recursive_mutex> time_lock(m_mtx_time);
+    struct tm * t = getTimeAndDate();
+    filename << dirname << "event" << std::setfill('0') << t->tm_year+1900 << std::setw(2) << t->tm_mon+1
+      << std::setw(2) << t->tm_mday << "-" << std::setw(2) << t->tm_hour << std::setw(2) << t->tm_min
+      << std::setw(2) << t->tm_sec << "_" << imu_blackbox::name((Trigger) header.cause) << ".bin";
   }
 
-  while ((ent = readdir(dir)) != NULL) {
-    std::string curr(ent->d_name);
-    if (curr.find("datalog") != std::string::npos) {  // found log file
-      int begin = curr.find("datalog") + 7;  // get pos of first digit
-      std::string sub = curr.substr(begin, 4);  // get substring of number
-      if (std::stoi(sub) + 1 > filenum)
-        filenum = std::stoi(sub) + 1;  // set new file number
-    }
-  }
-  closedir(dir);
-
-
-  // set new filename as /datalogXXXX.bin
-  filename << "datalog" << std::setfill('0') << std::setw(4) << filenum << ".bin";
-
-  printf("[PLATYPUS] Saving %d Bytes to file %s\n", data.size(), filename.str().c_str());
-
-  // open file stream, put 8bit chars from memory to file
-  std::fstream outfile;
-  outfile.open(filename.str(), std::ofstream::out | std::ofstream::app | std::ofstream::binary);
-  std::streambuf * sbuf = outfile.rdbuf(); // want to use sputc()
-  for (size_t i = 0; i < data.size(); ++i) {
-    sbuf->sputc(data[i]);
-  }
-  outfile.close();
-
-  printf("[PLATYPUS] Writing done.\n");
+  if (imu_blackbox::save(filename.str().c_str(), header, data))
+    printf("[PLATYPUS] Event saved to %s, %u samples before and %u after the trigger (%u lost).\n",
+      filename.str().c_str(), header.pre, header.post, header.lost);
+  else
+    printf("[PLATYPUS] Error saving event to %s\n", filename.str().c_str());
   fflush(stdout);
-
-  // clear data vector and shrink allocated memory down to 0 again
-  data.clear();
-  data.shrink_to_fit();
-
-  m_saving = false;
 }
 
 
@@ -1117,27 +1310,15 @@ void platypus::writeDataToFlash(std::vector<uint8_t> &data) {
 
 //_______________________________________________________________________________________________________
 DisplayStates platypus::tap_event() {
-  std::vector<float> imu_data = m_imu->toReadable(m_imu_data);
-  std::vector<float> imu_curr = m_imu->toReadable(m_imu->readRawIMU());
-  //printf("%f, %f, %f | %f, %f, %f\n", imu_data[0], imu_data[1], imu_data[2], imu_curr[3], imu_curr[4], imu_curr[5]);
-  //fflush(stdout);
-
-  // try to filter taps more or less accurately
+  // the tap itself comes from m_gestures, without rotation
 
   // platypus board needs to be level (parallel to ground)
-  if (imu_data[0] > 1 || imu_data[0] < -1)
-    return DisplayStates::NOCHANGE;
-  if (imu_data[1] > 1 || imu_data[1] < -1)
-    return DisplayStates::NOCHANGE;
-  if (imu_data[2] < 8)
+  const float* g = m_gestures.getGravity();
+  if (g[0] > 1 || g[0] < -1)
     return DisplayStates::NOCHANGE;
-
-  // current gyro values need to be small
-  if (imu_curr[3] > 45 || imu_curr[3] < -45)
-    return DisplayStates::NOCHANGE;
-  if (imu_curr[4] > 45 || imu_curr[4] < -45)
+  if (g[1] > 1 || g[1] < -1)
     return DisplayStates::NOCHANGE;
-  if (imu_curr[5] > 45 || imu_curr[5] < -45)
+  if (g[2] < 8)
     return DisplayStates::NOCHANGE;
 
   switch (m_dsp_state) {
@@ -1214,23 +1395,36 @@ void platypus::printDebug(int &last_min, std::vector<float> data) {
     printf("\tY: %f\n", data[4]);
     printf("\tZ: %f\n", data[5]);
 
-    if (m_data_memory[m_data_idx].size() > 1048576)
-      printf("data size [MiB]:\n\t%.3f\n", m_data_memory[m_data_idx].size() / 1048576.0);
-    else if (m_data_memory[m_data_idx].size() > 1024)
-      printf("data size [KiB]:\n\t%.2f\n", m_data_memory[m_data_idx].size() / 1024.0);
+    size_t bytes = m_log_arena.getBytes();
+    if (bytes > 1048576)
+      printf("data size [MiB]:\n\t%.3f\n", bytes / 1048576.0);
+    else if (bytes > 1024)
+      printf("data size [KiB]:\n\t%.2f\n", bytes / 1024.0);
     else
-      printf("data size [B]:\n\t%d\n", m_data_memory[m_data_idx].size());
+      printf("data size [B]:\n\t%zu\n", bytes);
 
     printf("\n");
     fflush(stdout);
   } else if (m_debug == 1 && abs(t->tm_min - last_min) >= 5) {
     printf("[PLATYPUS] %d-%d-%d %2d:%2d | ", t->tm_year+1900, t->tm_mon+1, t->tm_mday, t->tm_hour, t->tm_min);
-    if (m_data_memory[m_data_idx].size() > 1048576)
-      printf("%.3f MiB\n", m_data_memory[m_data_idx].size() / 1048576.0);
-    else if (m_data_memory[m_data_idx].size() > 1024)
-      printf("%.2f KiB\n", m_data_memory[m_data_idx].size() / 1024.0);
+    size_t bytes = m_log_arena.getBytes();
+    if (bytes > 1048576)
+      printf("%.3f MiB\n", bytes / 1048576.0);
+    else if (bytes > 1024)
+      printf("%.2f KiB\n", bytes / 1024.0);
     else
-      printf("%d B\n", m_data_memory[m_data_idx].size());
+      printf("%zu B\n", bytes);
+    if (m_imu_init) {
+      printf("[PLATYPUS] IMU low power: %lu entries, %lu exits\n", m_imu->getLowPowerEntries(), m_imu->getLowPowerExits());
+      printf("[PLATYPUS] IMU clock: %.0f ppm over %lu blocks\n", m_imu_clock.getDrift(), m_imu_clock.getBlocks());
+      printf("[PLATYPUS] IMU activity: %s, %u steps\n", imu_activity::name(m_activity.getActivity()), m_activity.getSteps());
+      log_writer_stats log = m_log_writer.getStats();
+      printf("[PLATYPUS] Log writer: %lu pages in %lu files, %.0f%% packed, queue %zu (max %zu), %.1f ms per batch (max %.1f), %lu samples dropped\n",
+        log.pages, log.segments, log.raw_bytes > 0 ? 100.0 * log.bytes / log.raw_bytes : 100.0, log.depth, log.max_depth,
+        log.mean_write_ms, log.max_write_ms, m_log_dropped);
+      printf("[PLATYPUS] Log journal: %lu pages, %lu syncs, %lu pages recovered\n", log.journal_pages, log.journal_syncs,
+        log.recovered);
+    }
 
     fflush(stdout);
 
@@ -1266,7 +1460,7 @@ void platypus::printTimer(int sec) {
 
 // -------------  Interrupt  -------------
 void platypus::interrupt() {
-  printf("[MAIN] imu_isr called.\n");
+  printf("[PLATYPUS] IMU interrupt.\n");
   // Start game
   if(gameStarted == 1) {
     revealYourself = 1;
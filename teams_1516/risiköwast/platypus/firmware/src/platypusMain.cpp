@@ -3,7 +3,9 @@
 #include <fstream>
 #include <chrono>
 
+#include <ctype.h>
 #include <signal.h>
+#include <stdlib.h>
 #include <syslog.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -12,7 +14,7 @@
 #include "./imu_edison.h"
 #include "./batgauge_edison.h"
 
-int m_running = 1;
+volatile sig_atomic_t m_running = 1;
 
 //display_edison* m_dsp;  // display
 platypus* m_pps;
@@ -33,22 +35,16 @@ bool m_start_env = true;
 bool m_start_dsp = true;
 bool m_start_mcu = false;
 bool m_start_bat = true;
-
-typedef std::chrono::high_resolution_clock Clock;
-typedef std::chrono::milliseconds milliseconds;
-
-Clock::time_point last_int;
+// IMU sample rate of the black box [Hz], 0 is off
+float m_capture_rate = 0.0;
 
 //_______________________________________________________________________________________________________
+// only ends the main loop, main() shuts down so the data log is written and closed
 void sig_handler(int signo) {
   if (signo == SIGINT || signo == SIGTERM) {
-    printf("\n[MAIN] Exiting nicely...\n");
-    m_pps->exitNicely();
-    m_pps->sendThis("quit");
-    m_pps->m_active = 0;
-    fflush(stdout);
+    if (m_pps != NULL)
+      m_pps->m_active = 0;
     m_running = 0;
-    exit(0);
   }
 }
 
@@ -111,40 +107,27 @@ void parseConfig(std::string path) {
   m_start_dsp = stob(cfg["start_dsp"], m_start_dsp);
   m_start_mcu = stob(cfg["start_mcu"], m_start_mcu);
   m_start_bat = stob(cfg["start_bat"], m_start_bat);
-}
-
-//_______________________________________________________________________________________________________
-void imu_isr(void*) {
-  uint8_t is = m_imu->getIntStatus();
-  Clock::time_point now = Clock::now();
-  milliseconds ms = std::chrono::duration_cast<milliseconds>(now - last_int);
-  if (ms.count() < 250)
-    return;
-
-  printf("[MAIN] imu_isr called.\n");
-  m_pps->interrupt();
-
-  if (m_imu->hasFIFOInt(is)) {
-    printf("[MAIN] FIFO interrupt\n");
-    m_imu->FIFOrst();
-  }
-  if (m_imu->hasWOMInt(is)) {
-    DisplayStates tap = m_pps->tap_event();
-    if (tap != DisplayStates::NOCHANGE)
-      printf("[MAIN] WOM interrupt, new display state: %d\n", tap);
+  if (cfg["capture_rate"] != "") {
+    // a rate that does not parse leaves the black box off instead of ending the program
+    const char* value = cfg["capture_rate"].c_str();
+    char* end;
+    float rate = strtof(value, &end);
+    while (isspace(*end))
+      ++end;
+    if (end == value || *end != '\0' || !(rate >= 0.0)) {
+      printf("[MAIN] Invalid capture_rate \"%s\", black box off.\n", value);
+      fflush(stdout);
+      rate = 0.0;
+    }
+    m_capture_rate = rate;
   }
-  fflush(stdout);
-  last_int = Clock::now();
 }
 
-
 //_______________________________________________________________________________________________________
 int main(int argc, char** argv) {
   signal(SIGINT, sig_handler);
   signal(SIGTERM, sig_handler);
 
-  last_int = Clock::now();
-
   if (argc == 1)
     parseConfig("./platypus.conf");
   else
@@ -154,11 +137,11 @@ int main(int argc, char** argv) {
 
   // Set up IMU, LDC
   if (m_start_imu) {
-    m_imu = m_pps->imu_init(m_i2c_bus, m_mpu_address, m_start_env);
-    mraa::Gpio* imu_interrupt = new mraa::Gpio(36);
-    imu_interrupt->dir(mraa::DIR_IN);
-    imu_interrupt->isr(mraa::EDGE_FALLING, imu_isr, NULL);
-    imu_interrupt->mode(mraa::MODE_HIZ);
+    // IMU INT pin wakes the IMU thread (WoM, FIFO overflow)
+    gpio_irq_source* imu_interrupt = new gpio_irq_source(IMU_INT_GPIO, mraa::EDGE_FALLING);
+    m_imu = m_pps->imu_init(m_i2c_bus, m_mpu_address, m_start_env, imu_interrupt);
+    if (m_capture_rate > 0.0)
+      m_pps->blackbox_init(m_capture_rate);
   }
   if (m_start_ldc) {
     m_pps->ldc_init(m_i2c_bus);
@@ -217,13 +200,19 @@ int main(int argc, char** argv) {
   //}
 
   m_pps->spawn_threads();
-  while (m_pps->m_active == 1) {
+  while (m_pps->m_active == 1 && m_running) {
     // check if the battery is low, exit nicely if yes
     //if (m_start_bat && m_bat->getAlertStatus())
     //  break;
     usleep(100000);
   }
 
+  if (!m_running) {
+    printf("\n[MAIN] Exiting nicely...\n");
+    fflush(stdout);
+    m_pps->exitNicely();
+    m_pps->sendThis("quit");
+  }
   m_pps->join_threads();
 
   delete m_pps;
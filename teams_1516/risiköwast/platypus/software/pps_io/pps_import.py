@@ -10,6 +10,17 @@ HEADERSIZE = 20 # size in bytes of data header
 SAMPLESIZE = 12 # size in bytes of one sample of data
 SAMPLERATE = 25 # samplerate in Hz
 
+## version 2 files (firmware log_format.h), little endian: a file header (device, full scales,
+## sample rate, channels), then pages of a page header (sequence number, monotonic time, samples,
+## codec, CRC32C), the data header and the samples in the codec of the page
+FILEMAGIC = b'PPSLOG'
+FILEHEADERSIZE = 64
+PAGEMAGIC = b'PG'
+PAGEHEADERSIZE = 28
+CODEC_RAW = 0 # samples as in the plain files
+CODEC_DELTA = 1 # first sample, then per frame and channel: width, minimum, bit-packed zig-zag deltas
+CODECFRAME = 32 # samples per frame
+
 ## data descriptor for the platypus default data:
 desc_pps = {	'names':   ('t', 'ax', 'ay', 'az', 'gx', 'gy', 'gz', 'l1', 'l2', 'temp', 'press', 'hum'), 
 					'formats': ('f8', 'h', 'h', 'h', 'h', 'h', 'h', 'H', 'H', 'i', 'I', 'I') }
@@ -35,7 +46,156 @@ def pps_convtime(b1,b2,b3,b4):
 		return False
 
 
+## decodes [n] samples of a page packed with the delta codec, returns an (n, 6) array
+def pps_decode_delta(buf, n):
+	raw = np.zeros((n, 6), dtype=np.int16)
+	prev = list(unpack("<6h", buf[0:SAMPLESIZE]))
+	pos = SAMPLESIZE
+	for f in range(0, n, CODECFRAME):
+		m = min(CODECFRAME, n - f)
+		for c in range(6):
+			width = buf[pos]
+			lo = buf[pos+1] | (buf[pos+2] << 8)
+			pos += 3
+			nbytes = (m * width + 7) // 8
+			bits = int.from_bytes(buf[pos:pos+nbytes], 'little')
+			pos += nbytes
+			mask = (1 << width) - 1
+			x = prev[c]
+			for i in range(m):
+				z = (((bits >> (i * width)) & mask) + lo) & 0xFFFF
+				x = ((x + ((z >> 1) ^ -(z & 1)) + 0x8000) & 0xFFFF) - 0x8000
+				raw[f+i, c] = x
+			prev[c] = x
+	return raw
+
+
+## CRC32C (Castagnoli) of [buf] continued from [crc]
+_crctable = []
+for _i in range(256):
+	_c = _i
+	for _k in range(8):
+		_c = (_c >> 1) ^ 0x82F63B78 if _c & 1 else _c >> 1
+	_crctable.append(_c)
+
+def crc32c(buf, crc=0):
+	crc ^= 0xFFFFFFFF
+	for b in buf:
+		crc = _crctable[(crc ^ b) & 0xFF] ^ (crc >> 8)
+	return crc ^ 0xFFFFFFFF
+
+
+## the file header of a version 2 file as a dict, None for the plain files before
+def pps_read_header(filename):
+	with open(filename, "rb") as f:
+		bs = f.read(FILEHEADERSIZE)
+	if len(bs) < FILEHEADERSIZE or bs[0:6] != FILEMAGIC or unpack("<I", bs[60:64])[0] != crc32c(bs[0:60]):
+		return None
+	version, size, info = unpack("<HHH", bs[6:12])
+	if version != 2 or size != FILEHEADERSIZE or info != HEADERSIZE:
+		return None
+	afs, gfs, rate, bandwidth, channels, valuesize = unpack("<HHffBB", bs[28:42])
+	return {'version': version, 'device': bs[12:28].split(b'\0')[0].decode('ascii', 'replace'),
+		'afs': afs, 'gfs': gfs, 'rate': rate, 'bandwidth': bandwidth,
+		'schema': bs[42:60].split(b'\0')[0].decode('ascii', 'replace').split()}
+
+
+## one page at [pos] of [buf]: (sequence, stamp [ns], data header, (n, 6) samples, size), None if broken
+def pps_read_page(buf, pos):
+	if pos + PAGEHEADERSIZE + HEADERSIZE > len(buf) or buf[pos:pos+2] != PAGEMAGIC or buf[pos+3] != 0:
+		return None
+	codec = buf[pos+2]
+	seq, stamp, n, info, size, crc = unpack("<IqHHII", buf[pos+4:pos+PAGEHEADERSIZE])
+	end = pos + PAGEHEADERSIZE + HEADERSIZE + size
+	if info != HEADERSIZE or end > len(buf) or codec not in (CODEC_RAW, CODEC_DELTA):
+		return None
+	if crc32c(buf[pos+PAGEHEADERSIZE:end], crc32c(buf[pos:pos+24])) != crc:
+		return None
+	payload = buf[pos+PAGEHEADERSIZE+HEADERSIZE:end]
+	if codec == CODEC_RAW:
+		raw = np.frombuffer(payload, dtype='>i2').reshape((n, 6))
+	else:
+		raw = pps_decode_delta(payload, n)
+	return (seq, stamp, buf[pos+PAGEHEADERSIZE:pos+PAGEHEADERSIZE+HEADERSIZE], raw, end - pos)
+
+
+def pps_import_v2(filename, header):
+	f = open(filename, "rb")
+	buf = f.read()
+	f.close()
+
+	rate = header['rate'] if header['rate'] > 0 else SAMPLERATE
+	pages = [] # (sequence, stamp, data header, samples) per page
+	samples = 0
+	skipped = 0
+	seq = None
+	pos = FILEHEADERSIZE
+	while pos + PAGEHEADERSIZE + HEADERSIZE <= len(buf):
+		page = pps_read_page(buf, pos)
+		if page is None:
+			# broken or cut off, go on with the next intact page
+			skipped += 1
+			pos = buf.find(PAGEMAGIC, pos + 1)
+			if pos < 0:
+				break
+			continue
+		if seq is not None and page[0] != seq + 1:
+			print("      ", page[0] - seq - 1, "pages missing before page", page[0])
+		seq = page[0]
+		pages.append(page[0:4])
+		samples += len(page[3])
+		pos += page[4]
+	if skipped > 0:
+		print("       skipped", skipped, "broken positions in", filename)
+
+	# sample period fitted to the monotonic stamps of consecutive pages, the header rate without them
+	period = 1.0 / rate
+	span = 0
+	count = 0
+	for a, b in zip(pages, pages[1:]):
+		if b[0] == a[0] + 1 and a[1] > 0 and b[1] > a[1]:
+			span += b[1] - a[1]
+			count += len(a[3])
+	if count > 0:
+		period = span * 1e-9 / count
+		print("       sample rate %.4f Hz (header %.4f Hz)" % (1.0 / period, rate))
+
+	# the monotonic clock to the wall time of the data headers: a header cut to the second puts
+	# the offset within one second after header - stamp, the middle of what all pages allow
+	offsets = []
+	for seq, stamp, bs, raw in pages:
+		tme = pps_convtime(bs[0], bs[1], bs[2], bs[3])
+		if stamp > 0 and tme is not False:
+			offsets.append(tme - seconds(stamp * 1e-9))
+	offset = (max(offsets) + min(offsets) + seconds(1.0)) / 2 if len(offsets) > 0 else None
+
+	data = np.recarray((samples,), dtype=desc_pps)
+	i = 0
+	for seq, stamp, bs, raw in pages:
+		tme = pps_convtime(bs[0], bs[1], bs[2], bs[3])
+		# every page starts at its stamp, pages without one at the time of their header
+		if stamp > 0 and offset is not None:
+			tme = offset + seconds(stamp * 1e-9)
+		l1 = (bs[4]<<8)+(bs[5])
+		l2 = (bs[6]<<8)+(bs[7])
+		temp = (bs[8]<<24)+(bs[9]<<16)+(bs[10]<<8)+(bs[11])
+		press = (bs[12]<<24)+(bs[13]<<16)+(bs[14]<<8)+(bs[15])
+		hum = (bs[16]<<24)+(bs[17]<<16)+(bs[18]<<8)+(bs[19])
+		for x in range(len(raw)):
+			data[i] = np.array((tme + seconds(x * period),) + tuple(int(v) for v in raw[x]) + (l1, l2, temp, press, hum), dtype=desc_pps)
+			i += 1
+		progress(i, samples)
+
+	if i > 0:
+		return data
+	else:
+		return []
+
+
 def pps_import_file(filename):
+	header = pps_read_header(filename)
+	if header is not None:
+		return pps_import_v2(filename, header)
 	fsize = os.path.getsize(filename) # size of the file in bytes
 	numheaders = int(fsize / (PAGESIZE + HEADERSIZE)) + 1 # number of headers in the data (+1 for first header that is always present)
 	rawsize = fsize - (numheaders * HEADERSIZE) # size of sample data without headers in bytes